@@ -0,0 +1,385 @@
+/*
+ * bandwidth.c
+ *
+ * Where a run spends the serial link. It reads a capture of the run
+ * (CREATE_CAPTURE, ../Project-5/capture.h), takes it apart into Open
+ * Interface commands and the replies to their queries (traffic.c), and
+ * reports the bytes each way against the link's budget of LINK_BUDGET
+ * bytes per second:
+ * - per opcode, with the replies counted to the query that asked
+ * - per sensor packet, groups split into their packets
+ * - per opcode over time, in INTERVAL s steps
+ *
+ * and the bytes that bought nothing:
+ * - redundant commands, the same as the last one that set the same
+ *   state (drive, mode, leds, motors, a song slot...) less than
+ *   REFRESH s before
+ * - stale reads, a packet asked for again within SENSOR_PERIOD of the
+ *   last time, before the robot has measured it again
+ * - bytes sent that are no opcode, such as the spare bytes of a command
+ *   sent longer than it is
+ * - unchanged reads, a packet that came back the same as last time;
+ *   not wrong, but a hint that it is asked for more often than it moves
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oi.h"
+#include "capture.h"
+#include "packets.h"
+#include "traffic.h"
+
+#define LINK_BUDGET     11520  // bytes/s each way at 115200 baud, 10 bits a byte
+#define SENSOR_PERIOD   0.015  // s between the robot's sensor updates
+#define REFRESH         1.0    // s after which a repeated command is a refresh
+#define INTERVAL        5.0    // s per row over time
+#define TIMELINE_OPCODES 8     // busiest opcodes shown over time
+
+#define OPCODES         256
+#define PACKETS         256
+#define STATE_MAX       35     // longest command kept to compare, a full song
+
+// State a command sets, so one that sets it again the same is redundant
+enum { StateDrive, StateMode, StateLeds, StateMotors, StateOutputs, StateDigits, StateScheduleLeds,
+	StateSong, STATES = StateSong + 4 };
+
+typedef struct
+{
+	unsigned long messages;
+	unsigned long sent;       // bytes
+	unsigned long replies;    // bytes
+	unsigned long redundant;  // messages
+	unsigned long redundantBytes;
+}
+OpcodeUse;
+
+typedef struct
+{
+	unsigned long asked;
+	unsigned long bytes;      // of replies
+	unsigned long stale;      // reads
+	unsigned long unchanged;
+	unsigned long staleBytes;
+	unsigned long unchangedBytes;
+	int read;                 // has been read before
+	double lastTime;          // s
+	unsigned int lastValue;
+}
+PacketUse;
+
+typedef struct
+{
+	unsigned char bytes[STATE_MAX];
+	int length;
+	double time;              // s, or negative if never set
+}
+StateUse;
+
+static void usage() {
+
+	fprintf(stderr, "usage: bandwidth [--interval s] [--refresh s] [--csv file] capture\n");
+
+}
+
+// The state a command sets, or -1 for commands that act or ask
+static int state_of(const unsigned char* b, int length) {
+
+	switch (b[0]) {
+	case CmdDrive:
+	case CmdDriveWheels:
+	case 146:
+		return StateDrive;
+	case CmdSafe:
+	case CmdFull:
+		return StateMode;
+	case CmdLeds:
+		return StateLeds;
+	case CmdMotors:
+	case CmdPWMMotors:
+		return StateMotors;
+	case CmdOutputs:
+		return StateOutputs;
+	case 163:
+	case 164:
+		return StateDigits;
+	case 162:
+		return StateScheduleLeds;
+	case CmdSong:
+		return StateSong + (b[1] & 3);
+	}
+
+	return -1;
+
+}
+
+// Whether the command sets its state as it already was, and keeps it
+static int redundant(StateUse* states, const unsigned char* b, int length, double time, double refresh) {
+
+	int state = state_of(b, length);
+	if (state < 0 || length > STATE_MAX)
+		return 0;
+
+	StateUse* s = &states[state];
+	int same = s->time >= 0 && time - s->time < refresh
+		&& s->length == length && memcmp(s->bytes, b, length) == 0;
+
+	// a refresh restarts the clock, a redundant command does not
+	if (!same) {
+		memcpy(s->bytes, b, length);
+		s->length = length;
+		s->time = time;
+	}
+	return same;
+
+}
+
+/*
+Takes a reply apart into its packets, groups into their members, and
+counts them in packets and in the interval's row.
+*/
+static void read_packets(PacketUse* packets, PacketUse* row, const unsigned char* ids, int count,
+	const unsigned char* reply, int replied, double time) {
+
+	int i, k, first, last, at = 0;
+
+	for (i = 0; i < count; i++) {
+		if (!packetGroup(ids[i], &first, &last))
+			first = last = ids[i];
+
+		for (k = first; k <= last; k++) {
+			int size = packetSize(k);
+			if (size == 0 || at + size > replied)
+				return;
+
+			PacketUse* p = &packets[k];
+			unsigned int value = size == 2 ? (reply[at] << 8) | reply[at + 1] : reply[at];
+			at += size;
+
+			p->asked++;
+			p->bytes += size;
+			row[k].asked++;
+			row[k].bytes += size;
+			if (p->read && time - p->lastTime < SENSOR_PERIOD) {
+				p->stale++;
+				p->staleBytes += size;
+			} else if (p->read && value == p->lastValue) {
+				p->unchanged++;
+				p->unchangedBytes += size;
+			}
+			p->read = 1;
+			p->lastTime = time;
+			p->lastValue = value;
+		}
+	}
+
+}
+
+static double percent(double part, double whole) {
+
+	return whole > 0 ? 100 * part / whole : 0;
+
+}
+
+int main(int argc, char* argv[]) {
+
+	CaptureFile file;
+	Traffic traffic;
+	const char* path = NULL;
+	const char* csvPath = NULL;
+	double interval = INTERVAL;
+	double refresh = REFRESH;
+	int i, k;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			interval = atof(argv[++i]);
+		else if (strcmp(argv[i], "--refresh") == 0 && i + 1 < argc)
+			refresh = atof(argv[++i]);
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (argv[i][0] != '-' && path == NULL)
+			path = argv[i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (path == NULL || interval <= 0) {
+		usage();
+		return 2;
+	}
+
+	if (!captureLoad(&file, path))
+		return 1;
+	if (!trafficLoad(&traffic, &file))
+		return 1;
+
+	double duration = traffic.ns / 1e9;
+	int intervals = (int) (duration / interval) + 1;
+
+	static OpcodeUse opcodes[OPCODES];
+	static PacketUse packets[PACKETS];
+	StateUse states[STATES];
+	OpcodeUse* timeline = (OpcodeUse*) calloc((size_t) intervals * OPCODES, sizeof(OpcodeUse));
+	PacketUse* packetTimeline = (PacketUse*) calloc((size_t) intervals * PACKETS, sizeof(PacketUse));
+	unsigned long sent = 0, received = 0, unanswered = 0;
+
+	for (i = 0; i < STATES; i++)
+		states[i].time = -1;
+
+	for (i = 0; i < traffic.count; i++) {
+		const TrafficMessage* m = &traffic.messages[i];
+		const unsigned char* b = trafficBytes(&traffic, m);
+		double time = m->ns / 1e9;
+		int row = (int) (time / interval);
+		OpcodeUse* use = &opcodes[b[0]];
+		OpcodeUse* now = &timeline[row * OPCODES + b[0]];
+
+		use->messages++;
+		use->sent += m->length;
+		use->replies += m->replied;
+		now->messages++;
+		now->sent += m->length;
+		now->replies += m->replied;
+		sent += m->length;
+		received += m->replied;
+		unanswered += m->replied < m->replyLength;
+
+		if (redundant(states, b, m->length, time, refresh)) {
+			use->redundant++;
+			use->redundantBytes += m->length;
+			now->redundant++;
+			now->redundantBytes += m->length;
+		}
+
+		if (m->replyLength == 0)
+			continue;
+
+		PacketUse* packetRow = &packetTimeline[row * PACKETS];
+		if (b[0] == CmdSensors)
+			read_packets(packets, packetRow, b + 1, 1, trafficReply(&traffic, m), m->replied, time);
+		else
+			read_packets(packets, packetRow, b + 2, m->length - 2, trafficReply(&traffic, m), m->replied, time);
+	}
+
+	printf("Bandwidth: %s, %.1f s, link budget %d B/s each way\n", path, duration, LINK_BUDGET);
+	printf("  sent     %8lu B, %7.1f B/s, %5.1f%% of the budget\n",
+		sent, sent / duration, percent(sent / duration, LINK_BUDGET));
+	printf("  received %8lu B, %7.1f B/s, %5.1f%% of the budget\n",
+		received, received / duration, percent(received / duration, LINK_BUDGET));
+	if (unanswered || traffic.unasked || traffic.partial)
+		printf("  %lu queries not answered in full, %lu reply bytes nobody asked for, %lu bytes of a command cut short\n",
+			unanswered, traffic.unasked, traffic.partial);
+
+	// per opcode, busiest first
+	int order[OPCODES], count = 0;
+	for (i = 0; i < OPCODES; i++) {
+		if (opcodes[i].messages > 0)
+			order[count++] = i;
+	}
+	for (i = 1; i < count; i++) {
+		int o = order[i];
+		unsigned long bytes = opcodes[o].sent + opcodes[o].replies;
+		for (k = i; k > 0 && opcodes[order[k - 1]].sent + opcodes[order[k - 1]].replies < bytes; k--)
+			order[k] = order[k - 1];
+		order[k] = o;
+	}
+
+	unsigned long redundantMessages = 0, redundantBytes = 0, unknownBytes = 0;
+	printf("\n  %6s %-18s %9s %9s %9s %8s %6s %6s %10s %10s\n", "opcode", "name", "messages", "sent B",
+		"reply B", "B/s", "sent%", "recv%", "redundant", "redund. B");
+	for (i = 0; i < count; i++) {
+		const OpcodeUse* u = &opcodes[order[i]];
+		printf("  %6d %-18s %9lu %9lu %9lu %8.1f %6.1f %6.1f %10lu %10lu\n", order[i], trafficOpcodeName(order[i]),
+			u->messages, u->sent, u->replies, (u->sent + u->replies) / duration,
+			percent(u->sent / duration, LINK_BUDGET), percent(u->replies / duration, LINK_BUDGET),
+			u->redundant, u->redundantBytes);
+		redundantMessages += u->redundant;
+		redundantBytes += u->redundantBytes;
+		if (strcmp(trafficOpcodeName(order[i]), "unknown") == 0)
+			unknownBytes += u->sent;
+	}
+
+	unsigned long staleBytes = 0, unchangedBytes = 0;
+	printf("\n  %6s %-32s %9s %9s %8s %6s %7s %10s\n", "packet", "name", "asked", "reply B", "B/s", "recv%",
+		"stale%", "unchanged%");
+	for (i = 0; i < PACKETS; i++) {
+		const PacketUse* p = &packets[i];
+		if (p->asked == 0)
+			continue;
+		const PacketInfo* info = packetInfo(i);
+		printf("  %6d %-32s %9lu %9lu %8.1f %6.1f %7.1f %10.1f\n", i, info != NULL ? info->name : "unknown",
+			p->asked, p->bytes, p->bytes / duration, percent(p->bytes / duration, LINK_BUDGET),
+			percent(p->stale, p->asked), percent(p->unchanged, p->asked));
+		staleBytes += p->staleBytes;
+		unchangedBytes += p->unchangedBytes;
+	}
+
+	// the busiest opcodes over time, sent and reply bytes together
+	int shown = count < TIMELINE_OPCODES ? count : TIMELINE_OPCODES;
+	printf("\n  B/s over time, sent and replies to the opcode's queries\n");
+	printf("  %7s %8s %8s", "from s", "sent", "recv");
+	for (k = 0; k < shown; k++)
+		printf(" %7d", order[k]);
+	printf("\n");
+	for (i = 0; i < intervals; i++) {
+		double span = i < intervals - 1 ? interval : duration - i * interval;
+		unsigned long rowSent = 0, rowReceived = 0;
+		if (span <= 0)
+			continue;
+		for (k = 0; k < OPCODES; k++) {
+			rowSent += timeline[i * OPCODES + k].sent;
+			rowReceived += timeline[i * OPCODES + k].replies;
+		}
+		printf("  %7.1f %8.1f %8.1f", i * interval, rowSent / span, rowReceived / span);
+		for (k = 0; k < shown; k++) {
+			const OpcodeUse* u = &timeline[i * OPCODES + order[k]];
+			printf(" %7.1f", (u->sent + u->replies) / span);
+		}
+		printf("\n");
+	}
+
+	printf("\n  Waste\n");
+	printf("  redundant commands %6lu, %7lu B, %5.1f%% of the bytes sent\n",
+		redundantMessages, redundantBytes, percent(redundantBytes, sent));
+	printf("  not commands               %7lu B, bytes the robot has no opcode for\n", unknownBytes);
+	printf("  stale reads                %7lu B, %5.1f%% of the bytes received\n",
+		staleBytes, percent(staleBytes, received));
+	printf("  unchanged reads            %7lu B, %5.1f%% of the bytes received\n",
+		unchangedBytes, percent(unchangedBytes, received));
+
+	if (csvPath != NULL) {
+		FILE* csv = fopen(csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Bandwidth: ERROR: cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "from_s,kind,id,name,messages,sent_bytes,reply_bytes,redundant\n");
+		for (i = 0; i < intervals; i++) {
+			for (k = 0; k < OPCODES; k++) {
+				const OpcodeUse* u = &timeline[i * OPCODES + k];
+				if (u->messages > 0)
+					fprintf(csv, "%.1f,opcode,%d,%s,%lu,%lu,%lu,%lu\n", i * interval, k, trafficOpcodeName(k),
+						u->messages, u->sent, u->replies, u->redundant);
+			}
+			for (k = 0; k < PACKETS; k++) {
+				const PacketUse* p = &packetTimeline[i * PACKETS + k];
+				const PacketInfo* info = packetInfo(k);
+				if (p->asked > 0)
+					fprintf(csv, "%.1f,packet,%d,%s,%lu,0,%lu,0\n", i * interval, k,
+						info != NULL ? info->name : "unknown", p->asked, p->bytes);
+			}
+		}
+		fclose(csv);
+	}
+
+	free(timeline);
+	free(packetTimeline);
+	trafficFree(&traffic);
+	captureUnload(&file);
+	return 0;
+
+}
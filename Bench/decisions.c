@@ -0,0 +1,707 @@
+/*
+ * decisions.c
+ *
+ * The projects' control decisions replayed from a capture of a run
+ * (CREATE_CAPTURE, ../Project-5/capture.h), with no robot, no serial
+ * port and no sleeps. The sensor replies of the capture are fed to the
+ * functions the program calls on them, in the order it calls them, and
+ * the drive commands they decide are checked against the ones the
+ * program sent. Then each decision is timed over the whole run, again
+ * and again, for its CPU cost per call.
+ *
+ * The project is told by the query its sense() sends every tick:
+ * - Project-5: the slip monitor (slip.c), the card detector and the plan
+ *   follower (mission.c); the Drive (137) of every tick is checked, or
+ *   that an unchanged one was held back by its shadow
+ * - Project-4: the speed governor, the behaviors (wall.c) and the
+ *   shaper; every Drive Direct (145) is checked to WHEEL_TOLERANCE, or
+ *   that an unchanged one was held back by its shadow, as the shaper's
+ *   step is taken from the times of the recorded commands and replies
+ *   rather than from the program's clock
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oi.h"
+#include "capture.h"
+#include "traffic.h"
+#include "slip.h"
+#include "motion.h"
+#include "mission.h"
+#include "shaper.h"
+#include "governor.h"
+#include "follow.h"
+#include "wall.h"
+
+// Project-5's mission, as in its main.c
+#define SQUARE_SIDE     4.0   // ft
+#define STRAFE_SPACING  0.5   // ft
+#define CONTROL_PERIOD  0.1   // s per tick
+#define CARD_THRESHOLD  150   // rise in the front left cliff signal over a card
+
+// Project-4's, as in its main.c
+#define FOLLOW_KP       0.1
+#define FOLLOW_KI       0.01
+#define FOLLOW_KD       0
+#define FOLLOW_OFFSET   100
+#define FOLLOW_SPEED    100
+#define SURFACE         "tile"
+
+#define TIME_BUDGET     0.5   // s of CPU each decision is timed for
+#define WHEEL_TOLERANCE 1     // mm/s a shaped wheel may be off
+#define SHOW_MISMATCHES 10
+
+// sense() of each project
+static const unsigned char cardsQuery[] = { 149, 12, 29, 18, 19, 20, 14, 41, 42, 43, 44, 37, 25, 26 };
+static const unsigned char wallQuery[] = { 149, 13, 7, 9, 10, 11, 12, 18, 45, 46, 47, 48, 49, 50, 51 };
+
+// One tick of Project-5, from its sense() reply
+typedef struct
+{
+	double time;            // s, of the reply
+	unsigned int cliffSignal;
+	unsigned char button;
+	short distance;
+	unsigned char overcurrent;
+	short requestedLeft;
+	short requestedRight;
+	unsigned short countLeft;
+	unsigned short countRight;
+	int drive;              // message of the drive command sent, or -1
+	double traveled;        // mm, filled in by the check
+}
+CardTick;
+
+// One drive command of Project-4, with the sense() before it if any
+typedef struct
+{
+	int sensed;             // 0 for drive_stop()'s commands
+	WallSensors sensors;
+	double time;            // s, of the Drive Direct, or of the reply if none was sent
+	double dt;              // s since the step before
+	int drive;              // message of the Drive Direct sent, or -1
+	DriveCommand command;   // the behaviors' and the governor's, filled in by the check
+	DriveCommand governed;
+}
+WallStep;
+
+typedef struct
+{
+	int opcode;             // 0 for none, CmdDrive or CmdDriveWheels
+	short a, b;             // velocity and radius, or left and right
+}
+Drive;
+
+typedef struct
+{
+	SlipMonitor slip;
+	CardDetector cards;
+	double traveled;
+	short velocity;
+	int done;               // the plan is finished, abandoned or stopped
+	int found;
+}
+CardState;
+
+typedef struct
+{
+	WallMission mission;
+	Governor governor;
+	Shaper shaper;
+}
+WallState;
+
+typedef void (*Pass)(const void* ticks, int count);
+
+static MotionPlan plan;
+static unsigned int startCliff;     // front left cliff signal before the loop
+static double gains[5] = { FOLLOW_KP, FOLLOW_KI, FOLLOW_KD, FOLLOW_OFFSET, FOLLOW_SPEED };
+static const SurfaceProfile* surface;
+static volatile long sink;          // keeps the timed decisions from being optimized away
+
+static void usage() {
+
+	fprintf(stderr, "usage: decisions [--gains kp,ki,kd,offset,speed] [--surface name] capture\n");
+
+}
+
+static double cpu_time() {
+
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+
+}
+
+static double get_mm(double feet) {
+
+	return feet / 0.00328084;
+
+}
+
+static short word(const unsigned char* b) {
+
+	return (b[0] << 8) | b[1];
+
+}
+
+static int is_query(const Traffic* t, const TrafficMessage* m, const unsigned char* query, int length) {
+
+	return m->length == length && memcmp(trafficBytes(t, m), query, length) == 0
+		&& m->replied == m->replyLength;
+
+}
+
+static int count_queries(const Traffic* t, const unsigned char* query, int length) {
+
+	int i, n = 0;
+
+	for (i = 0; i < t->count; i++)
+		n += is_query(t, &t->messages[i], query, length);
+	return n;
+
+}
+
+// The drive command of message i
+static Drive recorded(const Traffic* t, int i) {
+
+	Drive d = { 0, 0, 0 };
+
+	if (i < 0)
+		return d;
+
+	const unsigned char* b = trafficBytes(t, &t->messages[i]);
+	d.opcode = b[0];
+	if (d.opcode == CmdDrive) {
+		d.a = word(b + 1);
+		d.b = word(b + 3);
+	} else {
+		d.a = word(b + 3);
+		d.b = word(b + 1);
+	}
+	return d;
+
+}
+
+static void print_drive(const char* label, const Drive* d) {
+
+	if (d->opcode == CmdDrive)
+		printf("%s Drive %d mm/s radius %d", label, d->a, d->b);
+	else if (d->opcode == CmdDriveWheels)
+		printf("%s Drive Direct left %d right %d", label, d->a, d->b);
+	else
+		printf("%s nothing", label);
+
+}
+
+static void mismatch(int* mismatches, int tick, double time, const Drive* decided, const Drive* sent) {
+
+	if (++*mismatches > SHOW_MISMATCHES)
+		return;
+
+	printf("  tick %d at %.2f s:", tick, time);
+	print_drive(" decided", decided);
+	print_drive(", sent", sent);
+	printf("\n");
+
+}
+
+/*
+Project-5's ticks: each sense() reply, and the Drive or Drive Direct sent
+before the next one. The front left cliff signal that primes the card
+detector is the last Sensors (142) query for packet 29 before the first.
+*/
+static int cards_ticks(const Traffic* t, CardTick* ticks) {
+
+	int i, n = 0;
+
+	for (i = 0; i < t->count; i++) {
+		const TrafficMessage* m = &t->messages[i];
+		const unsigned char* b = trafficBytes(t, m);
+
+		if (n == 0 && m->length == 2 && b[0] == CmdSensors && b[1] == 29 && m->replied == 2)
+			startCliff = (unsigned short) word(trafficReply(t, m));
+
+		if ((b[0] == CmdDrive || b[0] == CmdDriveWheels) && n > 0 && ticks[n - 1].drive < 0)
+			ticks[n - 1].drive = i;
+
+		if (!is_query(t, m, cardsQuery, sizeof(cardsQuery)))
+			continue;
+
+		const unsigned char* r = trafficReply(t, m);
+		CardTick* k = &ticks[n++];
+		k->time = m->replyNs / 1e9;
+		k->cliffSignal = (unsigned short) word(r);
+		k->button = r[2];
+		k->distance = word(r + 3);
+		k->overcurrent = r[7];
+		k->requestedRight = word(r + 8);
+		k->requestedLeft = word(r + 10);
+		k->countLeft = word(r + 12);
+		k->countRight = word(r + 14);
+		k->drive = -1;
+		k->traveled = 0;
+	}
+
+	return n;
+
+}
+
+static void cards_init(CardState* s) {
+
+	slipInit(&s->slip);
+	missionCardInit(&s->cards, CARD_THRESHOLD, startCliff);
+	s->traveled = 0;
+	s->velocity = 0;
+	s->done = 0;
+	s->found = 0;
+
+}
+
+/*
+Project-5's tick: check_wheels() feeds the slip monitor, then the tasks
+in their order. The button stops the loop, the card task watches the
+cliff signal and the search follows the plan until it is finished or
+the wheels are stuck, and then stops.
+*/
+static void cards_decide(CardState* s, const CardTick* k, Drive* d) {
+
+	short radius;
+
+	d->opcode = 0;
+
+	s->traveled += k->distance;
+	int wheels = slipUpdate(&s->slip, k->time, k->requestedLeft, k->requestedRight,
+		k->countLeft, k->countRight, k->overcurrent);
+
+	s->found += missionCardCheck(&s->cards, k->cliffSignal);
+
+	if (s->done)
+		return;
+
+	if (k->button) {
+		s->done = 1;
+		return;
+	}
+
+	if ((wheels & RobotStuck) || !missionFollow(&plan, s->traveled, CONTROL_PERIOD, &s->velocity, &radius)) {
+		s->done = 1;
+		d->opcode = CmdDriveWheels;
+		d->a = 0;
+		d->b = 0;
+		return;
+	}
+
+	d->opcode = CmdDrive;
+	d->a = s->velocity;
+	d->b = radius;
+
+}
+
+static int cards_check(const Traffic* t, CardTick* ticks, int count) {
+
+	CardState s;
+	Drive last = { 0, 0, 0 };
+	int i, checked = 0, held = 0, mismatches = 0;
+
+	cards_init(&s);
+
+	for (i = 0; i < count; i++) {
+		Drive decided, sent = recorded(t, ticks[i].drive);
+
+		cards_decide(&s, &ticks[i], &decided);
+		ticks[i].traveled = s.traveled;
+		if (decided.opcode == 0)
+			continue;
+
+		checked++;
+		if (sent.opcode == 0 && decided.opcode == last.opcode && decided.a == last.a && decided.b == last.b) {
+			held++;
+			continue;
+		}
+		if (sent.opcode != decided.opcode || sent.a != decided.a || sent.b != decided.b)
+			mismatch(&mismatches, i, ticks[i].time, &decided, &sent);
+		if (sent.opcode != 0)
+			last = sent;
+	}
+
+	printf("  checked %d drive commands, %d held back unchanged, %d did not match\n", checked, held, mismatches);
+	printf("  %d cards detected, %.0f mm of the %.0f mm plan traveled\n", s.found, s.traveled, plan.length);
+	return mismatches;
+
+}
+
+// Timed passes over Project-5's ticks
+
+static void cards_pass(const void* ticks, int count) {
+
+	const CardTick* k = (const CardTick*) ticks;
+	CardState s;
+	Drive d;
+	int i;
+
+	cards_init(&s);
+	for (i = 0; i < count; i++) {
+		cards_decide(&s, &k[i], &d);
+		sink += d.a + d.b;
+	}
+
+}
+
+static void slip_pass(const void* ticks, int count) {
+
+	const CardTick* k = (const CardTick*) ticks;
+	SlipMonitor slip;
+	int i;
+
+	slipInit(&slip);
+	for (i = 0; i < count; i++)
+		sink += slipUpdate(&slip, k[i].time, k[i].requestedLeft, k[i].requestedRight,
+			k[i].countLeft, k[i].countRight, k[i].overcurrent);
+
+}
+
+static void card_pass(const void* ticks, int count) {
+
+	const CardTick* k = (const CardTick*) ticks;
+	CardDetector cards;
+	int i;
+
+	missionCardInit(&cards, CARD_THRESHOLD, startCliff);
+	for (i = 0; i < count; i++)
+		sink += missionCardCheck(&cards, k[i].cliffSignal);
+
+}
+
+static void follow_pass(const void* ticks, int count) {
+
+	const CardTick* k = (const CardTick*) ticks;
+	short velocity = 0, radius;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!missionFollow(&plan, k[i].traveled, CONTROL_PERIOD, &velocity, &radius))
+			break;
+		sink += velocity + radius;
+	}
+
+}
+
+/*
+Project-4's drive commands: each sense() reply with the Drive Direct
+after it, if the shadow let one out. The commands of drive_stop() come
+without a reply. Both projects tick every CONTROL_PERIOD.
+*/
+static int wall_steps(const Traffic* t, WallStep* steps) {
+
+	int i, k, n = 0;
+	double last = 0;
+
+	for (i = 0; i < t->count; i++) {
+		const TrafficMessage* m = &t->messages[i];
+		const unsigned char* b = trafficBytes(t, m);
+
+		if (is_query(t, m, wallQuery, sizeof(wallQuery))) {
+			const unsigned char* r = trafficReply(t, m);
+			WallStep* s = &steps[n++];
+			memset(s, 0, sizeof(WallStep));
+			s->sensed = 1;
+			s->drive = -1;
+			s->time = m->replyNs / 1e9;
+			s->sensors.bumpDrop = r[0];
+			for (k = 0; k < 4; k++)
+				s->sensors.cliff = (s->sensors.cliff << 1) | (r[1 + k] & 1);
+			s->sensors.button = r[5];
+			s->sensors.lightBumps = r[6];
+			for (k = 0; k < GOV_SENSORS; k++)
+				s->sensors.lightBumpSignals[k] = (unsigned short) word(r + 7 + 2 * k);
+			continue;
+		}
+
+		if (b[0] != CmdDriveWheels)
+			continue;
+
+		// a tick's drive goes out right after its reply, a later one is
+		// drive_stop()'s after the tick's own was held back
+		if (n == 0 || steps[n - 1].drive >= 0 || m->ns / 1e9 - steps[n - 1].time > CONTROL_PERIOD / 2) {
+			memset(&steps[n], 0, sizeof(WallStep));
+			n++;
+		}
+		steps[n - 1].drive = i;
+		steps[n - 1].time = m->ns / 1e9;
+	}
+
+	// drive() steps the shaper on every tick, sent or held back
+	for (i = 0; i < n; i++) {
+		steps[i].dt = steps[i].time - last;
+		last = steps[i].time;
+	}
+
+	return n;
+
+}
+
+static void wall_init(WallState* s) {
+
+	shaperInit(&s->shaper, surface);
+	governorInit(&s->governor, WALL_CRUISE_SPEED, WALL_APPROACH_SPEED);
+	wallInit(&s->mission);
+	followInit(&s->mission.follower, gains[0], gains[1], gains[2], gains[3], gains[4]);
+
+}
+
+/*
+Project-4's tick: sense() updates the governor, the behaviors bid as in
+the arbiter, and drive() caps the winner with the governor and shapes
+it. drive_stop() only drives.
+*/
+static void wall_decide(WallState* s, WallStep* step, short* left, short* right) {
+
+	DriveCommand command = { 0, 0 };
+
+	if (step->sensed) {
+		governorUpdate(&s->governor, step->sensors.lightBumpSignals);
+		wallTick(&s->mission, &step->sensors, &command);
+	}
+	step->command = command;
+
+	governorApply(&s->governor, &command.left, &command.right);
+	step->governed = command;
+
+	shaperSetTarget(&s->shaper, command.left, command.right);
+	shaperStep(&s->shaper, step->dt, left, right);
+
+}
+
+static int wall_check(const Traffic* t, WallStep* steps, int count) {
+
+	WallState s;
+	Drive last = { 0, 0, 0 };
+	int i, checked = 0, held = 0, mismatches = 0, following = -1;
+	double time = 0;
+
+	wall_init(&s);
+
+	for (i = 0; i < count; i++) {
+		Drive decided = { CmdDriveWheels, 0, 0 }, sent = recorded(t, steps[i].drive);
+
+		time += steps[i].dt;
+		wall_decide(&s, &steps[i], &decided.a, &decided.b);
+		if (s.mission.phase == PhaseFollow && following < 0)
+			following = i;
+
+		checked++;
+		if (sent.opcode == 0 && last.opcode == CmdDriveWheels && abs(last.a - decided.a) <= WHEEL_TOLERANCE
+			&& abs(last.b - decided.b) <= WHEEL_TOLERANCE) {
+			held++;
+			continue;
+		}
+		if (sent.opcode != CmdDriveWheels || abs(sent.a - decided.a) > WHEEL_TOLERANCE
+			|| abs(sent.b - decided.b) > WHEEL_TOLERANCE)
+			mismatch(&mismatches, i, time, &decided, &sent);
+		if (sent.opcode != 0)
+			last = sent;
+	}
+
+	printf("  checked %d drive commands, %d held back unchanged, %d did not match\n", checked, held, mismatches);
+	if (following >= 0)
+		printf("  following the wall from tick %d\n", following);
+	else
+		printf("  never followed the wall\n");
+	return mismatches;
+
+}
+
+// Timed passes over Project-4's steps
+
+static void wall_pass(const void* steps, int count) {
+
+	WallStep* k = (WallStep*) steps;
+	WallState s;
+	short left, right;
+	int i;
+
+	wall_init(&s);
+	for (i = 0; i < count; i++) {
+		wall_decide(&s, &k[i], &left, &right);
+		sink += left + right;
+	}
+
+}
+
+static void governor_pass(const void* steps, int count) {
+
+	const WallStep* k = (const WallStep*) steps;
+	Governor governor;
+	int i;
+
+	governorInit(&governor, WALL_CRUISE_SPEED, WALL_APPROACH_SPEED);
+	for (i = 0; i < count; i++) {
+		DriveCommand command = k[i].command;
+		if (k[i].sensed)
+			governorUpdate(&governor, k[i].sensors.lightBumpSignals);
+		governorApply(&governor, &command.left, &command.right);
+		sink += command.left + command.right;
+	}
+
+}
+
+static void behavior_pass(const void* steps, int count) {
+
+	const WallStep* k = (const WallStep*) steps;
+	WallMission mission;
+	DriveCommand command;
+	int i;
+
+	wallInit(&mission);
+	followInit(&mission.follower, gains[0], gains[1], gains[2], gains[3], gains[4]);
+	for (i = 0; i < count; i++) {
+		if (!k[i].sensed)
+			continue;
+		sink += wallTick(&mission, &k[i].sensors, &command);
+		sink += command.left + command.right;
+	}
+
+}
+
+static void shaper_pass(const void* steps, int count) {
+
+	const WallStep* k = (const WallStep*) steps;
+	Shaper shaper;
+	short left, right;
+	int i;
+
+	shaperInit(&shaper, surface);
+	for (i = 0; i < count; i++) {
+		shaperSetTarget(&shaper, k[i].governed.left, k[i].governed.right);
+		shaperStep(&shaper, k[i].dt, &left, &right);
+		sink += left + right;
+	}
+
+}
+
+// Runs pass over the ticks until TIME_BUDGET s of CPU and prints the cost per call
+static void time_pass(const char* name, Pass pass, const void* ticks, int count, int calls) {
+
+	long passes = 0;
+	double begin = cpu_time(), took;
+
+	do {
+		pass(ticks, count);
+		passes++;
+		took = cpu_time() - begin;
+	} while (took < TIME_BUDGET);
+
+	printf("  %-10s %9.1f %12ld\n", name, took * 1e9 / (passes * calls), passes * calls);
+
+}
+
+static int count_sensed(const WallStep* steps, int count) {
+
+	int i, n = 0;
+
+	for (i = 0; i < count; i++)
+		n += steps[i].sensed;
+	return n;
+
+}
+
+int main(int argc, char* argv[]) {
+
+	CaptureFile file;
+	Traffic traffic;
+	const char* path = NULL;
+	const char* surfaceName = SURFACE;
+	int i, mismatches;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--gains") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%lf,%lf,%lf,%lf,%lf", &gains[0], &gains[1], &gains[2], &gains[3], &gains[4]) != 5) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--surface") == 0 && i + 1 < argc)
+			surfaceName = argv[++i];
+		else if (argv[i][0] != '-' && path == NULL)
+			path = argv[i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (path == NULL) {
+		usage();
+		return 2;
+	}
+
+	surface = shaperSurface(surfaceName);
+	if (surface == NULL) {
+		fprintf(stderr, "Decisions: ERROR: unknown surface %s, use tile, wood or carpet\n", surfaceName);
+		return 2;
+	}
+
+	if (!captureLoad(&file, path))
+		return 1;
+	if (!trafficLoad(&traffic, &file))
+		return 1;
+
+	int cardTicks = count_queries(&traffic, cardsQuery, sizeof(cardsQuery));
+	int wallTicks = count_queries(&traffic, wallQuery, sizeof(wallQuery));
+	if (cardTicks == 0 && wallTicks == 0) {
+		fprintf(stderr, "Decisions: ERROR: %s has neither Project-4's nor Project-5's sense() query\n", path);
+		return 1;
+	}
+
+	if (cardTicks >= wallTicks) {
+		Waypoint waypoints[MOTION_MAX_SEGMENTS];
+		MotionLimits limits;
+		limits.maxSpeed = 250;
+		limits.minSpeed = 20;
+		limits.maxAccel = 300;
+		limits.maxLatAccel = 250;
+		limits.turnRadius = 150;
+		if (!motionPlan(&plan, waypoints, missionStrafe(waypoints, get_mm(SQUARE_SIDE), get_mm(STRAFE_SPACING)), &limits)) {
+			fprintf(stderr, "Decisions: ERROR: cannot plan the search\n");
+			return 1;
+		}
+
+		CardTick* ticks = (CardTick*) malloc(sizeof(CardTick) * cardTicks);
+		int count = cards_ticks(&traffic, ticks);
+		printf("Decisions: Project-5, %d ticks in %.1f s of capture\n", count, traffic.ns / 1e9);
+		mismatches = cards_check(&traffic, ticks, count);
+
+		printf("\n  %-10s %9s %12s\n", "decision", "ns/call", "calls");
+		time_pass("tick", cards_pass, ticks, count, count);
+		time_pass("slip", slip_pass, ticks, count, count);
+		time_pass("card", card_pass, ticks, count, count);
+		time_pass("follow", follow_pass, ticks, count, count);
+		free(ticks);
+	} else {
+		WallStep* steps = (WallStep*) malloc(sizeof(WallStep) * traffic.count);
+		int count = wall_steps(&traffic, steps);
+		int sensed = count_sensed(steps, count);
+		printf("Decisions: Project-4, %d ticks and %d shaper steps in %.1f s of capture\n",
+			sensed, count, traffic.ns / 1e9);
+		printf("  gains kp %g ki %g kd %g offset %g speed %g, %s\n",
+			gains[0], gains[1], gains[2], gains[3], gains[4], surfaceName);
+		mismatches = wall_check(&traffic, steps, count);
+
+		printf("\n  %-10s %9s %12s\n", "decision", "ns/call", "calls");
+		time_pass("tick", wall_pass, steps, count, count);
+		time_pass("governor", governor_pass, steps, count, count);
+		time_pass("behaviors", behavior_pass, steps, count, sensed);
+		time_pass("shaper", shaper_pass, steps, count, count);
+		free(steps);
+	}
+
+	trafficFree(&traffic);
+	captureUnload(&file);
+	return mismatches > 0 ? 1 : 0;
+
+}
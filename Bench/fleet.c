@@ -0,0 +1,396 @@
+/*
+ * fleet.c
+ *
+ * Project-5's card search on thousands of robots at once, on the batch
+ * simulator (../Simulator/batch.c). Each robot has its own scattered
+ * cards, sensor noise and start pose from its seed, as a trial of
+ * ./search does, and is driven every CONTROL_PERIOD by Project-5's own
+ * decisions (mission.c). The robots are split over the threads, each
+ * stepping its own batch.
+ *
+ * It reports the rate in robot-steps per second per thread, the cards
+ * found, and with --check how far the batch robots end up from the same
+ * searches on the simulator's robot (../Simulator/robot.c).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "oi.h"
+#include "arena.h"
+#include "robot.h"
+#include "batch.h"
+#include "motion.h"
+#include "mission.h"
+
+// Project-5's mission
+#define SQUARE_SIDE     4.0   // ft
+#define STRAFE_SPACING  0.5   // ft
+#define CRUISE_SPEED    250   // mm/s
+#define CONTROL_PERIOD  0.1   // s per tick
+#define CARD_THRESHOLD  150   // rise in the front left cliff signal over a card
+
+#define ROBOTS          4096
+#define START_JITTER    50.0  // mm, as ./search
+#define HEADING_JITTER  5.0   // degrees
+#define TIME_LIMIT      3.0   // times the planned duration the fleet may run
+#define SENSE_STEPS     3     // batch steps between sensor updates, 15 ms
+#define CARD_REACH      50.0  // mm from a card a rise is put down to it
+#define CHECK_ROBOTS    16    // compared with robot.c by --check
+
+// One thread's robots and their controllers
+typedef struct
+{
+	const Arena* arena;
+	const MotionPlan* plan;
+	unsigned int seed;     // of the first robot
+	int count;
+	Batch batch;
+
+	// Project-5's state, per robot
+	double* traveled;
+	short* velocity;
+	CardDetector* detector;
+	unsigned int* found;   // bit per card found
+	double* finished;      // s, or NAN while searching
+	double* allFound;      // s, or NAN
+
+	double took;           // s of CPU
+}
+Slice;
+
+static void usage() {
+
+	fprintf(stderr, "usage: fleet [--robots n] [--threads n] [--seed n] [--arena file] [--check]\n");
+
+}
+
+static double get_mm(double feet) {
+
+	return feet / 0.00328084;
+
+}
+
+static unsigned int next_random(unsigned int* seed) {
+
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+
+}
+
+static double jitter(unsigned int* seed, double amplitude) {
+
+	return amplitude * ((next_random(seed) % 2001) / 1000.0 - 1);
+
+}
+
+static double cpu_time() {
+
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+
+}
+
+// The card robot i's front left cliff sensor rose over, as ./search
+static int card_under(const Batch* b, int i) {
+
+	double c = cos(robotCliffAngles[1]);
+	double s = sin(robotCliffAngles[1]);
+	double x = b->x[i] + (ROBOT_RADIUS - 10) * (b->cos[i] * c - b->sin[i] * s);
+	double y = b->y[i] + (ROBOT_RADIUS - 10) * (b->sin[i] * c + b->cos[i] * s);
+	double best = CARD_REACH;
+	int card = -1;
+	int k;
+
+	for (k = 0; k < b->cardCount; k++) {
+		double dx = fmax(fmax(b->cardX0[k][i] - x, x - b->cardX1[k][i]), 0);
+		double dy = fmax(fmax(b->cardY0[k][i] - y, y - b->cardY1[k][i]), 0);
+		if (hypot(dx, dy) <= best) {
+			best = hypot(dx, dy);
+			card = k;
+		}
+	}
+	return card;
+
+}
+
+static int slice_init(Slice* s) {
+
+	int i;
+
+	if (!batchInit(&s->batch, s->arena, s->count))
+		return 0;
+	s->traveled = (double*) calloc(s->count, sizeof(double));
+	s->velocity = (short*) calloc(s->count, sizeof(short));
+	s->detector = (CardDetector*) calloc(s->count, sizeof(CardDetector));
+	s->found = (unsigned int*) calloc(s->count, sizeof(unsigned int));
+	s->finished = (double*) malloc(s->count * sizeof(double));
+	s->allFound = (double*) malloc(s->count * sizeof(double));
+
+	for (i = 0; i < s->count; i++) {
+		unsigned int seed = s->seed + i;
+		unsigned int pose = seed;
+		double x = s->arena->startX + jitter(&pose, START_JITTER);
+		double y = s->arena->startY + jitter(&pose, START_JITTER);
+		double heading = (s->arena->startHeading + jitter(&pose, HEADING_JITTER)) * M_PI / 180;
+
+		batchScatter(&s->batch, i, seed);
+		batchPlace(&s->batch, i, x, y, heading);
+		s->finished[i] = NAN;
+		s->allFound[i] = NAN;
+	}
+	return 1;
+
+}
+
+static void slice_free(Slice* s) {
+
+	batchFree(&s->batch);
+	free(s->traveled);
+	free(s->velocity);
+	free(s->detector);
+	free(s->found);
+	free(s->finished);
+	free(s->allFound);
+
+}
+
+static void* run_slice(void* arg) {
+
+	Slice* s = (Slice*) arg;
+	Batch* b = &s->batch;
+	int perTick = (int) lround(CONTROL_PERIOD / BATCH_STEP);
+	double limit = motionDuration(s->plan) * TIME_LIMIT;
+	int searching = s->count;
+	int i, k;
+
+	double begin = cpu_time();
+
+	batchSense(b);
+	for (i = 0; i < s->count; i++)
+		missionCardInit(&s->detector[i], CARD_THRESHOLD, b->cliff[1][i]);
+
+	while (searching > 0 && b->now < limit) {
+		// control, robot by robot as main.c does on its one
+		for (i = 0; i < s->count; i++) {
+			short radius;
+
+			if (!isnan(s->finished[i]))
+				continue;
+
+			s->traveled[i] += b->distance[i];
+			b->distance[i] = 0;
+			if (missionCardCheck(&s->detector[i], b->cliff[1][i])) {
+				int card = card_under(b, i);
+				if (card >= 0) {
+					s->found[i] |= 1u << card;
+					if (s->found[i] == (1u << b->cardCount) - 1)
+						s->allFound[i] = b->now;
+				}
+			}
+
+			if (!missionFollow(s->plan, s->traveled[i], CONTROL_PERIOD, &s->velocity[i], &radius)) {
+				s->finished[i] = b->now;
+				searching--;
+				batchDriveWheels(b, i, 0, 0);
+			} else {
+				batchDrive(b, i, s->velocity[i], radius);
+			}
+		}
+
+		// physics for a tick, all robots at once
+		for (k = 0; k < perTick; k++) {
+			batchStep(b);
+			if ((k + 1) % SENSE_STEPS == 0)
+				batchSense(b);
+		}
+	}
+
+	s->took = cpu_time() - begin;
+	return NULL;
+
+}
+
+static void drive(Robot* r, short velocity, short radius) {
+
+	unsigned char command[] = { CmdDrive, velocity >> 8, velocity, radius >> 8, radius };
+	int i;
+
+	for (i = 0; i < (int) sizeof(command); i++)
+		robotInput(r, command[i]);
+
+}
+
+// The same search on robot.c, to where it stops; the distance from
+// where the batch robot stopped
+static double check_robot(const Slice* s, int i) {
+
+	Arena arena = *s->arena;
+	Robot robot;
+	unsigned int seed = s->seed + i;
+	unsigned int pose = seed;
+	short velocity = 0;
+	short radius;
+	double traveled = 0;
+	double limit = motionDuration(s->plan) * TIME_LIMIT;
+
+	arenaScatter(&arena, seed);
+	robotInit(&robot, &arena);
+	robot.seed = seed;
+	robot.x += jitter(&pose, START_JITTER);
+	robot.y += jitter(&pose, START_JITTER);
+	robot.heading += jitter(&pose, HEADING_JITTER) * M_PI / 180;
+	robotInput(&robot, CmdStart);
+	robotInput(&robot, CmdFull);
+
+	double start = robot.now;
+	while (robot.now - start < limit) {
+		traveled += robot.distance;
+		robot.distance = 0;
+		if (!missionFollow(s->plan, traveled, CONTROL_PERIOD, &velocity, &radius))
+			break;
+		drive(&robot, velocity, radius);
+		robotStep(&robot, robot.now + CONTROL_PERIOD);
+	}
+
+	return hypot(robot.x - s->batch.x[i], robot.y - s->batch.y[i]);
+
+}
+
+int main(int argc, char* argv[]) {
+
+	Arena arena;
+	MotionPlan plan;
+	MotionLimits limits;
+	Waypoint path[MOTION_MAX_SEGMENTS];
+	const char* arenaPath = NULL;
+	int robots = ROBOTS;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int seed = 1;
+	int check = 0;
+	int i, k;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--robots") == 0 && i + 1 < argc)
+			robots = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc)
+			arenaPath = argv[++i];
+		else if (strcmp(argv[i], "--check") == 0)
+			check = 1;
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (robots < 1 || threads < 1) {
+		usage();
+		return 2;
+	}
+	if (threads > robots)
+		threads = robots;
+
+	if (arenaPath == NULL)
+		arenaDefault(&arena);
+	else if (!arenaLoad(&arena, arenaPath))
+		return 1;
+	if (!arena.hasScatter || arena.cardCount == 0 || arena.cardCount > BATCH_CARDS) {
+		fprintf(stderr, "Fleet: ERROR: the arena needs 1 to %d cards and a scatter area\n", BATCH_CARDS);
+		return 1;
+	}
+
+	// Project-5's plan
+	limits.maxSpeed = CRUISE_SPEED;
+	limits.minSpeed = 20;
+	limits.maxAccel = 300;
+	limits.maxLatAccel = 250;
+	limits.turnRadius = 150;
+	if (!motionPlan(&plan, path, missionStrafe(path, get_mm(SQUARE_SIDE), get_mm(STRAFE_SPACING)), &limits)) {
+		fprintf(stderr, "Fleet: ERROR: cannot plan the search\n");
+		return 1;
+	}
+
+	Slice* slices = (Slice*) calloc(threads, sizeof(Slice));
+	for (i = 0, k = 0; i < threads; i++) {
+		slices[i].arena = &arena;
+		slices[i].plan = &plan;
+		slices[i].seed = seed + k;
+		slices[i].count = robots / threads + (i < robots % threads);
+		k += slices[i].count;
+		if (!slice_init(&slices[i])) {
+			fprintf(stderr, "Fleet: ERROR: cannot allocate %d robots\n", slices[i].count);
+			return 1;
+		}
+	}
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	pthread_t* pool = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+	for (i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, run_slice, &slices[i]);
+	for (i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+	free(pool);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double took = end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	unsigned long steps = 0;
+	double cpu = 0;
+	long found = 0, passed = 0, cards = 0;
+	int all = 0, stuck = 0;
+	double finished = 0;
+
+	for (i = 0; i < threads; i++) {
+		const Slice* s = &slices[i];
+		steps += s->batch.steps;
+		cpu += s->took;
+		for (k = 0; k < s->count; k++) {
+			found += __builtin_popcount(s->found[k]);
+			passed += __builtin_popcount(s->batch.cardsSeen[k]);
+			cards += s->batch.cardCount;
+			all += !isnan(s->allFound[k]);
+			stuck += isnan(s->finished[k]);
+			finished += isnan(s->finished[k]) ? s->batch.now : s->finished[k];
+		}
+	}
+
+	printf("Fleet: %d robots, %d cards each, %d threads, %.1f s simulated\n",
+		robots, arena.cardCount, threads, slices[0].batch.now);
+	printf("  %lu robot-steps in %.2f s, %.2f M/s, %.2f M/s per thread\n",
+		steps, took, steps / took / 1e6, steps / cpu / 1e6);
+	printf("  cards found %.1f%% (%.1f%% under a cliff sensor), all found in %.1f%% of robots\n",
+		100.0 * found / cards, 100.0 * passed / cards, 100.0 * all / robots);
+	printf("  finished in %.1f s on average, %d robots did not finish\n", finished / robots, stuck);
+
+	if (check) {
+		int n = slices[0].count < CHECK_ROBOTS ? slices[0].count : CHECK_ROBOTS;
+		double worst = 0, sum = 0;
+		for (i = 0; i < n; i++) {
+			double d = check_robot(&slices[0], i);
+			sum += d;
+			worst = d > worst ? d : worst;
+		}
+		printf("  against robot.c, %d robots end %.1f mm apart on average, %.1f mm at worst\n",
+			n, sum / n, worst);
+	}
+
+	for (i = 0; i < threads; i++)
+		slice_free(&slices[i]);
+	free(slices);
+	return 0;
+
+}
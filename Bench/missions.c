@@ -0,0 +1,783 @@
+/*
+ * missions.c
+ *
+ * Mission benchmark of the project behaviors. Each mission runs one
+ * project's program against the simulator on the virtual clock, once
+ * per seed, and measures what the project set out to do from the
+ * simulator's report and trace, and the program's own output:
+ *
+ *  bump:   Project-2 pushed against something every 2 s; how long it
+ *          takes to back off and let go of the bumper
+ *  square: Project-3's square; how far from its start it closes, how
+ *          far its heading is off the start heading, and how long it
+ *          takes
+ *  wall:   Project-4 following a wall; the mean gap between bumper and
+ *          wall, its RMS about the mean, and the speed along it
+ *  cards:  Project-5's search of cards scattered by the seed; how long
+ *          it takes to detect them all, how many it misses, and how
+ *          many never went under any cliff sensor
+ *  cards_pipeline: the same search run with --pipeline, sensing,
+ *          control and commands each on a thread of their own
+ *
+ * The seed scatters the cards and sets the simulated sensors' noise, so
+ * a seed always poses the same problem. The mean of each metric over
+ * the seeds is compared with a stored baseline, and a mean that got
+ * worse by more than its tolerance is a regression.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "arena.h"
+#include "robot.h"
+
+#define SEEDS          5     // seeds 1..n run by default
+#define RUN_TIMEOUT    120.0 // s of real time a run may take
+#define LINK_TIMEOUT   5.0   // s for the simulator to make its port
+#define EXIT_GRACE     2.0   // s the simulator has to finish after the program
+#define WALL_SETTLE    10.0  // s of motion before the wall gap counts
+#define TRACE_MAX      200000 // trace rows read from a run
+#define METRICS_MAX    8     // metrics of a mission
+#define CARD_WINDOW    0.2   // s of trace searched for a detected card
+#define ROWS_MAX       1024  // baseline rows
+
+typedef struct
+{
+	double time, x, y, heading, left, right;
+	int bump;
+	unsigned int cards;
+}
+TraceRow;
+
+// What a run left behind: the simulator's trace and report, and what
+// the program printed
+typedef struct
+{
+	int seed;
+	TraceRow* rows;
+	int count;
+	int first, last;       // rows where the wheels first and last turn
+	char report[8192];
+	char output[65536];
+	int failed;            // timed out or the program failed
+}
+Run;
+
+typedef struct Mission Mission;
+
+struct Mission
+{
+	const char* name;
+	const char* project;   // directory next to Bench
+	const char* arena;     // simulator arena, NULL for the default
+	const char* simArgs[4];
+	const char* progArgs[4];
+	const char* metrics[METRICS_MAX];
+	// fills values, in the order of metrics; returns 0 if the run
+	// has nothing to measure
+	int (*measure)(const Mission* m, const Run* run, double* values);
+};
+
+// How a metric is judged against the baseline: a change worse than the
+// larger of slack of the old value and floor is a regression
+typedef struct
+{
+	const char* metric;
+	int better;            // 1 higher is better, -1 lower is, 0 neither
+	double slack;
+	double floor;
+}
+Judge;
+
+typedef struct
+{
+	char mission[16];
+	char metric[32];
+	double value;
+}
+Row;
+
+static int measure_bump(const Mission* m, const Run* run, double* values);
+static int measure_square(const Mission* m, const Run* run, double* values);
+static int measure_wall(const Mission* m, const Run* run, double* values);
+static int measure_cards(const Mission* m, const Run* run, double* values);
+
+static const Mission missions[] = {
+	{ "bump", "Project-2", "../Simulator/arenas/room.txt", { "--bump-every", "2", "--button-at", "20" }, { NULL },
+		{ "escape_mean_s", "escape_worst_s", "escapes_missed" }, measure_bump },
+	{ "square", "Project-3", "../Simulator/arenas/room.txt", { NULL }, { NULL },
+		{ "closure_mm", "heading_error_deg", "time_s" }, measure_square },
+	{ "wall", "Project-4", "../Simulator/arenas/wall.txt", { "--button-at", "60" }, { NULL },
+		{ "gap_mm", "gap_rms_mm", "speed_mm_s" }, measure_wall },
+	{ "cards", "Project-5", NULL, { NULL }, { NULL },
+		{ "find_all_s", "cards_missed", "cards_missed_any" }, measure_cards },
+	{ "cards_pipeline", "Project-5", NULL, { NULL }, { "--pipeline" },
+		{ "find_all_s", "cards_missed", "cards_missed_any" }, measure_cards },
+};
+
+static const Judge judges[] = {
+	{ "escape_mean_s",     -1, 0.25, 0.02 },
+	{ "escape_worst_s",    -1, 0.25, 0.05 },
+	{ "escapes_missed",    -1, 0,    0.5 },
+	{ "closure_mm",        -1, 0.5,  20 },
+	{ "heading_error_deg", -1, 0.5,  3 },
+	{ "time_s",            -1, 0.1,  0.5 },
+	{ "gap_mm",             0, 0.25, 10 },
+	{ "gap_rms_mm",        -1, 0.5,  5 },
+	{ "speed_mm_s",         1, 0.5,  10 },
+	{ "find_all_s",        -1, 0.2,  2 },
+	{ "cards_missed",      -1, 0,    0.5 },
+	{ "cards_missed_any",  -1, 0,    0.5 },
+	{ "runs_failed",       -1, 0,    0.5 },
+};
+
+static char workDir[64];
+static FILE* csv = NULL;
+static Row baseline[ROWS_MAX];
+static int baselineCount = 0;
+static Row results[ROWS_MAX];
+static int resultCount = 0;
+
+static void usage() {
+
+	fprintf(stderr,
+		"usage: missions [--missions name,...] [--seeds n] [--csv file]\n"
+		"                [--baseline file] [--keep]\n");
+
+}
+
+static double now_seconds() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+static const Judge* find_judge(const char* metric) {
+
+	int i;
+
+	for (i = 0; i < (int) (sizeof(judges) / sizeof(judges[0])); i++) {
+		if (strcmp(judges[i].metric, metric) == 0)
+			return &judges[i];
+	}
+	return NULL;
+
+}
+
+static const Row* find_baseline(const char* mission, const char* metric) {
+
+	int i;
+
+	for (i = 0; i < baselineCount; i++) {
+		if (strcmp(baseline[i].mission, mission) == 0 && strcmp(baseline[i].metric, metric) == 0)
+			return &baseline[i];
+	}
+	return NULL;
+
+}
+
+// Writes one seed's value, or the mean when seed is -1, to the CSV, and
+// keeps the means for the baseline comparison
+static void result(const char* mission, const char* metric, int seed, double value) {
+
+	if (csv != NULL) {
+		if (seed >= 0)
+			fprintf(csv, "%s,%s,%d,%.3f\n", mission, metric, seed, value);
+		else
+			fprintf(csv, "%s,%s,,%.3f\n", mission, metric, value);
+	}
+
+	if (seed < 0 && resultCount < ROWS_MAX) {
+		Row* r = &results[resultCount++];
+		snprintf(r->mission, sizeof(r->mission), "%s", mission);
+		snprintf(r->metric, sizeof(r->metric), "%s", metric);
+		r->value = value;
+	}
+
+}
+
+// Reads the means of a CSV written with --csv
+static int load_baseline(const char* path) {
+
+	char line[256];
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Missions: ERROR: cannot read %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL && baselineCount < ROWS_MAX) {
+		Row* r = &baseline[baselineCount];
+		if (sscanf(line, "%15[^,],%31[^,],,%lf", r->mission, r->metric, &r->value) == 3)
+			baselineCount++;
+	}
+	fclose(f);
+	return 1;
+
+}
+
+// Prints the means that moved past their tolerance, returns the number
+// that got worse
+static int compare() {
+
+	int compared = 0;
+	int worse = 0;
+	int moved = 0;
+	int i;
+
+	for (i = 0; i < resultCount; i++) {
+		const Row* r = &results[i];
+		const Row* old = find_baseline(r->mission, r->metric);
+		const Judge* j = find_judge(r->metric);
+		if (old == NULL || j == NULL)
+			continue;
+		compared++;
+
+		double change = r->value - old->value;
+		double tolerance = fmax(j->slack * fabs(old->value), j->floor);
+		if (fabs(change) <= tolerance)
+			continue;
+
+		const char* verdict = "changed";
+		if (j->better != 0 && change * j->better < 0) {
+			verdict = "REGRESSION";
+			worse++;
+		}
+		else if (j->better != 0)
+			verdict = "better";
+
+		if (moved++ == 0)
+			printf("Changed from the baseline:\n");
+		printf("  %-6s %-18s %10.3f -> %10.3f (tolerance %.3f) %s\n", r->mission, r->metric,
+			old->value, r->value, tolerance, verdict);
+	}
+
+	printf("Baseline: %d means compared, %d moved past their tolerance, %d regressions\n",
+		compared, moved, worse);
+	return worse;
+
+}
+
+static void path_in(char* path, size_t size, const char* name) {
+
+	snprintf(path, size, "%s/%s", workDir, name);
+
+}
+
+static pid_t spawn(const char* dir, const char* program, const char* const* args,
+	const char* outPath, char* const* env) {
+
+	pid_t pid = fork();
+	if (pid != 0)
+		return pid;
+
+	int out = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out >= 0) {
+		dup2(out, 1);
+		dup2(out, 2);
+		close(out);
+	}
+	if (dir != NULL && chdir(dir) != 0)
+		_exit(127);
+	execve(program, (char* const*) args, env);
+	_exit(127);
+
+}
+
+// Waits up to timeout s for pid, returns its status or -1 if it is still going
+static int wait_for(pid_t pid, double timeout) {
+
+	double deadline = now_seconds() + timeout;
+	int status = 0;
+	pid_t r;
+
+	while ((r = waitpid(pid, &status, WNOHANG)) == 0) {
+		if (now_seconds() > deadline)
+			return -1;
+		usleep(10000);
+	}
+	return r == pid ? status : 0; // or already waited for
+
+}
+
+static void stop(pid_t pid) {
+
+	if (wait_for(pid, 0) != -1)
+		return;
+	kill(pid, SIGTERM);
+	if (wait_for(pid, EXIT_GRACE) == -1) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+
+}
+
+static int load_trace(Run* run, const char* path) {
+
+	char line[256];
+	int i;
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+
+	run->count = 0;
+	while (fgets(line, sizeof(line), f) != NULL && run->count < TRACE_MAX) {
+		TraceRow* r = &run->rows[run->count];
+		if (sscanf(line, "%lf,%lf,%lf,%lf,%lf,%lf,%d,%u", &r->time, &r->x, &r->y, &r->heading,
+			&r->left, &r->right, &r->bump, &r->cards) == 8)
+			run->count++;
+	}
+	fclose(f);
+
+	run->first = -1;
+	run->last = -1;
+	for (i = 0; i < run->count; i++) {
+		if (run->rows[i].left == 0 && run->rows[i].right == 0)
+			continue;
+		if (run->first < 0)
+			run->first = i;
+		run->last = i;
+	}
+	return run->first >= 0;
+
+}
+
+static void load_text(char* text, size_t size, const char* path) {
+
+	text[0] = 0;
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+		return;
+	size_t n = fread(text, 1, size - 1, f);
+	text[n] = 0;
+	fclose(f);
+
+}
+
+// Runs the mission's program against the simulator with one seed
+static void run_mission(const Mission* m, int seed, Run* run) {
+
+	char clockPath[128], linkPath[128], tracePath[128], simOut[128], progOut[128];
+	char seedText[16], dir[64], program[64], device[160], clockEnv[160];
+	const char* simArgs[24];
+	int n = 0;
+	int i;
+
+	path_in(clockPath, sizeof(clockPath), "clock");
+	path_in(linkPath, sizeof(linkPath), "tty");
+	snprintf(tracePath, sizeof(tracePath), "%s/%s-%d.csv", workDir, m->name, seed);
+	snprintf(simOut, sizeof(simOut), "%s/%s-%d.sim", workDir, m->name, seed);
+	snprintf(progOut, sizeof(progOut), "%s/%s-%d.out", workDir, m->name, seed);
+	snprintf(seedText, sizeof(seedText), "%d", seed);
+
+	simArgs[n++] = "../Simulator/createsim";
+	simArgs[n++] = "--virtual";
+	simArgs[n++] = clockPath;
+	simArgs[n++] = "--link";
+	simArgs[n++] = linkPath;
+	simArgs[n++] = "--trace";
+	simArgs[n++] = tracePath;
+	simArgs[n++] = "--exit-on-powerdown";
+	simArgs[n++] = "--seed";
+	simArgs[n++] = seedText;
+	if (m->arena != NULL) {
+		simArgs[n++] = "--arena";
+		simArgs[n++] = m->arena;
+	}
+	for (i = 0; i < 4 && m->simArgs[i] != NULL; i++)
+		simArgs[n++] = m->simArgs[i];
+	simArgs[n] = NULL;
+
+	unlink(linkPath);
+	run->seed = seed;
+	run->failed = 1;
+	run->count = 0;
+
+	pid_t sim = spawn(NULL, simArgs[0], simArgs, simOut, environ);
+
+	// the port is linked once the simulator is ready for the program
+	double deadline = now_seconds() + LINK_TIMEOUT;
+	while (access(linkPath, F_OK) != 0 && now_seconds() < deadline)
+		usleep(10000);
+	if (access(linkPath, F_OK) != 0) {
+		fprintf(stderr, "Missions: ERROR: the simulator did not start, see %s\n", simOut);
+		stop(sim);
+		return;
+	}
+
+	snprintf(dir, sizeof(dir), "../%s", m->project);
+	snprintf(program, sizeof(program), "./create2");
+	snprintf(device, sizeof(device), "CREATE_DEVICE=%s", linkPath);
+	snprintf(clockEnv, sizeof(clockEnv), "CREATE_CLOCK=%s", clockPath);
+	char* env[] = { device, clockEnv, NULL };
+	const char* progArgs[6];
+	n = 0;
+	progArgs[n++] = program;
+	for (i = 0; i < 4 && m->progArgs[i] != NULL; i++)
+		progArgs[n++] = m->progArgs[i];
+	progArgs[n] = NULL;
+
+	pid_t prog = spawn(dir, program, progArgs, progOut, env);
+
+	int status = wait_for(prog, RUN_TIMEOUT);
+	if (status == -1)
+		fprintf(stderr, "Missions: ERROR: %s seed %d took over %.0f s, see %s\n", m->name, seed, RUN_TIMEOUT, progOut);
+	else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		fprintf(stderr, "Missions: ERROR: %s seed %d failed, see %s\n", m->name, seed, progOut);
+	else
+		run->failed = 0;
+	stop(prog);
+
+	// the simulator ends on the program's power down, or reports when stopped
+	if (wait_for(sim, EXIT_GRACE) == -1)
+		stop(sim);
+
+	load_text(run->report, sizeof(run->report), simOut);
+	load_text(run->output, sizeof(run->output), progOut);
+	if (!run->failed && !load_trace(run, tracePath)) {
+		fprintf(stderr, "Missions: ERROR: %s seed %d never moved, see %s\n", m->name, seed, tracePath);
+		run->failed = 1;
+	}
+
+}
+
+static int measure_bump(const Mission* m, const Run* run, double* values) {
+
+	int pushes, escaped;
+	double mean, worst;
+
+	const char* line = strstr(run->report, "pushes ");
+	if (line == NULL || sscanf(line, "pushes %d, escaped %d, mean %lf s, worst %lf s",
+		&pushes, &escaped, &mean, &worst) != 4)
+		return 0;
+
+	values[0] = mean;
+	values[1] = worst;
+	values[2] = pushes - escaped;
+	return 1;
+
+}
+
+static int measure_square(const Mission* m, const Run* run, double* values) {
+
+	const TraceRow* start = &run->rows[run->first];
+	const TraceRow* end = &run->rows[run->count - 1];
+
+	// a closed square ends facing the way it started
+	double turned = fmod(fabs(end->heading - start->heading), 360);
+
+	values[0] = hypot(end->x - start->x, end->y - start->y);
+	values[1] = turned > 180 ? 360 - turned : turned;
+	values[2] = run->rows[run->last].time - start->time;
+	return 1;
+
+}
+
+static int measure_wall(const Mission* m, const Run* run, double* values) {
+
+	Arena arena;
+	double sum = 0, squares = 0, path = 0;
+	double bearing;
+	int n = 0;
+	int i;
+
+	if (!arenaLoad(&arena, m->arena))
+		return 0;
+
+	double from = run->rows[run->first].time + WALL_SETTLE;
+	double to = run->rows[run->last].time;
+	const TraceRow* previous = NULL;
+
+	for (i = run->first; i <= run->last; i++) {
+		const TraceRow* r = &run->rows[i];
+		if (r->time < from)
+			continue;
+
+		double gap = arenaClearance(&arena, r->x, r->y, &bearing) - ROBOT_RADIUS;
+		sum += gap;
+		squares += gap * gap;
+		n++;
+		if (previous != NULL)
+			path += hypot(r->x - previous->x, r->y - previous->y);
+		previous = r;
+	}
+
+	if (n < 2 || to <= from)
+		return 0;
+
+	double mean = sum / n;
+	values[0] = mean;
+	values[1] = sqrt(fmax(squares / n - mean * mean, 0));
+	values[2] = path / (to - from);
+	return 1;
+
+}
+
+// Card under the front left cliff sensor, the only one Project-5
+// watches, within CARD_WINDOW of trace time at, or -1
+static int card_detected(const Arena* arena, const Run* run, double at) {
+
+	int i;
+
+	for (i = run->first; i < run->count; i++) {
+		const TraceRow* r = &run->rows[i];
+		if (r->time < at - CARD_WINDOW)
+			continue;
+		if (r->time > at + CARD_WINDOW)
+			break;
+
+		// where the simulator puts the sensor, on the rim of the body
+		double angle = r->heading * M_PI / 180 + robotCliffAngles[1];
+		int card = arenaCard(arena, r->x + (ROBOT_RADIUS - 10) * cos(angle),
+			r->y + (ROBOT_RADIUS - 10) * sin(angle));
+		if (card >= 0)
+			return card;
+	}
+	return -1;
+
+}
+
+static int measure_cards(const Mission* m, const Run* run, double* values) {
+
+	Arena arena;
+	const char* p = run->report;
+	unsigned int detected = 0;
+	double last = 0;
+	int missedAny = 0;
+	int missed;
+	int i;
+
+	// the simulator counts a card found under any of the cliff sensors
+	while ((p = strstr(p, "  card ")) != NULL) {
+		int card;
+		double at;
+
+		if (sscanf(p, "  card %d found at %lf s", &card, &at) != 2)
+			missedAny++;
+		p++;
+	}
+
+	// the cards as the simulator scattered them
+	if (m->arena == NULL)
+		arenaDefault(&arena);
+	else if (!arenaLoad(&arena, m->arena))
+		return 0;
+	arenaScatter(&arena, (unsigned int) run->seed);
+
+	// the program's detections, from the start of its search, which is
+	// when the wheels first turn; a card detected again counts once
+	double start = run->rows[run->first].time;
+	p = run->output;
+	while ((p = strstr(p, "Card: found at ")) != NULL) {
+		double at;
+
+		if (sscanf(p, "Card: found at %lf s", &at) == 1) {
+			int card = card_detected(&arena, run, start + at);
+			if (card >= 0 && card < 32 && !(detected & (1u << card))) {
+				detected |= 1u << card;
+				last = at;
+			}
+		}
+		p++;
+	}
+
+	missed = arena.cardCount;
+	for (i = 0; i < arena.cardCount && i < 32; i++) {
+		if (detected & (1u << i))
+			missed--;
+	}
+
+	// only a search that found every card has a time to find them all
+	values[0] = missed == 0 ? last : NAN;
+	values[1] = missed;
+	values[2] = missedAny;
+	return 1;
+
+}
+
+// Runs a mission with every seed and reports each metric's mean
+static void bench_mission(const Mission* m, int seeds, Run* run) {
+
+	double values[METRICS_MAX];
+	double sums[METRICS_MAX] = { 0 };
+	int counts[METRICS_MAX] = { 0 };
+	int metrics = 0;
+	int failed = 0;
+	int seed;
+	int i;
+
+	while (metrics < METRICS_MAX && m->metrics[metrics] != NULL)
+		metrics++;
+
+	printf("Mission %s (%s):\n", m->name, m->project);
+	printf("  %-18s", "seed");
+	for (seed = 1; seed <= seeds; seed++)
+		printf(" %9d", seed);
+	printf(" %9s\n", "mean");
+
+	double* table = (double*) malloc(sizeof(double) * metrics * seeds);
+
+	for (seed = 1; seed <= seeds; seed++) {
+		run_mission(m, seed, run);
+		if (run->failed || !m->measure(m, run, values)) {
+			failed++;
+			for (i = 0; i < metrics; i++)
+				values[i] = NAN;
+		}
+
+		for (i = 0; i < metrics; i++) {
+			table[i * seeds + seed - 1] = values[i];
+			if (isnan(values[i]))
+				continue;
+			result(m->name, m->metrics[i], seed, values[i]);
+			sums[i] += values[i];
+			counts[i]++;
+		}
+	}
+
+	for (i = 0; i < metrics; i++) {
+		printf("  %-18s", m->metrics[i]);
+		for (seed = 1; seed <= seeds; seed++) {
+			double v = table[i * seeds + seed - 1];
+			if (isnan(v))
+				printf(" %9s", "-");
+			else
+				printf(" %9.3f", v);
+		}
+
+		if (counts[i] > 0) {
+			printf(" %9.3f\n", sums[i] / counts[i]);
+			result(m->name, m->metrics[i], -1, sums[i] / counts[i]);
+		}
+		else
+			printf(" %9s\n", "-");
+	}
+	printf("  %-18s %d of %d\n", "runs_failed", failed, seeds);
+	result(m->name, "runs_failed", -1, failed);
+
+	free(table);
+
+}
+
+static int selected(const char* list, const char* name) {
+
+	size_t n = strlen(name);
+	const char* p = list;
+
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == list || p[-1] == ',') && (p[n] == ',' || p[n] == 0))
+			return 1;
+		p += n;
+	}
+	return 0;
+
+}
+
+static void remove_work(int keep) {
+
+	char path[320];
+	struct dirent* entry;
+
+	if (keep) {
+		printf("Runs kept in %s\n", workDir);
+		return;
+	}
+
+	DIR* dir = opendir(workDir);
+	if (dir == NULL)
+		return;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", workDir, entry->d_name);
+		unlink(path);
+	}
+	closedir(dir);
+	rmdir(workDir);
+
+}
+
+int main(int argc, char* argv[]) {
+
+	const char* list = NULL;
+	const char* csvPath = NULL;
+	const char* baselinePath = "missions.baseline.csv";
+	int seeds = SEEDS;
+	int keep = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--missions") == 0 && i + 1 < argc)
+			list = argv[++i];
+		else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+			seeds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (strcmp(argv[i], "--keep") == 0)
+			keep = 1;
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (seeds < 1 || seeds >= 1000) {
+		usage();
+		return 2;
+	}
+
+	if (strcmp(baselinePath, "none") != 0 && !load_baseline(baselinePath))
+		return 1;
+
+	if (csvPath != NULL) {
+		csv = fopen(csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Missions: ERROR: cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "mission,metric,seed,value\n");
+	}
+
+	snprintf(workDir, sizeof(workDir), "/tmp/missionsXXXXXX");
+	if (mkdtemp(workDir) == NULL) {
+		fprintf(stderr, "Missions: ERROR: cannot make a directory for the runs\n");
+		return 1;
+	}
+
+	Run run;
+	run.rows = (TraceRow*) malloc(sizeof(TraceRow) * TRACE_MAX);
+
+	for (i = 0; i < (int) (sizeof(missions) / sizeof(missions[0])); i++) {
+		if (list == NULL || selected(list, missions[i].name))
+			bench_mission(&missions[i], seeds, &run);
+	}
+
+	free(run.rows);
+	remove_work(keep);
+
+	if (csv != NULL)
+		fclose(csv);
+
+	if (baselineCount > 0 && compare() > 0)
+		return 1;
+	return 0;
+
+}
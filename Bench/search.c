@@ -0,0 +1,491 @@
+/*
+ * search.c
+ *
+ * Monte-Carlo study of card search strategies for Project-5. Each trial
+ * scatters the arena's cards from a seed, sets the sensor noise from
+ * it, puts the robot down a little off the center and runs a search in
+ * process: the simulator's robot (../Simulator/robot.c) driven every
+ * CONTROL_PERIOD by Project-5's own decisions (mission.c): along a
+ * plan from its motion.c, tracked with the distance sensor, counting a
+ * card found when the front left cliff signal rises by more than
+ * CARD_THRESHOLD. Trials run on every core.
+ *
+ * A strategy is a pattern, the spacing between its passes and a cruise
+ * speed:
+ *
+ *  strafe: Project-5's search, from the center to a corner of the
+ *          square, then back and forth across it
+ *  spiral: from the center to a corner, then round the square inward
+ *
+ * For each it reports the cards found, and for comparison the cards
+ * that passed under any of the four cliff sensors, how often all were
+ * found, and the distribution of the time to find the first, half and
+ * all of them.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "oi.h"
+#include "arena.h"
+#include "robot.h"
+#include "motion.h"
+#include "mission.h"
+
+// Project-5's mission
+#define SQUARE_SIDE     4.0   // ft
+#define CONTROL_PERIOD  0.1   // s per tick
+#define CARD_THRESHOLD  150   // rise in the front left cliff signal over a card
+
+#define TRIALS          1000  // per strategy
+#define START_JITTER    50.0  // mm the robot may be put down off the center
+#define HEADING_JITTER  5.0   // degrees it may be turned
+#define TIME_LIMIT      3.0   // times the planned duration a trial may run
+#define STRATEGY_MAX    16
+#define CARD_MAX        32
+#define CARD_REACH      50.0  // mm from a card a rise is put down to it
+
+enum { Strafe, Spiral };
+
+typedef struct
+{
+	int pattern;
+	double spacing;        // ft between passes
+	double speed;          // mm/s cruise
+	MotionPlan plan;
+	char name[32];
+}
+Strategy;
+
+// What one trial did
+typedef struct
+{
+	int cards;             // in the arena
+	int found;
+	int passed;            // under any cliff sensor, noticed or not
+	double foundAt[CARD_MAX]; // s from the start of the search, in order found
+	double finished;       // s to the end of the plan, or the limit
+	int stuck;
+}
+Trial;
+
+typedef struct
+{
+	const Arena* arena;
+	Strategy* strategies;
+	int strategyCount;
+	int trials;
+	unsigned int seed;     // of trial 0
+	Trial* results;        // strategyCount * trials
+	atomic_int next;       // next trial to run, over all strategies
+}
+Study;
+
+static void usage() {
+
+	fprintf(stderr,
+		"usage: search [--strategy strafe|spiral:spacing_ft:speed_mm_s]... [--trials n]\n"
+		"              [--threads n] [--seed n] [--arena file] [--csv file]\n");
+
+}
+
+static double get_mm(double feet) {
+
+	return feet / 0.00328084;
+
+}
+
+// Waypoints of a strategy, starting in the center facing +x like Project-5
+static int search_path(const Strategy* s, Waypoint* path) {
+
+	double half = get_mm(SQUARE_SIDE / 2);
+	double step = get_mm(s->spacing);
+	double in = 0;
+	int n = 0;
+
+	if (s->pattern == Strafe)
+		return missionStrafe(path, get_mm(SQUARE_SIDE), step);
+
+	// the same setup, then round the square, each lap a pass further in
+	path[n].x = 0;     path[n++].y = 0;
+	path[n].x = half;  path[n++].y = 0;
+	path[n].x = half;  path[n++].y = half;
+
+	while (half - in > step / 2 && n + 5 <= MOTION_MAX_SEGMENTS) {
+		path[n].x = -half + in; path[n++].y = half - in;
+		path[n].x = -half + in; path[n++].y = -half + in;
+		path[n].x = half - in;  path[n++].y = -half + in;
+		path[n].x = half - in;  path[n++].y = half - in - step;
+		in += step;
+		path[n].x = half - in;  path[n++].y = half - in;
+	}
+
+	return n;
+
+}
+
+static int parse_strategy(Strategy* s, const char* text) {
+
+	char pattern[16];
+
+	if (sscanf(text, "%15[^:]:%lf:%lf", pattern, &s->spacing, &s->speed) != 3
+		|| s->spacing <= 0 || s->speed <= 0 || s->speed > MOTION_WHEEL_MAX)
+		return 0;
+
+	if (strcmp(pattern, "strafe") == 0)
+		s->pattern = Strafe;
+	else if (strcmp(pattern, "spiral") == 0)
+		s->pattern = Spiral;
+	else
+		return 0;
+
+	snprintf(s->name, sizeof(s->name), "%s %.2f ft %.0f mm/s", pattern, s->spacing, s->speed);
+	return 1;
+
+}
+
+static int plan_strategy(Strategy* s) {
+
+	Waypoint path[MOTION_MAX_SEGMENTS];
+	MotionLimits limits;
+
+	// Project-5's limits but the cruise speed
+	limits.maxSpeed = s->speed;
+	limits.minSpeed = 20;
+	limits.maxAccel = 300;
+	limits.maxLatAccel = 250;
+	limits.turnRadius = 150;
+
+	if (!motionPlan(&s->plan, path, search_path(s, path), &limits)) {
+		fprintf(stderr, "Search: ERROR: cannot plan %s\n", s->name);
+		return 0;
+	}
+	return 1;
+
+}
+
+static void drive(Robot* r, short velocity, short radius) {
+
+	unsigned char command[] = { CmdDrive, velocity >> 8, velocity, radius >> 8, radius };
+	int i;
+
+	for (i = 0; i < (int) sizeof(command); i++)
+		robotInput(r, command[i]);
+
+}
+
+static unsigned int next_random(unsigned int* seed) {
+
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+
+}
+
+static double jitter(unsigned int* seed, double amplitude) {
+
+	return amplitude * ((next_random(seed) % 2001) / 1000.0 - 1);
+
+}
+
+// The card the front left cliff sensor rose over. Its signal is up to a
+// sensor period old, so the nearest card within CARD_REACH of it.
+static int card_under(const Arena* a, const Robot* r) {
+
+	double x = r->x + (ROBOT_RADIUS - 10) * cos(r->heading + 20 * M_PI / 180);
+	double y = r->y + (ROBOT_RADIUS - 10) * sin(r->heading + 20 * M_PI / 180);
+	double best = CARD_REACH;
+	int card = -1;
+	int i;
+
+	for (i = 0; i < a->cardCount && i < CARD_MAX; i++) {
+		const Rect* c = &a->cards[i];
+		double dx = fmax(fmax(c->x0 - x, x - c->x1), 0);
+		double dy = fmax(fmax(c->y0 - y, y - c->y1), 0);
+		if (hypot(dx, dy) <= best) {
+			best = hypot(dx, dy);
+			card = i;
+		}
+	}
+	return card;
+
+}
+
+// One search with the cards, noise and start pose from seed
+static void run_trial(const Study* study, const Strategy* s, unsigned int seed, Trial* t) {
+
+	Arena arena = *study->arena;
+	Robot robot;
+	unsigned int pose = seed;
+	CardDetector detector;
+	short velocity = 0;
+	short radius;
+	double traveled = 0;
+	int i;
+
+	arenaScatter(&arena, seed);
+	robotInit(&robot, &arena);
+	robot.seed = seed;
+	robot.x += jitter(&pose, START_JITTER);
+	robot.y += jitter(&pose, START_JITTER);
+	robot.heading += jitter(&pose, HEADING_JITTER) * M_PI / 180;
+
+	robotInput(&robot, CmdStart);
+	robotInput(&robot, CmdFull);
+	robotStep(&robot, CONTROL_PERIOD);
+
+	memset(t, 0, sizeof(Trial));
+	t->cards = arena.cardCount;
+
+	double limit = motionDuration(&s->plan) * TIME_LIMIT;
+	double start = robot.now;
+	missionCardInit(&detector, CARD_THRESHOLD, robot.snap.cliffSignal[1]);
+	int seen[CARD_MAX] = { 0 };
+
+	for (;;) {
+		double now = robot.now - start;
+
+		// sense: distance since the last tick and the front left cliff signal
+		traveled += robot.distance;
+		robot.distance = 0;
+		if (missionCardCheck(&detector, robot.snap.cliffSignal[1])) {
+			int card = card_under(&arena, &robot);
+			if (card >= 0 && !seen[card]) {
+				seen[card] = 1;
+				t->foundAt[t->found++] = now;
+			}
+		}
+
+		// control: the plan, looking ahead by a tick
+		if (!missionFollow(&s->plan, traveled, CONTROL_PERIOD, &velocity, &radius)) {
+			t->finished = now;
+			break;
+		}
+		if (now > limit) {
+			t->finished = now;
+			t->stuck = 1;
+			break;
+		}
+		drive(&robot, velocity, radius);
+		robotStep(&robot, robot.now + CONTROL_PERIOD);
+	}
+
+	for (i = 0; i < arena.cardCount && i < CARD_MAX; i++)
+		t->passed += (robot.cardsSeen >> i) & 1;
+	for (i = t->found; i < CARD_MAX; i++)
+		t->foundAt[i] = NAN;
+
+}
+
+static void* worker(void* arg) {
+
+	Study* study = (Study*) arg;
+	int total = study->strategyCount * study->trials;
+	int k;
+
+	while ((k = atomic_fetch_add(&study->next, 1)) < total) {
+		int s = k / study->trials;
+		int trial = k % study->trials;
+		// every strategy faces the same layouts
+		run_trial(study, &study->strategies[s], study->seed + trial, &study->results[k]);
+	}
+	return NULL;
+
+}
+
+static int compare_doubles(const void* a, const void* b) {
+
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return x < y ? -1 : x > y;
+
+}
+
+static double percentile(const double* sorted, int n, double p) {
+
+	int i = (int) (p * (n - 1) + 0.5);
+	return sorted[i];
+
+}
+
+// Time to find the k-th card over the trials that found it: p10 p50 p90 max
+static void print_times(const char* label, const Trial* trials, int count, int k, double* times) {
+
+	int n = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (trials[i].found > k)
+			times[n++] = trials[i].foundAt[k];
+	}
+
+	printf("  %-12s", label);
+	if (n == 0) {
+		printf(" never\n");
+		return;
+	}
+	qsort(times, n, sizeof(double), compare_doubles);
+	printf(" p10 %6.1f  p50 %6.1f  p90 %6.1f  max %6.1f s  (%d trials)\n",
+		percentile(times, n, 0.1), percentile(times, n, 0.5), percentile(times, n, 0.9), times[n - 1], n);
+
+}
+
+static void report(const Study* study, int s, FILE* csv) {
+
+	const Strategy* strategy = &study->strategies[s];
+	const Trial* trials = &study->results[s * study->trials];
+	int count = study->trials;
+	long found = 0, passed = 0, cards = 0;
+	int all = 0, stuck = 0;
+	double finished = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		found += trials[i].found;
+		passed += trials[i].passed;
+		cards += trials[i].cards;
+		all += trials[i].found == trials[i].cards;
+		stuck += trials[i].stuck;
+		finished += trials[i].finished;
+
+		if (csv != NULL) {
+			const Trial* t = &trials[i];
+			double last = t->found == t->cards && t->found > 0 ? t->foundAt[t->found - 1] : NAN;
+			fprintf(csv, "%s,%.2f,%.0f,%u,%d,%d,%.2f,%.2f\n",
+				strategy->pattern == Strafe ? "strafe" : "spiral", strategy->spacing, strategy->speed,
+				study->seed + i, t->found, t->cards, last, t->finished);
+		}
+	}
+
+	int cardCount = trials[0].cards;
+	double* times = (double*) malloc(sizeof(double) * count);
+
+	printf("%s: %.0f mm, about %.1f s planned\n", strategy->name, strategy->plan.length,
+		motionDuration(&strategy->plan));
+	printf("  cards found %.1f%% (%.1f%% under a cliff sensor), all found in %.1f%% of %d trials\n",
+		100.0 * found / cards, 100.0 * passed / cards, 100.0 * all / count, count);
+	printf("  finished in %.1f s on average, %d trials did not finish\n", finished / count, stuck);
+	if (cardCount > 0) {
+		char label[32];
+		print_times("first card", trials, count, 0, times);
+		if (cardCount > 2) {
+			snprintf(label, sizeof(label), "%d cards", (cardCount + 1) / 2);
+			print_times(label, trials, count, (cardCount + 1) / 2 - 1, times);
+		}
+		if (cardCount > 1)
+			print_times("all cards", trials, count, cardCount - 1, times);
+	}
+
+	free(times);
+
+}
+
+int main(int argc, char* argv[]) {
+
+	Strategy strategies[STRATEGY_MAX];
+	Arena arena;
+	const char* arenaPath = NULL;
+	const char* csvPath = NULL;
+	int count = 0;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+
+	Study study;
+	study.trials = TRIALS;
+	study.seed = 1;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--strategy") == 0 && i + 1 < argc && count < STRATEGY_MAX) {
+			if (!parse_strategy(&strategies[count++], argv[++i])) {
+				usage();
+				return 2;
+			}
+		}
+		else if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc)
+			study.trials = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			study.seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc)
+			arenaPath = argv[++i];
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvPath = argv[++i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (study.trials < 1 || threads < 1) {
+		usage();
+		return 2;
+	}
+
+	// Project-5's search first, then wider passes, faster, and the spiral
+	if (count == 0) {
+		const char* defaults[] = { "strafe:0.5:250", "strafe:0.75:250", "strafe:1:250",
+			"strafe:0.5:350", "spiral:0.5:250", "spiral:0.75:250" };
+		for (count = 0; count < (int) (sizeof(defaults) / sizeof(defaults[0])); count++)
+			parse_strategy(&strategies[count], defaults[count]);
+	}
+	for (i = 0; i < count; i++) {
+		if (!plan_strategy(&strategies[i]))
+			return 1;
+	}
+
+	if (arenaPath == NULL)
+		arenaDefault(&arena);
+	else if (!arenaLoad(&arena, arenaPath))
+		return 1;
+	if (!arena.hasScatter || arena.cardCount == 0 || arena.cardCount > CARD_MAX) {
+		fprintf(stderr, "Search: ERROR: the arena needs cards and a scatter area\n");
+		return 1;
+	}
+
+	FILE* csv = NULL;
+	if (csvPath != NULL) {
+		csv = fopen(csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Search: ERROR: cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "pattern,spacing_ft,speed_mm_s,seed,found,cards,all_found_s,finished_s\n");
+	}
+
+	study.arena = &arena;
+	study.strategies = strategies;
+	study.strategyCount = count;
+	study.results = (Trial*) malloc(sizeof(Trial) * count * study.trials);
+	atomic_init(&study.next, 0);
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	pthread_t* pool = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+	for (i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, worker, &study);
+	for (i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+	free(pool);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double took = end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	printf("Search: %d strategies, %d trials each, %d cards, %d threads, %.1f s\n",
+		count, study.trials, arena.cardCount, threads, took);
+	for (i = 0; i < count; i++)
+		report(&study, i, csv);
+
+	if (csv != NULL)
+		fclose(csv);
+	free(study.results);
+	return 0;
+
+}
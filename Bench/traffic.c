@@ -0,0 +1,161 @@
+/*
+ * traffic.c
+ *
+ * Open Interface messages of a capture. See traffic.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oi.h"
+#include "robot.h"
+#include "packets.h"
+#include "traffic.h"
+
+static const struct
+{
+	int opcode;
+	const char* name;
+}
+opcodes[] = {
+	{ CmdStart, "start" },
+	{ CmdBaud, "baud" },
+	{ CmdControl, "control" },
+	{ CmdSafe, "safe" },
+	{ CmdFull, "full" },
+	{ CmdPwrDwn, "power down" },
+	{ CmdSpot, "spot" },
+	{ CmdClean, "clean" },
+	{ CmdDemo, "max clean" },
+	{ CmdDrive, "drive" },
+	{ CmdMotors, "motors" },
+	{ CmdLeds, "leds" },
+	{ CmdSong, "song" },
+	{ CmdPlay, "play" },
+	{ CmdSensors, "sensors" },
+	{ CmdDock, "seek dock" },
+	{ CmdPWMMotors, "pwm motors" },
+	{ CmdDriveWheels, "drive direct" },
+	{ 146, "drive pwm" },
+	{ CmdOutputs, "outputs" },
+	{ 148, "stream" },
+	{ CmdSensorList, "query list" },
+	{ 150, "pause stream" },
+	{ CmdIRChar, "ir char" },
+	{ 162, "scheduling leds" },
+	{ 163, "digit leds raw" },
+	{ 164, "digit leds ascii" },
+	{ 165, "buttons" },
+	{ 167, "schedule" },
+	{ 168, "set day and time" },
+	{ CmdStop, "stop" },
+};
+
+const char* trafficOpcodeName(int opcode) {
+
+	int i;
+
+	for (i = 0; i < (int) (sizeof(opcodes) / sizeof(opcodes[0])); i++) {
+		if (opcodes[i].opcode == opcode)
+			return opcodes[i].name;
+	}
+
+	return "unknown";
+
+}
+
+int trafficReplyLength(const unsigned char* command, int length) {
+
+	int i, size = 0;
+
+	if (command[0] == CmdSensors && length == 2)
+		return packetSize(command[1]);
+
+	if (command[0] != CmdSensorList)
+		return 0;
+
+	for (i = 2; i < length; i++)
+		size += packetSize(command[i]);
+	return size;
+
+}
+
+int trafficLoad(Traffic* t, const CaptureFile* f) {
+
+	uint64_t i, sentCount = 0, replyCount = 0;
+	uint64_t start = 0;     // first byte of the command being sent
+	int waiting = 0;        // oldest message that may still be owed a reply
+
+	memset(t, 0, sizeof(Traffic));
+	t->messages = (TrafficMessage*) malloc((f->count + 1) * sizeof(TrafficMessage));
+	t->sent = (unsigned char*) malloc(f->count + 1);
+	t->replies = (unsigned char*) malloc(f->count + 1);
+	if (t->messages == NULL || t->sent == NULL || t->replies == NULL) {
+		fprintf(stderr, "Traffic: ERROR: no memory for %llu records\n", (unsigned long long) f->count);
+		trafficFree(t);
+		return 0;
+	}
+
+	for (i = 0; i < f->count; i++) {
+		const CaptureRecord* r = &f->records[i];
+		t->ns = r->ns;
+
+		if (r->direction == CaptureRx) {
+			while (waiting < t->count && t->messages[waiting].replied >= t->messages[waiting].replyLength)
+				waiting++;
+			if (waiting == t->count) {
+				t->unasked++;
+				continue;
+			}
+
+			TrafficMessage* m = &t->messages[waiting];
+			if (m->replied == 0)
+				m->reply = replyCount;
+			t->replies[replyCount++] = r->data;
+			m->replied++;
+			m->replyNs = r->ns;
+			continue;
+		}
+
+		t->sent[sentCount++] = r->data;
+		int have = sentCount - start;
+		int need = robotCommandLength(&t->sent[start], have);
+		if (need == 0 || have < need)
+			continue;
+
+		TrafficMessage* m = &t->messages[t->count++];
+		memset(m, 0, sizeof(TrafficMessage));
+		m->ns = r->ns;
+		m->sent = start;
+		m->length = need;
+		m->reply = replyCount;
+		m->replyLength = trafficReplyLength(&t->sent[start], need);
+		start = sentCount;
+	}
+
+	t->partial = sentCount - start;
+	return 1;
+
+}
+
+void trafficFree(Traffic* t) {
+
+	free(t->messages);
+	free(t->sent);
+	free(t->replies);
+	memset(t, 0, sizeof(Traffic));
+
+}
+
+const unsigned char* trafficBytes(const Traffic* t, const TrafficMessage* m) {
+
+	return &t->sent[m->sent];
+
+}
+
+const unsigned char* trafficReply(const Traffic* t, const TrafficMessage* m) {
+
+	return &t->replies[m->reply];
+
+}
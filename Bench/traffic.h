@@ -0,0 +1,86 @@
+/*
+ * traffic.h
+ *
+ * A capture (../Project-5/capture.h) taken apart into Open Interface
+ * messages: every command sent to the robot, and for a Sensors (142) or
+ * Query List (149) the reply that answered it. Commands are cut with the
+ * simulator's robotCommandLength and replies sized with its packet table,
+ * so the two sides read the bytes alike.
+ *
+ * Replies are handed to queries in the order the queries were sent, as
+ * the robot answers them, so a query from one thread and the commands of
+ * another may interleave freely. Reply bytes that no query asked for,
+ * such as a stream, are only counted.
+ */
+
+#ifndef INCLUDE_TRAFFIC_H
+#define INCLUDE_TRAFFIC_H
+
+#include <stdint.h>
+
+#include "capture.h"
+
+typedef struct
+{
+	uint64_t ns;            // capture time of the last byte sent
+	uint64_t replyNs;       // of the last reply byte, 0 without one
+	uint32_t sent;          // first byte in Traffic.sent
+	uint32_t reply;         // first byte in Traffic.replies
+	uint16_t length;        // bytes sent
+	uint16_t replyLength;   // bytes the query asks for
+	uint16_t replied;       // of those in the capture, fewer if it was cut short
+}
+TrafficMessage;
+
+typedef struct
+{
+	TrafficMessage* messages;
+	int count;
+	unsigned char* sent;    // every byte sent, in order
+	unsigned char* replies; // every reply byte handed to a query
+	uint64_t ns;            // capture time of the last record
+	unsigned long unasked;  // reply bytes with no query waiting
+	unsigned long partial;  // bytes of a command cut short at the end
+}
+Traffic;
+
+/*
+ * Function: trafficLoad
+ *  Takes a loaded capture apart.
+ *
+ *  Returns 0 if the memory cannot be had.
+ */
+int trafficLoad(Traffic* t, const CaptureFile* f);
+
+/*
+ * Function: trafficFree
+ *  Frees the arrays of trafficLoad.
+ */
+void trafficFree(Traffic* t);
+
+/*
+ * Function: trafficReplyLength
+ *  Bytes the robot answers a complete command with: the packet sizes of
+ *  a Sensors (142) or Query List (149), 0 for any other command.
+ */
+int trafficReplyLength(const unsigned char* command, int length);
+
+/*
+ * Function: trafficOpcodeName
+ *  Name of an Open Interface command, "unknown" for an unknown opcode.
+ */
+const char* trafficOpcodeName(int opcode);
+
+/*
+ * Function: trafficBytes
+ *  The bytes message m sent.
+ */
+const unsigned char* trafficBytes(const Traffic* t, const TrafficMessage* m);
+
+/*
+ * Function: trafficReply
+ *  The reply to message m, replied bytes long.
+ */
+const unsigned char* trafficReply(const Traffic* t, const TrafficMessage* m);
+
+#endif
@@ -0,0 +1,780 @@
+/*
+ * transport.c
+ *
+ * Microbenchmark of the serial and OI command layers the projects share
+ * (Project-5's serial.c and clock.c, identical in Projects 2-5). Runs
+ * against two robots on a pseudo-terminal:
+ *
+ *  pty: a child process that answers every query at once, with no wire
+ *       pacing, so what is measured is the cost of the transport itself
+ *  sim: the simulator (../Simulator/createsim), at the 115200 baud rate
+ *
+ * and measures commands per second, bytes per read and write system
+ * call, the round trip of a Sensors (142) query for every packet and
+ * group, the projects' get_byte() wait and stream frame decoding, live
+ * and from memory. The results can be written to a CSV file and
+ * compared with an earlier one, so a transport change shows up as a
+ * change in these numbers.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+
+#include "oi.h"
+#include "serial.h"
+#include "clock.h"
+#include "packets.h"
+#include "robot.h"
+
+#define COMMANDS       2000  // Drive Direct commands timed
+#define SAMPLES        100   // round trips per packet
+#define GET_BYTE_SAMPLES 20  // round trips through get_byte()
+#define STREAM_FRAMES  20000 // frames the pty robot sends back to back
+#define STREAM_TIME    2.0   // s of the simulator's stream
+#define DECODE_FRAMES  200000 // frames decoded from memory
+#define REPLY_TIMEOUT  1.0   // s before a query counts as lost
+#define SETTLE_TIMEOUT 5.0   // s for the robot to work through a backlog
+#define BASELINE_MAX   1024  // rows read from a baseline
+#define BASELINE_NOISE 0.10  // change from the baseline worth showing
+
+// Packets in the stream, the ones Project-5 reads every tick
+static const unsigned char streamIds[] = { 7, 18, 29, 37, 43, 44 };
+
+typedef unsigned char byte;
+
+typedef struct
+{
+	const char* name;
+	Serial serial;
+	pid_t child;
+	int paced; // replies come at the wire rate
+}
+Target;
+
+// Read and write system calls of this process, from /proc/self/io
+typedef struct
+{
+	unsigned long rchar, wchar, syscr, syscw;
+}
+IoCounts;
+
+// Stream (148) frame decoder: header 19, length, packets, checksum
+typedef struct
+{
+	int state;
+	int length;
+	int have;
+	byte sum;
+	byte body[256];
+	unsigned long frames;
+	unsigned long bad; // checksum failures
+}
+StreamDecoder;
+
+enum { SeekHeader, ReadLength, ReadBody, ReadChecksum };
+
+typedef struct
+{
+	char mode[16];
+	char metric[32];
+	int packet;
+	double value;
+}
+Row;
+
+static FILE* csv = NULL;
+static Row baseline[BASELINE_MAX];
+static int baselineCount = 0;
+static Row results[BASELINE_MAX];
+static int resultCount = 0;
+
+static void usage() {
+
+	fprintf(stderr,
+		"usage: transport [--mode pty|sim|both] [--sim path] [--samples n]\n"
+		"                 [--csv file] [--baseline file]\n");
+
+}
+
+static void read_io(IoCounts* io) {
+
+	char name[32];
+	unsigned long value;
+
+	memset(io, 0, sizeof(IoCounts));
+
+	FILE* f = fopen("/proc/self/io", "r");
+	if (f == NULL)
+		return;
+
+	while (fscanf(f, "%31[^:]: %lu\n", name, &value) == 2) {
+		if (strcmp(name, "rchar") == 0)
+			io->rchar = value;
+		else if (strcmp(name, "wchar") == 0)
+			io->wchar = value;
+		else if (strcmp(name, "syscr") == 0)
+			io->syscr = value;
+		else if (strcmp(name, "syscw") == 0)
+			io->syscw = value;
+	}
+	fclose(f);
+
+}
+
+static const Row* find_baseline(const char* mode, const char* metric, int packet) {
+
+	int i;
+
+	for (i = 0; i < baselineCount; i++) {
+		if (strcmp(baseline[i].mode, mode) == 0 && strcmp(baseline[i].metric, metric) == 0
+			&& baseline[i].packet == packet)
+			return &baseline[i];
+	}
+	return NULL;
+
+}
+
+// Writes a result to the CSV and keeps it for the baseline comparison.
+// packet is -1 for results that are not about one packet.
+static void result(const Target* t, const char* metric, int packet, double value) {
+
+	if (csv != NULL) {
+		if (packet >= 0)
+			fprintf(csv, "%s,%s,%d,%.3f\n", t->name, metric, packet, value);
+		else
+			fprintf(csv, "%s,%s,,%.3f\n", t->name, metric, value);
+	}
+
+	if (resultCount < BASELINE_MAX) {
+		Row* r = &results[resultCount++];
+		snprintf(r->mode, sizeof(r->mode), "%s", t->name);
+		snprintf(r->metric, sizeof(r->metric), "%s", metric);
+		r->packet = packet;
+		r->value = value;
+	}
+
+}
+
+// Prints the results that moved more than BASELINE_NOISE
+static void compare() {
+
+	int compared = 0;
+	int moved = 0;
+	int i;
+
+	for (i = 0; i < resultCount; i++) {
+		const Row* r = &results[i];
+		const Row* old = find_baseline(r->mode, r->metric, r->packet);
+		if (old == NULL)
+			continue;
+		compared++;
+
+		double change = old->value != 0 ? (r->value - old->value) / old->value : r->value != 0;
+		if (change < BASELINE_NOISE && change > -BASELINE_NOISE)
+			continue;
+		if (moved++ == 0)
+			printf("Changed from the baseline:\n");
+
+		printf("  %-6s %-20s", r->mode, r->metric);
+		if (r->packet >= 0)
+			printf(" %3d", r->packet);
+		else
+			printf("    ");
+		printf(" %12.3f -> %12.3f (%+.0f%%)\n", old->value, r->value, change * 100);
+	}
+
+	printf("Baseline: %d results compared, %d moved more than %.0f%%\n", compared, moved, BASELINE_NOISE * 100);
+
+}
+
+static int load_baseline(const char* path) {
+
+	char line[256];
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Transport: ERROR: cannot read %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL && baselineCount < BASELINE_MAX) {
+		Row* r = &baseline[baselineCount];
+		char packet[16] = "";
+
+		if (sscanf(line, "%15[^,],%31[^,],%15[^,],%lf", r->mode, r->metric, packet, &r->value) == 4)
+			r->packet = atoi(packet);
+		else if (sscanf(line, "%15[^,],%31[^,],,%lf", r->mode, r->metric, &r->value) == 3)
+			r->packet = -1;
+		else
+			continue; // the header
+		baselineCount++;
+	}
+	fclose(f);
+	return 1;
+
+}
+
+static int compare_doubles(const void* a, const void* b) {
+
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return x < y ? -1 : x > y;
+
+}
+
+static double percentile(const double* sorted, int n, double p) {
+
+	int i = (int) (p * (n - 1) + 0.5);
+	return sorted[i];
+
+}
+
+// Feeds one byte to the decoder, returns 1 when it completes a frame
+static int decode(StreamDecoder* d, byte c) {
+
+	switch (d->state) {
+	case SeekHeader:
+		if (c == 19) {
+			d->sum = c;
+			d->state = ReadLength;
+		}
+		return 0;
+	case ReadLength:
+		d->length = c;
+		d->have = 0;
+		d->sum += c;
+		d->state = c > 0 ? ReadBody : ReadChecksum;
+		return 0;
+	case ReadBody:
+		d->body[d->have++] = c;
+		d->sum += c;
+		if (d->have == d->length)
+			d->state = ReadChecksum;
+		return 0;
+	}
+
+	// a bad frame may have started on a data byte that happened to be
+	// 19, look for the next header
+	d->state = SeekHeader;
+	if ((byte) (d->sum + c) != 0) {
+		d->bad++;
+		return 0;
+	}
+	d->frames++;
+	return 1;
+
+}
+
+// Lays out one stream frame of streamIds, returns its length
+static int make_frame(byte* frame, int seed) {
+
+	byte sum = 0;
+	int n = 2;
+	int i, j;
+
+	for (i = 0; i < (int) sizeof(streamIds); i++) {
+		frame[n++] = streamIds[i];
+		for (j = 0; j < packetSize(streamIds[i]); j++)
+			frame[n++] = (byte) (seed * 7 + i + j);
+	}
+
+	frame[0] = 19;
+	frame[1] = n - 2;
+	for (i = 0; i < n; i++)
+		sum += frame[i];
+	frame[n++] = -sum;
+	return n;
+
+}
+
+static void write_all(int fd, const byte* buf, int n) {
+
+	while (n > 0) {
+		int w = write(fd, buf, n);
+		if (w <= 0)
+			_exit(0); // the bench has gone
+		buf += w;
+		n -= w;
+	}
+
+}
+
+// The pty robot: answers queries with zeros of the right size as soon
+// as they are complete, and a Stream (148) with STREAM_FRAMES frames
+static void respond(int fd) {
+
+	byte command[ROBOT_COMMAND_MAX];
+	byte reply[ROBOT_OUT_MAX];
+	int have = 0;
+	byte c;
+	int i, n;
+
+	while (read(fd, &c, 1) == 1) {
+		command[have++] = c;
+		int need = robotCommandLength(command, have);
+		if (need == 0 || have < need)
+			continue;
+		have = 0;
+
+		switch (command[0]) {
+		case CmdSensors:
+			n = packetSize(command[1]);
+			memset(reply, 0, n);
+			write_all(fd, reply, n);
+			break;
+		case CmdSensorList:
+			for (i = 0, n = 0; i < command[1]; i++)
+				n += packetSize(command[2 + i]);
+			memset(reply, 0, n);
+			write_all(fd, reply, n);
+			break;
+		case 148:
+			for (i = 0, n = 0; i < STREAM_FRAMES; i++) {
+				n += make_frame(reply + n, i);
+				if (n > ROBOT_OUT_MAX - 64) {
+					write_all(fd, reply, n);
+					n = 0;
+				}
+			}
+			write_all(fd, reply, n);
+			break;
+		}
+	}
+	_exit(0);
+
+}
+
+static void make_raw(int fd) {
+
+	struct termios options;
+
+	tcgetattr(fd, &options);
+	cfmakeraw(&options);
+	tcsetattr(fd, TCSANOW, &options);
+
+}
+
+static int open_pty(Target* t) {
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		fprintf(stderr, "Transport: ERROR: cannot open a pseudo-terminal\n");
+		return 0;
+	}
+
+	char* slave = ptsname(master);
+	int hold = open(slave, O_RDWR | O_NOCTTY);
+	make_raw(hold);
+
+	t->child = fork();
+	if (t->child == 0) {
+		close(hold);
+		respond(master);
+	}
+	close(master);
+
+	serialOpen(&t->serial, slave, B115200, 0);
+	close(hold);
+	t->name = "pty";
+	t->paced = 0;
+	return 1;
+
+}
+
+static int open_sim(Target* t, const char* simPath) {
+
+	char slave[256];
+	int out[2];
+
+	if (pipe(out) != 0)
+		return 0;
+
+	t->child = fork();
+	if (t->child == 0) {
+		dup2(out[1], 1);
+		close(out[0]);
+		close(out[1]);
+		execl(simPath, simPath, "--quiet", (char*) NULL);
+		_exit(127);
+	}
+	close(out[1]);
+
+	// the simulator prints its port first thing
+	FILE* f = fdopen(out[0], "r");
+	if (fgets(slave, sizeof(slave), f) == NULL) {
+		fprintf(stderr, "Transport: ERROR: cannot start %s\n", simPath);
+		fclose(f);
+		waitpid(t->child, NULL, 0);
+		return 0;
+	}
+	fclose(f);
+	slave[strcspn(slave, "\n")] = 0;
+
+	serialOpen(&t->serial, slave, B115200, 0);
+	t->name = "sim";
+	t->paced = 1;
+
+	// Start and Safe, the simulated OI ignores queries until Start
+	serialSend(&t->serial, CmdStart);
+	serialSend(&t->serial, CmdSafe);
+	return 1;
+
+}
+
+static void close_target(Target* t) {
+
+	serialClose(&t->serial);
+	kill(t->child, SIGTERM);
+	waitpid(t->child, NULL, 0);
+
+}
+
+// Lets the robot catch up with what was sent, the simulator takes
+// commands in at the wire rate, and drops whatever it said
+static void settle(Target* t) {
+
+	byte c;
+
+	serialDrain(&t->serial);
+	serialSend(&t->serial, CmdSensors);
+	serialSend(&t->serial, 35);
+
+	double give_up = clockNow() + SETTLE_TIMEOUT;
+	while (serialNumBytesWaiting(&t->serial) == 0 && clockNow() < give_up)
+		clockSleep(0.001);
+	clockSleep(0.02);
+	while (serialGetChar(&t->serial, &c))
+		;
+
+}
+
+// Reads n reply bytes by polling as fast as possible. Returns 0 on a timeout.
+static int read_reply(Target* t, byte* buf, int n, unsigned long* polls) {
+
+	double give_up = clockNow() + REPLY_TIMEOUT;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		while (serialNumBytesWaiting(&t->serial) == 0) {
+			(*polls)++;
+			if (clockNow() > give_up)
+				return 0;
+		}
+		(*polls)++;
+		serialGetChar(&t->serial, &buf[i]);
+	}
+	return 1;
+
+}
+
+// The projects' get_byte(): serialAwait polls for the reply
+static byte get_byte(Target* t) {
+
+	byte c;
+
+	serialAwait(&t->serial, 1, 0);
+	serialGetChar(&t->serial, &c);
+	return c;
+
+}
+
+static void bench_commands(Target* t) {
+
+	IoCounts before, after;
+	int i;
+
+	settle(t);
+	read_io(&before);
+	double start = clockNow();
+
+	for (i = 0; i < COMMANDS; i++) {
+		serialLock(&t->serial);
+		serialSend(&t->serial, CmdDriveWheels);
+		serialSend(&t->serial, 0);
+		serialSend(&t->serial, 0);
+		serialSend(&t->serial, 0);
+		serialSend(&t->serial, 0);
+		serialUnlock(&t->serial);
+	}
+	serialDrain(&t->serial);
+
+	double elapsed = clockNow() - start;
+	read_io(&after);
+
+	double perSecond = COMMANDS / elapsed;
+	double perWrite = after.syscw > before.syscw
+		? (double) (after.wchar - before.wchar) / (after.syscw - before.syscw) : 0;
+	double sendUs = elapsed / (COMMANDS * 5) * 1e6;
+
+	printf("  commands: %.0f Drive Direct/s, %.2f us per serialSend, %.2f bytes per write\n",
+		perSecond, sendUs, perWrite);
+	result(t, "commands_per_s", -1, perSecond);
+	result(t, "send_us_per_byte", -1, sendUs);
+	result(t, "bytes_per_write", -1, perWrite);
+
+}
+
+static void bench_round_trips(Target* t, int samples) {
+
+	static const int groups[] = { 0, 1, 2, 3, 4, 5, 6, 100, 101, 106, 107 };
+	int ids[PKT_LAST - PKT_FIRST + 1 + sizeof(groups) / sizeof(groups[0])];
+	double* took = (double*) malloc(samples * sizeof(double));
+	byte reply[ROBOT_OUT_MAX];
+	unsigned long polls = 0;
+	unsigned long bytes = 0;
+	unsigned long lost = 0;
+	IoCounts before, after;
+	int count = 0;
+	int i, k;
+
+	for (i = PKT_FIRST; i <= PKT_LAST; i++) {
+		if (packetSize(i) > 0)
+			ids[count++] = i;
+	}
+	for (i = 0; i < (int) (sizeof(groups) / sizeof(groups[0])); i++)
+		ids[count++] = groups[i];
+
+	settle(t);
+	read_io(&before);
+
+	printf("  round trip of Sensors (142), us:\n");
+	for (k = 0; k < count; k++) {
+		int size = packetSize(ids[k]);
+		int got = 0;
+
+		for (i = 0; i < samples; i++) {
+			double start = clockNow();
+			serialLock(&t->serial);
+			serialSend(&t->serial, CmdSensors);
+			serialSend(&t->serial, ids[k]);
+			int ok = read_reply(t, reply, size, &polls);
+			serialUnlock(&t->serial);
+
+			if (!ok) {
+				lost++;
+				settle(t);
+				continue;
+			}
+			took[got++] = (clockNow() - start) * 1e6;
+			bytes += size;
+		}
+		if (got == 0)
+			continue;
+
+		qsort(took, got, sizeof(double), compare_doubles);
+		double p50 = percentile(took, got, 0.5);
+		double p99 = percentile(took, got, 0.99);
+		double max = took[got - 1];
+
+		printf("    packet %3d (%2d bytes): p50 %8.1f  p99 %8.1f  max %8.1f\n", ids[k], size, p50, p99, max);
+		result(t, "rtt_p50_us", ids[k], p50);
+		result(t, "rtt_p99_us", ids[k], p99);
+		result(t, "rtt_max_us", ids[k], max);
+	}
+
+	read_io(&after);
+	double perRead = after.syscr > before.syscr
+		? (double) (after.rchar - before.rchar) / (after.syscr - before.syscr) : 0;
+	double pollsPerByte = bytes > 0 ? (double) polls / bytes : 0;
+
+	printf("  replies: %.2f bytes per read, %.1f polls per byte, %lu queries lost\n",
+		perRead, pollsPerByte, lost);
+	result(t, "bytes_per_read", -1, perRead);
+	result(t, "polls_per_byte", -1, pollsPerByte);
+	result(t, "queries_lost", -1, lost);
+
+	free(took);
+
+}
+
+static void bench_get_byte(Target* t) {
+
+	double took[GET_BYTE_SAMPLES];
+	int i;
+
+	settle(t);
+
+	for (i = 0; i < GET_BYTE_SAMPLES; i++) {
+		double start = clockNow();
+		serialLock(&t->serial);
+		serialSend(&t->serial, CmdSensors);
+		serialSend(&t->serial, 7);
+		get_byte(t);
+		serialUnlock(&t->serial);
+		took[i] = (clockNow() - start) * 1e6;
+	}
+
+	qsort(took, GET_BYTE_SAMPLES, sizeof(double), compare_doubles);
+	double p50 = percentile(took, GET_BYTE_SAMPLES, 0.5);
+	double max = took[GET_BYTE_SAMPLES - 1];
+
+	printf("  get_byte(): packet 7 in p50 %.1f us, max %.1f us\n", p50, max);
+	result(t, "get_byte_p50_us", 7, p50);
+	result(t, "get_byte_max_us", 7, max);
+
+}
+
+static void bench_stream(Target* t) {
+
+	StreamDecoder d;
+	unsigned long bytes = 0;
+	byte c;
+	int i;
+
+	settle(t);
+	memset(&d, 0, sizeof(StreamDecoder));
+
+	serialLock(&t->serial);
+	serialSend(&t->serial, 148);
+	serialSend(&t->serial, sizeof(streamIds));
+	for (i = 0; i < (int) sizeof(streamIds); i++)
+		serialSend(&t->serial, streamIds[i]);
+	serialUnlock(&t->serial);
+
+	// the pty robot sends its frames and stops, the simulator streams
+	// one every 15 ms until it is paused
+	double start = clockNow();
+	double last = start;
+	double end = start + (t->paced ? STREAM_TIME : 10.0);
+	while (clockNow() < end && (t->paced || d.frames < STREAM_FRAMES)) {
+		if (!serialGetChar(&t->serial, &c))
+			continue;
+		bytes++;
+		if (decode(&d, c))
+			last = clockNow();
+	}
+
+	if (t->paced) {
+		serialSend(&t->serial, 150);
+		serialSend(&t->serial, 0);
+		last = end;
+	}
+	settle(t);
+
+	double elapsed = last - start;
+	double frames = elapsed > 0 ? d.frames / elapsed : 0;
+	double rate = elapsed > 0 ? bytes / elapsed / 1e3 : 0;
+
+	printf("  stream: %.0f frames/s, %.1f kB/s, %lu bad checksums\n", frames, rate, d.bad);
+	result(t, "stream_frames_per_s", -1, frames);
+	result(t, "stream_kb_per_s", -1, rate);
+	result(t, "stream_bad_frames", -1, d.bad);
+
+}
+
+// Decoding alone, from memory
+static void bench_decode() {
+
+	Target memory = { "memory" };
+
+	StreamDecoder d;
+	int size = 0;
+	int i;
+
+	byte* buf = (byte*) malloc((size_t) DECODE_FRAMES * 64);
+	for (i = 0; i < DECODE_FRAMES; i++)
+		size += make_frame(buf + size, i);
+
+	memset(&d, 0, sizeof(StreamDecoder));
+	double start = clockNow();
+	for (i = 0; i < size; i++)
+		decode(&d, buf[i]);
+	double elapsed = clockNow() - start;
+
+	double rate = size / elapsed / 1e6;
+	printf("Decode: %.1f MB/s, %.0f frames/s from memory\n", rate, d.frames / elapsed);
+	result(&memory, "decode_mb_per_s", -1, rate);
+
+	free(buf);
+
+}
+
+static void run(Target* t, int samples) {
+
+	printf("Transport %s:\n", t->name);
+	bench_commands(t);
+	bench_round_trips(t, samples);
+	bench_get_byte(t);
+	bench_stream(t);
+
+}
+
+int main(int argc, char* argv[]) {
+
+	const char* mode = "both";
+	const char* simPath = "../Simulator/createsim";
+	const char* csvPath = NULL;
+	const char* baselinePath = NULL;
+	int samples = SAMPLES;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+			mode = argv[++i];
+		else if (strcmp(argv[i], "--sim") == 0 && i + 1 < argc)
+			simPath = argv[++i];
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+			samples = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+			baselinePath = argv[++i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (samples < 1 || (strcmp(mode, "pty") != 0 && strcmp(mode, "sim") != 0 && strcmp(mode, "both") != 0)) {
+		usage();
+		return 2;
+	}
+
+	if (!clockInit())
+		return 1;
+	if (baselinePath != NULL && !load_baseline(baselinePath))
+		return 1;
+
+	if (csvPath != NULL) {
+		csv = fopen(csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Transport: ERROR: cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "mode,metric,packet,value\n");
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	Target t;
+	if (strcmp(mode, "sim") != 0) {
+		if (!open_pty(&t))
+			return 1;
+		run(&t, samples);
+		close_target(&t);
+	}
+	if (strcmp(mode, "pty") != 0) {
+		if (!open_sim(&t, simPath))
+			return 1;
+		run(&t, samples);
+		close_target(&t);
+	}
+
+	bench_decode();
+	if (baselinePath != NULL)
+		compare();
+
+	if (csv != NULL)
+		fclose(csv);
+
+	return 0;
+
+}
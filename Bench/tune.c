@@ -0,0 +1,541 @@
+/*
+ * tune.c
+ *
+ * Gain sweep for Project-4's wall follower. Every candidate, a set of
+ * gains, offset and speed, runs Project-4's behaviors on the batch
+ * simulator (../Simulator/batch.c) along a long wall (../Project-4/
+ * wall.c): drive to the wall under the speed governor, back off the
+ * bump, turn until the right light bumper sees it, then follow it with
+ * the PI controller of ../Project-4/follow.c, through the same governor
+ * and shaper as the robot. Each candidate runs against every wall model, a reflectivity
+ * scaling the light bumper signals, from several start poses and noise
+ * seeds. The runs are spread over a thread pool, a block of robots at a
+ * time.
+ *
+ * From SETTLE s after it starts following, each run measures the gap
+ * between bumper and wall, its RMS about the mean (the tracking error)
+ * and the speed along the path. A candidate is judged on its worst wall:
+ * the highest tracking error and the lowest speed. It fails if it bumps
+ * the wall or loses it on any run (LOST_GAP). The Pareto front of the
+ * candidates that pass, speed against tracking error, is what gets
+ * printed.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "oi.h"
+#include "arena.h"
+#include "robot.h"
+#include "batch.h"
+#include "shaper.h"
+#include "governor.h"
+#include "follow.h"
+#include "wall.h"
+
+// Project-4's mission
+#define CONTROL_PERIOD  0.1   // s per tick
+#define SURFACE         "tile"
+
+#define SEEDS           4     // runs per candidate and wall
+#define TRIAL_TIME      50.0  // s each run lasts
+#define SETTLE          10.0  // s of following before it counts
+#define LOST_GAP        250.0 // mm from the wall that is losing it, or
+                              // under a quarter of the speed
+#define START_JITTER    50.0  // mm
+#define HEADING_JITTER  5.0   // degrees
+#define SENSE_STEPS     3     // batch steps between sensor updates, 15 ms
+#define BLOCK           256   // robots a worker takes at a time
+#define GRID_MAX        16    // values per parameter
+#define WALL_MAX        8
+
+typedef struct
+{
+	double kp, ki, kd;
+	int offset;
+	short speed;
+}
+Candidate;
+
+typedef struct
+{
+	char name[16];
+	double reflectivity;
+}
+Wall;
+
+// What one run measured
+typedef struct
+{
+	double gapSum;         // mm, over the ticks measured
+	double gapSquares;
+	int samples;
+	double path;           // mm along the path while following
+	double time;           // s of it
+	int ticks;             // measured, following or not
+	int bumps;
+	int lost;              // went further than LOST_GAP, or stopped following
+}
+Run;
+
+// Project-4's state on one robot
+typedef struct
+{
+	WallMission mission;
+	Governor governor;
+	Shaper shaper;
+	double followFrom;     // s following first started, or -1
+	int sampled;           // measured at the last tick
+	double lastX, lastY;
+}
+Controller;
+
+typedef struct
+{
+	const Arena* arena;
+	const SurfaceProfile* surface;
+	const Candidate* candidates;
+	int candidateCount;
+	const Wall* walls;
+	int wallCount;
+	int seeds;
+	unsigned int seed;     // of the first seed
+	Run* runs;             // candidate, then wall, then seed
+	int total;
+	atomic_int next;       // first robot of the next block
+	atomic_ulong steps;
+}
+Sweep;
+
+// A candidate judged on its worst wall
+typedef struct
+{
+	int candidate;
+	double speed;          // mm/s, the slowest wall
+	double error;          // mm, the highest gap RMS
+	double gapLow;         // mm, mean gap, nearest and furthest wall
+	double gapHigh;
+	int failed;
+}
+Score;
+
+static void usage() {
+
+	fprintf(stderr,
+		"usage: tune [--kp list] [--ki list] [--kd list] [--offset list] [--speed list] [--wall name:reflectivity]...\n"
+		"            [--seeds n] [--threads n] [--seed n] [--arena file] [--csv file]\n");
+
+}
+
+static unsigned int next_random(unsigned int* seed) {
+
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+
+}
+
+static double jitter(unsigned int* seed, double amplitude) {
+
+	return amplitude * ((next_random(seed) % 2001) / 1000.0 - 1);
+
+}
+
+static int parse_list(const char* text, double* values) {
+
+	char* end;
+	int n = 0;
+
+	while (n < GRID_MAX) {
+		values[n++] = strtod(text, &end);
+		if (end == text)
+			return 0;
+		if (*end != ',')
+			return *end == '\0' ? n : 0;
+		text = end + 1;
+	}
+	return 0;
+
+}
+
+static int parse_wall(Wall* w, const char* text) {
+
+	return sscanf(text, "%15[^:]:%lf", w->name, &w->reflectivity) == 2 && w->reflectivity > 0;
+
+}
+
+static void controller_init(Controller* c, const Sweep* s, const Candidate* k) {
+
+	wallInit(&c->mission);
+	followInit(&c->mission.follower, k->kp, k->ki, k->kd, k->offset, k->speed);
+	governorInit(&c->governor, WALL_CRUISE_SPEED, WALL_APPROACH_SPEED);
+	shaperInit(&c->shaper, s->surface);
+	c->followFrom = -1;
+	c->sampled = 0;
+
+}
+
+// Robots first to first + count of the sweep, on one batch
+static void run_block(Sweep* s, int first, int count) {
+
+	Batch b;
+	Controller* controllers = (Controller*) malloc(sizeof(Controller) * count);
+	int perTick = (int) lround(CONTROL_PERIOD / BATCH_STEP);
+	int i, k;
+
+	if (!batchInit(&b, s->arena, count) || controllers == NULL) {
+		fprintf(stderr, "Tune: ERROR: cannot allocate %d robots\n", count);
+		exit(1);
+	}
+
+	for (i = 0; i < count; i++) {
+		int robot = first + i;
+		int candidate = robot / (s->wallCount * s->seeds);
+		int wall = robot / s->seeds % s->wallCount;
+		unsigned int seed = s->seed + robot % s->seeds;
+		unsigned int pose = seed;
+
+		double x = s->arena->startX + jitter(&pose, START_JITTER);
+		double y = s->arena->startY + jitter(&pose, START_JITTER);
+		double heading = (s->arena->startHeading + jitter(&pose, HEADING_JITTER)) * M_PI / 180;
+		batchPlace(&b, i, x, y, heading);
+		b.seed[i] = seed;
+		b.reflectivity[i] = s->walls[wall].reflectivity;
+		controller_init(&controllers[i], s, &s->candidates[candidate]);
+		memset(&s->runs[robot], 0, sizeof(Run));
+	}
+
+	batchSense(&b);
+	while (b.now < TRIAL_TIME) {
+		for (i = 0; i < count; i++) {
+			Controller* c = &controllers[i];
+			Run* run = &s->runs[first + i];
+			WallSensors sensors;
+			DriveCommand command;
+			short left, right;
+
+			memset(&sensors, 0, sizeof(sensors));
+			sensors.bumpDrop = b.bump[i];
+			sensors.lightBumps = b.lightBumps[i];
+			for (k = 0; k < GOV_SENSORS; k++)
+				sensors.lightBumpSignals[k] = b.light[k][i];
+
+			// a tick of Project-4: sense(), the arbiter and drive()
+			governorUpdate(&c->governor, sensors.lightBumpSignals);
+			int bumped = (sensors.bumpDrop & BmpBoth) && c->mission.backoff == 0;
+			wallTick(&c->mission, &sensors, &command);
+			if (c->mission.phase == PhaseFollow && c->followFrom < 0)
+				c->followFrom = b.now;
+
+			governorApply(&c->governor, &command.left, &command.right);
+			shaperSetTarget(&c->shaper, command.left, command.right);
+			shaperStep(&c->shaper, CONTROL_PERIOD, &left, &right);
+			batchDriveWheels(&b, i, left, right);
+
+			// measured from SETTLE s after it first starts following,
+			// over the ticks it is still following
+			int following = c->mission.phase == PhaseFollow && c->followFrom >= 0 && b.now >= c->followFrom + SETTLE;
+			if (c->followFrom >= 0 && b.now >= c->followFrom + SETTLE) {
+				run->ticks++;
+				run->bumps += bumped;
+			}
+			if (following) {
+				double gap = b.clearance[i] - ROBOT_RADIUS;
+				if (c->sampled) {
+					run->path += hypot(b.x[i] - c->lastX, b.y[i] - c->lastY);
+					run->time += CONTROL_PERIOD;
+				}
+				run->gapSum += gap;
+				run->gapSquares += gap * gap;
+				run->samples++;
+				run->lost |= gap > LOST_GAP;
+				c->lastX = b.x[i];
+				c->lastY = b.y[i];
+			}
+			c->sampled = following;
+		}
+
+		for (k = 0; k < perTick; k++) {
+			batchStep(&b);
+			if ((k + 1) % SENSE_STEPS == 0)
+				batchSense(&b);
+		}
+	}
+
+	// never got to follow, spent half the time on anything else, or
+	// turned on the spot instead of going anywhere
+	for (i = 0; i < count; i++) {
+		Run* run = &s->runs[first + i];
+		const Candidate* k = &s->candidates[(first + i) / (s->wallCount * s->seeds)];
+		run->lost |= run->samples < 2 || run->samples < run->ticks / 2 || run->path < run->time * k->speed / 4;
+	}
+
+	atomic_fetch_add(&s->steps, b.steps);
+	batchFree(&b);
+	free(controllers);
+
+}
+
+static void* worker(void* arg) {
+
+	Sweep* s = (Sweep*) arg;
+	int first;
+
+	while ((first = atomic_fetch_add(&s->next, BLOCK)) < s->total)
+		run_block(s, first, s->total - first < BLOCK ? s->total - first : BLOCK);
+	return NULL;
+
+}
+
+// One candidate on one wall over the seeds
+static void wall_result(const Sweep* s, int candidate, int wall, double* speed, double* gap, double* rms, int* bumps, int* lost) {
+
+	const Run* runs = &s->runs[(candidate * s->wallCount + wall) * s->seeds];
+	double sum = 0, variance = 0, path = 0, time = 0;
+	int samples = 0;
+	int i;
+
+	*bumps = 0;
+	*lost = 0;
+	for (i = 0; i < s->seeds; i++) {
+		const Run* r = &runs[i];
+		*bumps += r->bumps;
+		*lost += r->lost;
+		if (r->samples < 2)
+			continue;
+		double mean = r->gapSum / r->samples;
+		sum += r->gapSum;
+		samples += r->samples;
+		variance += fmax(r->gapSquares / r->samples - mean * mean, 0);
+		path += r->path;
+		time += r->time;
+	}
+
+	*gap = samples > 0 ? sum / samples : NAN;
+	*rms = sqrt(variance / s->seeds);
+	*speed = time > 0 ? path / time : 0;
+
+}
+
+static void score(const Sweep* s, int candidate, Score* out, FILE* csv) {
+
+	const Candidate* k = &s->candidates[candidate];
+	int w;
+
+	out->candidate = candidate;
+	out->speed = HUGE_VAL;
+	out->error = 0;
+	out->gapLow = HUGE_VAL;
+	out->gapHigh = -HUGE_VAL;
+	out->failed = 0;
+
+	for (w = 0; w < s->wallCount; w++) {
+		double speed, gap, rms;
+		int bumps, lost;
+
+		wall_result(s, candidate, w, &speed, &gap, &rms, &bumps, &lost);
+		out->speed = fmin(out->speed, speed);
+		out->error = fmax(out->error, rms);
+		out->gapLow = fmin(out->gapLow, gap);
+		out->gapHigh = fmax(out->gapHigh, gap);
+		out->failed |= bumps > 0 || lost > 0;
+
+		if (csv != NULL)
+			fprintf(csv, "%g,%g,%g,%d,%d,%s,%g,%.1f,%.1f,%.2f,%d,%d\n", k->kp, k->ki, k->kd, k->offset, k->speed,
+				s->walls[w].name, s->walls[w].reflectivity, speed, gap, rms, bumps, lost);
+	}
+
+}
+
+static int compare_speed(const void* a, const void* b) {
+
+	const Score* x = (const Score*) a;
+	const Score* y = (const Score*) b;
+	if (x->speed != y->speed)
+		return x->speed < y->speed ? -1 : 1;
+	// the least error last, where the front is walked from
+	return x->error > y->error ? -1 : x->error < y->error;
+
+}
+
+static void print_score(const char* label, const Sweep* s, const Score* score) {
+
+	const Candidate* k = &s->candidates[score->candidate];
+
+	printf("  %-5s %6.3f %7.4f %5.2f %6d %6d  %6.1f %7.2f %6.0f-%-4.0f %s\n", label, k->kp, k->ki, k->kd, k->offset, k->speed,
+		score->speed, score->error, score->gapLow, score->gapHigh, score->failed ? "fails" : "");
+
+}
+
+int main(int argc, char* argv[]) {
+
+	double kp[GRID_MAX] = { 0.02, 0.05, 0.1, 0.2, 0.4 };
+	double ki[GRID_MAX] = { 0, 0.005, 0.01, 0.02 };
+	double kd[GRID_MAX] = { 0, 0.5, 1, 2 };
+	double offset[GRID_MAX] = { 50, 100, 200, 400 };
+	double speed[GRID_MAX] = { 100, 150, 200, 250, 300 };
+	int kpCount = 5, kiCount = 4, kdCount = 4, offsetCount = 4, speedCount = 5;
+	// the lab wall reads about 1490 touching it, half the simulator's
+	Wall walls[WALL_MAX] = { { "white", 0.5 }, { "grey", 0.25 }, { "dark", 0.12 } };
+	int wallCount = 0;
+	const char* arenaPath = "../Simulator/arenas/longwall.txt";
+	const char* csvPath = NULL;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	Arena arena;
+	Sweep sweep;
+	int a, b, c, d, e, i, n;
+
+	memset(&sweep, 0, sizeof(Sweep));
+	sweep.seeds = SEEDS;
+	sweep.seed = 1;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--kp") == 0 && i + 1 < argc)
+			n = kpCount = parse_list(argv[++i], kp);
+		else if (strcmp(argv[i], "--ki") == 0 && i + 1 < argc)
+			n = kiCount = parse_list(argv[++i], ki);
+		else if (strcmp(argv[i], "--kd") == 0 && i + 1 < argc)
+			n = kdCount = parse_list(argv[++i], kd);
+		else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc)
+			n = offsetCount = parse_list(argv[++i], offset);
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			n = speedCount = parse_list(argv[++i], speed);
+		else if (strcmp(argv[i], "--wall") == 0 && i + 1 < argc && wallCount < WALL_MAX)
+			n = parse_wall(&walls[wallCount++], argv[++i]);
+		else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+			n = (sweep.seeds = atoi(argv[++i])) > 0;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			n = (threads = atoi(argv[++i])) > 0;
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			sweep.seed = strtoul(argv[++i], NULL, 10);
+			n = 1;
+		}
+		else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+			arenaPath = argv[++i];
+			n = 1;
+		}
+		else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+			csvPath = argv[++i];
+			n = 1;
+		}
+		else
+			n = 0;
+
+		if (n == 0) {
+			usage();
+			return 2;
+		}
+	}
+	if (wallCount == 0)
+		wallCount = 3;
+
+	if (!arenaLoad(&arena, arenaPath))
+		return 1;
+	sweep.arena = &arena;
+	sweep.surface = shaperSurface(SURFACE);
+
+	// Project-4's own gains first, then the grid
+	int candidateCount = 1 + kpCount * kiCount * kdCount * offsetCount * speedCount;
+	Candidate* candidates = (Candidate*) malloc(sizeof(Candidate) * candidateCount);
+	candidates[0].kp = 0.1;
+	candidates[0].ki = 0.01;
+	candidates[0].kd = 0;
+	candidates[0].offset = 100;
+	candidates[0].speed = 100;
+	n = 1;
+	for (a = 0; a < kpCount; a++)
+		for (b = 0; b < kiCount; b++)
+			for (c = 0; c < kdCount; c++)
+				for (d = 0; d < offsetCount; d++)
+					for (e = 0; e < speedCount; e++) {
+						candidates[n].kp = kp[a];
+						candidates[n].ki = ki[b];
+						candidates[n].kd = kd[c];
+						candidates[n].offset = (int) offset[d];
+						candidates[n].speed = (short) speed[e];
+						n++;
+					}
+
+	sweep.candidates = candidates;
+	sweep.candidateCount = candidateCount;
+	sweep.walls = walls;
+	sweep.wallCount = wallCount;
+	sweep.total = candidateCount * wallCount * sweep.seeds;
+	sweep.runs = (Run*) malloc(sizeof(Run) * sweep.total);
+	atomic_init(&sweep.next, 0);
+	atomic_init(&sweep.steps, 0);
+
+	struct timespec begin, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	pthread_t* pool = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+	for (i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, worker, &sweep);
+	for (i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+	free(pool);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double took = end.tv_sec - begin.tv_sec + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	FILE* csv = NULL;
+	if (csvPath != NULL) {
+		csv = fopen(csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Tune: ERROR: cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "kp,ki,kd,offset,speed,wall,reflectivity,speed_mm_s,gap_mm,gap_rms_mm,bumps,lost\n");
+	}
+
+	Score* scores = (Score*) malloc(sizeof(Score) * candidateCount);
+	int passed = 0;
+	for (i = 0; i < candidateCount; i++) {
+		score(&sweep, i, &scores[i], csv);
+		passed += !scores[i].failed;
+	}
+	if (csv != NULL)
+		fclose(csv);
+
+	printf("Tune: %d candidates on %d walls, %d seeds, %d runs, %.1f M robot-steps in %.1f s, %d threads\n",
+		candidateCount, wallCount, sweep.seeds, sweep.total, atomic_load(&sweep.steps) / 1e6, took, threads);
+	printf("  walls:");
+	for (i = 0; i < wallCount; i++)
+		printf(" %s %.2f", walls[i].name, walls[i].reflectivity);
+	printf(", %d candidates never bumped nor lost the wall\n\n", passed);
+
+	printf("          kp      ki    kd offset  speed    mm/s  rms_mm  gap_mm\n");
+	print_score("now", &sweep, &scores[0]);
+
+	// the front: by speed, fastest first, each with less error than
+	// every faster one
+	Score* front = (Score*) malloc(sizeof(Score) * candidateCount);
+	n = 0;
+	for (i = 0; i < candidateCount; i++) {
+		if (!scores[i].failed)
+			front[n++] = scores[i];
+	}
+	qsort(front, n, sizeof(Score), compare_speed);
+
+	double best = HUGE_VAL;
+	for (i = n - 1; i >= 0; i--) {
+		if (front[i].error < best) {
+			best = front[i].error;
+			print_score("front", &sweep, &front[i]);
+		}
+	}
+
+	free(front);
+	free(scores);
+	free(sweep.runs);
+	free(candidates);
+	return 0;
+
+}
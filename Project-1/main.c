@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
 #include "oi.h"
@@ -11,7 +12,9 @@ unsigned char color = 255;
 void init(Serial* serial, byte state)
 {
     serialClose(serial);
-    serialOpen(serial, "/dev/ttyUSB0", B115200, true);
+    // CREATE_DEVICE points the program at another port, e.g. the simulator
+    char* device = getenv("CREATE_DEVICE");
+    serialOpen(serial, device != NULL ? device : "/dev/ttyUSB0", B115200, true);
     serialSend(serial, 128);    // Send Start
     serialSend(serial, state);    // Send state
 
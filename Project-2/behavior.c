@@ -0,0 +1,64 @@
+/*
+ * behavior.c
+ *
+ * Fixed-priority arbiter. See behavior.h.
+ */
+
+#include <stdio.h>
+
+#include "behavior.h"
+
+void arbiterInit(Arbiter* a) {
+
+	a->count = 0;
+	a->winner = -1;
+	a->switches = 0;
+
+}
+
+int arbiterAdd(Arbiter* a, const char* name, BehaviorFn propose) {
+
+	if (a->count >= BEHAVIOR_MAX) {
+		fprintf(stderr, "Behavior: ERROR: no room for %s\n", name);
+		return 0;
+	}
+
+	a->behaviors[a->count].name = name;
+	a->behaviors[a->count].propose = propose;
+	a->count++;
+
+	return 1;
+
+}
+
+int arbiterTick(Arbiter* a, DriveCommand* command) {
+
+	DriveCommand proposal;
+	int winner = -1;
+	int i;
+
+	command->left = 0;
+	command->right = 0;
+
+	for (i = 0; i < a->count; i++) {
+		if (a->behaviors[i].propose(&proposal) && winner < 0) {
+			winner = i;
+			*command = proposal;
+		}
+	}
+
+	if (winner != a->winner)
+		a->switches++;
+	a->winner = winner;
+
+	return winner;
+
+}
+
+const char* arbiterWinnerName(const Arbiter* a) {
+
+	if (a->winner < 0)
+		return "none";
+	return a->behaviors[a->winner].name;
+
+}
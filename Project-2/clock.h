@@ -0,0 +1,149 @@
+/*
+ * clock.h
+ *
+ * Time for the whole program. On the robot it is the monotonic clock.
+ * When CREATE_CLOCK names the clock file of a simulator started with
+ * --virtual, it is the simulator's time instead: the simulator only
+ * moves it on while every thread of the program is asleep or blocked,
+ * so a sleep ends as soon as the simulated robot has caught up with it
+ * and a mission runs as fast as the host can compute it.
+ *
+ * clockDrive makes the clock virtual without a simulator, for playing
+ * a capture back: time jumps to the next wakeup whenever every thread
+ * is asleep or blocked, so waits take no real time at all.
+ *
+ * While the clock is virtual every sleep, every wait on another thread
+ * and every thread start and exit has to go through here, or time
+ * stops (a thread spinning on its own) or runs ahead of a thread that
+ * is still working.
+ */
+
+#ifndef INCLUDE_CLOCK_H
+#define INCLUDE_CLOCK_H
+
+#include <stdatomic.h>
+
+#define CLOCK_THREADS  16
+#define CLOCK_FOREVER  1e9 // s, a sleep that only an interrupt ends
+
+// Sleeper states
+enum { SleeperFree, SleeperRunning, SleeperAsleep, SleeperWoken };
+
+// Layout of the clock file shared with the simulator
+typedef struct
+{
+	atomic_llong now;                  // virtual time, ns
+	atomic_int attached;               // 1 while a program is using the clock
+	atomic_int running;                // threads neither asleep nor blocked
+	atomic_int state[CLOCK_THREADS];   // Sleeper* of each thread
+	atomic_llong wake[CLOCK_THREADS];  // ns each sleeper wakes at
+	atomic_int pending[CLOCK_THREADS]; // interrupted before it slept
+	atomic_llong written;              // bytes the program has written to the port
+	atomic_llong read;                 // bytes the program has read from it
+}
+SharedClock;
+
+/*
+ * Function: clockInit
+ *  Picks the time source. Call first thing in main, before any thread
+ *  is started.
+ *
+ *  Returns 0 if CREATE_CLOCK is set but the clock file cannot be used.
+ */
+int clockInit();
+
+/*
+ * Function: clockDrive
+ *  Makes the clock virtual and moves it on from a thread of its own,
+ *  starting from the current time. Call before any thread but the
+ *  calling one is started, and not with CREATE_CLOCK set.
+ *
+ *  Returns 0 if the clock cannot be driven.
+ */
+int clockDrive();
+
+/*
+ * Function: clockVirtual
+ *  Returns true when time comes from the simulator.
+ */
+int clockVirtual();
+
+/*
+ * Function: clockNow
+ *  Current time in seconds.
+ */
+double clockNow();
+
+/*
+ * Function: clockSleepUntil
+ *  Sleeps until the clock reaches when, or clockInterrupt wakes this
+ *  thread.
+ *
+ *  Returns 0 if the sleep was interrupted.
+ */
+int clockSleepUntil(double when);
+
+/*
+ * Function: clockSleep
+ *  Sleeps for seconds.
+ */
+void clockSleep(double seconds);
+
+/*
+ * Function: clockSpinUntil
+ *  Busy waits until the clock reaches when, for the last fraction of a
+ *  millisecond before a deadline. Sleeps instead while virtual, where
+ *  spinning would stop the clock.
+ */
+void clockSpinUntil(double when);
+
+/*
+ * Function: clockSelf
+ *  Sleeper number of the calling thread, for clockInterrupt.
+ */
+int clockSelf();
+
+/*
+ * Function: clockInterrupt
+ *  Ends the current or the next sleep of another thread early.
+ */
+void clockInterrupt(int sleeper);
+
+/*
+ * Function: clockSpawn
+ *  Counts a thread about to be started. Call before pthread_create, so
+ *  the clock cannot move before the thread gets going.
+ */
+void clockSpawn();
+
+/*
+ * Function: clockExit
+ *  Last call of a thread started after clockSpawn. If pthread_create
+ *  failed, the caller makes it instead.
+ */
+void clockExit();
+
+/*
+ * Function: clockWrote
+ *  Counts bytes written to the robot's port. A pseudo-terminal passes
+ *  them on a moment after the write returns, and the simulator must not
+ *  move time on while some are still on their way.
+ */
+void clockWrote(int bytes);
+
+/*
+ * Function: clockRead
+ *  Counts bytes read from the robot's port, so the simulator can tell
+ *  its replies are through the pseudo-terminal before it moves time on.
+ */
+void clockRead(int bytes);
+
+/*
+ * Function: clockBlock, clockUnblock
+ *  Bracket a wait on another thread (a lock held across a sleep, a
+ *  join) so the clock can move while this thread waits.
+ */
+void clockBlock();
+void clockUnblock();
+
+#endif
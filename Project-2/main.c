@@ -1,16 +1,46 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "oi.h"
 #include "serial.h"
+#include "clock.h"
+#include "shaper.h"
+#include "behavior.h"
+#include "safety.h"
+#include "shadow.h"
 
 enum bool {false, true};
 typedef unsigned char byte;
 Serial* serial;
 
+#define CONTROL_PERIOD 100000 // us between drive commands
+#define SHADOW_REFRESH 1.0    // s before an unchanged command is resent
+
+Shaper shaper;
+double lastShaped; // time of the last shaped drive command
+
+Arbiter arbiter;
+Safety safety;
+Shadow shadow;
+int safetyStopsSeen; // supervisor stops the shadow knows about
+
+// Latest sensor readings, refreshed once per tick by sense()
+typedef struct
+{
+	byte bumpDrop;     // bumps and wheel drops
+	byte cliff;        // one bit per cliff sensor, left is the high bit
+	unsigned int wall; // wall signal 0-1023
+	byte button;
+}
+Sensors;
+
+Sensors sensors;
+
 void send_byte(byte b)
 {
 	serialSend(serial, b);
@@ -21,13 +51,49 @@ byte get_byte()
 	byte c;
 	
 	// if there is no waiting byte, wait
-	while ( serialNumBytesWaiting(serial) == 0 )
-		usleep(15000);
+	serialAwait(serial, 1, 0);
 
 	serialGetChar(serial, &c);
 	return c;
 };
 
+double now_seconds()
+{
+	return clockNow();
+};
+
+/*
+Sends a command that sets actuator state (drive, LEDs, motors, songs)
+unless the shadow says the robot already has it. A drive is filtered by
+the safety supervisor here, holding the port.
+*/
+void send_command(int slot, const byte* command, int length)
+{
+	byte safe[SHADOW_MAX];
+	int i;
+
+	serialCommandLock(serial);
+
+	if (length <= SHADOW_MAX) {
+		memcpy(safe, command, length);
+		safetyFilterCommand(&safety, safe, length);
+		command = safe;
+	}
+
+	// a safety stop changed the drive state behind our back
+	if (safety.stops != safetyStopsSeen) {
+		shadowInvalidate(&shadow, ShadowDrive);
+		safetyStopsSeen = safety.stops;
+	}
+
+	if (shadowCheck(&shadow, slot, command, length, now_seconds())) {
+		for (i = 0; i < length; i++)
+			send_byte( command[i] );
+	}
+
+	serialCommandUnlock(serial);
+};
+
 void start(byte state)
 {
 	// allocate memory for Serial struct
@@ -37,15 +103,26 @@ void start(byte state)
 	serialClose(serial);
 
 	// constant B115200 comes from termios.h
-	serialOpen(serial, "/dev/ttyUSB0", B115200, false);
+	// CREATE_DEVICE points the program at another port, e.g. the simulator,
+	// CREATE_REPLAY at a capture to play back instead of the robot
+	char* device = getenv("CREATE_DEVICE");
+	char* replay = getenv("CREATE_REPLAY");
+	if (replay != NULL)
+		serialOpenReplay(serial, replay, getenv("CREATE_REPLAY_FAST") != NULL);
+	else
+		serialOpen(serial, device != NULL ? device : "/dev/ttyUSB0", B115200, false);
+
+	// CREATE_CAPTURE records the session for replay
+	char* capture = getenv("CREATE_CAPTURE");
+	if (capture != NULL && !serialRecord(serial, capture))
+		exit(1);
+
 	send_byte( CmdStart );	// Send Start
 	send_byte( state );	// Send state
 
 	// turn off any motors
-	send_byte( CmdMotors );
-	send_byte( 0 );
-	send_byte( 0 );
-	send_byte( 0 );
+	byte motors[] = { CmdMotors, 0, 0, 0 };
+	send_command(ShadowMotors, motors, sizeof(motors));
 
 	// clear out any bites from previous runs
 	while( serialNumBytesWaiting(serial) > 0 )
@@ -53,53 +130,52 @@ void start(byte state)
 };
 
 /*
- * stops for 15ms
- */
-unsigned char get_bump()
+Reads every sensor the behaviors use with one Query List:
+bumps and wheel drops (7), cliffs (9-12), wall signal (27) and buttons (18).
+Halts until the reply has arrived.
+*/
+void sense()
 {
-	send_byte( CmdSensors );
-	send_byte( SenBumpDrop ); //bumps and wheel drops
+	serialLock(serial);
 
-	return get_byte() & BmpBoth; //discard wheel drops
-};
+	int i;
 
-int get_wall()
-{
-	send_byte( CmdSensors );
+	send_byte( CmdSensorList );
+	send_byte( 7 );
+	send_byte( SenBumpDrop );
+	send_byte( 9 );
+	send_byte( 10 );
+	send_byte( 11 );
+	send_byte( 12 );
 	send_byte( 27 );
+	send_byte( SenButton );
 
-	int value = get_byte();
-	value += value << 8;
-	value += get_byte();
+	sensors.bumpDrop = get_byte();
 
-	return value;
-};
+	sensors.cliff = 0;
+	for (i = 0; i < 4; i++)
+		sensors.cliff = (sensors.cliff << 1) | (get_byte() & 1);
 
-/*
- * stops for 15ms
- */
-unsigned char get_button()
-{
-	send_byte( CmdSensors );
-	send_byte( SenButton );
+	sensors.wall = get_byte() << 8;
+	sensors.wall |= get_byte();
+
+	sensors.button = get_byte();
 
-	return get_byte();
+	serialUnlock(serial);
 };
 
 void set_led(byte ledBits, byte pwrLedColor)
 {
-	send_byte( CmdLeds );
-	send_byte( ledBits );
-	send_byte( pwrLedColor );
-	send_byte( 255 ); // set intensity high
+	byte command[] = { CmdLeds, ledBits, pwrLedColor, 255 }; // set intensity high
+
+	send_command(ShadowLeds, command, sizeof(command));
 };
 
 /*
-Enables robot to drive directly non linearly 
-using the sign and value of both velocity values
-by moving the wheels at different velocities.
+Sends the Drive Direct command without shaping.
+The safety supervisor still gets the last word in send_command.
 */
-void drive(short leftWheelVelocity, short rightWheelVelocity)
+void drive_direct(short leftWheelVelocity, short rightWheelVelocity)
 {
 	byte left_low = leftWheelVelocity; // cast short to byte (discard high byte)
 	byte left_high = leftWheelVelocity >> 8; // bitwise shift high to low to save high byte
@@ -107,30 +183,36 @@ void drive(short leftWheelVelocity, short rightWheelVelocity)
 	byte right_low = rightWheelVelocity;
 	byte right_high = rightWheelVelocity >> 8;
 	
-	send_byte( CmdDriveWheels );
-	send_byte( right_high );
-	send_byte( right_low );
-	send_byte( left_high );
-	send_byte( left_low );
+	byte command[] = { CmdDriveWheels, right_high, right_low, left_high, left_low };
+	send_command(ShadowDrive, command, sizeof(command));
 };
 
 /*
-Enables robot to drive directly forward/backwards 
-based on the sign and value of the velocity value
-by moving the wheels at the same velocity.
-positve wheelVelocity moves robot forward
-negative wheelVelocity moves robot in reverse
+Steps the shaper from the time of the last shaped command
+and sends the wheel velocities it allows.
 */
-void linear_drive(short wheelVelocity)
+void shaped_drive()
 {
-	byte low = wheelVelocity; // cast short to byte (discard high byte)
-	byte high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
-	
-	send_byte( CmdDriveWheels );
-	send_byte( high );
-	send_byte( low );
-	send_byte( high );
-	send_byte( low );
+	short left, right;
+	double now = now_seconds();
+
+	shaperStep(&shaper, now - lastShaped, &left, &right);
+	lastShaped = now;
+
+	drive_direct(left, right);
+};
+
+/*
+Enables robot to drive directly non linearly 
+using the sign and value of both velocity values
+by moving the wheels at different velocities.
+The wheels are ramped toward the velocities under the surface limits,
+so call it at the control rate until the robot gets there.
+*/
+void drive(short leftWheelVelocity, short rightWheelVelocity)
+{
+	shaperSetTarget(&shaper, leftWheelVelocity, rightWheelVelocity);
+	shaped_drive();
 };
 
 /*
@@ -140,89 +222,154 @@ positve wheelVelocity moves robot forward
 negative wheelVelocity moves robot in reverse
 positve radius turns robot left
 negative radius turns robot right
+Converted to wheel velocities so it is shaped like drive().
 */
 void angular_drive(short wheelVelocity, short radius)
 {
-	byte wheel_low = wheelVelocity; // cast short to byte (discard high byte)
-	byte wheel_high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
-	
-	byte radius_low = radius;
-	byte radius_high = radius >> 8;
-	
-	send_byte( CmdDrive );
-	send_byte( wheel_high );
-	send_byte( wheel_low );
-	send_byte( radius_high );
-	send_byte( radius_low );
+	shaperSetArc(&shaper, wheelVelocity, radius);
+	shaped_drive();
+};
+
+/*
+Ramps the wheels down to a stop at the control rate.
+*/
+void drive_stop()
+{
+	drive(0, 0);
+	while (!shaperSettled(&shaper)) {
+		clockSleep(CONTROL_PERIOD / 1e6);
+		drive(0, 0);
+	}
+};
+
+/*
+Cliff avoidance: back straight away from a cliff,
+or hold still if a wheel has dropped.
+*/
+int cliff_avoid(DriveCommand* command)
+{
+	if (sensors.bumpDrop & WheelDropAll) {
+		command->left = 0;
+		command->right = 0;
+		return true;
+	}
+
+	if (sensors.cliff != 0) {
+		command->left = -200;
+		command->right = -200;
+		return true;
+	}
+
+	return false;
+};
+
+/*
+Bump reflex.
+If both sensors are pressed, drive straight backwards until they are deactivated.
+If one sensor is pressed, drive away from it with an ICC of 1.0m until it is deactivated.
+*/
+int bump_escape(DriveCommand* command)
+{
+	byte bmp = sensors.bumpDrop & BmpBoth; //discard wheel drops
+
+	/*
+	radius measured in mm
+	1.0m = 1000mm
+	*/
+	short wheelVelocity = -500; // max velocity in reverse
+	short turnRadius = 1000; // in mm
+
+	if (bmp == 0)
+		return false;
+
+	if (bmp == BmpBoth) {
+		command->left = wheelVelocity;
+		command->right = wheelVelocity;
+	} else if (bmp == BmpRight) {
+		shaperArcWheels(wheelVelocity, turnRadius, &command->left, &command->right); // back away curving to the left
+	} else {
+		shaperArcWheels(wheelVelocity, -turnRadius, &command->left, &command->right); // back away curving to the right
+	}
+
+	return true;
+};
+
+/*
+Lowest priority: nothing to react to, so stand still.
+*/
+int stand_still(DriveCommand* command)
+{
+	command->left = 0;
+	command->right = 0;
+	return true;
 };
 
 int main(int args, char** argv)
 {
-	int j; // for index
-	byte bmp = 0, btn = 0, pwrLed = 255, bmpLed = 0;
+	byte btn = 0, pwrLed = 255, bmpLed = 0;
+	int lastWinner = -1;
+	DriveCommand command;
+
+	// CREATE_CLOCK runs the mission on the simulator's time
+	if (!clockInit())
+		return 1;
+
+	// acceleration limits for the floor, e.g. ./create2 carpet
+	const SurfaceProfile* surface = shaperSurface(args > 1 ? argv[1] : "tile");
+	if (surface == NULL) {
+		fprintf(stderr, "Unknown surface %s, use tile, wood or carpet\n", argv[1]);
+		return 1;
+	}
+	shaperInit(&shaper, surface);
+	shadowInit(&shadow, SHADOW_REFRESH);
+	lastShaped = now_seconds();
+
+	// reflexes first, highest priority on top
+	arbiterInit(&arbiter);
+	arbiterAdd(&arbiter, "cliff", cliff_avoid);
+	arbiterAdd(&arbiter, "bump", bump_escape);
+	arbiterAdd(&arbiter, "idle", stand_still);
 	
 	start(CmdFull); //full mode
+
+	// Full mode has no cliff or wheel drop protection of its own
+	if (!safetyStart(&safety, serial))
+		return 1;
 	
 	// initialize pwrLed to red
 	set_led(bmpLed, pwrLed);
-	
-	int drive_enabled = true; //remove after testing
-
-	do
-	{
-		for ( j=0; j<10; ++j )
-		{
-
-			/*
-			Note: mapping_ratio may need to flipped (mapping_ratio = 1 - mapping_ratio)
-			to correct colors. Green(0) is away from wall & Red(255) is hitting the wall.
-			*/
-			int wall = get_wall();
-			float mapping_ratio = wall / 1023.0;
-			pwrLed = mapping_ratio * 255;
-			set_led(bmpLed, pwrLed);
-
-			bmp = get_bump(); // halts 15ms
-			if (bmp != 0 && drive_enabled) {
-				/*
-				radius measured in mm
-				1.0m = 1000mm???
-				*/
-				short wheelVelocity = -500; // max velocity in reverse
-				short turnRadius = 1000; // in mm
-				if (bmp == BmpBoth) {
-					//drive straight backwards until the sensors are deactivated
-					linear_drive(-500);
-				} else {
-					if (bmp == BmpRight) {
-						//drive backwards in a circle away from the activated bump with an ICC of 1.0m until the sensor is deactivated
-						angular_drive(wheelVelocity, turnRadius); // back away curving to the left
-					} else {
-						//drive backwards in a circle away from the activated bump with an ICC of 1.0m until the sensor is deactivated
-						angular_drive(wheelVelocity, (-1 * turnRadius)); // back away curving to the right
-					}
-				}
-			} else {
-				if (drive_enabled) {
-					linear_drive(0); //stop
-				}
-			}
-
-			//if button is pushed end program
-			btn = get_button(); // halts 15ms
-			if ( btn ) {
-				break;
-			}
-
-			usleep(100000);
-		}
-		
-		//if button is pushed end program
-		if ( btn ) {
-			break;
+
+	//if button is pushed end program
+	while (!btn) {
+
+		sense(); // halts until the reply is in
+
+		// every behavior bids, the arbiter picks one command for this tick
+		arbiterTick(&arbiter, &command);
+		drive(command.left, command.right);
+
+		if (arbiter.winner != lastWinner) {
+			printf("Behavior: %s\n", arbiterWinnerName(&arbiter));
+			lastWinner = arbiter.winner;
 		}
-		
-	} while (!btn); //if button is pushed end program
+
+		/*
+		Note: mapping_ratio may need to flipped (mapping_ratio = 1 - mapping_ratio)
+		to correct colors. Green(0) is away from wall & Red(255) is hitting the wall.
+		*/
+		float mapping_ratio = sensors.wall / 1023.0;
+		pwrLed = mapping_ratio * 255;
+		set_led(bmpLed, pwrLed);
+
+		btn = sensors.button;
+
+		clockSleep(CONTROL_PERIOD / 1e6);
+	}
+
+	drive_stop();
+	safetyStop(&safety);
+	printf("Commands: %ld bytes sent, %ld redundant bytes dropped\n",
+		shadow.sentBytes, shadow.suppressedBytes);
 
 	send_byte(CmdPwrDwn);
 	return 0;
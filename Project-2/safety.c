@@ -0,0 +1,192 @@
+/*
+ * safety.c
+ *
+ * Cliff and wheel drop supervisor. See safety.h.
+ */
+
+#include <stdio.h>
+
+#include "oi.h"
+#include "clock.h"
+#include "safety.h"
+
+/*
+Reads count bytes of a response, giving up after SAFETY_TIMEOUT.
+Returns true if all of them arrived.
+*/
+static int read_response(Serial* serial, unsigned char* buf, int count) {
+
+	int i;
+
+	if (!serialAwait(serial, count, SAFETY_TIMEOUT))
+		return 0;
+
+	for (i = 0; i < count; i++)
+		serialGetChar(serial, &buf[i]);
+
+	return 1;
+
+}
+
+static void send_stop(Serial* serial) {
+
+	serialSend(serial, CmdDriveWheels);
+	serialSend(serial, 0);
+	serialSend(serial, 0);
+	serialSend(serial, 0);
+	serialSend(serial, 0);
+	serialDrain(serial);
+
+}
+
+static void* supervise(void* arg) {
+
+	Safety* safety = (Safety*) arg;
+	unsigned char b[5];
+	double replied = 0; // the previous reply, the last look at the robot
+	int i;
+
+	while (safety->running) {
+
+		// a hazard may have come up any time since the last look, and the
+		// wait for the port is part of the time to stop
+		double since = replied > 0 ? replied : clockNow();
+
+		serialLock(safety->serial);
+
+		serialSend(safety->serial, CmdSensorList);
+		serialSend(safety->serial, 5);
+		serialSend(safety->serial, SenBumpDrop);
+		for (i = 9; i <= 12; i++)
+			serialSend(safety->serial, i);
+
+		if (read_response(safety->serial, b, 5)) {
+			int hazard = 0;
+			replied = clockNow();
+
+			if (b[0] & WheelDropAll)
+				hazard |= HazardWheelDrop;
+			for (i = 0; i < 4; i++) {
+				if (b[1 + i] & 1)
+					hazard |= HazardCliffL << i;
+			}
+
+			// stop on every new hazard, still holding the port. The hazard
+			// is published first: a drive waiting for the port is filtered
+			// once it gets it, so none can follow the stop out unchecked
+			int fresh = hazard & ~atomic_load(&safety->hazard);
+			atomic_store(&safety->hazard, hazard);
+
+			if (fresh) {
+				send_stop(safety->serial);
+				safety->lastLatency = (clockNow() - since) * 1000;
+				if (safety->lastLatency > safety->maxLatency)
+					safety->maxLatency = safety->lastLatency;
+				if (safety->lastLatency > SAFETY_BUDGET)
+					safety->overBudget++;
+				safety->stops++;
+				printf("Safety: %s%s, stopped in %.2f ms\n",
+					hazard & HazardWheelDrop ? "wheel drop " : "",
+					hazard & HazardCliffAny ? "cliff" : "",
+					safety->lastLatency);
+			}
+		} else {
+			fprintf(stderr, "Safety: ERROR: no response to poll\n");
+		}
+
+		serialUnlock(safety->serial);
+
+		clockSleep(SAFETY_PERIOD / 1e6);
+	}
+
+	clockExit();
+	return NULL;
+
+}
+
+int safetyStart(Safety* safety, Serial* serial) {
+
+	safety->serial = serial;
+	safety->running = 1;
+	atomic_init(&safety->hazard, 0);
+	safety->stops = 0;
+	safety->overBudget = 0;
+	safety->lastLatency = 0;
+	safety->maxLatency = 0;
+
+	clockSpawn();
+	if (pthread_create(&safety->thread, NULL, supervise, safety) != 0) {
+		fprintf(stderr, "Safety: ERROR: could not start supervisor\n");
+		safety->running = 0;
+		clockExit();
+		return 0;
+	}
+
+	return 1;
+
+}
+
+void safetyStop(Safety* safety) {
+
+	if (!safety->running)
+		return;
+
+	safety->running = 0;
+	clockBlock();
+	pthread_join(safety->thread, NULL);
+	clockUnblock();
+
+	printf("Safety: %d stops, worst %.2f ms, %d over the %.0f ms budget\n",
+		safety->stops, safety->maxLatency, safety->overBudget, SAFETY_BUDGET);
+
+}
+
+void safetyFilter(const Safety* safety, short* left, short* right) {
+
+	int hazard = atomic_load(&safety->hazard);
+
+	if (hazard & HazardWheelDrop) {
+		*left = 0;
+		*right = 0;
+	} else if (hazard & HazardCliffAny) {
+		// cliff sensors are at the front, backing away is safe
+		if (*left > 0)
+			*left = 0;
+		if (*right > 0)
+			*right = 0;
+	}
+
+}
+
+void safetyFilterVelocity(const Safety* safety, short* velocity) {
+
+	int hazard = atomic_load(&safety->hazard);
+
+	if ((hazard & HazardWheelDrop) || ((hazard & HazardCliffAny) && *velocity > 0))
+		*velocity = 0;
+
+}
+
+void safetyFilterCommand(const Safety* safety, unsigned char* command, int length) {
+
+	if (length != 5)
+		return;
+
+	if (command[0] == CmdDriveWheels) {
+		short right = (command[1] << 8) | command[2];
+		short left = (command[3] << 8) | command[4];
+
+		safetyFilter(safety, &left, &right);
+		command[1] = right >> 8;
+		command[2] = right;
+		command[3] = left >> 8;
+		command[4] = left;
+	} else if (command[0] == CmdDrive) {
+		short velocity = (command[1] << 8) | command[2];
+
+		safetyFilterVelocity(safety, &velocity);
+		command[1] = velocity >> 8;
+		command[2] = velocity;
+	}
+
+}
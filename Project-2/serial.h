@@ -15,11 +15,27 @@
 
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "capture.h"
+#include "replay.h"
+
+#define SERIAL_POLL 0.0005 // s between looks for a reply in serialAwait
 
 typedef struct
 {
 	int fd; // file descriptor from ioctl
 	int verbose; // should bytes sent be printed to stdout
+	pthread_mutex_t lock; // held for a whole query/response
+	int depth; // times the holder has taken lock
+	atomic_int waiters; // threads blocked on lock
+	atomic_uint taken; // times lock has been taken
+	pthread_mutex_t write; // held while bytes of a command or query go out
+	atomic_int writeWaiters; // threads blocked on write
+	atomic_uint writeTaken; // times write has been taken
+	Capture* capture; // every byte sent and read is recorded here, if set
+	Replay* replay; // plays the robot's part instead of fd, if set
 }
 Serial;
 
@@ -34,6 +50,25 @@ Serial;
  */
 void serialOpen(Serial* s, char* device, int baudCode, int verbose);
 
+/*
+ * Function: serialOpenReplay
+ *  Opens a capture in place of a device, see replay.h. Exits if path
+ *  is not a capture, like serialOpen for a missing device.
+ *
+ *  fast: runs the program on a virtual clock of its own (clockDrive),
+ *  so the recorded delays and the program's sleeps take no real time
+ */
+void serialOpenReplay(Serial* s, char* path, int fast);
+
+/*
+ * Function: serialRecord
+ *  Records every byte sent and read from here on into a capture file,
+ *  see capture.h. The capture is closed when the program exits.
+ *
+ *  Returns 0 if the file cannot be created.
+ */
+int serialRecord(Serial* s, char* path);
+
 /*
  * Function serialClose
  *
@@ -54,6 +89,46 @@ void serialSetBaud(Serial* s, int baudCode);
  * Helper function sends c to dev at s.
  */
 int serialSend(Serial *s, unsigned char c);
+
+/*
+ * Function serialLock
+ *
+ * Takes s for a whole command or query and its response, so bytes
+ * from another thread cannot be interleaved. Nests in one thread.
+ */
+void serialLock(Serial *s);
+void serialUnlock(Serial *s);
+
+/*
+ * Function serialCommandLock
+ *
+ * Takes s for writing one command that expects no response. Another
+ * thread's query may be out, its holder waiting for the reply in
+ * serialAwait, so a timed command does not wait out the reply. Within
+ * serialLock it only nests; serialLock must not be taken under it.
+ */
+void serialCommandLock(Serial *s);
+void serialCommandUnlock(Serial *s);
+
+/*
+ * Function serialAwait
+ *
+ * Waits under serialLock until count reply bytes are waiting, letting
+ * commands of other threads out meanwhile (serialCommandLock).
+ *
+ * timeout: seconds to give up after, 0 to wait as long as it takes
+ *
+ * Returns false if it gave up.
+ */
+int serialAwait(Serial *s, int count, double timeout);
+
+/*
+ * Function serialDrain
+ *
+ * Waits until every byte written to s has been transmitted.
+ */
+void serialDrain(Serial *s);
+
 int serialNumBytesWaiting(Serial *s);
 int serialGetChar(Serial *s, unsigned char *c);
 int serialGetSignal(Serial *s, int sig);
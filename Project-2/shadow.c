@@ -0,0 +1,49 @@
+/*
+ * shadow.c
+ *
+ * Redundant command suppression. See shadow.h.
+ */
+
+#include <string.h>
+
+#include "shadow.h"
+
+void shadowInit(Shadow* shadow, double refresh) {
+
+	memset(shadow, 0, sizeof(Shadow));
+	shadow->refresh = refresh;
+
+}
+
+int shadowCheck(Shadow* shadow, int slot, const unsigned char* command, int length, double now) {
+
+	if (slot < 0 || slot >= SHADOW_SLOTS || length > SHADOW_MAX) {
+		// not shadowed, always send
+		shadow->sentBytes += length;
+		return 1;
+	}
+
+	ShadowSlot* s = &shadow->slots[slot];
+
+	if (s->valid && s->length == length && memcmp(s->bytes, command, length) == 0
+		&& (shadow->refresh <= 0 || now - s->sentAt < shadow->refresh)) {
+		shadow->suppressedBytes += length;
+		return 0;
+	}
+
+	memcpy(s->bytes, command, length);
+	s->length = length;
+	s->sentAt = now;
+	s->valid = 1;
+	shadow->sentBytes += length;
+
+	return 1;
+
+}
+
+void shadowInvalidate(Shadow* shadow, int slot) {
+
+	if (slot >= 0 && slot < SHADOW_SLOTS)
+		shadow->slots[slot].valid = 0;
+
+}
@@ -0,0 +1,140 @@
+/*
+ * shaper.c
+ *
+ * Acceleration and jerk limited wheel velocities. See shaper.h.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "shaper.h"
+
+// Limits measured at the wheel. Carpet grips less and the wheels sink
+// in, so it gets the gentlest profile.
+static const SurfaceProfile surfaces[] = {
+	{ "tile",   1000, 8000 },
+	{ "wood",    800, 6000 },
+	{ "carpet",  500, 3000 },
+	{ NULL, 0, 0 }
+};
+
+const SurfaceProfile* shaperSurface(const char* name) {
+
+	int i;
+
+	for (i = 0; surfaces[i].name != NULL; i++) {
+		if (strcmp(surfaces[i].name, name) == 0)
+			return &surfaces[i];
+	}
+
+	return NULL;
+
+}
+
+static double clamp_wheel(double v) {
+
+	if (v > SHAPER_WHEEL_MAX)
+		return SHAPER_WHEEL_MAX;
+	if (v < -SHAPER_WHEEL_MAX)
+		return -SHAPER_WHEEL_MAX;
+	return v;
+
+}
+
+void shaperInit(Shaper* s, const SurfaceProfile* surface) {
+
+	memset(s, 0, sizeof(Shaper));
+	s->surface = surface;
+
+}
+
+void shaperSetTarget(Shaper* s, short left, short right) {
+
+	s->left.target = clamp_wheel(left);
+	s->right.target = clamp_wheel(right);
+
+}
+
+void shaperArcWheels(short velocity, short radius, short* left, short* right) {
+
+	double l = velocity;
+	double r = velocity;
+
+	if (radius == 1) {
+		// turn in place counter-clockwise
+		l = -velocity;
+	} else if (radius == -1) {
+		// turn in place clockwise
+		r = -velocity;
+	} else if (radius != 0 && radius != 32767 && radius != -32768) {
+		l = velocity * (radius - SHAPER_WHEEL_BASE / 2) / radius;
+		r = velocity * (radius + SHAPER_WHEEL_BASE / 2) / radius;
+	}
+
+	*left = (short) lround(clamp_wheel(l));
+	*right = (short) lround(clamp_wheel(r));
+
+}
+
+void shaperSetArc(Shaper* s, short velocity, short radius) {
+
+	short left, right;
+
+	shaperArcWheels(velocity, radius, &left, &right);
+	shaperSetTarget(s, left, right);
+
+}
+
+/*
+Moves one wheel toward its target. The acceleration is limited so it
+can still be ramped back to zero by the jerk limit before the target
+is reached, which keeps the velocity from overshooting.
+*/
+static void step_wheel(ShapedWheel* w, const SurfaceProfile* p, double dt) {
+
+	double error = w->target - w->velocity;
+	double want = sqrt(2 * p->maxJerk * fabs(error));
+	double change = p->maxJerk * dt;
+
+	if (want > p->maxAccel)
+		want = p->maxAccel;
+	if (error < 0)
+		want = -want;
+
+	if (want > w->accel + change)
+		w->accel += change;
+	else if (want < w->accel - change)
+		w->accel -= change;
+	else
+		w->accel = want;
+
+	w->velocity += w->accel * dt;
+
+	// crossed the target, stop there
+	if ((error >= 0 && w->velocity >= w->target) || (error <= 0 && w->velocity <= w->target)) {
+		w->velocity = w->target;
+		w->accel = 0;
+	}
+
+}
+
+void shaperStep(Shaper* s, double dt, short* left, short* right) {
+
+	if (dt > SHAPER_MAX_DT)
+		dt = SHAPER_MAX_DT;
+	if (dt < 0)
+		dt = 0;
+
+	step_wheel(&s->left, s->surface, dt);
+	step_wheel(&s->right, s->surface, dt);
+
+	*left = (short) lround(s->left.velocity);
+	*right = (short) lround(s->right.velocity);
+
+}
+
+int shaperSettled(const Shaper* s) {
+
+	return s->left.velocity == s->left.target && s->right.velocity == s->right.target;
+
+}
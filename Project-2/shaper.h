@@ -0,0 +1,88 @@
+/*
+ * shaper.h
+ *
+ * Drive command shaper. Sits between the mission and the Drive Direct
+ * command and moves each wheel toward its requested velocity under an
+ * acceleration and jerk limit, so step changes in the request do not
+ * make the wheels slip. Limits come from a per-surface profile.
+ */
+
+#ifndef INCLUDE_SHAPER_H
+#define INCLUDE_SHAPER_H
+
+#define SHAPER_WHEEL_BASE  235.0 // mm between the wheels
+#define SHAPER_WHEEL_MAX   500   // mm/s per wheel
+#define SHAPER_MAX_DT      0.1   // longest step in seconds, covers stalls in the loop
+
+typedef struct
+{
+	const char* name;
+	double maxAccel; // mm/s^2 per wheel
+	double maxJerk;  // mm/s^3 per wheel
+}
+SurfaceProfile;
+
+typedef struct
+{
+	double velocity; // last shaped velocity, mm/s
+	double accel;    // current acceleration, mm/s^2
+	double target;   // requested velocity, mm/s
+}
+ShapedWheel;
+
+typedef struct
+{
+	ShapedWheel left;
+	ShapedWheel right;
+	const SurfaceProfile* surface;
+}
+Shaper;
+
+/*
+ * Function: shaperSurface
+ *  Looks up a surface profile by name ("tile", "wood", "carpet").
+ *
+ *  Returns NULL if the name is unknown.
+ */
+const SurfaceProfile* shaperSurface(const char* name);
+
+/*
+ * Function: shaperInit
+ *  Starts the shaper at rest with the limits of surface.
+ */
+void shaperInit(Shaper* s, const SurfaceProfile* surface);
+
+/*
+ * Function: shaperSetTarget
+ *  Requests new wheel velocities in mm/s. Values are clamped to the
+ *  wheel limit.
+ */
+void shaperSetTarget(Shaper* s, short left, short right);
+
+/*
+ * Function: shaperArcWheels
+ *  Converts a Drive (137) style command, center velocity in mm/s and
+ *  turn radius in mm, to wheel velocities.
+ */
+void shaperArcWheels(short velocity, short radius, short* left, short* right);
+
+/*
+ * Function: shaperSetArc
+ *  Requests a Drive (137) style command, see shaperArcWheels.
+ */
+void shaperSetArc(Shaper* s, short velocity, short radius);
+
+/*
+ * Function: shaperStep
+ *  Advances the shaper by dt seconds and returns the wheel velocities
+ *  to send.
+ */
+void shaperStep(Shaper* s, double dt, short* left, short* right);
+
+/*
+ * Function: shaperSettled
+ *  Returns true once both wheels have reached their targets.
+ */
+int shaperSettled(const Shaper* s);
+
+#endif
@@ -3,14 +3,69 @@
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "oi.h"
 #include "serial.h"
+#include "clock.h"
+#include "motion.h"
+#include "slip.h"
+#include "wheel.h"
+#include "safety.h"
+#include "task.h"
+#include "realtime.h"
+#include "timed.h"
+#include "song.h"
 
 enum bool {false, true};
 typedef unsigned char byte;
 Serial* serial;
 
+#define SIDE_LENGTH     1000.0 // mm
+#define CONTROL_PERIOD  0.06   // seconds per tick of the event loop
+#define TELEMETRY_PERIOD 1.0   // seconds between progress lines
+
+typedef struct
+{
+	byte bump;       // bumper bits, wheel drops discarded
+	byte button;
+	byte songPlaying; // song playing (37)
+	double traveled; // mm along the plan
+	int wheels;      // slip monitor state
+}
+Sensors;
+
+Sensors sensors;
+EventLoop loop;
+MotionPlan plan;
+short planVelocity;        // last velocity commanded along the plan
+int held = false;          // the bump reflex has the robot stopped
+int stuck = false;         // the plan was abandoned
+int reportedWheels = WheelsOK;
+
+SlipMonitor slip;
+Safety safety;
+RealTime rt;
+TimedQueue timed;
+SongManager songs;
+
+// played when the square is completed
+const byte victoryNotes[] = {
+	91, 8, // note, note duration
+	90, 8,
+	99, 8,
+	69, 8,
+	80, 8,
+	88, 8,
+	92, 8,
+	96, 25
+};
+const Song victory = { "victory", victoryNotes, sizeof(victoryNotes) / 2 };
+
+WheelLoop wheelLoop;
+int wheelLoopEnabled = false; // on when a gains file is given
+double lastWheelCommand;      // time of the last wheel loop command
+
 void send_byte(byte b)
 {
 	serialSend(serial, b);
@@ -21,8 +76,7 @@ byte get_byte()
 	byte c;
 	
 	// if there is no waiting byte, wait
-	while ( serialNumBytesWaiting(serial) == 0 )
-		usleep(15000);
+	serialAwait(serial, 1, 0);
 
 	serialGetChar(serial, &c);
 	return c;
@@ -37,7 +91,20 @@ void start(byte state)
 	serialClose(serial);
 
 	// constant B115200 comes from termios.h
-	serialOpen(serial, "/dev/ttyUSB0", B115200, false);
+	// CREATE_DEVICE points the program at another port, e.g. the simulator,
+	// CREATE_REPLAY at a capture to play back instead of the robot
+	char* device = getenv("CREATE_DEVICE");
+	char* replay = getenv("CREATE_REPLAY");
+	if (replay != NULL)
+		serialOpenReplay(serial, replay, getenv("CREATE_REPLAY_FAST") != NULL);
+	else
+		serialOpen(serial, device != NULL ? device : "/dev/ttyUSB0", B115200, false);
+
+	// CREATE_CAPTURE records the session for replay
+	char* capture = getenv("CREATE_CAPTURE");
+	if (capture != NULL && !serialRecord(serial, capture))
+		exit(1);
+
 	send_byte( CmdStart );	// Send Start
 	send_byte( state );	// Send state
 
@@ -52,46 +119,103 @@ void start(byte state)
 		get_byte();
 };
 
+// two bytes, high byte first
+unsigned short get_word()
+{
+	unsigned short value = get_byte() << 8;
+	value |= get_byte();
+	return value;
+};
+
 /*
- * stops for 15ms
- */
-unsigned char get_bump()
+Sends a whole command in one go, for the timed queue's emitter.
+*/
+void emit_command(int tag, const byte* command, int length)
 {
-	send_byte( CmdSensors );
-	send_byte( SenBumpDrop ); //bumps and wheel drops
+	int i;
+
+	serialCommandLock(serial);
+
+	for (i = 0; i < length; i++)
+		send_byte( command[i] );
 
-	return get_byte() & BmpBoth; //discard wheel drops
+	serialCommandUnlock(serial);
+};
+
+double now_seconds()
+{
+	return clockNow();
 };
 
-int get_wall()
+/*
+The distance in millimeters traveled since it was last requested,
+signed 16-bit value, high byte first.
+*/
+int get_distance()
 {
+	serialLock(serial);
+
 	send_byte( CmdSensors );
-	send_byte( 27 );
+	send_byte( 19 );
+	short value = get_word();
 
-	int value = get_byte();
-	value += value << 8;
-	value += get_byte();
+	serialUnlock(serial);
 
 	return value;
 };
 
 /*
- * stops for 15ms
- */
-unsigned char get_button()
+Reads everything the tasks need with one Query List: bumps (7), button (18),
+distance (19), wheel overcurrents (14), requested wheel velocities (41, 42),
+encoder counts (43, 44) and song playing (37). Runs once at the top of every tick and feeds
+the slip monitor.
+*/
+void sense()
 {
-	send_byte( CmdSensors );
-	send_byte( SenButton );
+	serialLock(serial);
 
-	return get_byte();
+	send_byte( CmdSensorList );
+	send_byte( 9 );
+	send_byte( SenBumpDrop );
+	send_byte( SenButton );
+	send_byte( 19 );
+	send_byte( 14 );
+	send_byte( 41 );
+	send_byte( 42 );
+	send_byte( 43 );
+	send_byte( 44 );
+	send_byte( 37 );
+
+	byte bumpDrop = get_byte();
+	byte button = get_byte();
+	short distance = get_word();
+	byte overcurrent = get_byte();
+	short requestedRight = get_word();
+	short requestedLeft = get_word();
+	unsigned short countLeft = get_word();
+	unsigned short countRight = get_word();
+	byte songPlaying = get_byte();
+
+	serialUnlock(serial);
+
+	sensors.bump = bumpDrop & BmpBoth; //discard wheel drops
+	sensors.button = button;
+	sensors.songPlaying = songPlaying;
+	sensors.traveled += distance;
+	sensors.wheels = slipUpdate(&slip, now_seconds(), requestedLeft, requestedRight,
+		countLeft, countRight, overcurrent);
 };
 
 void set_led(byte ledBits, byte pwrLedColor)
 {
+	serialCommandLock(serial);
+
 	send_byte( CmdLeds );
 	send_byte( ledBits );
 	send_byte( pwrLedColor );
 	send_byte( 255 ); // set intensity high
+
+	serialCommandUnlock(serial);
 };
 
 /*
@@ -101,6 +225,11 @@ by moving the wheels at different velocities.
 */
 void drive(short leftWheelVelocity, short rightWheelVelocity)
 {
+	serialCommandLock(serial);
+
+	// under the port, so a safety stop cannot slip in after the check
+	safetyFilter(&safety, &leftWheelVelocity, &rightWheelVelocity);
+
 	byte left_low = leftWheelVelocity; // cast short to byte (discard high byte)
 	byte left_high = leftWheelVelocity >> 8; // bitwise shift high to low to save high byte
 	
@@ -112,25 +241,8 @@ void drive(short leftWheelVelocity, short rightWheelVelocity)
 	send_byte( right_low );
 	send_byte( left_high );
 	send_byte( left_low );
-};
 
-/*
-Enables robot to drive directly forward/backwards 
-based on the sign and value of the velocity value
-by moving the wheels at the same velocity.
-positve wheelVelocity moves robot forward
-negative wheelVelocity moves robot in reverse
-*/
-void linear_drive(short wheelVelocity)
-{
-	byte low = wheelVelocity; // cast short to byte (discard high byte)
-	byte high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
-	
-	send_byte( CmdDriveWheels );
-	send_byte( high );
-	send_byte( low );
-	send_byte( high );
-	send_byte( low );
+	serialCommandUnlock(serial);
 };
 
 /*
@@ -143,6 +255,11 @@ negative radius turns robot right
 */
 void angular_drive(short wheelVelocity, short radius)
 {
+	serialCommandLock(serial);
+
+	// under the port, so a safety stop cannot slip in after the check
+	safetyFilterVelocity(&safety, &wheelVelocity);
+
 	byte wheel_low = wheelVelocity; // cast short to byte (discard high byte)
 	byte wheel_high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
 	
@@ -154,120 +271,239 @@ void angular_drive(short wheelVelocity, short radius)
 	send_byte( wheel_low );
 	send_byte( radius_high );
 	send_byte( radius_low );
+
+	serialCommandUnlock(serial);
 };
 
-void playSong()
+/*
+Sends a drive command for the plan. With the wheel loop on, it is converted
+to wheel velocities and trimmed from the wheel speeds the slip monitor measured in sense();
+otherwise the robot's own velocity controller is trusted.
+*/
+void plan_drive(short velocity, short radius)
 {
-	// song opcode
-	send_byte( 140 );
+	double targetLeft, targetRight;
+	short left, right;
+	double now = now_seconds();
 
-	// set song track to 0
-	send_byte( 0 );
+	if (!wheelLoopEnabled) {
+		angular_drive(velocity, radius);
+		return;
+	}
 
-	//send length in notes
-	send_byte( 8 );
+	motionWheels(velocity, radius, &targetLeft, &targetRight);
+	wheelCommand(&wheelLoop, now - lastWheelCommand, targetLeft, targetRight,
+		slip.measured[0], slip.measured[1], &left, &right);
+	lastWheelCommand = now;
 
-	// compose song
-	send_byte( 91 ); // note
-	send_byte( 8 ); // note duration
+	drive(left, right);
+};
 
-	send_byte( 90 );
-	send_byte( 8 );
+/*
+One tick of driving along the plan, using the distance sensor to track progress.
+Nothing is sent while the bump reflex holds the robot; the plan resumes from the
+distance already traveled, so the delay does not effect the distance the Roomba
+must travel. Returns true once the plan is finished or abandoned.
+*/
+int follow_plan()
+{
+	short radius = RadStraight;
 
-	send_byte( 99 );
-	send_byte( 8 );
+	if (held)
+		return false;
 
-	send_byte( 69 );
-	send_byte( 8 );
+	if (sensors.wheels & RobotStuck) {
+		printf("Stuck at %.0f mm of %.0f mm, giving up\n", sensors.traveled, plan.length);
+		stuck = true;
+		return true;
+	}
 
-	send_byte( 80 );
-	send_byte( 8 );
+	// look ahead by the distance covered before the next command goes out
+	if (!motionCommand(&plan, sensors.traveled + planVelocity * CONTROL_PERIOD, &planVelocity, &radius))
+		return true;
 
-	send_byte( 88 );
-	send_byte( 8 );
+	plan_drive(planVelocity, radius);
+	return false;
+};
 
-	send_byte( 92 );
-	send_byte( 8 );
+/*
+Song manager output. A play that has to wait for its upload goes on
+the timed queue, everything else goes out straight away.
+*/
+void song_send(const byte* command, int length, double when)
+{
+	if (when <= now_seconds())
+		emit_command(0, command, length);
+	else
+		timedSchedule(&timed, when, 0, command, length);
+};
 
-	send_byte( 96 );
-	send_byte( 25 );
-	
-	usleep(100000);
-	
-	// play song opcode
-	send_byte( 141 );
+/*
+Tasks, run in this order on every tick of the loop.
+*/
 
-	// select song track to play
-	send_byte( 0 );
-	
-	usleep(5000000);
-}
+// if button is pushed end program
+int button_stop(Task* t)
+{
+	TASK_BEGIN(t);
 
+	TASK_AWAIT(t, sensors.button != 0);
+	printf("Button pressed, stopping\n");
+	loopStop(&loop);
 
+	TASK_END(t);
+};
 
-int main(int args, char** argv)
+// If bumped, stop and hold until the bump is no longer detected.
+int bump_reflex(Task* t)
 {
-	byte bmp = 0;
-	byte btn = 0;
-	
-	// all for tests
-	int turns = 4;
-	int drive_enabled = 1;
-	int turn_enabled = 1;
-	
-	start(CmdFull); //full mode
+	TASK_BEGIN(t);
 
-	for (int i = 0; i < turns && !btn; i++) {
-
-		// drive straight & stop when bumped
-		for (int j = 0; j < 100 && drive_enabled; j++) {
-
-			/*
-			if bumped 
-			stop and wait 1/10 of a second then check sensor again
-			repeat until no bump detected
-			*/
-			bmp = get_bump();
-			while (bmp != 0) {
-				angular_drive(0, 0);
-				usleep(100000);
-				bmp = get_bump();
-			}
-
-			/*
-			drive straight with a velocity of 100mm per second
-			for loop repeats for 10 iterations, each iteration lasts 1 second
-			100mm * 10 seconds = 10cm
-			*/
-			//angular_drive(100, 32768);
-			//angular_drive(100, 32767);
-			linear_drive(100);
-
-			//if button is pushed end program
-			btn = get_button(); // halts 15ms
-			if ( btn ) {
-				break;
-			}
-
-			// sleep for 1/10 seconds, needed to measure distance traveled
-			// therefore, for every (10 j) @ 1/10 seconds I've traveled 1 seconds
-			// need 10 seconds
-			usleep(100000);
-		}
-
-		// turn PI / 2 counter-clockwise
-		if (turn_enabled) {
-			angular_drive(185, 1);
-			usleep(1000000);
-			angular_drive(0,0);
-		}
+	for (;;) {
+		TASK_AWAIT(t, sensors.bump != 0);
+		held = true;
+		angular_drive(0, 0);
+		planVelocity = 0;
 
+		TASK_AWAIT(t, sensors.bump == 0);
+		held = false;
 	}
 
-	// square completed! play sound
-	playSong();
-		
+	TASK_END(t);
+};
+
+int song_update(Task* t)
+{
+	songUpdate(&songs, sensors.songPlaying, t->now);
+	return TaskWaiting;
+};
+
+int square_mission(Task* t)
+{
+	TASK_BEGIN(t);
+
+	TASK_AWAIT(t, follow_plan());
+	angular_drive(0, 0);
+
+	if (stuck)
+		TASK_EXIT(t);
+
+	// square completed! play sound until the song playing flag drops
+	songPlay(&songs, &victory, t->now);
+	TASK_AWAIT(t, !songBusy(&songs));
+
+	TASK_END(t);
+};
+
+int telemetry(Task* t)
+{
+	if (sensors.wheels != reportedWheels) {
+		printf("Wheels: %s%s%s%s at %.0f mm (left %.0f, right %.0f mm/s)\n",
+			sensors.wheels == WheelsOK ? "ok" : "",
+			sensors.wheels & WheelSlip ? "slip " : "",
+			sensors.wheels & WheelStall ? "stall " : "",
+			sensors.wheels & RobotStuck ? "stuck " : "",
+			sensors.traveled, slip.measured[0], slip.measured[1]);
+		reportedWheels = sensors.wheels;
+	}
+
+	TASK_BEGIN(t);
+
+	for (;;) {
+		TASK_SLEEP(t, TELEMETRY_PERIOD);
+		printf("%5.1f s: %.0f of %.0f mm at %d mm/s%s\n", t->now - loop.start,
+			sensors.traveled, plan.length, planVelocity, held ? ", held by bump" : "");
+	}
+
+	TASK_END(t);
+};
+
+int main(int args, char** argv)
+{
+	// square with side length = 1m, starting halfway along its first side
+	// facing +x, so all four corners are turned and it ends facing +x again
+	Waypoint square[] = {
+		{ 0, 0 },
+		{ SIDE_LENGTH / 2, 0 },
+		{ SIDE_LENGTH / 2, SIDE_LENGTH },
+		{ -SIDE_LENGTH / 2, SIDE_LENGTH },
+		{ -SIDE_LENGTH / 2, 0 },
+		{ 0, 0 }
+	};
+
+	MotionLimits limits;
+	limits.maxSpeed = 300;    // mm/s
+	limits.minSpeed = 20;     // mm/s
+	limits.maxAccel = 300;    // mm/s^2
+	limits.maxLatAccel = 250; // mm/s^2
+	limits.turnRadius = 150;  // mm
+
+	if (!motionPlan(&plan, square, sizeof(square) / sizeof(square[0]), &limits))
+		return 1;
+
+	printf("Square: %.0f mm in %d segments, about %.1f s\n", plan.length, plan.count, motionDuration(&plan));
+
+	// optional real-time scheduling and wheel velocity loop,
+	// e.g. ./create2 --realtime=2,3 wheel.gains
+	int i;
+	rtInit(&rt);
+	for (i = 1; i < args; i++) {
+		int option = rtParse(&rt, argv[i]);
+		if (option < 0)
+			return 1;
+		if (option)
+			continue;
+
+		WheelGains gains;
+		wheelDefaultGains(&gains);
+		if (!wheelLoadGains(&gains, argv[i]))
+			return 1;
+		wheelInit(&wheelLoop, &gains);
+		wheelLoopEnabled = true;
+	}
+
+	// CREATE_CLOCK runs the mission on the simulator's time
+	if (!clockInit())
+		return 1;
+
+	// before any thread starts, so their stacks are locked too
+	rtLockMemory(&rt);
+
+	start(CmdFull); //full mode
+
+	// Full mode has no cliff or wheel drop protection of its own
+	if (!safetyStart(&safety, serial))
+		return 1;
+	rtThread(&rt, safety.thread, "safety", RT_PRIORITY_SAFETY, rt.ioCpu);
+
+	if (!timedStart(&timed, emit_command))
+		return 1;
+	rtThread(&rt, timed.thread, "emitter", RT_PRIORITY_IO, rt.ioCpu);
+	songInit(&songs, song_send);
+
+	// clear distance accumulated before the plan starts
+	get_distance();
+	slipInit(&slip);
+	wheelReset(&wheelLoop);
+	lastWheelCommand = now_seconds();
+
+	loopInit(&loop, CONTROL_PERIOD, sense);
+	loopAdd(&loop, "button", button_stop);
+	loopAdd(&loop, "bump", bump_reflex);
+	loopAdd(&loop, "songs", song_update);
+	loopAdd(&loop, "square", square_mission);
+	loopAdd(&loop, "telemetry", telemetry);
+	rtCurrentThread(&rt, "control", RT_PRIORITY_CONTROL, rt.controlCpu);
+	loopRun(&loop, square_mission);
+
+	angular_drive(0, 0);
+	timedStop(&timed);
+	safetyStop(&safety);
+	printf("Loop: %ld ticks, %ld overran the %.0f ms period, worst wakeup %.2f ms late\n",
+		loop.ticks, loop.overruns, CONTROL_PERIOD * 1000, loop.maxLate * 1000);
+	rtReport(&rt);
+	songPrint(&songs);
 
 	send_byte(CmdPwrDwn);
-	return 0;
+	return stuck ? 1 : 0;
 }
@@ -0,0 +1,241 @@
+/*
+ * motion.c
+ *
+ * Waypoint list to velocity/radius schedule. See motion.h.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "oi.h"
+#include "motion.h"
+
+// Wrap an angle into (-pi, pi]
+static double wrap_angle(double a) {
+
+	while (a > M_PI)
+		a -= 2 * M_PI;
+	while (a <= -M_PI)
+		a += 2 * M_PI;
+	return a;
+
+}
+
+static double min2(double a, double b) {
+	return a < b ? a : b;
+}
+
+static int add_segment(MotionPlan* plan, double length, short radius, double maxSpeed) {
+
+	if (length < 0.5)
+		return 1; // nothing left of this segment
+
+	if (plan->count >= MOTION_MAX_SEGMENTS) {
+		fprintf(stderr, "Motion: ERROR: too many segments\n");
+		return 0;
+	}
+
+	MotionSegment* seg = &plan->segments[plan->count++];
+	seg->start = plan->length;
+	seg->length = length;
+	seg->radius = radius;
+	seg->maxSpeed = maxSpeed;
+	seg->entrySpeed = 0;
+	seg->exitSpeed = 0;
+	plan->length += length;
+
+	return 1;
+
+}
+
+int motionPlan(MotionPlan* plan, const Waypoint* points, int count, const MotionLimits* limits) {
+
+	double legLength[MOTION_MAX_SEGMENTS];
+	double heading[MOTION_MAX_SEGMENTS];
+	double tangent[MOTION_MAX_SEGMENTS]; // tangent length of the arc at each corner
+	int radius[MOTION_MAX_SEGMENTS];
+	double turn[MOTION_MAX_SEGMENTS];
+	int legs = count - 1;
+	int i;
+
+	plan->count = 0;
+	plan->length = 0;
+	plan->minSpeed = limits->minSpeed;
+	plan->maxAccel = limits->maxAccel;
+
+	if (legs < 1 || legs > MOTION_MAX_SEGMENTS) {
+		fprintf(stderr, "Motion: ERROR: bad waypoint count %d\n", count);
+		return 0;
+	}
+
+	for (i = 0; i < legs; i++) {
+		double dx = points[i + 1].x - points[i].x;
+		double dy = points[i + 1].y - points[i].y;
+		legLength[i] = sqrt(dx * dx + dy * dy);
+		heading[i] = atan2(dy, dx);
+	}
+
+	// Size the arc at each corner. Corner i joins leg i - 1 and leg i.
+	// Interior legs are shared by two corners, so each may only take half.
+	tangent[0] = 0;
+	turn[0] = 0;
+	radius[0] = 0;
+	for (i = 1; i < legs; i++) {
+		turn[i] = wrap_angle(heading[i] - heading[i - 1]);
+		tangent[i] = 0;
+		radius[i] = 0;
+
+		if (fabs(turn[i]) < 1e-6)
+			continue;
+
+		if (fabs(turn[i]) > M_PI * 179.0 / 180.0) {
+			fprintf(stderr, "Motion: ERROR: corner %d reverses direction\n", i);
+			return 0;
+		}
+
+		double half = tan(fabs(turn[i]) / 2);
+		double roomIn = (i - 1 == 0) ? legLength[i - 1] : legLength[i - 1] / 2;
+		double roomOut = (i == legs - 1) ? legLength[i] : legLength[i] / 2;
+		double r = min2(limits->turnRadius, min2(roomIn, roomOut) / half);
+
+		radius[i] = (int) r;
+		if (radius[i] < 1)
+			radius[i] = 1;
+		tangent[i] = radius[i] * half;
+	}
+
+	// Emit straight, arc, straight, ... with the speed cap of each piece
+	for (i = 0; i < legs; i++) {
+		double tangentOut = (i + 1 < legs) ? tangent[i + 1] : 0;
+
+		if (!add_segment(plan, legLength[i] - tangent[i] - tangentOut, RadStraight, limits->maxSpeed))
+			return 0;
+
+		if (i + 1 < legs && radius[i + 1] > 0) {
+			double r = radius[i + 1];
+			double cap = min2(limits->maxSpeed, sqrt(limits->maxLatAccel * r));
+
+			// outer wheel must stay within its limit
+			cap = min2(cap, MOTION_WHEEL_MAX * r / (r + MOTION_WHEEL_BASE / 2));
+
+			short signedRadius = turn[i + 1] > 0 ? radius[i + 1] : -radius[i + 1];
+			if (!add_segment(plan, r * fabs(turn[i + 1]), signedRadius, cap))
+				return 0;
+		}
+	}
+
+	if (plan->count == 0) {
+		fprintf(stderr, "Motion: ERROR: path has no length\n");
+		return 0;
+	}
+
+	// Junction speeds: start and end at rest, never faster than either
+	// neighbour allows, then limit by acceleration forwards and backwards.
+	double junction[MOTION_MAX_SEGMENTS + 1];
+	double a = limits->maxAccel;
+
+	junction[0] = 0;
+	junction[plan->count] = 0;
+	for (i = 1; i < plan->count; i++)
+		junction[i] = min2(plan->segments[i - 1].maxSpeed, plan->segments[i].maxSpeed);
+
+	for (i = 0; i < plan->count; i++) {
+		double reach = sqrt(junction[i] * junction[i] + 2 * a * plan->segments[i].length);
+		junction[i + 1] = min2(junction[i + 1], reach);
+	}
+
+	for (i = plan->count - 1; i >= 0; i--) {
+		double reach = sqrt(junction[i + 1] * junction[i + 1] + 2 * a * plan->segments[i].length);
+		junction[i] = min2(junction[i], reach);
+	}
+
+	for (i = 0; i < plan->count; i++) {
+		plan->segments[i].entrySpeed = junction[i];
+		plan->segments[i].exitSpeed = junction[i + 1];
+	}
+
+	return 1;
+
+}
+
+int motionCommand(const MotionPlan* plan, double traveled, short* velocity, short* radius) {
+
+	int i;
+
+	if (traveled >= plan->length) {
+		*velocity = 0;
+		*radius = RadStraight;
+		return 0;
+	}
+
+	if (traveled < 0)
+		traveled = 0;
+
+	// plans are short, a linear scan is plenty
+	for (i = 0; i < plan->count - 1; i++) {
+		if (traveled < plan->segments[i + 1].start)
+			break;
+	}
+
+	const MotionSegment* seg = &plan->segments[i];
+	double s = traveled - seg->start;
+	double a = plan->maxAccel;
+
+	double v = seg->maxSpeed;
+	v = min2(v, sqrt(seg->entrySpeed * seg->entrySpeed + 2 * a * s));
+	v = min2(v, sqrt(seg->exitSpeed * seg->exitSpeed + 2 * a * (seg->length - s)));
+	if (v < plan->minSpeed)
+		v = plan->minSpeed;
+
+	*velocity = (short) (v + 0.5);
+	*radius = seg->radius;
+	return 1;
+
+}
+
+void motionWheels(short velocity, short radius, double* left, double* right) {
+
+	*left = velocity;
+	*right = velocity;
+
+	if (radius == RadCCW) {
+		// turn in place counter-clockwise
+		*left = -velocity;
+	} else if (radius == RadCW) {
+		// turn in place clockwise
+		*right = -velocity;
+	} else if (radius != 0 && radius != 32767 && radius != (short) RadStraight) {
+		*left = velocity * (radius - MOTION_WHEEL_BASE / 2) / radius;
+		*right = velocity * (radius + MOTION_WHEEL_BASE / 2) / radius;
+	}
+
+}
+
+double motionDuration(const MotionPlan* plan) {
+
+	double total = 0;
+	double a = plan->maxAccel;
+	int i;
+
+	for (i = 0; i < plan->count; i++) {
+		const MotionSegment* seg = &plan->segments[i];
+		double e = seg->entrySpeed;
+		double x = seg->exitSpeed;
+
+		// peak speed of an accelerate / cruise / decelerate profile
+		double peak = sqrt((2 * a * seg->length + e * e + x * x) / 2);
+		if (peak > seg->maxSpeed)
+			peak = seg->maxSpeed;
+
+		double up = (peak * peak - e * e) / (2 * a);
+		double down = (peak * peak - x * x) / (2 * a);
+		double cruise = seg->length - up - down;
+
+		total += (peak - e) / a + (peak - x) / a;
+		if (cruise > 0)
+			total += cruise / peak;
+	}
+
+	return total;
+
+}
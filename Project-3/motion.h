@@ -0,0 +1,100 @@
+/*
+ * motion.h
+ *
+ * Motion primitives for the Create 2. A list of waypoints is turned
+ * into a schedule of straight segments joined by arcs of bounded
+ * radius, with a speed profile that respects the acceleration limits.
+ * The schedule is indexed by distance traveled along the path so the
+ * drive helpers can execute it with the distance sensor (packet 19).
+ */
+
+#ifndef INCLUDE_MOTION_H
+#define INCLUDE_MOTION_H
+
+#define MOTION_MAX_SEGMENTS  64
+
+// Create 2 geometry and actuator limits
+#define MOTION_WHEEL_BASE    235.0 // mm between the wheels
+#define MOTION_WHEEL_MAX     500.0 // mm/s per wheel
+
+typedef struct
+{
+	double x; // mm
+	double y; // mm
+}
+Waypoint;
+
+typedef struct
+{
+	double maxSpeed;    // cruise speed in mm/s
+	double minSpeed;    // speed used to get moving from rest, mm/s
+	double maxAccel;    // tangential acceleration in mm/s^2
+	double maxLatAccel; // centripetal acceleration in arcs, mm/s^2
+	double turnRadius;  // preferred corner radius in mm
+}
+MotionLimits;
+
+typedef struct
+{
+	double start;  // path distance where the segment begins, mm
+	double length; // mm
+	short radius;  // OI drive radius, RadStraight for straight segments
+	double entrySpeed;
+	double maxSpeed;
+	double exitSpeed;
+}
+MotionSegment;
+
+typedef struct
+{
+	MotionSegment segments[MOTION_MAX_SEGMENTS];
+	int count;
+	double length; // total path length, mm
+	double minSpeed;
+	double maxAccel;
+}
+MotionPlan;
+
+/*
+ * Function: motionPlan
+ *  Builds a schedule from a waypoint list. Corners are blended with
+ *  arcs of radius limits->turnRadius, shrunk when the neighbouring
+ *  segments are too short to hold the full arc.
+ *
+ *  plan: schedule to fill in
+ *  points: waypoints in mm, the robot starts at points[0]
+ *  count: number of waypoints
+ *  limits: speed and acceleration limits
+ *
+ *  Returns 1 on success, 0 if the path cannot be planned.
+ */
+int motionPlan(MotionPlan* plan, const Waypoint* points, int count, const MotionLimits* limits);
+
+/*
+ * Function: motionCommand
+ *  Looks up the drive command for a point on the path.
+ *
+ *  plan: schedule built by motionPlan
+ *  traveled: distance traveled along the path, mm
+ *  velocity: filled with the OI drive velocity, mm/s
+ *  radius: filled with the OI drive radius, mm
+ *
+ *  Returns 0 once the end of the path has been reached.
+ */
+int motionCommand(const MotionPlan* plan, double traveled, short* velocity, short* radius);
+
+/*
+ * Function: motionWheels
+ *  Converts an OI drive velocity and radius to wheel velocities.
+ *
+ *  left, right: filled with the wheel velocities, mm/s
+ */
+void motionWheels(short velocity, short radius, double* left, double* right);
+
+/*
+ * Function: motionDuration
+ *  Estimated time in seconds to execute the schedule.
+ */
+double motionDuration(const MotionPlan* plan);
+
+#endif
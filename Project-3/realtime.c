@@ -0,0 +1,178 @@
+/*
+ * realtime.c
+ *
+ * SCHED_FIFO, CPU pinning and locked memory. See realtime.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+void rtInit(RealTime* rt) {
+
+	memset(rt, 0, sizeof(RealTime));
+	rt->controlCpu = -1;
+	rt->ioCpu = -1;
+
+}
+
+int rtParse(RealTime* rt, const char* arg) {
+
+	const char* option = "--realtime";
+	size_t n = strlen(option);
+	char* end;
+
+	if (strncmp(arg, option, n) != 0 || (arg[n] != '\0' && arg[n] != '='))
+		return 0;
+
+	rt->enabled = 1;
+	if (arg[n] == '\0')
+		return 1;
+
+	rt->controlCpu = (int) strtol(arg + n + 1, &end, 10);
+	rt->ioCpu = rt->controlCpu;
+	if (*end == ',')
+		rt->ioCpu = (int) strtol(end + 1, &end, 10);
+
+	if (*end != '\0' || end == arg + n + 1 || rt->controlCpu < 0 || rt->ioCpu < 0) {
+		fprintf(stderr, "RealTime: ERROR: expected --realtime=CPU[,CPU], got %s\n", arg);
+		return -1;
+	}
+
+	return 1;
+
+}
+
+// Touch the stack below the caller so it is mapped before the loop runs
+static void prefault_stack() {
+
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+
+}
+
+/*
+Faults in and locks the top of another thread's stack, which it cannot
+touch from here without trampling the frames in use.
+*/
+static int lock_stack(pthread_t thread) {
+
+	pthread_attr_t attr;
+	void* base;
+	size_t size;
+
+	int err = pthread_getattr_np(thread, &attr);
+	if (err != 0)
+		return err;
+	err = pthread_attr_getstack(&attr, &base, &size);
+	pthread_attr_destroy(&attr);
+	if (err != 0)
+		return err;
+
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t top = (uintptr_t) base + size;
+	uintptr_t bottom = (top - (size < RT_STACK_PREFAULT ? size : RT_STACK_PREFAULT)) & ~(page - 1);
+
+	return mlock((void*) bottom, top - bottom) == 0 ? 0 : errno;
+
+}
+
+void rtLockMemory(RealTime* rt) {
+
+	if (!rt->enabled)
+		return;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+		rt->memoryLocked = 1;
+		printf("RealTime: memory locked\n");
+	} else {
+		rt->refused++;
+		printf("RealTime: memory not locked (%s)\n", strerror(errno));
+	}
+
+	prefault_stack();
+
+}
+
+void rtThread(RealTime* rt, pthread_t thread, const char* name, int priority, int cpu) {
+
+	struct sched_param param;
+	char pinning[32] = "not pinned";
+	int err;
+
+	if (!rt->enabled)
+		return;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	err = pthread_setschedparam(thread, SCHED_FIFO, &param);
+	if (err == 0)
+		rt->scheduled++;
+	else
+		rt->refused++;
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		int pinErr = pthread_setaffinity_np(thread, sizeof(set), &set);
+		if (pinErr == 0) {
+			rt->pinned++;
+			snprintf(pinning, sizeof(pinning), "on CPU %d", cpu);
+		} else {
+			rt->refused++;
+			snprintf(pinning, sizeof(pinning), "CPU %d refused", cpu);
+		}
+	}
+
+	// the calling thread pre-faults its own stack, see rtCurrentThread
+	char stack[64] = "stack pre-faulted";
+	if (!pthread_equal(thread, pthread_self())) {
+		int stackErr = lock_stack(thread);
+		if (stackErr == 0) {
+			snprintf(stack, sizeof(stack), "stack locked");
+		} else {
+			rt->refused++;
+			snprintf(stack, sizeof(stack), "stack not locked (%s)", strerror(stackErr));
+		}
+	}
+
+	if (err == 0)
+		printf("RealTime: %s thread SCHED_FIFO %d, %s, %s\n", name, priority, pinning, stack);
+	else
+		printf("RealTime: %s thread normal scheduling (%s), %s, %s\n", name, strerror(err), pinning, stack);
+
+}
+
+void rtCurrentThread(RealTime* rt, const char* name, int priority, int cpu) {
+
+	if (!rt->enabled)
+		return;
+
+	prefault_stack();
+	rtThread(rt, pthread_self(), name, priority, cpu);
+
+}
+
+void rtReport(const RealTime* rt) {
+
+	if (!rt->enabled)
+		return;
+
+	printf("RealTime: %d threads SCHED_FIFO, %d pinned, memory %slocked, %d steps refused\n",
+		rt->scheduled, rt->pinned, rt->memoryLocked ? "" : "not ", rt->refused);
+
+}
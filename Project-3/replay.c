@@ -0,0 +1,261 @@
+/*
+ * replay.c
+ *
+ * Capture playback in place of the robot. See replay.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "oi.h"
+#include "replay.h"
+#include "clock.h"
+
+// Whether what the program sent since its last reply ends like the
+// first end bytes sent before exchange e, or the other way round
+static int matches_at(const Replay* r, const ReplayExchange* e, uint64_t end) {
+
+	uint64_t n = end;
+	uint64_t i;
+
+	if (n > REPLAY_MATCH)
+		n = REPLAY_MATCH;
+	if (n > (uint64_t) r->sentSince)
+		n = r->sentSince;
+	if (n == 0)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		unsigned char captured = r->file.records[e->tx + end - 1 - i].data;
+		unsigned char sent = r->sent[(r->sentTotal - 1 - i) % REPLAY_MATCH];
+		if (captured != sent)
+			return 0;
+	}
+	return 1;
+
+}
+
+// Whether the first end bytes sent before exchange e finish a Sensors
+// or Query List, the only commands the robot answers
+static int ends_query(const Replay* r, const ReplayExchange* e, uint64_t end) {
+
+	const CaptureRecord* sent = &r->file.records[e->tx];
+	uint64_t n;
+
+	if (sent[end - 2].data == CmdSensors)
+		return 1;
+
+	for (n = 1; n + 2 <= end && n <= 255; n++) {
+		if (sent[end - n - 2].data == CmdSensorList && sent[end - n - 1].data == n)
+			return 1;
+	}
+	return 0;
+
+}
+
+// Whether exchange e answers what the program sent. On the robot another
+// thread's command may have gone out between the query and its reply, so
+// the captured bytes may go on past the end of a query.
+static int matches(const Replay* r, const ReplayExchange* e) {
+
+	uint64_t end;
+
+	if (matches_at(r, e, e->txCount))
+		return 1;
+	if (r->sentSince < 2)
+		return 0;
+
+	for (end = e->txCount; end-- > 2;) {
+		if (ends_query(r, e, end) && matches_at(r, e, end))
+			return 1;
+	}
+	return 0;
+
+}
+
+static uint64_t query_ns(const Replay* r, int k) {
+
+	const ReplayExchange* e = &r->exchanges[k];
+	return r->file.records[e->tx + e->txCount - 1].ns;
+
+}
+
+// Picks the exchange that answers what the program sent, if any
+static void match(Replay* r) {
+
+	int k;
+	int found = -1;
+
+	if (r->current >= 0 || r->sentSince == 0)
+		return;
+
+	for (k = r->first; k < r->count && k < r->first + REPLAY_WINDOW; k++) {
+		if (!r->exchanges[k].used && matches(r, &r->exchanges[k])) {
+			found = k;
+			break;
+		}
+	}
+
+	// asked more often than on the robot, which would have said the same
+	// again, unless the capture is over
+	if (found < 0 && r->first < r->count) {
+		for (k = r->latest; k >= 0 && k > r->latest - REPLAY_WINDOW; k--) {
+			if (r->exchanges[k].used && matches(r, &r->exchanges[k])) {
+				found = k;
+				r->repeated++;
+				break;
+			}
+		}
+	}
+
+	if (found < 0)
+		return;
+
+	r->exchanges[found].used = 1;
+	r->current = found;
+	r->served = 0;
+	r->anchorTime = r->sentTime;
+	r->anchorNs = query_ns(r, found);
+	r->sentSince = 0;
+	if (found > r->latest)
+		r->latest = found;
+
+	// asked less often, the rest of the run has moved on from these
+	while (r->first < r->count && (r->exchanges[r->first].used
+		|| query_ns(r, r->first) + REPLAY_STALE * 1e9 < query_ns(r, r->latest))) {
+		if (!r->exchanges[r->first].used)
+			r->skipped++;
+		r->first++;
+	}
+
+}
+
+// Replies of the current exchange the program may read now
+static int due(const Replay* r) {
+
+	const ReplayExchange* e;
+	int n = 0;
+
+	if (r->current < 0)
+		return 0;
+
+	e = &r->exchanges[r->current];
+	// a microsecond of slack: records are in whole nanoseconds, and on a
+	// virtual clock a poll lands on the very nanosecond a reply was read
+	double since = (clockNow() - r->anchorTime) * 1e9 + 1000;
+	while (r->served + n < e->rxCount
+		&& r->file.records[e->rx + r->served + n].ns - r->anchorNs <= since)
+		n++;
+	return n;
+
+}
+
+int replayOpen(Replay* r, const char* path) {
+
+	uint64_t i;
+
+	if (!captureLoad(&r->file, path))
+		return 0;
+
+	pthread_mutex_init(&r->lock, NULL);
+	r->count = 0;
+	r->first = 0;
+	r->current = -1;
+	r->latest = -1;
+	r->repeated = 0;
+	r->skipped = 0;
+	r->sentTotal = 0;
+	r->sentSince = 0;
+	r->replies = 0;
+	r->read = 0;
+	r->captured = 0;
+
+	// one exchange per run of replies, with what was sent before it
+	r->exchanges = (ReplayExchange*) calloc(r->file.count + 1, sizeof(ReplayExchange));
+	uint64_t tx = 0;
+	for (i = 0; i < r->file.count; i++) {
+		if (r->file.records[i].direction != CaptureRx) {
+			r->captured++;
+			continue;
+		}
+
+		if (i == 0 || r->file.records[i - 1].direction != CaptureRx) {
+			ReplayExchange* e = &r->exchanges[r->count++];
+			e->tx = tx;
+			e->txCount = i - tx;
+			e->rx = i;
+		}
+		r->exchanges[r->count - 1].rxCount++;
+		r->replies++;
+		tx = i + 1;
+	}
+
+	return 1;
+
+}
+
+void replaySend(Replay* r, unsigned char c) {
+
+	pthread_mutex_lock(&r->lock);
+
+	// the rest of the last reply still comes, as the robot answers a
+	// query whatever is sent after it
+	r->sent[r->sentTotal % REPLAY_MATCH] = c;
+	r->sentTotal++;
+	r->sentSince++;
+	r->sentTime = clockNow();
+
+	pthread_mutex_unlock(&r->lock);
+
+}
+
+int replayWaiting(Replay* r) {
+
+	pthread_mutex_lock(&r->lock);
+
+	match(r);
+
+	// nothing left to wait for, the run is over
+	if (r->current < 0 && r->first >= r->count) {
+		pthread_mutex_unlock(&r->lock);
+		printf("Replay: end of the capture\n");
+		exit(0);
+	}
+
+	int n = due(r);
+
+	pthread_mutex_unlock(&r->lock);
+
+	return n;
+
+}
+
+int replayGetChar(Replay* r, unsigned char* c) {
+
+	int got = 0;
+
+	pthread_mutex_lock(&r->lock);
+
+	match(r);
+	if (due(r) > 0) {
+		const ReplayExchange* e = &r->exchanges[r->current];
+		*c = r->file.records[e->rx + r->served].data;
+		r->read++;
+		got = 1;
+
+		if (++r->served == e->rxCount)
+			r->current = -1;
+	}
+
+	pthread_mutex_unlock(&r->lock);
+
+	return got;
+
+}
+
+void replayReport(Replay* r) {
+
+	printf("Replay: %lu replies handed out for %lu captured, %lu queries asked again, %lu never asked, %lu bytes sent of %lu captured\n",
+		r->read, r->replies, r->repeated, r->skipped, r->sentTotal, r->captured);
+
+}
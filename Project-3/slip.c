@@ -0,0 +1,86 @@
+/*
+ * slip.c
+ *
+ * Commanded versus measured wheel motion. See slip.h.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "slip.h"
+
+void slipInit(SlipMonitor* m) {
+
+	memset(m, 0, sizeof(SlipMonitor));
+
+}
+
+/*
+Checks one wheel and counts how many updates in a row it has been
+stalled or off its request. Returns the wheel's state bits.
+*/
+static int check_wheel(SlipMonitor* m, int wheel, short requested) {
+
+	double measured = m->measured[wheel];
+	double error = fabs(measured - requested);
+	double allowed = SLIP_TOLERANCE * abs(requested);
+	int state = WheelsOK;
+
+	if (allowed < SLIP_MIN_ERROR)
+		allowed = SLIP_MIN_ERROR;
+
+	if (abs(requested) >= SLIP_MIN_SPEED && fabs(measured) < SLIP_MIN_SPEED / 2)
+		m->stallCount[wheel]++;
+	else
+		m->stallCount[wheel] = 0;
+
+	if (error > allowed)
+		m->slipCount[wheel]++;
+	else
+		m->slipCount[wheel] = 0;
+
+	if (m->stallCount[wheel] >= SLIP_PERIODS)
+		state |= WheelStall;
+	else if (m->slipCount[wheel] >= SLIP_PERIODS)
+		state |= WheelSlip;
+
+	return state;
+
+}
+
+int slipUpdate(SlipMonitor* m, double time, short requestedLeft, short requestedRight,
+	unsigned short countLeft, unsigned short countRight, unsigned char overcurrent) {
+
+	double dt = time - m->lastTime;
+
+	if (!m->primed || dt <= 0) {
+		m->lastCount[0] = countLeft;
+		m->lastCount[1] = countRight;
+		m->lastTime = time;
+		m->primed = 1;
+		return m->state;
+	}
+
+	// counts wrap around, the signed difference is the motion
+	m->measured[0] = (short) (countLeft - m->lastCount[0]) * SLIP_MM_PER_COUNT / dt;
+	m->measured[1] = (short) (countRight - m->lastCount[1]) * SLIP_MM_PER_COUNT / dt;
+	m->lastCount[0] = countLeft;
+	m->lastCount[1] = countRight;
+	m->lastTime = time;
+
+	int left = check_wheel(m, 0, requestedLeft);
+	int right = check_wheel(m, 1, requestedRight);
+
+	if (overcurrent & (OverCLeftWheel | OverCRightWheel))
+		m->overCount++;
+	else
+		m->overCount = 0;
+
+	m->state = left | right;
+	if (((left & WheelStall) && (right & WheelStall)) || m->overCount >= SLIP_PERIODS)
+		m->state |= RobotStuck;
+
+	return m->state;
+
+}
@@ -0,0 +1,65 @@
+/*
+ * slip.h
+ *
+ * Wheel slip and stall monitor. Compares the wheel velocities the robot
+ * was asked for (packets 41 and 42) with the velocities measured from
+ * the wheel encoders (packets 43 and 44) and the wheel overcurrent bits
+ * (packet 14). A condition has to hold for a few sensor periods in a
+ * row before it is reported, so one noisy sample does not stop a mission.
+ */
+
+#ifndef INCLUDE_SLIP_H
+#define INCLUDE_SLIP_H
+
+// Monitor states, combined as bits
+#define WheelsOK        0x00
+#define WheelSlip       0x01 // a wheel is not tracking its requested velocity
+#define WheelStall      0x02 // a wheel is requested to move but is not turning
+#define RobotStuck      0x04 // both wheels stalled, or a wheel overcurrent
+
+// Wheel overcurrent bits in packet 14
+#define OverCLeftWheel  0x10
+#define OverCRightWheel 0x08
+
+// Create 2 encoders: 508.8 counts per revolution of a 72 mm wheel
+#define SLIP_MM_PER_COUNT (3.14159265 * 72.0 / 508.8)
+
+#define SLIP_PERIODS    3    // consecutive updates before a condition is reported
+#define SLIP_MIN_SPEED  20   // mm/s, requests below this are treated as stopped
+#define SLIP_TOLERANCE  0.35 // allowed tracking error as a share of the request
+#define SLIP_MIN_ERROR  40   // mm/s, tracking error always allowed
+
+typedef struct
+{
+	unsigned short lastCount[2]; // left, right encoder counts
+	double lastTime;             // seconds
+	int primed;                  // a first sample has been taken
+	int slipCount[2];
+	int stallCount[2];
+	int overCount;
+	double measured[2];          // wheel velocities from the encoders, mm/s
+	int state;                   // WheelSlip | WheelStall | RobotStuck
+}
+SlipMonitor;
+
+/*
+ * Function: slipInit
+ *  Clears the monitor. The next update only primes the encoder counts.
+ */
+void slipInit(SlipMonitor* m);
+
+/*
+ * Function: slipUpdate
+ *  Feeds one sensor update to the monitor.
+ *
+ *  time: when the sample was taken, seconds
+ *  requestedLeft, requestedRight: requested wheel velocities, mm/s
+ *  countLeft, countRight: raw encoder counts
+ *  overcurrent: packet 14
+ *
+ *  Returns the monitor state.
+ */
+int slipUpdate(SlipMonitor* m, double time, short requestedLeft, short requestedRight,
+	unsigned short countLeft, unsigned short countRight, unsigned char overcurrent);
+
+#endif
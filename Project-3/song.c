@@ -0,0 +1,255 @@
+/*
+ * song.c
+ *
+ * Song slot cache, streaming and playback tracking. See song.h.
+ */
+
+#include <stdio.h>
+
+#include "song.h"
+
+void songInit(SongManager* m, SongSend send) {
+
+	int i;
+
+	for (i = 0; i < SONG_SLOTS; i++) {
+		m->slots[i].song = NULL;
+		m->slots[i].chunk = 0;
+		m->slots[i].lastPlayed = 0;
+	}
+
+	m->send = send;
+	m->playing = NULL;
+	m->nextSlot = -1;
+	m->plays = 0;
+	m->uploads = 0;
+	m->cached = 0;
+	m->replays = 0;
+
+}
+
+static int chunk_notes(const Song* song, int chunk) {
+
+	int left = song->count - chunk * SONG_MAX_NOTES;
+	return left < SONG_MAX_NOTES ? left : SONG_MAX_NOTES;
+
+}
+
+// Seconds a chunk plays for, durations are in 1/64 s
+static double chunk_length(const Song* song, int chunk) {
+
+	const unsigned char* notes = song->notes + 2 * chunk * SONG_MAX_NOTES;
+	int n = chunk_notes(song, chunk);
+	int ticks = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		ticks += notes[2 * i + 1];
+
+	return ticks / 64.0;
+
+}
+
+/*
+Finds the slot holding a chunk, uploading it into an empty slot or the
+least recently played one if none does. The slot in avoid is never
+overwritten. Sets *uploaded when an upload went out.
+*/
+static int load_chunk(SongManager* m, const Song* song, int chunk, int avoid, double now, int* uploaded) {
+
+	unsigned char command[3 + 2 * SONG_MAX_NOTES];
+	int best = -1;
+	int i;
+
+	*uploaded = 0;
+
+	for (i = 0; i < SONG_SLOTS; i++) {
+		if (m->slots[i].song == song && m->slots[i].chunk == chunk)
+			return i;
+	}
+
+	for (i = 0; i < SONG_SLOTS; i++) {
+		if (i == avoid)
+			continue;
+		if (m->slots[i].song == NULL) {
+			best = i;
+			break;
+		}
+		if (best < 0 || m->slots[i].lastPlayed < m->slots[best].lastPlayed)
+			best = i;
+	}
+
+	int n = chunk_notes(song, chunk);
+	const unsigned char* notes = song->notes + 2 * chunk * SONG_MAX_NOTES;
+
+	command[0] = 140; // song opcode
+	command[1] = best;
+	command[2] = n;
+	for (i = 0; i < 2 * n; i++)
+		command[3 + i] = notes[i];
+
+	m->send(command, 3 + 2 * n, now);
+	m->slots[best].song = song;
+	m->slots[best].chunk = chunk;
+	m->uploads++;
+	*uploaded = 1;
+
+	return best;
+
+}
+
+static void send_play(SongManager* m, int slot, double when) {
+
+	unsigned char play[] = { 141, slot }; // play song opcode, song slot
+
+	m->send(play, sizeof(play), when);
+	m->plays++;
+	m->slots[slot].lastPlayed = m->plays;
+
+}
+
+/*
+Times the next chunk's play for the end of the current one. The robot
+ignores a play while a song is playing, so a few more copies follow in
+case the current chunk runs a little long; they are ignored once the
+next chunk has started, and stop well short of its end.
+*/
+static void time_next(SongManager* m) {
+
+	unsigned char play[] = { 141, m->nextSlot };
+	double length = chunk_length(m->playing, m->chunk + 1);
+	int i;
+
+	send_play(m, m->nextSlot, m->nextAt);
+	for (i = 1; i < SONG_CHUNK_PLAYS && i * SONG_CHUNK_RETRY < length / 2; i++)
+		m->send(play, sizeof(play), m->nextAt + i * SONG_CHUNK_RETRY);
+
+}
+
+// Uploads the chunk after the current one and times its play
+static void queue_next(SongManager* m, double now) {
+
+	int uploaded;
+
+	m->nextSlot = -1;
+	if (m->chunk + 1 >= m->chunks)
+		return;
+
+	m->nextSlot = load_chunk(m, m->playing, m->chunk + 1, m->slot, now, &uploaded);
+	if (!uploaded)
+		m->cached++;
+
+	m->nextAt = m->endAt + SONG_CHUNK_GAP;
+	if (uploaded && m->nextAt < now + SONG_SETTLE)
+		m->nextAt = now + SONG_SETTLE;
+
+	time_next(m);
+
+}
+
+static void start_chunk(SongManager* m, int slot, double playAt) {
+
+	m->slot = slot;
+	m->playAt = playAt;
+	m->endAt = playAt + chunk_length(m->playing, m->chunk);
+	m->started = 0;
+	m->retried = 0;
+
+}
+
+int songPlay(SongManager* m, const Song* song, double now) {
+
+	int uploaded;
+
+	if (songBusy(m))
+		return 0;
+
+	if (song->count < 1) {
+		fprintf(stderr, "Song: ERROR: %s has no notes\n", song->name);
+		return 0;
+	}
+
+	m->playing = song;
+	m->chunk = 0;
+	m->chunks = (song->count + SONG_MAX_NOTES - 1) / SONG_MAX_NOTES;
+
+	int slot = load_chunk(m, song, 0, -1, now, &uploaded);
+	if (!uploaded)
+		m->cached++;
+
+	double playAt = uploaded ? now + SONG_SETTLE : now;
+	send_play(m, slot, playAt);
+	start_chunk(m, slot, playAt);
+	queue_next(m, now);
+
+	return 1;
+
+}
+
+// Sends the current chunk's play again now and moves the rest of the song along
+static void replay(SongManager* m, double now) {
+
+	send_play(m, m->slot, now);
+	start_chunk(m, m->slot, now);
+	m->retried = 1;
+	m->replays++;
+
+	if (m->nextSlot >= 0) {
+		m->nextAt = m->endAt + SONG_CHUNK_GAP;
+		time_next(m);
+	}
+
+}
+
+void songUpdate(SongManager* m, int playing, double now) {
+
+	if (m->playing == NULL)
+		return;
+
+	// the next chunk's play is due, make it the current one
+	if (m->nextSlot >= 0 && now >= m->nextAt) {
+		m->chunk++;
+		start_chunk(m, m->nextSlot, m->nextAt);
+		queue_next(m, now);
+		return;
+	}
+
+	if (playing) {
+		m->started = 1;
+		return;
+	}
+
+	if (m->started) {
+		if (now < m->endAt - SONG_EARLY && !m->retried) {
+			// dropped long before this chunk could be done, so what played
+			// was the chunk before it, and this play arrived too soon
+			replay(m, now);
+		} else if (m->nextSlot < 0) {
+			m->playing = NULL; // the song is over
+		}
+		return;
+	}
+
+	if (now > m->playAt + SONG_START_TIMEOUT) {
+		if (m->retried) {
+			fprintf(stderr, "Song: ERROR: %s never started\n", m->playing->name);
+			m->playing = NULL;
+			return;
+		}
+		replay(m, now);
+	}
+
+}
+
+int songBusy(const SongManager* m) {
+
+	return m->playing != NULL;
+
+}
+
+void songPrint(const SongManager* m) {
+
+	printf("Songs: %ld plays, %ld uploads, %ld chunks served from the slots, %ld plays sent again\n",
+		m->plays, m->uploads, m->cached, m->replays);
+
+}
@@ -0,0 +1,111 @@
+/*
+ * song.h
+ *
+ * Song manager. Songs are uploaded once into the robot's four song
+ * slots and remembered there, so playing one again is the two byte
+ * Play (141) command. When every slot is taken the least recently
+ * played song is overwritten. The end of playback is found from the
+ * song playing packet (37) fed in every tick, so nothing here ever
+ * waits.
+ *
+ * A song longer than a slot is streamed: it is split into chunks of
+ * SONG_MAX_NOTES and the next chunk is uploaded into another slot
+ * while the current one plays. Its play is timed from the note
+ * lengths to go out as the current chunk ends, with a few spare copies
+ * in case it runs long. If the song playing flag shows the chunk still
+ * did not start, its play is sent again that tick.
+ */
+
+#ifndef INCLUDE_SONG_H
+#define INCLUDE_SONG_H
+
+#define SONG_SLOTS          4     // song slots on the Create 2
+#define SONG_MAX_NOTES      16    // per slot
+#define SONG_SETTLE         0.1   // s between an upload and its play
+#define SONG_START_TIMEOUT  0.15  // s to see playback start before playing again
+#define SONG_CHUNK_GAP      0.015 // s after a chunk's predicted end to play the next
+#define SONG_CHUNK_PLAYS    4     // copies of that play, in case the chunk runs long
+#define SONG_CHUNK_RETRY    0.03  // s between the copies
+#define SONG_EARLY          0.25  // s before a chunk's predicted end that a drop means it never played
+
+typedef struct
+{
+	const char* name;
+	const unsigned char* notes; // note number, duration in 1/64 s, pairs
+	int count;                  // notes, any number
+}
+Song;
+
+typedef struct
+{
+	const Song* song; // what the slot holds, NULL if unknown
+	int chunk;        // which SONG_MAX_NOTES notes of it
+	long lastPlayed;  // play counter when it was last played
+}
+SongSlot;
+
+/*
+ * Sends a command to the robot no earlier than when (seconds, same
+ * clock as the now passed in below).
+ */
+typedef void (*SongSend)(const unsigned char* command, int length, double when);
+
+typedef struct
+{
+	SongSlot slots[SONG_SLOTS];
+	SongSend send;
+
+	const Song* playing; // NULL when quiet
+	int chunk;           // chunk now playing
+	int chunks;
+	int slot;            // slot of the chunk now playing
+	double playAt;       // s, when its play goes out
+	double endAt;        // s, when it should finish
+	int started;         // song playing flag has been seen for it
+	int retried;         // its play has been sent again
+	int nextSlot;        // slot of the next chunk, -1 if none
+	double nextAt;       // s, when the next chunk's play goes out
+
+	long plays;
+	long uploads;
+	long cached;         // chunks played without an upload
+	long replays;        // chunk plays that had to be sent again
+}
+SongManager;
+
+/*
+ * Function: songInit
+ *  Starts with every slot unknown.
+ */
+void songInit(SongManager* m, SongSend send);
+
+/*
+ * Function: songPlay
+ *  Starts a song, uploading its first chunk if no slot holds it.
+ *
+ *  Returns 1 if the song was started, 0 if another song is still
+ *  playing or the song is empty.
+ */
+int songPlay(SongManager* m, const Song* song, double now);
+
+/*
+ * Function: songUpdate
+ *  Follows playback and keeps a streamed song fed, call every tick.
+ *
+ *  playing: the song playing packet (37)
+ */
+void songUpdate(SongManager* m, int playing, double now);
+
+/*
+ * Function: songBusy
+ *  Returns true while a song is queued or playing.
+ */
+int songBusy(const SongManager* m);
+
+/*
+ * Function: songPrint
+ *  Prints how many plays were served from the slots.
+ */
+void songPrint(const SongManager* m);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * task.c
+ *
+ * Fixed-rate event loop for stackless tasks. See task.h.
+ */
+
+#include <stdio.h>
+
+#include "clock.h"
+#include "task.h"
+
+double loopNow() {
+
+	return clockNow();
+
+}
+
+void loopInit(EventLoop* loop, double period, void (*sense)(void)) {
+
+	loop->count = 0;
+	loop->period = period;
+	loop->sense = sense;
+	loop->start = 0;
+	loop->ticks = 0;
+	loop->overruns = 0;
+	loop->maxLate = 0;
+	loop->running = 1;
+
+}
+
+int loopAdd(EventLoop* loop, const char* name, TaskFn run) {
+
+	if (loop->count >= TASK_MAX) {
+		fprintf(stderr, "Task: ERROR: no room for %s\n", name);
+		return 0;
+	}
+
+	LoopTask* task = &loop->tasks[loop->count++];
+	task->name = name;
+	task->run = run;
+	task->state.line = 0;
+	task->state.wakeAt = 0;
+	task->state.now = 0;
+	task->done = 0;
+
+	return 1;
+
+}
+
+int loopTick(EventLoop* loop, TaskFn until) {
+
+	double now = loopNow();
+	int i;
+
+	if (loop->ticks == 0)
+		loop->start = now;
+
+	if (loop->sense != NULL)
+		loop->sense();
+
+	for (i = 0; i < loop->count && loop->running; i++) {
+		LoopTask* task = &loop->tasks[i];
+		if (task->done)
+			continue;
+
+		task->state.now = now;
+		if (task->run(&task->state) == TaskDone) {
+			task->done = 1;
+			if (task->run == until)
+				loop->running = 0;
+		}
+	}
+
+	loop->ticks++;
+	return loop->running;
+
+}
+
+void loopRun(EventLoop* loop, TaskFn until) {
+
+	double next = loopNow();
+
+	while (loopTick(loop, until)) {
+
+		next += loop->period;
+		if (loopNow() > next) {
+			// fell behind, start the next tick now rather than bunching up
+			loop->overruns++;
+			next = loopNow();
+		} else {
+			// absolute deadline, so time spent in the tick is not added on top
+			clockSleepUntil(next);
+
+			double late = loopNow() - next;
+			if (late > loop->maxLate)
+				loop->maxLate = late;
+		}
+	}
+
+}
+
+void loopStop(EventLoop* loop) {
+
+	loop->running = 0;
+
+}
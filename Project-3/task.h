@@ -0,0 +1,128 @@
+/*
+ * task.h
+ *
+ * Single-threaded event loop running stackless tasks. A mission is
+ * written as straight-line code that waits on time or sensor
+ * conditions with the TASK_ macros, but each wait returns to the
+ * loop instead of sleeping, so reflexes, the mission and telemetry all
+ * run on every tick of one thread.
+ *
+ * A task function looks like:
+ *
+ *  int blink(Task* t) {
+ *      TASK_BEGIN(t);
+ *      set_led(0, 0);
+ *      TASK_SLEEP(t, 0.5);
+ *      set_led(0, 255);
+ *      TASK_END(t);
+ *  }
+ *
+ * Locals do not survive a wait; keep state in globals or in the Task.
+ * Waits cannot be used inside a switch statement of the task itself,
+ * and only one wait fits on a source line.
+ */
+
+#ifndef INCLUDE_TASK_H
+#define INCLUDE_TASK_H
+
+#define TASK_MAX      8
+
+// Task function results
+#define TaskWaiting   0
+#define TaskDone      1
+
+typedef struct
+{
+	int line;      // where to resume, 0 to start over
+	double wakeAt; // s, for TASK_SLEEP
+	double now;    // time of the current tick, s
+}
+Task;
+
+typedef int (*TaskFn)(Task* task);
+
+#define TASK_BEGIN(t)       switch ((t)->line) { case 0:
+#define TASK_END(t)         } (t)->line = 0; return TaskDone
+
+// Wait until cond is true, checking once per tick
+#define TASK_AWAIT(t, cond) do { (t)->line = __LINE__; case __LINE__: \
+                                 if (!(cond)) return TaskWaiting; } while (0)
+
+// Wait for seconds to pass
+#define TASK_SLEEP(t, seconds) do { (t)->wakeAt = (t)->now + (seconds); \
+                                    TASK_AWAIT(t, (t)->now >= (t)->wakeAt); } while (0)
+
+// Finish the task early
+#define TASK_EXIT(t)        do { (t)->line = 0; return TaskDone; } while (0)
+
+typedef struct
+{
+	const char* name;
+	TaskFn run;
+	Task state;
+	int done;
+}
+LoopTask;
+
+typedef struct
+{
+	LoopTask tasks[TASK_MAX];
+	int count;
+	double period;        // s per tick
+	void (*sense)(void);  // reads the sensors once at the top of every tick, or NULL
+	double start;         // s, when the loop started
+	long ticks;
+	long overruns;        // ticks that took longer than the period
+	double maxLate;       // s, worst wakeup after a tick's deadline
+	volatile int running;
+}
+EventLoop;
+
+/*
+ * Function: loopInit
+ *  Sets up an empty loop.
+ *
+ *  period: seconds per tick
+ *  sense: called once at the start of each tick, before any task
+ */
+void loopInit(EventLoop* loop, double period, void (*sense)(void));
+
+/*
+ * Function: loopAdd
+ *  Adds a task. Tasks run in the order they are added, so put
+ *  reflexes first.
+ *
+ *  Returns 1 on success, 0 if the loop is full.
+ */
+int loopAdd(EventLoop* loop, const char* name, TaskFn run);
+
+/*
+ * Function: loopTick
+ *  Runs one tick: sense, then every task that has not finished. For
+ *  callers that pace the loop themselves.
+ *
+ *  Returns 0 once the task named by until has finished or loopStop
+ *  has been called.
+ */
+int loopTick(EventLoop* loop, TaskFn until);
+
+/*
+ * Function: loopRun
+ *  Ticks every period until the task named by until has finished or
+ *  loopStop is called.
+ */
+void loopRun(EventLoop* loop, TaskFn until);
+
+/*
+ * Function: loopStop
+ *  Ends loopRun after the current tick.
+ */
+void loopStop(EventLoop* loop);
+
+/*
+ * Function: loopNow
+ *  Seconds on the program clock, see clock.h.
+ */
+double loopNow();
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * wheel.c
+ *
+ * Feedforward plus PI wheel velocity loop. See wheel.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "wheel.h"
+
+#define WHEEL_MAX    500 // mm/s, OI limit
+#define WHEEL_MAX_DT 0.2 // s, longer gaps mean the loop was paused
+
+void wheelDefaultGains(WheelGains* g) {
+
+	g->kff = 1.0;
+	g->kp = 0.5;
+	g->ki = 1.0;
+	g->maxTrim = 80;
+
+}
+
+int wheelLoadGains(WheelGains* g, const char* path) {
+
+	char line[128];
+	char name[32];
+	double value;
+
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Wheel: ERROR: Could not open gains file %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#' || sscanf(line, "%31s %lf", name, &value) != 2)
+			continue;
+
+		if (strcmp(name, "kff") == 0)
+			g->kff = value;
+		else if (strcmp(name, "kp") == 0)
+			g->kp = value;
+		else if (strcmp(name, "ki") == 0)
+			g->ki = value;
+		else if (strcmp(name, "max_trim") == 0)
+			g->maxTrim = value;
+		else
+			fprintf(stderr, "Wheel: ignoring unknown gain %s\n", name);
+	}
+
+	fclose(f);
+	return 1;
+
+}
+
+void wheelInit(WheelLoop* w, const WheelGains* g) {
+
+	memset(w, 0, sizeof(WheelLoop));
+	w->gains = *g;
+
+}
+
+void wheelReset(WheelLoop* w) {
+
+	w->integral[0] = w->integral[1] = 0;
+	w->trim[0] = w->trim[1] = 0;
+
+}
+
+static double clamp(double v, double limit) {
+
+	if (v > limit)
+		return limit;
+	if (v < -limit)
+		return -limit;
+	return v;
+
+}
+
+static short wheel_step(WheelLoop* w, int wheel, double dt, double target, double measured) {
+
+	const WheelGains* g = &w->gains;
+
+	// a stop or a reversal starts the error over
+	if (target == 0 || target * w->target[wheel] < 0)
+		w->integral[wheel] = 0;
+	w->target[wheel] = target;
+
+	if (target == 0) {
+		w->trim[wheel] = 0;
+		return 0;
+	}
+
+	double error = target - measured;
+	double trim = g->kp * error + g->ki * (w->integral[wheel] + error * dt);
+
+	// only integrate while the correction has room, so it cannot wind up
+	if (fabs(trim) < g->maxTrim)
+		w->integral[wheel] += error * dt;
+
+	w->trim[wheel] = clamp(trim, g->maxTrim);
+
+	return (short) lround(clamp(g->kff * target + w->trim[wheel], WHEEL_MAX));
+
+}
+
+void wheelCommand(WheelLoop* w, double dt, double targetLeft, double targetRight,
+	double measuredLeft, double measuredRight, short* left, short* right) {
+
+	if (dt > WHEEL_MAX_DT)
+		dt = WHEEL_MAX_DT;
+
+	*left = wheel_step(w, 0, dt, targetLeft, measuredLeft);
+	*right = wheel_step(w, 1, dt, targetRight, measuredRight);
+
+}
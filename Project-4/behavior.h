@@ -0,0 +1,77 @@
+/*
+ * behavior.h
+ *
+ * Fixed-priority behavior arbitration. Every behavior (reflexes, wall
+ * following, the mission) is asked for a drive command on every tick,
+ * and the highest priority behavior that wants control wins. Behaviors
+ * must not block, so a reflex takes over on the first tick its sensor
+ * reading shows up, whatever the lower behaviors are in the middle of.
+ */
+
+#ifndef INCLUDE_BEHAVIOR_H
+#define INCLUDE_BEHAVIOR_H
+
+#define BEHAVIOR_MAX  8
+
+typedef struct
+{
+	short left;  // wheel velocities, mm/s
+	short right;
+}
+DriveCommand;
+
+/*
+ * A behavior looks at the latest sensor readings and returns true if it
+ * wants control this tick, filling in the command it would send.
+ */
+typedef int (*BehaviorFn)(DriveCommand* command);
+
+typedef struct
+{
+	const char* name;
+	BehaviorFn propose;
+}
+Behavior;
+
+typedef struct
+{
+	Behavior behaviors[BEHAVIOR_MAX]; // highest priority first
+	int count;
+	int winner;   // behavior in control after the last tick, -1 if none
+	int switches; // how many times control has changed hands
+}
+Arbiter;
+
+/*
+ * Function: arbiterInit
+ *  Starts an arbiter with no behaviors.
+ */
+void arbiterInit(Arbiter* a);
+
+/*
+ * Function: arbiterAdd
+ *  Adds a behavior below every behavior added before it.
+ *
+ *  Returns 1 on success, 0 if the arbiter is full.
+ */
+int arbiterAdd(Arbiter* a, const char* name, BehaviorFn propose);
+
+/*
+ * Function: arbiterTick
+ *  Asks every behavior for a command and picks the winner. All behaviors
+ *  are asked, even below the winner, so they can keep their own state
+ *  up to date.
+ *
+ *  command: filled with the winning command, or a stop if nobody bid
+ *
+ *  Returns the index of the winner, -1 if nobody bid.
+ */
+int arbiterTick(Arbiter* a, DriveCommand* command);
+
+/*
+ * Function: arbiterWinnerName
+ *  Name of the behavior in control, "none" if nobody bid.
+ */
+const char* arbiterWinnerName(const Arbiter* a);
+
+#endif
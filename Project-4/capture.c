@@ -0,0 +1,168 @@
+/*
+ * capture.c
+ *
+ * Memory mapped serial session recording. See capture.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+#include "clock.h"
+
+static size_t file_size(uint64_t records) {
+
+	return sizeof(CaptureHeader) + records * sizeof(CaptureRecord);
+
+}
+
+// Sizes the file for capacity records and maps all of it
+static int map_file(Capture* c, uint64_t capacity) {
+
+	if (ftruncate(c->fd, file_size(capacity)) != 0)
+		return 0;
+
+	void* map = mmap(NULL, file_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+	if (map == MAP_FAILED)
+		return 0;
+
+	if (c->header != NULL)
+		munmap(c->header, file_size(c->capacity));
+
+	c->header = (CaptureHeader*) map;
+	c->records = (CaptureRecord*) (c->header + 1);
+	c->capacity = capacity;
+	return 1;
+
+}
+
+int captureCreate(Capture* c, const char* path) {
+
+	memset(c, 0, sizeof(Capture));
+	pthread_mutex_init(&c->lock, NULL);
+
+	c->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (c->fd < 0) {
+		fprintf(stderr, "Capture: ERROR: cannot create %s\n", path);
+		return 0;
+	}
+
+	if (!map_file(c, CAPTURE_GROW)) {
+		fprintf(stderr, "Capture: ERROR: cannot map %s\n", path);
+		close(c->fd);
+		return 0;
+	}
+
+	c->started = clockNow();
+	memcpy(c->header->magic, CAPTURE_MAGIC, sizeof(c->header->magic));
+	c->header->version = CAPTURE_VERSION;
+	c->header->recordSize = sizeof(CaptureRecord);
+	c->header->wallclock = time(NULL);
+	c->header->started = c->started;
+	atomic_store(&c->header->count, 0);
+
+	return 1;
+
+}
+
+void captureByte(Capture* c, int direction, unsigned char data) {
+
+	double now = clockNow();
+
+	pthread_mutex_lock(&c->lock);
+
+	if (c->header == NULL) {
+		pthread_mutex_unlock(&c->lock);
+		return; // closed
+	}
+
+	uint64_t n = atomic_load_explicit(&c->header->count, memory_order_relaxed);
+
+	// out of room, stop recording rather than stall the robot
+	if (n == c->capacity && !map_file(c, c->capacity + CAPTURE_GROW)) {
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+
+	CaptureRecord* r = &c->records[n];
+	r->ns = (uint64_t) ((now - c->started) * 1e9);
+	r->direction = direction;
+	r->data = data;
+
+	atomic_store_explicit(&c->header->count, n + 1, memory_order_release);
+
+	pthread_mutex_unlock(&c->lock);
+
+}
+
+void captureClose(Capture* c) {
+
+	pthread_mutex_lock(&c->lock);
+
+	uint64_t n = atomic_load(&c->header->count);
+	munmap(c->header, file_size(c->capacity));
+	c->header = NULL;
+
+	if (ftruncate(c->fd, file_size(n)) != 0)
+		fprintf(stderr, "Capture: ERROR: cannot trim the file\n");
+	close(c->fd);
+
+	pthread_mutex_unlock(&c->lock);
+
+}
+
+int captureLoad(CaptureFile* f, const char* path) {
+
+	struct stat st;
+
+	memset(f, 0, sizeof(CaptureFile));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Capture: ERROR: cannot open %s\n", path);
+		return 0;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CaptureHeader)) {
+		fprintf(stderr, "Capture: ERROR: %s is not a capture\n", path);
+		close(fd);
+		return 0;
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Capture: ERROR: cannot map %s\n", path);
+		return 0;
+	}
+
+	const CaptureHeader* header = (const CaptureHeader*) map;
+	if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0
+		|| header->version != CAPTURE_VERSION || header->recordSize != sizeof(CaptureRecord)) {
+		fprintf(stderr, "Capture: ERROR: %s is not a version %d capture\n", path, CAPTURE_VERSION);
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	f->header = header;
+	f->records = (const CaptureRecord*) (header + 1);
+	f->size = st.st_size;
+	f->count = atomic_load((atomic_ullong*) &header->count);
+	if (file_size(f->count) > f->size)
+		f->count = (f->size - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+
+	return 1;
+
+}
+
+void captureUnload(CaptureFile* f) {
+
+	munmap((void*) f->header, f->size);
+	f->header = NULL;
+
+}
@@ -0,0 +1,106 @@
+/*
+ * capture.h
+ *
+ * Record of a serial session: every byte sent to and read from the
+ * robot with the time it went through, for replay.h and offline tools.
+ *
+ * The file is a CaptureHeader followed by fixed size CaptureRecords in
+ * the order they happened. It is written through a shared mapping that
+ * grows in CAPTURE_GROW steps, so recording a byte is a copy and no
+ * system call, and the header's count is only raised once a record is
+ * complete: a capture cut short by a crash is still valid up to its
+ * last byte, and a reader can map a capture that is still being
+ * written.
+ */
+
+#ifndef INCLUDE_CAPTURE_H
+#define INCLUDE_CAPTURE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define CAPTURE_MAGIC   "OICAP\0\0"
+#define CAPTURE_VERSION 1
+#define CAPTURE_GROW    65536 // records added each time the file fills up
+
+// Record directions
+enum { CaptureTx, CaptureRx };
+
+typedef struct
+{
+	char magic[8];          // CAPTURE_MAGIC
+	uint32_t version;       // CAPTURE_VERSION
+	uint32_t recordSize;    // sizeof(CaptureRecord)
+	int64_t wallclock;      // s since the epoch when recording started
+	double started;         // program clock when recording started, s
+	atomic_ullong count;    // complete records
+}
+CaptureHeader;
+
+typedef struct
+{
+	uint64_t ns;            // since the capture started
+	uint8_t direction;      // CaptureTx or CaptureRx
+	uint8_t data;
+	uint8_t spare[6];
+}
+CaptureRecord;
+
+typedef struct
+{
+	int fd;
+	CaptureHeader* header;  // mapping of the whole file
+	CaptureRecord* records;
+	uint64_t capacity;      // records the file has room for
+	double started;
+	pthread_mutex_t lock;   // bytes may come from more than one thread
+}
+Capture;
+
+// A capture mapped for reading
+typedef struct
+{
+	const CaptureHeader* header;
+	const CaptureRecord* records;
+	uint64_t count;         // complete records
+	size_t size;            // bytes mapped
+}
+CaptureFile;
+
+/*
+ * Function: captureCreate
+ *  Creates a capture file, replacing any old one.
+ *
+ *  Returns 0 if it cannot be created.
+ */
+int captureCreate(Capture* c, const char* path);
+
+/*
+ * Function: captureByte
+ *  Appends one byte sent (CaptureTx) or read (CaptureRx).
+ */
+void captureByte(Capture* c, int direction, unsigned char data);
+
+/*
+ * Function: captureClose
+ *  Trims the file to the records written and closes it.
+ */
+void captureClose(Capture* c);
+
+/*
+ * Function: captureLoad
+ *  Maps a capture for reading and checks its header. A capture still
+ *  being written is loaded up to its last complete record.
+ *
+ *  Returns 0 if path is not a capture.
+ */
+int captureLoad(CaptureFile* f, const char* path);
+
+/*
+ * Function: captureUnload
+ *  Unmaps a capture from captureLoad.
+ */
+void captureUnload(CaptureFile* f);
+
+#endif
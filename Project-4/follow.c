@@ -0,0 +1,66 @@
+/*
+ * follow.c
+ *
+ * PI wall follower. See follow.h.
+ */
+
+#include "shaper.h"
+#include "follow.h"
+
+static short clamp_wheel(short v) {
+
+	if (v > SHAPER_WHEEL_MAX)
+		return SHAPER_WHEEL_MAX;
+	if (v < -SHAPER_WHEEL_MAX)
+		return -SHAPER_WHEEL_MAX;
+	return v;
+
+}
+
+void followInit(WallFollower* f, double kp, double ki, double kd, int offset, short speed) {
+
+	f->kp = kp;
+	f->ki = ki;
+	f->kd = kd;
+	f->offset = offset;
+	f->speed = speed;
+	f->reference = 0;
+	f->errorP = 0;
+	f->errorD = 0;
+	f->errorI = 0;
+	f->left = 0;
+	f->right = 0;
+
+}
+
+void followStart(WallFollower* f, unsigned int signal) {
+
+	f->reference = (int) signal - f->offset;
+	f->errorP = f->reference - (int) signal;
+	f->errorD = 0;
+	f->errorI = 0;
+	f->left = f->speed;
+	f->right = f->speed;
+
+}
+
+void followStep(WallFollower* f, unsigned int signal, short* left, short* right) {
+
+	// too close makes the signal rise above the reference, so turn left
+	double errorP = f->reference - (int) signal;
+	f->errorD = errorP - f->errorP;
+	f->errorP = errorP;
+	f->errorI += errorP;
+
+	double error = f->kp * f->errorP + f->ki * f->errorI + f->kd * f->errorD;
+	f->right -= error;
+	f->left += error;
+
+	// keep the sums in range, the shaper clamps what is sent anyway
+	f->right = clamp_wheel(f->right);
+	f->left = clamp_wheel(f->left);
+
+	*left = f->left;
+	*right = f->right;
+
+}
@@ -0,0 +1,61 @@
+/*
+ * follow.h
+ *
+ * PI wall follower on the right light bumper signal (packet 51). Once
+ * the robot has turned until that sensor sees the wall, the signal then
+ * less an offset is the reference to hold, and every tick the error
+ * pushes one wheel up and the other down by the same amount, so the
+ * speed along the wall stays where it started. The signal a wall gives
+ * depends on its color as much as its distance, hence a brown wall
+ * wants other values than the white one in the lab.
+ *
+ * Since the error moves the wheels rather than setting them, the
+ * heading integrates it once more: kd on the change in the error is
+ * what holds the heading, and Project-4 runs without it.
+ */
+
+#ifndef INCLUDE_FOLLOW_H
+#define INCLUDE_FOLLOW_H
+
+#define FOLLOW_ALIGNED  50 // right light bumper signal that means the wall is alongside
+
+typedef struct
+{
+	double kp;          // wheel mm/s per unit of signal error
+	double ki;          // wheel mm/s per unit of error summed over the ticks
+	double kd;          // wheel mm/s per unit of change in the error since the last tick
+	int offset;         // the reference is the signal when aligned less this
+	short speed;        // mm/s along the wall
+
+	int reference;      // signal to hold
+	double errorP;      // at the last step
+	double errorD;      // change at the last step
+	double errorI;      // summed since the start
+	short left;         // wheel velocities, mm/s
+	short right;
+}
+WallFollower;
+
+/*
+ * Function: followInit
+ *  Sets the gains, offset and speed. The follower does nothing until
+ *  followStart.
+ */
+void followInit(WallFollower* f, double kp, double ki, double kd, int offset, short speed);
+
+/*
+ * Function: followStart
+ *  Starts following from the signal of the wall alongside, with both
+ *  wheels at the follower's speed and no error summed.
+ */
+void followStart(WallFollower* f, unsigned int signal);
+
+/*
+ * Function: followStep
+ *  One tick of the controller on a fresh right light bumper signal.
+ *
+ *  left, right: the wheel velocities to drive, mm/s
+ */
+void followStep(WallFollower* f, unsigned int signal, short* left, short* right);
+
+#endif
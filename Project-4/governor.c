@@ -0,0 +1,65 @@
+/*
+ * governor.c
+ *
+ * Forward speed cap from the light bumper signals. See governor.h.
+ */
+
+#include "governor.h"
+
+void governorInit(Governor* g, short cruiseSpeed, short minSpeed) {
+
+	int i;
+
+	for (i = 0; i < GOV_SENSORS; i++)
+		g->weight[i] = 1.0;
+	g->weight[0] = 0.25;
+	g->weight[GOV_SENSORS - 1] = 0.25;
+
+	g->clearSignal = 20;
+	g->nearSignal = 600;
+	g->cruiseSpeed = cruiseSpeed;
+	g->minSpeed = minSpeed;
+	g->nearest = 0;
+	g->limit = cruiseSpeed;
+
+}
+
+short governorUpdate(Governor* g, const unsigned int signals[GOV_SENSORS]) {
+
+	double nearest = 0;
+	int i;
+
+	// the strongest weighted return is the closest obstacle
+	for (i = 0; i < GOV_SENSORS; i++) {
+		double signal = signals[i] * g->weight[i];
+		if (signal > nearest)
+			nearest = signal;
+	}
+	g->nearest = (unsigned int) nearest;
+
+	if (g->nearest <= g->clearSignal) {
+		g->limit = g->cruiseSpeed;
+	} else if (g->nearest >= g->nearSignal) {
+		g->limit = g->minSpeed;
+	} else {
+		// linear between open space and close
+		double t = (double) (g->nearest - g->clearSignal) / (g->nearSignal - g->clearSignal);
+		g->limit = g->cruiseSpeed - t * (g->cruiseSpeed - g->minSpeed);
+	}
+
+	return g->limit;
+
+}
+
+void governorApply(const Governor* g, short* left, short* right) {
+
+	double forward = (*left + *right) / 2.0;
+
+	if (forward <= g->limit || forward <= 0)
+		return;
+
+	double scale = g->limit / forward;
+	*left = *left * scale;
+	*right = *right * scale;
+
+}
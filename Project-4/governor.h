@@ -0,0 +1,56 @@
+/*
+ * governor.h
+ *
+ * Proximity-aware speed governor. Reads the six light bumper signals
+ * (packets 46-51) on every sensor update and caps the forward speed
+ * by how close the nearest obstacle looks, so the robot can cruise in
+ * open space and only slows down near walls.
+ */
+
+#ifndef INCLUDE_GOVERNOR_H
+#define INCLUDE_GOVERNOR_H
+
+#define GOV_SENSORS  6 // left, front left, center left, center right, front right, right
+
+typedef struct
+{
+	double weight[GOV_SENSORS]; // share of each signal that counts toward proximity
+	unsigned int clearSignal;   // at or below this nothing is in the way
+	unsigned int nearSignal;    // at or above this the obstacle is close
+	short cruiseSpeed;          // cap in open space, mm/s
+	short minSpeed;             // cap next to an obstacle, mm/s
+	unsigned int nearest;       // weighted signal of the nearest obstacle
+	short limit;                // current forward speed cap, mm/s
+}
+Governor;
+
+/*
+ * Function: governorInit
+ *  Sets up the governor with the default signal thresholds.
+ *  The side sensors only count for a quarter, since they see the
+ *  wall being followed rather than what is ahead.
+ *
+ *  cruiseSpeed: forward speed allowed in open space, mm/s
+ *  minSpeed: forward speed allowed next to an obstacle, mm/s
+ */
+void governorInit(Governor* g, short cruiseSpeed, short minSpeed);
+
+/*
+ * Function: governorUpdate
+ *  Recomputes the speed cap from a fresh set of light bumper signals.
+ *
+ *  signals: light bumper signals 0-4095, in packet order 46-51
+ *
+ *  Returns the new forward speed cap in mm/s.
+ */
+short governorUpdate(Governor* g, const unsigned int signals[GOV_SENSORS]);
+
+/*
+ * Function: governorApply
+ *  Scales a pair of wheel velocities down so the forward speed stays
+ *  under the cap. Both wheels are scaled together to keep the turn
+ *  radius; turning in place and reversing are left alone.
+ */
+void governorApply(const Governor* g, short* left, short* right);
+
+#endif
@@ -1,12 +1,22 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <math.h>
+#include <time.h>
 
 #include "oi.h"
 #include "serial.h"
+#include "clock.h"
+#include "shaper.h"
+#include "governor.h"
+#include "behavior.h"
+#include "follow.h"
+#include "wall.h"
+#include "safety.h"
+#include "shadow.h"
 
 
 
@@ -15,6 +25,29 @@ enum bool {false, true};
 typedef unsigned char byte;
 Serial* serial;
 
+#define CONTROL_PERIOD 100000 // us between drive commands
+#define FOLLOW_KP      0.1    // wall follower gains, see Bench/tune for others
+#define FOLLOW_KI      0.01
+#define FOLLOW_KD      0
+#define FOLLOW_OFFSET  100    // hold the wall at the aligned signal less this
+#define FOLLOW_SPEED   100    // mm/s along the wall
+#define SHADOW_REFRESH 1.0    // s before an unchanged command is resent
+// *Note brown wall has a refDistance = 500
+
+Shaper shaper;
+double lastShaped; // time of the last shaped drive command
+
+Governor governor;
+Arbiter arbiter;
+Safety safety;
+Shadow shadow;
+int safetyStopsSeen; // supervisor stops the shadow knows about
+
+// Latest sensor readings, refreshed once per tick by sense()
+WallSensors sensors;
+
+WallMission mission;
+
 
 
 void send_byte(byte b) {
@@ -28,14 +61,52 @@ byte get_byte() {
 	byte c;
 
 	// if there is no waiting byte, wait
-	while ( serialNumBytesWaiting(serial) == 0 )
-		usleep(15000);
+	serialAwait(serial, 1, 0);
 
 	serialGetChar(serial, &c);
 	return c;
 
 };
 
+double now_seconds() {
+
+	return clockNow();
+
+};
+
+/*
+Sends a command that sets actuator state (drive, motors) unless the
+shadow says the robot already has it. A drive is filtered by the safety
+supervisor here, holding the port.
+*/
+void send_command(int slot, const byte* command, int length) {
+
+	byte safe[SHADOW_MAX];
+	int i;
+
+	serialCommandLock(serial);
+
+	if (length <= SHADOW_MAX) {
+		memcpy(safe, command, length);
+		safetyFilterCommand(&safety, safe, length);
+		command = safe;
+	}
+
+	// a safety stop changed the drive state behind our back
+	if (safety.stops != safetyStopsSeen) {
+		shadowInvalidate(&shadow, ShadowDrive);
+		safetyStopsSeen = safety.stops;
+	}
+
+	if (shadowCheck(&shadow, slot, command, length, now_seconds())) {
+		for (i = 0; i < length; i++)
+			send_byte( command[i] );
+	}
+
+	serialCommandUnlock(serial);
+
+};
+
 void start(byte state) {
 
 	// allocate memory for Serial struct
@@ -45,15 +116,26 @@ void start(byte state) {
 	serialClose(serial);
 
 	// constant B115200 comes from termios.h
-	serialOpen(serial, "/dev/ttyUSB0", B115200, false);
+	// CREATE_DEVICE points the program at another port, e.g. the simulator,
+	// CREATE_REPLAY at a capture to play back instead of the robot
+	char* device = getenv("CREATE_DEVICE");
+	char* replay = getenv("CREATE_REPLAY");
+	if (replay != NULL)
+		serialOpenReplay(serial, replay, getenv("CREATE_REPLAY_FAST") != NULL);
+	else
+		serialOpen(serial, device != NULL ? device : "/dev/ttyUSB0", B115200, false);
+
+	// CREATE_CAPTURE records the session for replay
+	char* capture = getenv("CREATE_CAPTURE");
+	if (capture != NULL && !serialRecord(serial, capture))
+		exit(1);
+
 	send_byte( CmdStart );	// Send Start
 	send_byte( state );	// Send state
 
 	// turn off any motors
-	send_byte( CmdMotors );
-	send_byte( 0 );
-	send_byte( 0 );
-	send_byte( 0 );
+	byte motors[] = { CmdMotors, 0, 0, 0 };
+	send_command(ShadowMotors, motors, sizeof(motors));
 
 	// clear out any bites from previous runs
 	while( serialNumBytesWaiting(serial) > 0 )
@@ -61,63 +143,99 @@ void start(byte state) {
 
 };
 
-// stops for 15ms
-unsigned char get_bump() {
+/*
+Reads every sensor the behaviors use with one Query List: bumps and
+wheel drops (7), cliffs (9-12), buttons (18), the light bumper bitmask (45)
+and all six light bumper signals (46-51), then updates the speed governor.
+*/
+void sense() {
 
-	send_byte( CmdSensors );
-	send_byte( SenBumpDrop ); //bumps and wheel drops
+	serialLock(serial);
 
-	return get_byte() & BmpBoth; //discard wheel drops
+	int i;
 
-};
+	send_byte( CmdSensorList );
+	send_byte( 7 + GOV_SENSORS );
+	send_byte( SenBumpDrop );
+	for (i = 9; i <= 12; i++)
+		send_byte( i );
+	send_byte( SenButton );
+	for (i = 45; i <= 45 + GOV_SENSORS; i++)
+		send_byte( i );
 
-/*
-Returns byte detailing which prox sensors have detected obstacles.
-For example, a wall
-*/
-byte wall_detected() {
+	sensors.bumpDrop = get_byte();
 
-	send_byte( CmdSensors );
-	send_byte( 45 );
-	return get_byte();
+	sensors.cliff = 0;
+	for (i = 0; i < 4; i++)
+		sensors.cliff = (sensors.cliff << 1) | (get_byte() & 1);
+
+	sensors.button = get_byte();
+	sensors.lightBumps = get_byte();
+	for (i = 0; i < GOV_SENSORS; i++) {
+		unsigned int value = get_byte() << 8;
+		value |= get_byte();
+		sensors.lightBumpSignals[i] = value;
+	}
+
+	governorUpdate(&governor, sensors.lightBumpSignals);
+
+	serialUnlock(serial);
 
 }
 
+// light bump right signal
 unsigned int get_wall() {
 
+	sense();
+	return sensors.lightBumpSignals[GOV_SENSORS - 1];
+
+};
+
+// waits for the reply
+unsigned char get_button() {
+
+	serialLock(serial);
+
 	send_byte( CmdSensors );
-	send_byte( 51 ); // light bumper
+	send_byte( SenButton );
+	byte value = get_byte();
 
-	unsigned int value = get_byte();
-	value += value << 8;
-	value += get_byte();
+	serialUnlock(serial);
 
 	return value;
 
 };
 
-int get_angle() {
-
-	// Potential problem [The value returned must be divided by 0.324056 to get degrees]
+/*
+Sends the Drive Direct command without shaping.
+The safety supervisor still gets the last word in send_command.
+*/
+void drive_direct(short leftWheelVelocity, short rightWheelVelocity) {
 
-	send_byte( CmdSensors );
-	send_byte( 20 );
+	byte left_low = leftWheelVelocity; // cast short to byte (discard high byte)
+	byte left_high = leftWheelVelocity >> 8; // bitwise shift high to low to save high byte
 
-	int value = get_byte();
-	value += value << 8;
-	value += get_byte();
+	byte right_low = rightWheelVelocity;
+	byte right_high = rightWheelVelocity >> 8;
 
-	return value;
+	byte command[] = { CmdDriveWheels, right_high, right_low, left_high, left_low };
+	send_command(ShadowDrive, command, sizeof(command));
 
 };
 
-// stops for 15ms
-unsigned char get_button() {
+/*
+Steps the shaper from the time of the last shaped command
+and sends the wheel velocities it allows.
+*/
+void shaped_drive() {
 
-	send_byte( CmdSensors );
-	send_byte( SenButton );
+	short left, right;
+	double now = now_seconds();
 
-	return get_byte();
+	shaperStep(&shaper, now - lastShaped, &left, &right);
+	lastShaped = now;
+
+	drive_direct(left, right);
 
 };
 
@@ -125,20 +243,15 @@ unsigned char get_button() {
 Enables robot to drive directly non linearly
 using the sign and value of both velocity values
 by moving the wheels at different velocities.
+Forward speed is capped by the governor near obstacles, and the wheels
+are ramped toward the velocities under the surface limits,
+so call it at the control rate until the robot gets there.
 */
 void drive(short leftWheelVelocity, short rightWheelVelocity) {
 
-	byte left_low = leftWheelVelocity; // cast short to byte (discard high byte)
-	byte left_high = leftWheelVelocity >> 8; // bitwise shift high to low to save high byte
-
-	byte right_low = rightWheelVelocity;
-	byte right_high = rightWheelVelocity >> 8;
-
-	send_byte( CmdDriveWheels );
-	send_byte( right_high );
-	send_byte( right_low );
-	send_byte( left_high );
-	send_byte( left_low );
+	governorApply(&governor, &leftWheelVelocity, &rightWheelVelocity);
+	shaperSetTarget(&shaper, leftWheelVelocity, rightWheelVelocity);
+	shaped_drive();
 
 };
 
@@ -149,99 +262,67 @@ positve wheelVelocity moves robot forward
 negative wheelVelocity moves robot in reverse
 positve radius turns robot left
 negative radius turns robot right
+Converted to wheel velocities so it is shaped like drive().
 */
 void angular_drive(short wheelVelocity, short radius) {
 
-	byte wheel_low = wheelVelocity; // cast short to byte (discard high byte)
-	byte wheel_high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
-
-	byte radius_low = radius;
-	byte radius_high = radius >> 8;
-
-	send_byte( CmdDrive );
-	send_byte( wheel_high );
-	send_byte( wheel_low );
-	send_byte( radius_high );
-	send_byte( radius_low );
+	if (wheelVelocity > governor.limit)
+		wheelVelocity = governor.limit;
+	shaperSetArc(&shaper, wheelVelocity, radius);
+	shaped_drive();
 
 };
 
 /*
-Robot will drive straight until bump is detected.
-Bump is assumed to be the wall.
+Ramps the wheels down to a stop at the control rate.
 */
-void find_wall(int enabled) {
+void drive_stop() {
 
-	//previous get_bump() != BmpBoth
-	while (enabled && !(get_bump() != 0) && !get_button()) {
-		drive(50, 50);
-		usleep(100000);
+	drive(0, 0);
+	while (!shaperSettled(&shaper)) {
+		clockSleep(CONTROL_PERIOD / 1e6);
+		drive(0, 0);
 	}
 
-}
+};
 
-/*
-Rotate until all prox. sensors
-are not detecting anything.
-*/
-void find_open_space() {
+// Behaviors for the arbiter, see wall.h
 
-	// If non-zero, one of six sensors detect signal
-	while (wall_detected() != 0) {
-		drive(-50, 50);
-		usleep(100000);
-	}
+int cliff_avoid(DriveCommand* command) {
 
-	// Stop rotating
-	drive(0, 0);
+	return wallCliffAvoid(&mission, &sensors, command);
 
 }
 
-/*
-Rotate until only right
-prox sensor is detecting something
-*/
-void find_obstacle() {
-
-	while (wall_detected() != 32) {
-		drive(-50, 50);
-		usleep(100000);
-	}
+int bump_reflex(DriveCommand* command) {
 
-	// Stop rotating
-	drive(0, 0);
+	return wallBumpReflex(&mission, &sensors, command);
 
 }
 
-/*
-Robot will rotate counterclockwise until wall sensor detects wall.
-1023 means robot is on the wall
-*/
-unsigned int align(int enabled) {
-
-	byte btn = 0;
-
-	// Find wall
-	unsigned int wall = get_wall();
-	while (enabled && wall < 50 && !btn) {
-		drive(-50, 50);
-		printf("%u \n", wall);
-		wall = get_wall();
-		usleep(100000);
-
-		btn = get_button();
-		btn = get_button();
-		if (!btn) {
-			drive(0, 0);
-			break;
-		}
-	}
+// the follower, printing its state every tick
+int wall_follow(DriveCommand* command) {
 
-	// Stop
-	drive(0, 0);
+	if (!wallFollow(&mission, &sensors, command))
+		return false;
+
+	// Display values
+	const WallFollower* f = &mission.follower;
+	printf("Wall: %u\n", sensors.lightBumpSignals[GOV_SENSORS - 1]);
+	printf("Error_p: %f\n", f->errorP);
+	printf("Weighted Error_p: %f\n", f->kp * f->errorP);
+	printf("Error_i: %f\n", f->errorI);
+	printf("Weighted Error_i: %f\n", f->ki * f->errorI);
+	printf("Left: %d\n", f->left);
+	printf("Right: %d\n", f->right);
 
-	// Return wall distance
-	return wall - 100;
+	return true;
+
+}
+
+int wall_mission(DriveCommand* command) {
+
+	return wallMission(&mission, &sensors, command);
 
 }
 
@@ -254,151 +335,76 @@ void test_wall_sensor(int enabled) {
 
 	while (enabled && !get_button()) {
 		printf("%u \n", get_wall());
-		usleep(100000);
+		clockSleep(CONTROL_PERIOD / 1e6);
 	}
 
 }
 
-void wall_drive(int enabled, unsigned int referenceDistance) {
-
-	// Brown wall has a refDistance = 500;
-
-	// Store button
-	byte btn = 0;
-	byte bmp = 0;
-
-	// Store error
-	double error_p = 0;
-	double error_i = 0;
-	//float error_d = 0;
-	//float error_prev = 0;
-
-	// Store error weight
-	double k_p = 0.1;
-	double k_i = 0.01;
-	//float k_d = 0.001;
-
-	short leftWheelVelocity = 100;
-	short rightWheelVelocity = 100;
-	unsigned int refDistance = referenceDistance;
-	unsigned int measuredDistance;
-
-	// If enabled and bmp not detected, drive along wall
-	while (enabled && !btn) {
-
-		// If BmpBoth, realign
-		bmp = get_bump();
-		if (bmp == BmpBoth) {
-			find_obstacle();
-			refDistance = align(1);
-		}
-
-		// If BmpRight, move around obstacle
-		if (bmp == BmpRight) {
-
-			/*
-			int xPosition = 0;
-			int yPosition = 0;
-			double theta = 0;
-
-			get_angle(); // clean garbage values
-			int angle = get_angle();
-			find_obstacle();
-			angle = get_angle();
-			*/
-
-		}
-
-		// Read wall sensor
-		measuredDistance = get_wall();
+int main(int args, char** argv) {
 
-		// Calculate error
-		error_p = refDistance - measuredDistance;
+	DriveCommand command;
+	int lastWinner = -1;
 
-		// Calculate accumulated error
-		error_i = error_i + error_p;
+	// CREATE_CLOCK runs the mission on the simulator's time
+	if (!clockInit())
+		return 1;
 
-		// Derivative omitted
-		//error_d = error_p - error_prev;
+	// acceleration limits for the floor, e.g. ./create2 carpet
+	const SurfaceProfile* surface = shaperSurface(args > 1 ? argv[1] : "tile");
+	if (surface == NULL) {
+		fprintf(stderr, "Unknown surface %s, use tile, wood or carpet\n", argv[1]);
+		return 1;
+	}
+	shaperInit(&shaper, surface);
+	shadowInit(&shadow, SHADOW_REFRESH);
+	lastShaped = now_seconds();
+	governorInit(&governor, WALL_CRUISE_SPEED, WALL_APPROACH_SPEED);
+	// Goto wall, align with it, then drive along it
+	wallInit(&mission);
+	followInit(&mission.follower, FOLLOW_KP, FOLLOW_KI, FOLLOW_KD, FOLLOW_OFFSET, FOLLOW_SPEED);
+
+	// reflexes first, highest priority on top
+	arbiterInit(&arbiter);
+	arbiterAdd(&arbiter, "cliff", cliff_avoid);
+	arbiterAdd(&arbiter, "bump", bump_reflex);
+	arbiterAdd(&arbiter, "wall follow", wall_follow);
+	arbiterAdd(&arbiter, "mission", wall_mission);
 
-		// Store current error for time (t + 1)
-		//error_prev = error_p;
+	//full mode
+	start(CmdFull);
 
-		// Calculate error
-		double error = k_p * error_p + k_i * error_i;
+	// Full mode has no cliff or wheel drop protection of its own
+	if (!safetyStart(&safety, serial))
+		return 1;
 
-		/*
-		// Check for convex vertex
-		if (error_p == refDistance) {
+	// Stop, if clean button is pressed
+	do {
 
-			// Store current wheel speeds
-			short tempLeft = leftWheelVelocity;
-			short tempRight = rightWheelVelocity;
+		sense();
 
-			// Rotate
+		// every behavior bids, the arbiter picks one command for this tick
+		arbiterTick(&arbiter, &command);
+		drive(command.left, command.right);
 
-		}
-		*/
-
-		// Set wheel speed values
-		rightWheelVelocity -= error;
-		leftWheelVelocity +=  error;
-
-		// Execute speeds
-		drive(leftWheelVelocity, rightWheelVelocity);
-
-		// Display values
-		printf("Wall: %u\n", measuredDistance);
-		printf("Error_p: %f\n", error_p);
-		printf("Weighted Error_p: %f\n", k_p * error_p);
-		printf("Error_i: %f\n", error_i);
-		printf("Weighted Error_i: %f\n", k_i * error_i);
-		printf("Left: %d\n", leftWheelVelocity);
-		printf("Right: %d\n", rightWheelVelocity);
-
-		// Stop, if clean button is pressed
-		btn = get_button();
-		if (!btn) {
-			drive(0, 0);
-			break;
+		if (arbiter.winner != lastWinner) {
+			printf("Behavior: %s\n", arbiterWinnerName(&arbiter));
+			lastWinner = arbiter.winner;
 		}
 
 		// Sleep for a tenth of second
-		usleep(100000);
+		clockSleep(CONTROL_PERIOD / 1e6);
 
-	}
-	
-	drive(0, 0);
+	} while (!sensors.button);
 
-}
-
-void crashNBurn() {
-
-	find_open_space();
-
-	angular_drive(50, 100);
-	unsigned int distance = align(1);
-	wall_drive(1, distance);
-
-}
-
-int main(int args, char** argv) {
-
-	//full mode
-	start(CmdFull);
-
-	// Goto wall
-	find_wall(1);
-
-	// Align with wall
-	unsigned int distance = align(1);
-
-	// Drive along wall
-	wall_drive(1, distance);
+	drive_stop();
 
 	// Test wall sensor values
 	test_wall_sensor(0);
 
+	safetyStop(&safety);
+	printf("Commands: %ld bytes sent, %ld redundant bytes dropped\n",
+		shadow.sentBytes, shadow.suppressedBytes);
+
 	// Power down
 	send_byte(CmdPwrDwn);
 
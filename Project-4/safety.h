@@ -0,0 +1,86 @@
+/*
+ * safety.h
+ *
+ * Safety supervisor for Full mode. Full mode turns off the robot's own
+ * cliff and wheel drop protection, so a thread of its own polls the
+ * wheel drops (packet 7) and cliffs (packets 9-12) and sends a stop the
+ * moment one shows up, ahead of anything the mission has queued. While
+ * the hazard lasts, the drive helpers run their commands through
+ * safetyFilter once they hold the port for commands; the hazard is set
+ * before the stop goes out, so no drive checked earlier can follow the
+ * stop. The time from the previous poll's reply, after which
+ * the hazard may have come up unseen, to the stop leaving the port is
+ * logged against a budget. It takes in the poll period, the wait for
+ * the port and the round trip.
+ */
+
+#ifndef INCLUDE_SAFETY_H
+#define INCLUDE_SAFETY_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "serial.h"
+
+// Hazard bits
+#define HazardCliffL     0x01
+#define HazardCliffFL    0x02
+#define HazardCliffFR    0x04
+#define HazardCliffR     0x08
+#define HazardCliffAny   0x0F
+#define HazardWheelDrop  0x10
+
+#define SAFETY_PERIOD    15000 // us between polls, the OI sensor update rate
+#define SAFETY_BUDGET    30.0  // ms allowed from the previous reply to stop
+#define SAFETY_TIMEOUT   0.05  // s to wait for a poll response
+
+typedef struct
+{
+	Serial* serial;
+	pthread_t thread;
+	volatile int running;
+	atomic_int hazard;     // current hazard bits
+	int stops;             // stops issued
+	int overBudget;        // stops that took longer than SAFETY_BUDGET
+	double lastLatency;    // ms, previous reply to stop transmitted
+	double maxLatency;     // ms
+}
+Safety;
+
+/*
+ * Function: safetyStart
+ *  Starts the supervisor thread on an open connection.
+ *
+ *  Returns 1 on success, 0 if the thread could not be started.
+ */
+int safetyStart(Safety* safety, Serial* serial);
+
+/*
+ * Function: safetyStop
+ *  Stops the supervisor thread and prints its latency summary.
+ */
+void safetyStop(Safety* safety);
+
+/*
+ * Function: safetyFilter
+ *  Limits wheel velocities to what is safe right now: nothing moves
+ *  with a wheel dropped, and only backing away is allowed at a cliff.
+ *  Call it with serialCommandLock held, so a stop cannot slip in
+ *  between the check and the command.
+ */
+void safetyFilter(const Safety* safety, short* left, short* right);
+
+/*
+ * Function: safetyFilterVelocity
+ *  Same as safetyFilter for a Drive (137) center velocity.
+ */
+void safetyFilterVelocity(const Safety* safety, short* velocity);
+
+/*
+ * Function: safetyFilterCommand
+ *  Same as safetyFilter on the bytes of a Drive Direct (145) or Drive
+ *  (137) command, in place. Any other command is left alone.
+ */
+void safetyFilterCommand(const Safety* safety, unsigned char* command, int length);
+
+#endif
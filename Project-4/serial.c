@@ -18,14 +18,43 @@
 #include <time.h>
 #include <assert.h>
 #include <ctype.h>
+#include <sched.h>
 
 #include "serial.h"
+#include "clock.h"
+
+static Serial* finishing = NULL; // capture to close and replay to report at exit
+
+static void finish() {
+	if(finishing->capture) captureClose(finishing->capture);
+	if(finishing->replay) replayReport(finishing->replay);
+}
 
 void serialOpen(Serial *s, char *device, int baudCode, int verbose) {
 	struct termios options;
 	int r;
 
 	s->verbose = verbose;
+	s->capture = NULL;
+	s->replay = NULL;
+
+	// Commands and queries may come from more than one thread. Priority
+	// inheritance keeps a real-time thread from waiting behind a
+	// preempted lower priority holder. A query holds lock until its
+	// reply is read, write only while bytes go out.
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&s->lock, &attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_NORMAL);
+	pthread_mutex_init(&s->write, &attr);
+	pthread_mutexattr_destroy(&attr);
+	s->depth = 0;
+	atomic_init(&s->waiters, 0);
+	atomic_init(&s->taken, 0);
+	atomic_init(&s->writeWaiters, 0);
+	atomic_init(&s->writeTaken, 0);
 
 	// Open the serial port.
 	if(s->verbose) printf("Serial: opening serial device %s\n", device);
@@ -82,6 +111,48 @@ void serialOpen(Serial *s, char *device, int baudCode, int verbose) {
 
 }
 
+void serialOpenReplay(Serial *s, char *path, int fast) {
+	pthread_mutexattr_t attr;
+
+	s->verbose = 0;
+	s->fd = -1;
+	s->capture = NULL;
+	s->replay = (Replay*)malloc(sizeof(Replay));
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&s->lock, &attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_NORMAL);
+	pthread_mutex_init(&s->write, &attr);
+	pthread_mutexattr_destroy(&attr);
+	s->depth = 0;
+	atomic_init(&s->waiters, 0);
+	atomic_init(&s->taken, 0);
+	atomic_init(&s->writeWaiters, 0);
+	atomic_init(&s->writeTaken, 0);
+
+	if(!replayOpen(s->replay, path)) exit(1);
+	if(fast && !clockDrive()) exit(1);
+
+	if(finishing == NULL) atexit(finish);
+	finishing = s;
+}
+
+int serialRecord(Serial *s, char *path) {
+	Capture* c = (Capture*)malloc(sizeof(Capture));
+
+	if(!captureCreate(c, path)) {
+		free(c);
+		return 0;
+	}
+	s->capture = c;
+
+	if(finishing == NULL) atexit(finish);
+	finishing = s;
+	return 1;
+}
+
 void serialClose(Serial *s){
 	close(s->fd);
 }
@@ -111,11 +182,19 @@ int serialSend(Serial *s, unsigned char c) {
 	// Send one character to the serial port.
 	if(s->verbose) printf("Serial: send character (%d)\n", (int)((unsigned char)c));
 
+	if(s->replay) {
+		replaySend(s->replay, c);
+		if(s->capture) captureByte(s->capture, CaptureTx, c);
+		return 1;
+	}
+
 	while(1) {
 		int n = write(s->fd, &c, 1);
 		int errsv = errno;
 		
 		if(n == 1) {
+			clockWrote(1);
+			if(s->capture) captureByte(s->capture, CaptureTx, c);
 			return 1;
 		} else if(errno != EAGAIN) {
 			fprintf(stderr, "Serial: ERROR: Could not write character: (%d) %c \n", (int)(c), isprint(c) ? c : ' ');
@@ -123,14 +202,106 @@ int serialSend(Serial *s, unsigned char c) {
 			return 0;
 		} else {
 			if(s->verbose) printf("Serial: Error EAGAIN on write... trying again.\n");
-			usleep(100);
+			clockSleep(0.0001);
 		}
 	}
 	return 1;
 }
 
+static void take(pthread_mutex_t *m, atomic_int *waiters, atomic_uint *taken) {
+	if (pthread_mutex_trylock(m) != 0) {
+		// the holder may be asleep waiting for a reply, let the clock run,
+		// unless it let go before it could see this thread waiting
+		atomic_fetch_add(waiters, 1);
+		if (pthread_mutex_trylock(m) != 0) {
+			clockBlock();
+			pthread_mutex_lock(m);
+			clockUnblock();
+		}
+		atomic_fetch_sub(waiters, 1);
+	}
+	atomic_fetch_add(taken, 1);
+}
+
+static void give(pthread_mutex_t *m, atomic_int *waiters, atomic_uint *taken, int last) {
+	unsigned before = atomic_load(taken);
+
+	pthread_mutex_unlock(m);
+
+	// A thread blocked on the lock does not count as running until it
+	// has it, so if this one went to sleep first the simulator could move
+	// time on past it. Stay up until someone has taken the lock.
+	while(last && clockVirtual() && atomic_load(waiters) > 0 && atomic_load(taken) == before)
+		sched_yield();
+}
+
+void serialLock(Serial *s) {
+	take(&s->lock, &s->waiters, &s->taken);
+	if(++s->depth == 1) take(&s->write, &s->writeWaiters, &s->writeTaken);
+}
+
+void serialUnlock(Serial *s) {
+	int last = --s->depth == 0;
+
+	if(last) give(&s->write, &s->writeWaiters, &s->writeTaken, 1);
+	give(&s->lock, &s->waiters, &s->taken, last);
+}
+
+void serialCommandLock(Serial *s) {
+	if(pthread_mutex_trylock(&s->lock) == 0) {
+		// this thread holds the port already and writes under it
+		if(s->depth > 0) {
+			s->depth++;
+			return;
+		}
+		give(&s->lock, &s->waiters, &s->taken, 1);
+	}
+	take(&s->write, &s->writeWaiters, &s->writeTaken);
+}
+
+void serialCommandUnlock(Serial *s) {
+	if(pthread_mutex_trylock(&s->lock) == 0) {
+		int held = s->depth > 0;
+
+		give(&s->lock, &s->waiters, &s->taken, !held);
+		if(held) {
+			serialUnlock(s);
+			return;
+		}
+	}
+	give(&s->write, &s->writeWaiters, &s->writeTaken, 1);
+}
+
+int serialAwait(Serial *s, int count, double timeout) {
+	double deadline = clockNow() + timeout;
+	int arrived = 1;
+
+	// Asked before letting go of write, so a replay matches the reply
+	// to the query just sent and not to a command sent after it.
+	if(serialNumBytesWaiting(s) >= count) return 1;
+
+	give(&s->write, &s->writeWaiters, &s->writeTaken, 1);
+	while(serialNumBytesWaiting(s) < count) {
+		if(timeout > 0 && clockNow() > deadline) {
+			arrived = 0;
+			break;
+		}
+		clockSleep(SERIAL_POLL);
+	}
+	take(&s->write, &s->writeWaiters, &s->writeTaken);
+
+	return arrived;
+}
+
+void serialDrain(Serial *s) {
+	if(s->replay) return;
+	tcdrain(s->fd);
+}
+
 int serialNumBytesWaiting(Serial *s) {
 	// Return the number of bytes in the input buffer.
+	if(s->replay) return replayWaiting(s->replay);
+
 	int bytes;
 	ioctl(s->fd, FIONREAD, &bytes);
 	return bytes;	
@@ -145,6 +316,13 @@ int serialGetChar(Serial *s, unsigned char *buf) {
 		printf("Serial: get character (%d) bytes in buffer.\n", serialNumBytesWaiting(s));
 	}
 	
+	// Captured replies instead, when replaying.
+	if(s->replay) {
+		if(!replayGetChar(s->replay, buf)) return 0;
+		if(s->capture) captureByte(s->capture, CaptureRx, *buf);
+		return 1;
+	}
+
 	// Try to read.
 	errno = 0;
 	int r = read(s->fd, buf, 1);
@@ -152,7 +330,9 @@ int serialGetChar(Serial *s, unsigned char *buf) {
 
 	// Got a character?
 	if(r == 1) {
+		clockRead(1);
 		if(s->verbose) printf("Serial: got character (%d)\n", (int) (unsigned char) *buf);
+		if(s->capture) captureByte(s->capture, CaptureRx, *buf);
 		successfulLastTime = 1;
 		return 1;
 	}
@@ -172,6 +352,7 @@ int serialGetChar(Serial *s, unsigned char *buf) {
 
 void serialSetSignal(Serial *s, int sig) {
 	if(s->verbose) printf("Serial: set signal %d\n", sig);
+	if(s->replay) return;
 	int status;
 	ioctl(s->fd, TIOCMGET, &status);
 	status |= sig;
@@ -180,6 +361,7 @@ void serialSetSignal(Serial *s, int sig) {
 
 void serialClearSignal(Serial *s, int sig) {
 	if(s->verbose) printf("Serial: clear signal %d\n", sig);
+	if(s->replay) return;
 	int status;
 	ioctl(s->fd, TIOCMGET, &status);
 	status &= ~sig;
@@ -188,6 +370,7 @@ void serialClearSignal(Serial *s, int sig) {
 
 int serialGetSignal(Serial *s, int sig) {
 	if(s->verbose) printf("Serial: get signal %d\n", sig);
+	if(s->replay) return 0;
 	int status;
 	ioctl(s->fd, TIOCMGET, &status);
 	return (int)(status & sig);
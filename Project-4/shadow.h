@@ -0,0 +1,70 @@
+/*
+ * shadow.h
+ *
+ * Actuator shadow state. Keeps a copy of the last drive, LED, motor
+ * and song command sent to the robot, so a helper that sends the same
+ * command again can drop it instead of spending link bandwidth on it.
+ * An identical command is still resent once it is older than the
+ * refresh period, in case the robot missed it.
+ */
+
+#ifndef INCLUDE_SHADOW_H
+#define INCLUDE_SHADOW_H
+
+#define SHADOW_MAX       40 // longest command, a 16 note song is 35 bytes
+
+// Shadow slots, one per piece of actuator state
+#define ShadowDrive      0  // Drive (137) and Drive Direct (145)
+#define ShadowLeds       1
+#define ShadowMotors     2
+#define ShadowSong       3  // song n is in slot ShadowSong + n
+#define SHADOW_SLOTS     (ShadowSong + 4)
+
+typedef struct
+{
+	unsigned char bytes[SHADOW_MAX];
+	int length;
+	double sentAt; // seconds
+	int valid;
+}
+ShadowSlot;
+
+typedef struct
+{
+	ShadowSlot slots[SHADOW_SLOTS];
+	double refresh;      // s before an identical command is resent, 0 never
+	long sentBytes;      // bytes let through
+	long suppressedBytes; // bytes dropped as redundant
+}
+Shadow;
+
+/*
+ * Function: shadowInit
+ *  Starts with nothing known about the robot's state.
+ *
+ *  refresh: seconds before an identical command is resent, 0 for never
+ */
+void shadowInit(Shadow* shadow, double refresh);
+
+/*
+ * Function: shadowCheck
+ *  Decides whether a command has to go out, and if so records it as
+ *  the robot's new state.
+ *
+ *  slot: which piece of state the command sets
+ *  command: the whole command, opcode first
+ *  length: bytes in command
+ *  now: current time, seconds
+ *
+ *  Returns 1 if the command must be sent, 0 if it is redundant.
+ */
+int shadowCheck(Shadow* shadow, int slot, const unsigned char* command, int length, double now);
+
+/*
+ * Function: shadowInvalidate
+ *  Forgets a slot, e.g. after something else changed that state
+ *  behind the command layer's back.
+ */
+void shadowInvalidate(Shadow* shadow, int slot);
+
+#endif
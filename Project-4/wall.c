@@ -0,0 +1,132 @@
+/*
+ * wall.c
+ *
+ * Project-4's behaviors. See wall.h.
+ */
+
+#include "oi.h"
+#include "wall.h"
+
+void wallInit(WallMission* m) {
+
+	m->phase = PhaseFindWall;
+	m->backoff = 0;
+
+}
+
+int wallCliffAvoid(WallMission* m, const WallSensors* s, DriveCommand* command) {
+
+	if (s->bumpDrop & WheelDropAll) {
+		command->left = 0;
+		command->right = 0;
+		return 1;
+	}
+
+	if (s->cliff != 0) {
+		command->left = -100;
+		command->right = -100;
+		return 1;
+	}
+
+	return 0;
+
+}
+
+int wallBumpReflex(WallMission* m, const WallSensors* s, DriveCommand* command) {
+
+	unsigned char bmp = s->bumpDrop & BmpBoth; //discard wheel drops
+
+	if (bmp != 0) {
+		if (m->backoff == 0)
+			m->phase = (m->phase == PhaseFindWall) ? PhaseAlign : PhaseFindObstacle;
+		m->backoff = WALL_BACKOFF_TICKS;
+	} else if (m->backoff > 0) {
+		m->backoff--;
+	} else {
+		return 0;
+	}
+
+	command->left = -WALL_APPROACH_SPEED;
+	command->right = -WALL_APPROACH_SPEED;
+	return 1;
+
+}
+
+int wallFollow(WallMission* m, const WallSensors* s, DriveCommand* command) {
+
+	if (m->phase != PhaseFollow)
+		return 0;
+
+	followStep(&m->follower, s->lightBumpSignals[GOV_SENSORS - 1], &command->left, &command->right);
+	return 1;
+
+}
+
+int wallMission(WallMission* m, const WallSensors* s, DriveCommand* command) {
+
+	unsigned int wall = s->lightBumpSignals[GOV_SENSORS - 1];
+
+	switch (m->phase) {
+
+	case PhaseFindWall:
+		command->left = WALL_CRUISE_SPEED;
+		command->right = WALL_CRUISE_SPEED;
+		return 1;
+
+	case PhaseFindObstacle:
+		// rotate until only the right prox sensor sees the obstacle
+		if (s->lightBumps != 32) {
+			command->left = -50;
+			command->right = 50;
+			return 1;
+		}
+		m->phase = PhaseAlign;
+		// fall through
+
+	case PhaseAlign:
+		if (wall < FOLLOW_ALIGNED) {
+			command->left = -50;
+			command->right = 50;
+			return 1;
+		}
+		followStart(&m->follower, wall);
+		m->phase = PhaseFollow;
+		command->left = 0;
+		command->right = 0;
+		return 1;
+
+	default:
+		return 0;
+
+	}
+
+}
+
+int wallTick(WallMission* m, const WallSensors* s, DriveCommand* command) {
+
+	DriveCommand proposal;
+	int winner = -1;
+
+	command->left = 0;
+	command->right = 0;
+
+	if (wallCliffAvoid(m, s, &proposal) && winner < 0) {
+		winner = 0;
+		*command = proposal;
+	}
+	if (wallBumpReflex(m, s, &proposal) && winner < 0) {
+		winner = 1;
+		*command = proposal;
+	}
+	if (wallFollow(m, s, &proposal) && winner < 0) {
+		winner = 2;
+		*command = proposal;
+	}
+	if (wallMission(m, s, &proposal) && winner < 0) {
+		winner = 3;
+		*command = proposal;
+	}
+
+	return winner;
+
+}
@@ -0,0 +1,93 @@
+/*
+ * wall.h
+ *
+ * Project-4's behaviors apart from the serial port: cliff avoidance,
+ * the bump reflex, wall following and the mission that finds the wall
+ * and lines up with it. Each looks at the latest sensor readings and
+ * bids for the wheels like a behavior.h behavior; main.c asks them
+ * through its arbiter, programs without one through wallTick.
+ */
+
+#ifndef INCLUDE_WALL_H
+#define INCLUDE_WALL_H
+
+#include "behavior.h"
+#include "governor.h"
+#include "follow.h"
+
+#define WALL_CRUISE_SPEED    300 // mm/s in open space
+#define WALL_APPROACH_SPEED  50  // mm/s next to a wall
+#define WALL_BACKOFF_TICKS   3   // ticks to keep backing off after a bump
+#define WALL_BEHAVIORS       4
+
+// Mission phases, one step per tick
+enum { PhaseFindWall, PhaseAlign, PhaseFindObstacle, PhaseFollow };
+
+// Latest sensor readings, refreshed once per tick
+typedef struct
+{
+	unsigned char bumpDrop;   // bumps and wheel drops
+	unsigned char cliff;      // one bit per cliff sensor, left is the high bit
+	unsigned char button;
+	unsigned char lightBumps; // light bumper bitmask
+	unsigned int lightBumpSignals[GOV_SENSORS];
+}
+WallSensors;
+
+typedef struct
+{
+	int phase;
+	int backoff;              // ticks of backing off left after a bump
+	WallFollower follower;    // set up with followInit
+}
+WallMission;
+
+/*
+ * Function: wallInit
+ *  Starts the mission looking for the wall.
+ */
+void wallInit(WallMission* m);
+
+/*
+ * Function: wallCliffAvoid
+ *  Backs straight away from a cliff, or holds still if a wheel has
+ *  dropped.
+ */
+int wallCliffAvoid(WallMission* m, const WallSensors* s, DriveCommand* command);
+
+/*
+ * Function: wallBumpReflex
+ *  Backs off while bumped and for a few ticks after, then hands the
+ *  robot back to the mission. Bumping the wall while looking for it
+ *  means it is time to align; bumping while following means an obstacle
+ *  (concave corner) is in the way, so turn until it is on the right.
+ */
+int wallBumpReflex(WallMission* m, const WallSensors* s, DriveCommand* command);
+
+/*
+ * Function: wallFollow
+ *  The follower on the right light bumper signal, once following.
+ */
+int wallFollow(WallMission* m, const WallSensors* s, DriveCommand* command);
+
+/*
+ * Function: wallMission
+ *  Lowest priority, one step of the mission per tick: drive straight
+ *  until the wall is bumped (the governor slows down near it), rotate
+ *  counterclockwise until the right light bumper sees the wall, then
+ *  leave the robot to wallFollow.
+ */
+int wallMission(WallMission* m, const WallSensors* s, DriveCommand* command);
+
+/*
+ * Function: wallTick
+ *  Asks the four behaviors, highest priority first, as main.c's arbiter
+ *  does: every one is asked and the first to bid drives.
+ *
+ *  command: filled with the winning command, or a stop if nobody bid
+ *
+ *  Returns the index of the winner, -1 if nobody bid.
+ */
+int wallTick(WallMission* m, const WallSensors* s, DriveCommand* command);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * clock.c
+ *
+ * Monotonic or simulator driven time. See clock.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "clock.h"
+
+static SharedClock local;       // sleeper table when the clock is real
+static SharedClock driven;      // the clock clockDrive moves on
+static SharedClock* shared = NULL; // the simulator's or driven, when virtual
+static pthread_mutex_t locks[CLOCK_THREADS];
+static pthread_cond_t wakeups[CLOCK_THREADS];
+static __thread int self = -1;
+
+static void futex_wait(atomic_int* word, int value) {
+
+	// a short timeout covers a wake that slips in before the wait
+	struct timespec ts = { 0, 1000000 };
+	syscall(SYS_futex, word, FUTEX_WAIT, value, &ts, NULL, 0);
+
+}
+
+static void futex_wake(atomic_int* word) {
+
+	syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+
+}
+
+static struct timespec to_timespec(double when) {
+
+	struct timespec ts;
+	ts.tv_sec = (time_t) when;
+	ts.tv_nsec = (long) ((when - ts.tv_sec) * 1e9);
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return ts;
+
+}
+
+static void detach() {
+
+	atomic_store(&shared->attached, 0);
+	atomic_store(&shared->running, 0);
+	futex_wake(&shared->running);
+
+}
+
+int clockInit() {
+
+	pthread_condattr_t attr;
+	int i;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		pthread_mutex_init(&locks[i], NULL);
+		pthread_cond_init(&wakeups[i], &attr);
+	}
+	pthread_condattr_destroy(&attr);
+
+	char* path = getenv("CREATE_CLOCK");
+	if (path == NULL)
+		return 1;
+
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Clock: ERROR: cannot open %s\n", path);
+		return 0;
+	}
+
+	void* map = mmap(NULL, sizeof(SharedClock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Clock: ERROR: cannot map %s\n", path);
+		return 0;
+	}
+
+	shared = (SharedClock*) map;
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		atomic_store(&shared->state[i], SleeperFree);
+		atomic_store(&shared->pending[i], 0);
+	}
+	atomic_store(&shared->running, 1); // this thread
+	atomic_store(&shared->attached, 1);
+	atexit(detach);
+
+	return 1;
+
+}
+
+// Plays the simulator's part for clockDrive: whenever no thread is
+// running, on to the earliest wakeup and wake whoever it was
+static void* drive(void* arg) {
+
+	int i;
+
+	while (1) {
+		int running = atomic_load(&driven.running);
+		if (running > 0) {
+			futex_wait(&driven.running, running);
+			continue;
+		}
+
+		long long next = -1;
+		for (i = 0; i < CLOCK_THREADS; i++) {
+			if (atomic_load(&driven.state[i]) != SleeperAsleep)
+				continue;
+			long long wake = atomic_load(&driven.wake[i]);
+			if (next < 0 || wake < next)
+				next = wake;
+		}
+
+		// only an interrupt can end a sleep forever, or every thread
+		// is blocked on one that has yet to let go
+		if (next < 0 || next >= (long long) (CLOCK_FOREVER * 1e9)) {
+			futex_wait(&driven.running, 0);
+			continue;
+		}
+
+		if (next > atomic_load(&driven.now))
+			atomic_store(&driven.now, next);
+
+		for (i = 0; i < CLOCK_THREADS; i++) {
+			int expected = SleeperAsleep;
+
+			if (atomic_load(&driven.state[i]) != SleeperAsleep || atomic_load(&driven.wake[i]) > next)
+				continue;
+			if (atomic_compare_exchange_strong(&driven.state[i], &expected, SleeperWoken)) {
+				atomic_fetch_add(&driven.running, 1);
+				futex_wake(&driven.state[i]);
+			}
+		}
+	}
+
+	return NULL;
+
+}
+
+int clockDrive() {
+
+	pthread_t thread;
+	int i;
+
+	if (shared != NULL) {
+		fprintf(stderr, "Clock: ERROR: the simulator's clock is in use\n");
+		return 0;
+	}
+
+	// carries on from the real clock, so no time read so far is ahead
+	atomic_store(&driven.now, (long long) (clockNow() * 1e9));
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		atomic_store(&driven.state[i], i == self ? SleeperRunning : SleeperFree);
+		atomic_store(&driven.pending[i], 0);
+	}
+	atomic_store(&driven.running, 1); // this thread
+	atomic_store(&driven.attached, 1);
+	shared = &driven;
+
+	if (pthread_create(&thread, NULL, drive, NULL) != 0) {
+		fprintf(stderr, "Clock: ERROR: could not start the clock\n");
+		shared = NULL;
+		return 0;
+	}
+	pthread_detach(thread);
+
+	return 1;
+
+}
+
+int clockVirtual() {
+
+	return shared != NULL;
+
+}
+
+double clockNow() {
+
+	if (shared != NULL)
+		return atomic_load(&shared->now) / 1e9;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+int clockSelf() {
+
+	SharedClock* c = shared != NULL ? shared : &local;
+	int i;
+
+	if (self >= 0)
+		return self;
+
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		int expected = SleeperFree;
+		if (atomic_compare_exchange_strong(&c->state[i], &expected, SleeperRunning)) {
+			atomic_store(&c->pending[i], 0);
+			self = i;
+			return self;
+		}
+	}
+
+	fprintf(stderr, "Clock: ERROR: more than %d threads\n", CLOCK_THREADS);
+	exit(1);
+
+}
+
+static int sleep_virtual(int s, double when) {
+
+	if (atomic_exchange(&shared->pending[s], 0))
+		return 0;
+
+	// a nanosecond over, so clockNow() is not still short of when on
+	// waking after the round trip through integer nanoseconds
+	atomic_store(&shared->wake[s], (long long) ceil(when * 1e9) + 1);
+	atomic_store(&shared->state[s], SleeperAsleep);
+	if (atomic_fetch_sub(&shared->running, 1) == 1)
+		futex_wake(&shared->running); // the simulator can move time on
+
+	// an interrupt between the check above and going to sleep
+	if (atomic_load(&shared->pending[s])) {
+		int expected = SleeperAsleep;
+		if (atomic_compare_exchange_strong(&shared->state[s], &expected, SleeperWoken))
+			atomic_fetch_add(&shared->running, 1);
+	}
+
+	// whoever wakes the sleeper counts it as running again
+	while (atomic_load(&shared->state[s]) == SleeperAsleep)
+		futex_wait(&shared->state[s], SleeperAsleep);
+
+	atomic_store(&shared->state[s], SleeperRunning);
+	return !atomic_exchange(&shared->pending[s], 0);
+
+}
+
+int clockSleepUntil(double when) {
+
+	int s = clockSelf();
+	int interrupted;
+
+	if (shared != NULL)
+		return sleep_virtual(s, when);
+
+	struct timespec ts = to_timespec(when);
+
+	pthread_mutex_lock(&locks[s]);
+	while (!atomic_load(&local.pending[s]) && clockNow() < when)
+		pthread_cond_timedwait(&wakeups[s], &locks[s], &ts);
+	interrupted = atomic_exchange(&local.pending[s], 0);
+	pthread_mutex_unlock(&locks[s]);
+
+	return !interrupted;
+
+}
+
+void clockSleep(double seconds) {
+
+	clockSleepUntil(clockNow() + seconds);
+
+}
+
+void clockSpinUntil(double when) {
+
+	if (shared != NULL) {
+		clockSleepUntil(when);
+		return;
+	}
+
+	while (clockNow() < when)
+		;
+
+}
+
+void clockInterrupt(int sleeper) {
+
+	if (sleeper < 0)
+		return;
+
+	if (shared == NULL) {
+		pthread_mutex_lock(&locks[sleeper]);
+		atomic_store(&local.pending[sleeper], 1);
+		pthread_cond_signal(&wakeups[sleeper]);
+		pthread_mutex_unlock(&locks[sleeper]);
+		return;
+	}
+
+	atomic_store(&shared->pending[sleeper], 1);
+
+	int expected = SleeperAsleep;
+	if (atomic_compare_exchange_strong(&shared->state[sleeper], &expected, SleeperWoken)) {
+		atomic_fetch_add(&shared->running, 1);
+		futex_wake(&shared->state[sleeper]);
+	}
+
+}
+
+void clockSpawn() {
+
+	if (shared != NULL)
+		atomic_fetch_add(&shared->running, 1);
+
+}
+
+void clockExit() {
+
+	SharedClock* c = shared != NULL ? shared : &local;
+
+	if (self >= 0) {
+		atomic_store(&c->state[self], SleeperFree);
+		self = -1;
+	}
+
+	if (shared != NULL && atomic_fetch_sub(&shared->running, 1) == 1)
+		futex_wake(&shared->running);
+
+}
+
+void clockWrote(int bytes) {
+
+	if (shared != NULL)
+		atomic_fetch_add(&shared->written, bytes);
+
+}
+
+void clockRead(int bytes) {
+
+	if (shared != NULL)
+		atomic_fetch_add(&shared->read, bytes);
+
+}
+
+void clockBlock() {
+
+	if (shared != NULL && atomic_fetch_sub(&shared->running, 1) == 1)
+		futex_wake(&shared->running);
+
+}
+
+void clockUnblock() {
+
+	if (shared != NULL)
+		atomic_fetch_add(&shared->running, 1);
+
+}
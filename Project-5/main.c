@@ -1,17 +1,148 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "oi.h"
 #include "serial.h"
+#include "clock.h"
+#include "motion.h"
+#include "mission.h"
+#include "slip.h"
+#include "wheel.h"
+#include "safety.h"
+#include "shadow.h"
+#include "task.h"
+#include "pipeline.h"
+#include "realtime.h"
+#include "timed.h"
+#include "song.h"
+#include "notify.h"
 
 enum bool {false, true};
 typedef unsigned char byte;
 
 Serial* serial;
 
+#define SQUARE_SIDE     4.0  // ft
+#define STRAFE_SPACING  .5   // ft
+#define CONTROL_PERIOD  0.1  // seconds per tick of the event loop
+#define SHADOW_REFRESH  1.0  // s before an unchanged command is resent
+#define TELEMETRY_PERIOD 1.0 // seconds between progress lines
+#define CARD_THRESHOLD  150  // rise in the front left cliff signal over a card
+#define LOW_BATTERY     15   // percent of capacity left that counts as low
+
+#define PLAY_SLOT       SHADOW_SLOTS       // play (141) is not state, never shadowed
+#define OUTBOX_SLOTS    (SHADOW_SLOTS + 1)
+
+typedef struct {
+	unsigned int cliffSignal; // front left cliff signal (29)
+	byte button;
+	byte songPlaying;   // song playing (37)
+	unsigned int charge;   // battery charge (25), mAh
+	unsigned int capacity; // battery capacity (26), mAh
+	double traveled;    // mm along the plan
+	double heading;     // degrees turned since the start, counter-clockwise positive
+	double sampled;     // when the encoders below were read, s
+	short requested[2]; // left, right requested wheel velocity (41, 42), mm/s
+	unsigned short counts[2]; // left, right encoder counts (43, 44)
+	byte overcurrent;   // wheel overcurrents (14)
+	int wheels;         // slip monitor state
+	double measured[2]; // left, right wheel speed from the encoders, mm/s
+} Sensors;
+
+/*
+Commands handed from the control stage to the actuator stage when
+running as a pipeline. The newest command per shadow slot wins.
+*/
+typedef struct {
+	byte bytes[OUTBOX_SLOTS][SHADOW_MAX];
+	int length[OUTBOX_SLOTS];
+	unsigned version[OUTBOX_SLOTS]; // bumped on every send_command
+} Outbox;
+
+Sensors sensors;
+CardDetector cards;  // front left cliff signal
+EventLoop loop;
+MotionPlan plan;
+short planVelocity;  // last velocity commanded along the plan
+int stuck = false;   // the plan was abandoned
+int reportedWheels = WheelsOK;
+
+SlipMonitor slip;
+Safety safety;
+Shadow shadow;
+int safetyStopsSeen; // supervisor stops the shadow knows about
+
+Pipeline pipeline;
+int pipelined = false;           // sensor, control and actuator on their own threads
+Outbox outbox;                   // written by the control stage
+unsigned emitted[OUTBOX_SLOTS];  // outbox versions the actuator stage has sent
+
+RealTime rt;
+TimedQueue timed;
+SongManager songs;
+
+// played when the search is finished
+const byte victoryNotes[] = {
+	43, 35,   // n1
+	43, 35,   // n2
+	43, 35,   // n3
+	39, 25,   // n4
+	46, 15,   // n5
+	43, 35,   // n6
+	39, 25,   // n7
+	46, 15,   // n8
+	43, 75,   // n9
+	50, 35,   // n10
+	50, 35,   // n11
+	50, 35,   // n12
+	39, 155,  // n13
+	46, 15,   // n14
+	43, 75,   // n15
+};
+const Song victory = { "victory", victoryNotes, sizeof(victoryNotes) / 2 };
+
+// played when a card is found
+const byte cardNotes[] = { 84, 8, 88, 8 };
+const Song cardTone = { "card", cardNotes, sizeof(cardNotes) / 2 };
+
+// played when the battery runs low
+const byte batteryNotes[] = { 40, 16, 36, 32 };
+const Song batteryTone = { "battery", batteryNotes, sizeof(batteryNotes) / 2 };
+
+Notifier notifier;
+LedState missionLeds = { 0, 255 }; // clean led red
+int batteryWarned = false;
+
+// power led flashes green three times
+const NotifyStep cardSteps[] = {
+	{ 0.15, 0, 0, 0 }, { 0.15, 0, 0, NotifyKeep },
+	{ 0.15, 0, 0, 0 }, { 0.15, 0, 0, NotifyKeep },
+	{ 0.15, 0, 0, 0 }, { 0.15, 0, 0, NotifyKeep },
+};
+const NotifyPattern cardFound = { "card found", cardSteps, 6, &cardTone };
+
+// check robot led (0x08) on for a second
+const NotifyStep wheelSteps[] = {
+	{ 1.0, 0x08, 0, NotifyKeep },
+};
+const NotifyPattern wheelTrouble = { "wheel trouble", wheelSteps, 1, NULL };
+
+// check robot led blinks slowly with the power led full red
+const NotifyStep batterySteps[] = {
+	{ 0.5, 0x08, 0, 255 }, { 0.5, 0, 0x08, 255 },
+	{ 0.5, 0x08, 0, 255 }, { 0.5, 0, 0x08, 255 },
+};
+const NotifyPattern lowBattery = { "low battery", batterySteps, 4, &batteryTone };
+
+WheelLoop wheelLoop;
+int wheelLoopEnabled = false; // on when a gains file is given
+double lastWheelCommand;      // time of the last wheel loop command
+
 void send_byte(byte b) {
 
 	serialSend(serial, b);
@@ -21,18 +152,90 @@ void send_byte(byte b) {
 byte get_byte() {
 
 	byte c;
-	usleep(15000); // wait 15ms to read
-	               // From Roomba Open Interface (OI) Specification
 
 	// if there is no waiting byte, wait
-	while ( serialNumBytesWaiting(serial) == 0 )
-		usleep(15000);
+	serialAwait(serial, 1, 0);
 
 	serialGetChar(serial, &c);
 	return c;
 
 }
 
+/*
+Reads a multi-byte response once all of it has arrived. Timed commands
+go out while it waits, the port is only held for the query.
+*/
+void get_bytes(byte* buf, int count) {
+
+	int i;
+	serialAwait(serial, count, 0);
+
+	for (i = 0; i < count; i++)
+		serialGetChar(serial, &buf[i]);
+
+}
+
+double now_seconds() {
+
+	return clockNow();
+
+}
+
+/*
+Sends a command that sets actuator state (drive, LEDs, motors, songs)
+unless the shadow says the robot already has it. A drive is filtered by
+the safety supervisor here, holding the port, however late it goes out.
+*/
+void emit_command(int slot, const byte* command, int length) {
+
+	byte safe[SHADOW_MAX];
+	int i;
+
+	serialCommandLock(serial);
+
+	if (length <= SHADOW_MAX) {
+		memcpy(safe, command, length);
+		safetyFilterCommand(&safety, safe, length);
+		command = safe;
+	}
+
+	// a safety stop changed the drive state behind our back
+	if (safety.stops != safetyStopsSeen) {
+		shadowInvalidate(&shadow, ShadowDrive);
+		safetyStopsSeen = safety.stops;
+	}
+
+	if (shadowCheck(&shadow, slot, command, length, now_seconds())) {
+		for (i = 0; i < length; i++)
+			send_byte( command[i] );
+	}
+
+	serialCommandUnlock(serial);
+
+}
+
+/*
+Sends a command straight away, or when running as a pipeline leaves it
+for the actuator stage.
+*/
+void send_command(int slot, const byte* command, int length) {
+
+	if (!pipelined) {
+		emit_command(slot, command, length);
+		return;
+	}
+
+	if (length > SHADOW_MAX) {
+		fprintf(stderr, "Outbox: ERROR: %d byte command does not fit\n", length);
+		return;
+	}
+
+	memcpy(outbox.bytes[slot], command, length);
+	outbox.length[slot] = length;
+	outbox.version[slot]++;
+
+}
+
 void start(byte state) {
 
 	serial = (Serial*)malloc(sizeof(Serial));
@@ -41,15 +244,26 @@ void start(byte state) {
 	serialClose(serial);
 
 	// constant B115200 comes from termios.h
-	serialOpen(serial, "/dev/ttyUSB0", B115200, false);
+	// CREATE_DEVICE points the program at another port, e.g. the simulator,
+	// CREATE_REPLAY at a capture to play back instead of the robot
+	char* device = getenv("CREATE_DEVICE");
+	char* replay = getenv("CREATE_REPLAY");
+	if (replay != NULL)
+		serialOpenReplay(serial, replay, getenv("CREATE_REPLAY_FAST") != NULL);
+	else
+		serialOpen(serial, device != NULL ? device : "/dev/ttyUSB0", B115200, false);
+
+	// CREATE_CAPTURE records the session for replay
+	char* capture = getenv("CREATE_CAPTURE");
+	if (capture != NULL && !serialRecord(serial, capture))
+		exit(1);
+
 	send_byte( CmdStart );	// Send Start
 	send_byte( state );	// Send state
 
 	// turn off any motors
-	send_byte( CmdMotors );
-	send_byte( 0 );
-	send_byte( 0 );
-	send_byte( 0 );
+	byte motors[] = { CmdMotors, 0, 0, 0 };
+	send_command(ShadowMotors, motors, sizeof(motors));
 
 	// clear out any bites from previous runs
 	while( serialNumBytesWaiting(serial) > 0 )
@@ -57,29 +271,11 @@ void start(byte state) {
 
 }
 
-unsigned char get_bump() {
-
-	send_byte( CmdSensors );
-	send_byte( SenBumpDrop ); //bumps and wheel drops
-
-	return get_byte() & BmpBoth; //discard wheel drops
-
-}
-
-unsigned char get_button() {
-
-	send_byte( CmdSensors );
-	send_byte( SenButton );
-	return get_byte();
-
-}
-
 void set_led(byte ledBits, byte pwrLedColor) {
 
-	send_byte( CmdLeds );
-	send_byte( ledBits );
-	send_byte( pwrLedColor );
-	send_byte( 255 ); // set intensity high
+	byte command[] = { CmdLeds, ledBits, pwrLedColor, 255 }; // set intensity high
+
+	send_command(ShadowLeds, command, sizeof(command));
 
 }
 
@@ -95,6 +291,8 @@ int get_distance() {
 
 	int distance = 0;
 
+	serialLock(serial);
+
 	send_byte( CmdSensors );
 	send_byte( 19 );
 
@@ -102,6 +300,8 @@ int get_distance() {
 	distance = distance << 8;
 	distance += get_byte();
 
+	serialUnlock(serial);
+
 	return distance;
 
 }
@@ -116,6 +316,8 @@ int get_angle() {
 
 	// Potential problem [The value returned must be divided by 0.324056 to get degrees]
 
+	serialLock(serial);
+
 	send_byte( CmdSensors );
 	send_byte( 20 );
 
@@ -123,12 +325,16 @@ int get_angle() {
 	value = value << 8;
 	value += get_byte();
 
+	serialUnlock(serial);
+
 	return value;
 
 }
 
 unsigned int get_cliff_front_left() {
 
+	serialLock(serial);
+
 	send_byte( CmdSensors );
 	send_byte( 29 );
 
@@ -136,75 +342,95 @@ unsigned int get_cliff_front_left() {
 	signalValue = signalValue << 8;
 	signalValue += get_byte();
 
+	serialUnlock(serial);
+
 	return signalValue;
 
 }
 
-void playSong() {
-
-	// song opcode
-	send_byte( 140 );
-
-	// set song track to 0
-	send_byte( 0 );
-
-	//send length in notes
-	send_byte( 15 );
-
-	send_byte( 43 ); // n1
-	send_byte( 35 );
+/*
+Reads everything the tasks need with one Query List: front left cliff
+signal (29), button (18), distance (19), angle (20), wheel overcurrents (14),
+requested wheel velocities (41, 42), encoder counts (43, 44), song
+playing (37) and battery charge and capacity (25, 26). Accumulates distance and angle into s.
+*/
+void sense_into(Sensors* s) {
 
-	send_byte( 43 ); // n2
-	send_byte( 35 );
+	byte b[21];
 
-	send_byte( 43 ); // n3
-	send_byte( 35 );
+	serialLock(serial);
 
-	send_byte( 39 ); // n4
+	send_byte( CmdSensorList );
+	send_byte( 12 );
+	send_byte( 29 );
+	send_byte( SenButton );
+	send_byte( 19 );
+	send_byte( 20 );
+	send_byte( 14 );
+	send_byte( 41 );
+	send_byte( 42 );
+	send_byte( 43 );
+	send_byte( 44 );
+	send_byte( 37 );
 	send_byte( 25 );
+	send_byte( 26 );
 
-	send_byte( 46 ); // n5
-	send_byte( 15 );
+	get_bytes(b, 21);
 
-	send_byte( 43 ); // n6
-	send_byte( 35 );
+	serialUnlock(serial);
 
-	send_byte( 39 ); // n7
-	send_byte( 25 );
+	s->cliffSignal = (b[0] << 8) | b[1];
+	s->button = b[2];
+	s->traveled += (short) ((b[3] << 8) | b[4]);
+	s->heading += (short) ((b[5] << 8) | b[6]);
 
-	send_byte( 46 ); // n8
-	send_byte( 15 );
+	s->sampled = now_seconds();
+	s->overcurrent = b[7];
+	s->requested[1] = (b[8] << 8) | b[9];
+	s->requested[0] = (b[10] << 8) | b[11];
+	s->counts[0] = (b[12] << 8) | b[13];
+	s->counts[1] = (b[14] << 8) | b[15];
+	s->songPlaying = b[16];
+	s->charge = (b[17] << 8) | b[18];
+	s->capacity = (b[19] << 8) | b[20];
 
-	send_byte( 43 ); // n9
-	send_byte( 75 );
-
-	send_byte( 50 ); // n10
-	send_byte( 35 );
+}
 
-	send_byte( 50 ); // n11
-	send_byte( 35 );
+/*
+Feeds the newest encoder counts to the slip monitor, once per tick. Read
+more often, the counts would repeat within one robot sensor update and
+look like stalled wheels.
+*/
+void check_wheels(Sensors* s) {
 
-	send_byte( 50 ); // n12
-	send_byte( 35 );
+	s->wheels = slipUpdate(&slip, s->sampled, s->requested[0], s->requested[1],
+		s->counts[0], s->counts[1], s->overcurrent);
+	s->measured[0] = slip.measured[0];
+	s->measured[1] = slip.measured[1];
 
-	send_byte( 39 ); // n13
-	send_byte( 155 );
+}
 
-	send_byte( 46 ); // n14
-	send_byte( 15 );
+// Runs once at the top of every tick
+void sense() {
 
-	send_byte( 43 ); // n15
-	send_byte( 75 );
+	sense_into(&sensors);
+	check_wheels(&sensors);
 
-	usleep(100000);
+}
 
-	// play song opcode
-	send_byte( 141 );
+/*
+Song manager output. Uploads and plays due now go out like any other
+command, a play that has to wait for its upload goes on the timed queue.
+*/
+void song_send(const byte* command, int length, double when) {
 
-	// select song track to play
-	send_byte( 0 );
+	// uploads are shadowed per song slot, plays always go out
+	int slot = command[0] == 140 ? ShadowSong + command[1] : PLAY_SLOT;
 
-	usleep(5000000);
+	if (when <= now_seconds())
+		send_command(slot, command, length);
+	else
+		timedSchedule(&timed, when, slot, command, length);
 
 }
 
@@ -221,11 +447,29 @@ void drive(short leftWheelVelocity, short rightWheelVelocity) {
 	byte right_low = rightWheelVelocity;
 	byte right_high = rightWheelVelocity >> 8;
 
-	send_byte( CmdDriveWheels );
-	send_byte( right_high );
-	send_byte( right_low );
-	send_byte( left_high );
-	send_byte( left_low );
+	byte command[] = { CmdDriveWheels, right_high, right_low, left_high, left_low };
+	send_command(ShadowDrive, command, sizeof(command));
+
+}
+
+/*
+Enables robot to drive directly angularly
+using the sign and value of both the velocity values and the radius
+positve wheelVelocity moves robot forward
+negative wheelVelocity moves robot in reverse
+positve radius turns robot left
+negative radius turns robot right
+*/
+void angular_drive(short wheelVelocity, short radius) {
+
+	byte wheel_low = wheelVelocity; // cast short to byte (discard high byte)
+	byte wheel_high = wheelVelocity >> 8; // bitwise shift high to low to save high byte
+
+	byte radius_low = radius;
+	byte radius_high = radius >> 8;
+
+	byte command[] = { CmdDrive, wheel_high, wheel_low, radius_high, radius_low };
+	send_command(ShadowDrive, command, sizeof(command));
 
 }
 
@@ -235,140 +479,318 @@ double get_mm(double feet) {
 }
 
 /*
-takes in distance(feet)
-drives that distance
+Sends a drive command for the plan. With the wheel loop on, it is converted
+to wheel velocities and trimmed from the wheel speeds the slip monitor measured in check_wheels();
+otherwise the robot's own velocity controller is trusted.
 */
-void drive_distance(double distance_in_feet, byte *b) {
-	
-	unsigned int i = get_cliff_front_left();
-	int prev_i = 0;
-	int threshold = 150;
-	int i_diff = 0;
-
-	if (! (*b)) {
-
-		usleep(100000);
-
-		int distance_traveled = 0;
-		int distance_in_mm = (int) get_mm(distance_in_feet);
-
-		// clear garbage value
-		get_distance();
-
-		// begin driving
-		drive(100, 100);
-
-		// until distance is reached or btn is pressed, drive
-		while ( (distance_traveled < distance_in_mm) && (*b == 0) ) {
-
-			// update dist
-			distance_traveled += get_distance();
-			if (distance_traveled >= distance_in_mm) {
-				drive(0, 0);
-				break;
-			}
-
-			// check for card
-			prev_i = i;
-			i = get_cliff_front_left();
-			i_diff = i - prev_i;
-
-			// update dist
-			distance_traveled += get_distance();
-			if (distance_traveled >= distance_in_mm) {
-				drive(0, 0);
-				break;
-			}
-
-			// if found toggle light
-			if (i_diff > threshold) {
-				set_led(0, 0);
-			} else {
-				set_led(0, 255);
-			}
-
-			// update dist
-			distance_traveled += get_distance();
-			if (distance_traveled >= distance_in_mm) {
-				drive(0, 0);
-				break;
-			}
-
-
-			*b = get_button();
-			// update dist
-			distance_traveled += get_distance();
-			if (distance_traveled >= distance_in_mm) {
-				drive(0, 0);
-				break;
-			}
+void plan_drive(short velocity, short radius) {
 
-		}
+	double targetLeft, targetRight;
+	short left, right;
+	double now = now_seconds();
 
-		// stop
-		drive(0, 0);
+	if (!wheelLoopEnabled) {
+		angular_drive(velocity, radius);
+		return;
+	}
 
-		// kill inertia
-		usleep(100000);
+	motionWheels(velocity, radius, &targetLeft, &targetRight);
+	wheelCommand(&wheelLoop, now - lastWheelCommand, targetLeft, targetRight,
+		sensors.measured[0], sensors.measured[1], &left, &right);
+	lastWheelCommand = now;
 
+	drive(left, right);
+
+}
+
+/*
+One tick of driving along the plan, tracking progress with the distance
+sensor. Corners are taken as arcs without stopping.
+Returns true once the plan is finished or abandoned.
+*/
+int follow_plan() {
+
+	short radius;
+
+	if (sensors.wheels & RobotStuck) {
+		printf("Stuck at %.0f mm of %.0f mm, giving up\n", sensors.traveled, plan.length);
+		stuck = true;
+		return true;
 	}
 
+	// look ahead by the distance covered before the next command goes out
+	if (!missionFollow(&plan, sensors.traveled, CONTROL_PERIOD, &planVelocity, &radius))
+		return true;
+
+	plan_drive(planVelocity, radius);
+	return false;
+
 }
 
-//1845685.68398
-void rotateLeft(byte *b) {
+/*
+Tasks, run in this order on every tick of the loop.
+*/
+
+// if button is pushed end program
+int button_stop(Task* t) {
+
+	TASK_BEGIN(t);
+
+	TASK_AWAIT(t, sensors.button != 0);
+	printf("Button pressed, stopping\n");
+	loopStop(&loop);
+
+	TASK_END(t);
 
-	if (!(*b)) {
-		drive(-100, 100);
-		usleep(1585000);
-		drive(0, 0);
+}
+
+int song_update(Task* t) {
+
+	songUpdate(&songs, sensors.songPlaying, t->now);
+	return TaskWaiting;
+
+}
+
+// a card under the front left cliff sensor flashes the power led
+int card_check(Task* t) {
+
+	if (missionCardCheck(&cards, sensors.cliffSignal)) {
+		printf("Card: found at %.2f s\n", t->now - loop.start);
+		notifyFire(&notifier, NotifyCardFound);
 	}
 
+	return TaskWaiting;
+
+}
+
+int search_mission(Task* t) {
+
+	TASK_BEGIN(t);
+
+	TASK_AWAIT(t, follow_plan());
+	drive(0, 0);
+
+	// no song if the search could not be finished
+	if (stuck)
+		TASK_EXIT(t);
+
+	// wait out a card tone, then play until the song playing flag drops
+	TASK_AWAIT(t, songPlay(&songs, &victory, t->now));
+	TASK_AWAIT(t, !songBusy(&songs));
+
+	TASK_END(t);
+
 }
 
-//1845685.68398
-void rotateRight(byte *b) {
+int telemetry(Task* t) {
+
+	if (sensors.wheels != reportedWheels) {
+		printf("Wheels: %s%s%s%s at %.0f mm (left %.0f, right %.0f mm/s)\n",
+			sensors.wheels == WheelsOK ? "ok" : "",
+			sensors.wheels & WheelSlip ? "slip " : "",
+			sensors.wheels & WheelStall ? "stall " : "",
+			sensors.wheels & RobotStuck ? "stuck " : "",
+			sensors.traveled, sensors.measured[0], sensors.measured[1]);
+		reportedWheels = sensors.wheels;
 
-	if (!(*b)) {
-		drive(100, -100);
-		usleep(1585000);
-		drive(0, 0);
+		if (sensors.wheels & (WheelSlip | WheelStall))
+			notifyFire(&notifier, NotifyWheels);
 	}
 
+	if (!batteryWarned && sensors.capacity > 0
+		&& sensors.charge * 100 < sensors.capacity * LOW_BATTERY) {
+		printf("Battery: %u of %u mAh left\n", sensors.charge, sensors.capacity);
+		notifyFire(&notifier, NotifyLowBattery);
+		batteryWarned = true;
+	}
+
+	TASK_BEGIN(t);
+
+	for (;;) {
+		TASK_SLEEP(t, TELEMETRY_PERIOD);
+		printf("%5.1f s: %.0f of %.0f mm at %d mm/s, heading %.0f deg\n", t->now - loop.start,
+			sensors.traveled, plan.length, planVelocity, sensors.heading);
+	}
+
+	TASK_END(t);
+
+}
+
+// Last task of the tick: the one LED command, mission state plus notifications
+int show_leds(Task* t) {
+
+	LedState leds;
+
+	notifyTick(&notifier, t->now, &missionLeds, &leds);
+	set_led(leds.leds, leds.color);
+
+	return TaskWaiting;
+
+}
+
+/*
+Pipeline stages. The sensor stage keeps its own Sensors between runs,
+the control stage runs one tick of the loop on the newest copy.
+*/
+void sense_stage(void* snapshot) {
+
+	sense_into((Sensors*) snapshot);
+
+}
+
+int control_stage(const void* snapshot, void* commands) {
+
+	memcpy(&sensors, snapshot, sizeof(Sensors));
+	check_wheels(&sensors);
+	int more = loopTick(&loop, search_mission);
+	memcpy(commands, &outbox, sizeof(Outbox));
+
+	return more;
+
+}
+
+void actuate_stage(const void* commands) {
+
+	const Outbox* out = (const Outbox*) commands;
+	int slot;
+
+	for (slot = 0; slot < OUTBOX_SLOTS; slot++) {
+		if (out->version[slot] != emitted[slot]) {
+			emit_command(slot, out->bytes[slot], out->length[slot]);
+			emitted[slot] = out->version[slot];
+		}
+	}
+
+}
+
+// Real-time settings for each pipeline thread, the serial ones first
+void stage_start(int stage) {
+
+	if (stage == StageSensor)
+		rtCurrentThread(&rt, "sensor", RT_PRIORITY_IO, rt.ioCpu);
+	else if (stage == StageActuator)
+		rtCurrentThread(&rt, "actuator", RT_PRIORITY_IO, rt.ioCpu);
+	else
+		rtCurrentThread(&rt, "control", RT_PRIORITY_CONTROL, rt.controlCpu);
+
 }
 
 int main(int args, char** argv) {
 
-	byte btn = 0;
-	int h_dist = 0;
+	Waypoint path[MOTION_MAX_SEGMENTS];
+	MotionLimits limits;
+	limits.maxSpeed = 250;    // mm/s
+	limits.minSpeed = 20;     // mm/s
+	limits.maxAccel = 300;    // mm/s^2
+	limits.maxLatAccel = 250; // mm/s^2
+	limits.turnRadius = 150;  // mm
+
+	int count = missionStrafe(path, get_mm(SQUARE_SIDE), get_mm(STRAFE_SPACING));
+	if (!motionPlan(&plan, path, count, &limits))
+		return 1;
+
+	printf("Search: %.0f mm in %d segments, about %.1f s\n", plan.length, plan.count, motionDuration(&plan));
+
+	// optional sensor/control/actuator threads, real-time scheduling and
+	// wheel velocity loop, e.g. ./create2 --pipeline --realtime=2,3 wheel.gains
+	int i;
+	rtInit(&rt);
+	for (i = 1; i < args; i++) {
+		if (strcmp(argv[i], "--pipeline") == 0) {
+			pipelined = true;
+			continue;
+		}
+
+		int option = rtParse(&rt, argv[i]);
+		if (option < 0)
+			return 1;
+		if (option)
+			continue;
+
+		WheelGains gains;
+		wheelDefaultGains(&gains);
+		if (!wheelLoadGains(&gains, argv[i]))
+			return 1;
+		wheelInit(&wheelLoop, &gains);
+		wheelLoopEnabled = true;
+	}
+
+	shadowInit(&shadow, SHADOW_REFRESH);
+
+	// CREATE_CLOCK runs the mission on the simulator's time
+	if (!clockInit())
+		return 1;
+
+	// before any thread starts, so their stacks are locked too
+	rtLockMemory(&rt);
 
 	start(CmdFull); //full mode
-	set_led(0, 255); // init clean led to red
-
-	// SETUP
-	drive_distance(2, &btn);
-	rotateLeft(&btn);
-	drive_distance(2, &btn);
-	rotateLeft(&btn);
-	// END SETUP
-
-	// BEGIN SEARCH (STRAFE METHOD)
-	while (!btn && h_dist < 4) {
-		drive_distance(4, &btn);
-		rotateLeft(&btn);
-		drive_distance(.5, &btn);
-		rotateLeft(&btn);
-		drive_distance(4, &btn);
-		rotateRight(&btn);
-		drive_distance(.5, &btn);
-		rotateRight(&btn);
-		h_dist++;
+
+	// Full mode has no cliff or wheel drop protection of its own
+	if (!safetyStart(&safety, serial))
+		return 1;
+	rtThread(&rt, safety.thread, "safety", RT_PRIORITY_SAFETY, rt.ioCpu);
+
+	if (!timedStart(&timed, emit_command))
+		return 1;
+	rtThread(&rt, timed.thread, "emitter", RT_PRIORITY_IO, rt.ioCpu);
+	songInit(&songs, song_send);
+
+	notifyInit(&notifier, &songs);
+	notifySet(&notifier, NotifyCardFound, &cardFound);
+	notifySet(&notifier, NotifyWheels, &wheelTrouble);
+	notifySet(&notifier, NotifyLowBattery, &lowBattery);
+
+	set_led(missionLeds.leds, missionLeds.color); // init clean led to red
+
+	// clear garbage values
+	get_distance();
+	get_angle();
+	missionCardInit(&cards, CARD_THRESHOLD, get_cliff_front_left());
+	slipInit(&slip);
+	wheelReset(&wheelLoop);
+	lastWheelCommand = now_seconds();
+
+	loopInit(&loop, CONTROL_PERIOD, pipelined ? NULL : sense);
+	loopAdd(&loop, "button", button_stop);
+	loopAdd(&loop, "songs", song_update);
+	loopAdd(&loop, "card", card_check);
+	loopAdd(&loop, "search", search_mission);
+	loopAdd(&loop, "telemetry", telemetry);
+	loopAdd(&loop, "leds", show_leds);
+
+	if (pipelined) {
+		if (!pipelineInit(&pipeline, sizeof(Sensors), sizeof(Outbox), CONTROL_PERIOD,
+				sense_stage, control_stage, actuate_stage)) {
+			stuck = true;
+		} else {
+			pipeline.threadStart = stage_start;
+			if (!pipelineRun(&pipeline))
+				stuck = true;
+		}
+		pipelined = false; // everything from here on goes out directly
+	} else {
+		rtCurrentThread(&rt, "control", RT_PRIORITY_CONTROL, rt.controlCpu);
+		loopRun(&loop, search_mission);
 	}
-	// END SEARCH
 
-	playSong();
+	drive(0, 0);
+	timedStop(&timed);
+	safetyStop(&safety);
+	if (pipeline.work[0] != NULL) {
+		pipelinePrint(&pipeline);
+		pipelineFree(&pipeline);
+	} else {
+		printf("Loop: %ld ticks, %ld overran the %.0f ms period, worst wakeup %.2f ms late\n",
+			loop.ticks, loop.overruns, CONTROL_PERIOD * 1000, loop.maxLate * 1000);
+	}
+	rtReport(&rt);
+	songPrint(&songs);
+	printf("Notify: %ld events fired, %ld patterns shown\n", notifier.fired, notifier.shown);
+	printf("Commands: %ld bytes sent, %ld redundant bytes dropped\n",
+		shadow.sentBytes, shadow.suppressedBytes);
 
 	send_byte(CmdPwrDwn);
-	return 0;
+	return stuck ? 1 : 0;
 
 }
@@ -0,0 +1,59 @@
+/*
+ * mission.c
+ *
+ * Card search decisions. See mission.h.
+ */
+
+#include "oi.h"
+#include "mission.h"
+
+int missionStrafe(Waypoint* path, double side, double spacing) {
+
+	double half = side / 2;
+	double x = half;
+	double y = half;
+	int n = 0;
+
+	// SETUP
+	path[n].x = 0;     path[n++].y = 0;
+	path[n].x = half;  path[n++].y = 0;
+	path[n].x = half;  path[n++].y = half;
+
+	// SEARCH (STRAFE METHOD)
+	while (n + 2 <= MOTION_MAX_SEGMENTS) {
+		x = -x;
+		path[n].x = x; path[n++].y = y;
+		y -= spacing;
+		if (y < -half)
+			y = -half;
+		path[n].x = x; path[n++].y = y;
+		if (y <= -half + 1e-6)
+			break;
+	}
+
+	return n;
+
+}
+
+int missionFollow(const MotionPlan* plan, double traveled, double period, short* velocity, short* radius) {
+
+	*radius = RadStraight;
+	return motionCommand(plan, traveled + *velocity * period, velocity, radius);
+
+}
+
+void missionCardInit(CardDetector* d, int threshold, unsigned int signal) {
+
+	d->threshold = threshold;
+	d->last = signal;
+
+}
+
+int missionCardCheck(CardDetector* d, unsigned int signal) {
+
+	int diff = (int) signal - (int) d->last;
+	d->last = signal;
+
+	return diff > d->threshold;
+
+}
@@ -0,0 +1,60 @@
+/*
+ * mission.h
+ *
+ * The decisions of the card search, apart from the serial port: the
+ * strafe path, the next drive command along the plan from the distance
+ * traveled, and a card in the front left cliff signal. main.c makes
+ * them on the robot's sensors; the simulators in Bench make the same
+ * ones on simulated sensors.
+ */
+
+#ifndef INCLUDE_MISSION_H
+#define INCLUDE_MISSION_H
+
+#include "motion.h"
+
+typedef struct
+{
+	int threshold;          // rise in the signal that is a card
+	unsigned int last;      // signal at the last check
+}
+CardDetector;
+
+/*
+ * Function: missionStrafe
+ *  Waypoints of the strafe search in mm, starting in the center facing
+ *  +x. Setup drives to a corner of the square, then the search sweeps
+ *  back and forth across it, stepping over by spacing at the end of
+ *  every sweep, until a step reaches the far side.
+ *
+ *  side, spacing: mm
+ *
+ *  Returns the number of waypoints.
+ */
+int missionStrafe(Waypoint* path, double side, double spacing);
+
+/*
+ * Function: missionFollow
+ *  Next drive command along the plan, looking ahead by the distance the
+ *  last velocity covers in period s, until the next command goes out.
+ *
+ *  velocity: the last velocity commanded, replaced by the next one
+ *
+ *  Returns 0 once the plan is finished.
+ */
+int missionFollow(const MotionPlan* plan, double traveled, double period, short* velocity, short* radius);
+
+/*
+ * Function: missionCardInit
+ *  Starts watching a cliff signal for cards from its current value.
+ */
+void missionCardInit(CardDetector* d, int threshold, unsigned int signal);
+
+/*
+ * Function: missionCardCheck
+ *  Returns true if the signal rose by more than the threshold since the
+ *  last check, going from the floor onto a card.
+ */
+int missionCardCheck(CardDetector* d, unsigned int signal);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * notify.c
+ *
+ * LED and tone patterns for mission events. See notify.h.
+ */
+
+#include <stdio.h>
+
+#include "notify.h"
+
+void notifyInit(Notifier* n, SongManager* songs) {
+
+	int i;
+
+	for (i = 0; i < NOTIFY_EVENTS; i++)
+		n->patterns[i] = NULL;
+
+	n->songs = songs;
+	n->pending = 0;
+	n->active = NULL;
+	n->step = 0;
+	n->stepEnd = 0;
+	n->fired = 0;
+	n->shown = 0;
+
+}
+
+void notifySet(Notifier* n, int event, const NotifyPattern* pattern) {
+
+	if (event < 0 || event >= NOTIFY_EVENTS) {
+		fprintf(stderr, "Notify: ERROR: no event %d\n", event);
+		return;
+	}
+
+	if (pattern != NULL && pattern->count < 1) {
+		fprintf(stderr, "Notify: ERROR: %s has no steps\n", pattern->name);
+		return;
+	}
+
+	n->patterns[event] = pattern;
+
+}
+
+void notifyFire(Notifier* n, int event) {
+
+	if (event < 0 || event >= NOTIFY_EVENTS || n->patterns[event] == NULL)
+		return;
+
+	if (n->pending & (1u << event))
+		return;
+
+	n->pending |= 1u << event;
+	n->fired++;
+
+}
+
+static void start_next(Notifier* n, double now) {
+
+	int i;
+
+	n->active = NULL;
+
+	for (i = 0; i < NOTIFY_EVENTS; i++) {
+		if (n->pending & (1u << i)) {
+			n->pending &= ~(1u << i);
+			n->active = n->patterns[i];
+			break;
+		}
+	}
+
+	if (n->active == NULL)
+		return;
+
+	n->step = 0;
+	n->stepEnd = now + n->active->steps[0].duration;
+	n->shown++;
+
+	// skipped if a song is already playing, the LEDs still show
+	if (n->active->tone != NULL && n->songs != NULL)
+		songPlay(n->songs, n->active->tone, now);
+
+}
+
+void notifyTick(Notifier* n, double now, const LedState* mission, LedState* out) {
+
+	*out = *mission;
+
+	if (n->active != NULL) {
+		while (now >= n->stepEnd) {
+			if (++n->step >= n->active->count) {
+				n->active = NULL;
+				break;
+			}
+			n->stepEnd += n->active->steps[n->step].duration;
+		}
+	}
+
+	if (n->active == NULL) {
+		if (n->pending == 0)
+			return;
+		start_next(n, now);
+	}
+
+	const NotifyStep* s = &n->active->steps[n->step];
+	out->leds = (mission->leds & ~s->off) | s->on;
+	if (s->color != NotifyKeep)
+		out->color = s->color;
+
+}
@@ -0,0 +1,94 @@
+/*
+ * notify.h
+ *
+ * Notification engine. The mission fires an event ("card found",
+ * "low battery", ...) and carries on; the engine plays the event's LED
+ * pattern and tone on its own timeline. Every tick it merges the
+ * pattern with the LED state the mission wants and hands back one LED
+ * state, so at most one LED command goes out per tick.
+ */
+
+#ifndef INCLUDE_NOTIFY_H
+#define INCLUDE_NOTIFY_H
+
+#include "song.h"
+
+// Events, a lower number wins when several are waiting
+#define NotifyLowBattery  0
+#define NotifyWheels      1 // slip or stall
+#define NotifyCardFound   2
+#define NOTIFY_EVENTS     3
+
+#define NotifyKeep        -1 // leave the mission's power LED color alone
+
+typedef struct
+{
+	unsigned char leds;  // LED bits (139)
+	unsigned char color; // power LED color, 0 green to 255 red
+}
+LedState;
+
+typedef struct
+{
+	double duration;     // s
+	unsigned char on;    // LED bits forced on
+	unsigned char off;   // LED bits forced off
+	short color;         // power LED color, or NotifyKeep
+}
+NotifyStep;
+
+typedef struct
+{
+	const char* name;
+	const NotifyStep* steps;
+	int count;
+	const Song* tone;    // played as the pattern starts, NULL for none
+}
+NotifyPattern;
+
+typedef struct
+{
+	const NotifyPattern* patterns[NOTIFY_EVENTS];
+	SongManager* songs;  // NULL for LEDs only
+	unsigned pending;    // a bit per fired event not yet shown
+
+	const NotifyPattern* active;
+	int step;
+	double stepEnd;      // s
+
+	long fired;
+	long shown;
+}
+Notifier;
+
+/*
+ * Function: notifyInit
+ *  Starts with no patterns.
+ *
+ *  songs: song manager for the tones, may be NULL
+ */
+void notifyInit(Notifier* n, SongManager* songs);
+
+/*
+ * Function: notifySet
+ *  Sets the pattern shown for an event.
+ */
+void notifySet(Notifier* n, int event, const NotifyPattern* pattern);
+
+/*
+ * Function: notifyFire
+ *  Records an event and returns straight away. Firing an event that
+ *  is already waiting does nothing.
+ */
+void notifyFire(Notifier* n, int event);
+
+/*
+ * Function: notifyTick
+ *  Advances the patterns, call once per tick.
+ *
+ *  mission: the LED state the mission wants
+ *  out: filled with the LED state to send
+ */
+void notifyTick(Notifier* n, double now, const LedState* mission, LedState* out);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * pipeline.c
+ *
+ * Sensor, control and actuator threads joined by seqlocks. See pipeline.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "pipeline.h"
+
+static const char* stageNames[PIPE_STAGES] = { "sensor", "control", "actuator" };
+
+void seqlockInit(Seqlock* lock, void* data, size_t size) {
+
+	atomic_init(&lock->seq, 0);
+	lock->data = data;
+	lock->size = size;
+
+}
+
+void seqlockWrite(Seqlock* lock, const void* src) {
+
+	unsigned seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(lock->data, src, lock->size);
+
+	atomic_store_explicit(&lock->seq, seq + 2, memory_order_release);
+
+}
+
+unsigned seqlockRead(Seqlock* lock, void* dst) {
+
+	unsigned before, after;
+
+	do {
+		before = atomic_load_explicit(&lock->seq, memory_order_acquire);
+		if (before & 1)
+			continue; // writer is mid copy
+
+		memcpy(dst, lock->data, lock->size);
+
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	return before;
+
+}
+
+static void record(StageStats* s, double started) {
+
+	double took = clockNow() - started;
+
+	s->runs++;
+	s->last = took;
+	s->total += took;
+	if (took > s->max)
+		s->max = took;
+
+}
+
+// Reads once per robot sensor update, any faster only reads the same
+// update again
+static void* sensor_stage(void* arg) {
+
+	Pipeline* p = (Pipeline*) arg;
+	double next;
+
+	if (p->threadStart != NULL)
+		p->threadStart(StageSensor);
+
+	next = clockNow();
+
+	while (atomic_load(&p->running)) {
+		double started = clockNow();
+		p->sense(p->work[0]);
+		seqlockWrite(&p->snapshot, p->work[0]);
+		record(&p->stats[StageSensor], started);
+
+		next += PIPE_SENSOR_PERIOD;
+		if (clockNow() > next)
+			next = clockNow(); // fell behind, do not bunch up
+		else
+			clockSleepUntil(next);
+	}
+
+	clockExit();
+	return NULL;
+
+}
+
+// Fixed rate on whatever snapshot is newest
+static void* control_stage(void* arg) {
+
+	Pipeline* p = (Pipeline*) arg;
+	double next;
+
+	if (p->threadStart != NULL)
+		p->threadStart(StageControl);
+
+	next = clockNow();
+
+	while (atomic_load(&p->running)) {
+
+		if (seqlockRead(&p->snapshot, p->work[1]) != 0) {
+			double started = clockNow();
+			int more = p->control(p->work[1], p->work[2]);
+			seqlockWrite(&p->commands, p->work[2]);
+			record(&p->stats[StageControl], started);
+
+			if (!more)
+				atomic_store(&p->running, 0);
+		}
+
+		next += p->period;
+		if (clockNow() > next)
+			next = clockNow(); // fell behind, do not bunch up
+		else
+			clockSleepUntil(next);
+	}
+
+	clockExit();
+	return NULL;
+
+}
+
+// Writes each new command block once
+static void* actuator_stage(void* arg) {
+
+	Pipeline* p = (Pipeline*) arg;
+	unsigned done = 0;
+	int last = 0;
+
+	if (p->threadStart != NULL)
+		p->threadStart(StageActuator);
+
+	while (!last) {
+		// one more pass after stopping so the final commands go out
+		last = !atomic_load(&p->running);
+
+		if (atomic_load_explicit(&p->commands.seq, memory_order_acquire) != done) {
+			done = seqlockRead(&p->commands, p->work[3]);
+			double started = clockNow();
+			p->actuate(p->work[3]);
+			record(&p->stats[StageActuator], started);
+		}
+
+		if (!last)
+			clockSleepUntil(clockNow() + PIPE_ACTUATOR_POLL);
+	}
+
+	clockExit();
+	return NULL;
+
+}
+
+int pipelineInit(Pipeline* p, size_t snapshotSize, size_t commandSize, double period,
+	void (*sense)(void*), int (*control)(const void*, void*), void (*actuate)(const void*)) {
+
+	int i;
+
+	memset(p, 0, sizeof(Pipeline));
+	p->sense = sense;
+	p->control = control;
+	p->actuate = actuate;
+	p->period = period;
+
+	void* shared[2];
+	shared[0] = calloc(1, snapshotSize);
+	shared[1] = calloc(1, commandSize);
+	p->work[0] = calloc(1, snapshotSize);
+	p->work[1] = calloc(1, snapshotSize);
+	p->work[2] = calloc(1, commandSize);
+	p->work[3] = calloc(1, commandSize);
+
+	for (i = 0; i < 4; i++) {
+		if (p->work[i] == NULL || (i < 2 && shared[i] == NULL)) {
+			fprintf(stderr, "Pipeline: ERROR: out of memory\n");
+			free(shared[0]);
+			free(shared[1]);
+			pipelineFree(p);
+			return 0;
+		}
+	}
+
+	seqlockInit(&p->snapshot, shared[0], snapshotSize);
+	seqlockInit(&p->commands, shared[1], commandSize);
+	atomic_init(&p->running, 0);
+
+	return 1;
+
+}
+
+int pipelineRun(Pipeline* p) {
+
+	void* (*stages[PIPE_STAGES])(void*) = { sensor_stage, control_stage, actuator_stage };
+	int started = 0;
+	int i;
+
+	atomic_store(&p->running, 1);
+
+	for (i = 0; i < PIPE_STAGES; i++) {
+		clockSpawn();
+		if (pthread_create(&p->threads[i], NULL, stages[i], p) != 0) {
+			fprintf(stderr, "Pipeline: ERROR: could not start the %s thread\n", stageNames[i]);
+			atomic_store(&p->running, 0);
+			clockExit();
+			break;
+		}
+		started++;
+	}
+
+	clockBlock();
+	for (i = 0; i < started; i++)
+		pthread_join(p->threads[i], NULL);
+	clockUnblock();
+
+	return started == PIPE_STAGES;
+
+}
+
+void pipelinePrint(const Pipeline* p) {
+
+	int i;
+
+	for (i = 0; i < PIPE_STAGES; i++) {
+		const StageStats* s = &p->stats[i];
+		printf("Pipeline: %-8s %6ld runs, mean %.2f ms, max %.2f ms\n", stageNames[i], s->runs,
+			s->runs > 0 ? s->total / s->runs * 1000 : 0.0, s->max * 1000);
+	}
+
+}
+
+void pipelineFree(Pipeline* p) {
+
+	int i;
+
+	free(p->snapshot.data);
+	free(p->commands.data);
+	p->snapshot.data = NULL;
+	p->commands.data = NULL;
+
+	for (i = 0; i < 4; i++) {
+		free(p->work[i]);
+		p->work[i] = NULL;
+	}
+
+}
@@ -0,0 +1,125 @@
+/*
+ * pipeline.h
+ *
+ * Optional three-stage pipeline. A sensor thread reads and decodes OI
+ * data into a snapshot on every sensor update, a control thread computes commands from the
+ * latest snapshot at a fixed rate, and an actuator thread writes the
+ * commands out. Stages hand data to each other through seqlocks, so a
+ * reader always gets the newest complete copy and no stage ever waits
+ * on another one; each stage's run time is measured on its own.
+ */
+
+#ifndef INCLUDE_PIPELINE_H
+#define INCLUDE_PIPELINE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define PIPE_SENSOR_PERIOD  0.015 // s between reads, the OI sensor update rate
+#define PIPE_ACTUATOR_POLL  0.001 // s between checks for new commands
+
+// Stages
+#define StageSensor    0
+#define StageControl   1
+#define StageActuator  2
+#define PIPE_STAGES    3
+
+/*
+ * Single writer, many reader snapshot. The sequence is odd while a
+ * write is in progress; readers retry until they copy a stable, even
+ * sequence.
+ */
+typedef struct
+{
+	atomic_uint seq;
+	void* data;
+	size_t size;
+}
+Seqlock;
+
+typedef struct
+{
+	long runs;
+	double last;  // s spent in the last run
+	double max;   // s
+	double total; // s
+}
+StageStats;
+
+typedef struct
+{
+	Seqlock snapshot; // sensor -> control
+	Seqlock commands; // control -> actuator
+
+	// stage work, called on the stage's own thread with its own copy
+	void (*sense)(void* snapshot);
+	int (*control)(const void* snapshot, void* commands); // 0 to stop
+	void (*actuate)(const void* commands);
+	void (*threadStart)(int stage); // optional, first thing on each stage thread
+
+	double period; // s per control step
+	void* work[4]; // sensor out, control in, control out, actuator in
+	StageStats stats[PIPE_STAGES];
+	pthread_t threads[PIPE_STAGES];
+	atomic_int running;
+}
+Pipeline;
+
+/*
+ * Function: seqlockInit
+ *  Uses data, size bytes, as the shared copy. Sequence 0 means nothing
+ *  has been written yet.
+ */
+void seqlockInit(Seqlock* lock, void* data, size_t size);
+
+/*
+ * Function: seqlockWrite
+ *  Publishes a new copy. Only one thread may write a given lock.
+ */
+void seqlockWrite(Seqlock* lock, const void* src);
+
+/*
+ * Function: seqlockRead
+ *  Copies out the newest complete copy.
+ *
+ *  Returns its sequence number, 0 if nothing has been written yet.
+ */
+unsigned seqlockRead(Seqlock* lock, void* dst);
+
+/*
+ * Function: pipelineInit
+ *  Sets up the buffers for the stages. The sensor stage keeps its own
+ *  copy between runs, so it may accumulate (e.g. odometry) in it.
+ *
+ *  snapshotSize: bytes of the sensor snapshot
+ *  commandSize: bytes of the command block
+ *  period: seconds per control step
+ *
+ *  Returns 1 on success, 0 if out of memory.
+ */
+int pipelineInit(Pipeline* p, size_t snapshotSize, size_t commandSize, double period,
+	void (*sense)(void*), int (*control)(const void*, void*), void (*actuate)(const void*));
+
+/*
+ * Function: pipelineRun
+ *  Starts the three stage threads and returns once control asks to
+ *  stop. The actuator writes the last commands before it exits.
+ *
+ *  Returns 1 on success, 0 if a thread could not be started.
+ */
+int pipelineRun(Pipeline* p);
+
+/*
+ * Function: pipelinePrint
+ *  Prints the run time of each stage.
+ */
+void pipelinePrint(const Pipeline* p);
+
+/*
+ * Function: pipelineFree
+ *  Releases the buffers.
+ */
+void pipelineFree(Pipeline* p);
+
+#endif
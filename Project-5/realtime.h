@@ -0,0 +1,81 @@
+/*
+ * realtime.h
+ *
+ * Optional real-time execution. Puts the control and serial threads
+ * under SCHED_FIFO, pins them to chosen CPUs, locks the process in
+ * memory and pre-faults stacks so page faults do not land in the loop.
+ * Every step is tried on its own; without the privileges for one it
+ * prints what was refused and carries on with normal scheduling.
+ */
+
+#ifndef INCLUDE_REALTIME_H
+#define INCLUDE_REALTIME_H
+
+#include <pthread.h>
+
+// SCHED_FIFO priorities, the stop path first
+#define RT_PRIORITY_SAFETY   80
+#define RT_PRIORITY_IO       75 // threads that own the serial link
+#define RT_PRIORITY_CONTROL  70
+
+#define RT_STACK_PREFAULT    (256 * 1024) // bytes of stack touched per thread
+
+typedef struct
+{
+	int enabled;
+	int controlCpu; // CPU for the control thread, -1 not pinned
+	int ioCpu;      // CPU for the serial threads, -1 not pinned
+	int memoryLocked;
+	int scheduled;  // threads now under SCHED_FIFO
+	int pinned;     // threads now pinned
+	int refused;    // steps that failed
+}
+RealTime;
+
+/*
+ * Function: rtInit
+ *  Starts with real-time mode off.
+ */
+void rtInit(RealTime* rt);
+
+/*
+ * Function: rtParse
+ *  Handles the command line option --realtime[=CONTROL_CPU[,IO_CPU]].
+ *  With one CPU both kinds of thread are pinned to it.
+ *
+ *  Returns 1 if arg was the option, 0 if it was not, -1 if it was
+ *  malformed.
+ */
+int rtParse(RealTime* rt, const char* arg);
+
+/*
+ * Function: rtLockMemory
+ *  Locks current and future pages (mlockall) and pre-faults the
+ *  calling thread's stack. Call before the other threads are started
+ *  so their stacks are locked as they are created.
+ */
+void rtLockMemory(RealTime* rt);
+
+/*
+ * Function: rtThread
+ *  Puts a thread under SCHED_FIFO at priority and pins it to cpu
+ *  (-1 for no pinning), printing what was applied. Another thread's
+ *  stack is faulted in and locked with mlock, as it may have been
+ *  started before mlockall or without it.
+ */
+void rtThread(RealTime* rt, pthread_t thread, const char* name, int priority, int cpu);
+
+/*
+ * Function: rtCurrentThread
+ *  rtThread for the calling thread, which also gets its stack
+ *  pre-faulted.
+ */
+void rtCurrentThread(RealTime* rt, const char* name, int priority, int cpu);
+
+/*
+ * Function: rtReport
+ *  Prints a one line summary of what real-time mode achieved.
+ */
+void rtReport(const RealTime* rt);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * replay.h
+ *
+ * Plays a capture (capture.h) back to the program in place of the
+ * robot. The capture is cut into exchanges, the bytes sent before each
+ * run of replies and the replies themselves. When the program waits
+ * for a reply, the oldest unused exchange whose last bytes sent match
+ * what the program last sent answers it, so threads may take their
+ * turns on the port in another order than they did on the robot. The
+ * match may stop short of the last bytes sent before the exchange, at
+ * the end of a query, when another thread's command went out while the
+ * query waited for its reply, and
+ * a reply keeps coming when the program sends something before it has
+ * read it all.
+ * Replies come after the same delay they had behind their query on the
+ * robot, on the program's clock. Fast replay drives that clock itself
+ * (clockDrive), so the delays and the program's own sleeps pass without
+ * taking real time.
+ *
+ * A program's threads do not keep exactly the same pace twice. A query
+ * asked more often than in the capture gets the latest matching reply
+ * again, as the robot would have said the same; exchanges more than
+ * REPLAY_STALE behind the newest one used are passed over. Both are
+ * counted, along with the bytes sent, so a program that behaves
+ * differently on the same input shows. Once every exchange has been
+ * used or passed over the robot has nothing more to say, so the
+ * program exits the next time it waits for a reply.
+ */
+
+#ifndef INCLUDE_REPLAY_H
+#define INCLUDE_REPLAY_H
+
+#include <pthread.h>
+
+#include "capture.h"
+
+#define REPLAY_MATCH   16 // last bytes sent compared with a captured query
+#define REPLAY_WINDOW  64 // exchanges searched for a match
+#define REPLAY_STALE   2.0 // s an unused exchange may fall behind
+
+typedef struct
+{
+	uint64_t tx;            // first byte sent since the previous replies
+	uint64_t txCount;
+	uint64_t rx;            // first reply
+	uint64_t rxCount;
+	int used;
+}
+ReplayExchange;
+
+typedef struct
+{
+	CaptureFile file;
+	ReplayExchange* exchanges;
+	int count;
+	int first;              // oldest unused exchange
+	int current;            // exchange being read, or -1
+	int latest;             // newest exchange used
+	uint64_t served;        // replies of current read
+	unsigned char sent[REPLAY_MATCH]; // ring of the last bytes sent
+	unsigned long sentTotal;
+	unsigned long captured; // bytes sent in the capture
+	int sentSince;          // bytes sent since the last query was answered
+	double sentTime;        // program clock of the last byte sent
+	double anchorTime;      // program clock of the current query
+	uint64_t anchorNs;      // capture time of its last byte
+	unsigned long replies;  // captured replies
+	unsigned long read;     // replies handed out
+	unsigned long repeated; // queries answered again
+	unsigned long skipped;  // exchanges passed over
+	pthread_mutex_t lock;
+}
+Replay;
+
+/*
+ * Function: replayOpen
+ *  Loads a capture to play back.
+ *
+ *  Returns 0 if path is not a capture.
+ */
+int replayOpen(Replay* r, const char* path);
+
+/*
+ * Function: replaySend
+ *  Takes a byte from the program in place of the robot.
+ */
+void replaySend(Replay* r, unsigned char c);
+
+/*
+ * Function: replayWaiting
+ *  Number of replies the program may read now. Exits the program when
+ *  every exchange has been used.
+ */
+int replayWaiting(Replay* r);
+
+/*
+ * Function: replayGetChar
+ *  Next reply. Returns false if none is due yet.
+ */
+int replayGetChar(Replay* r, unsigned char* c);
+
+/*
+ * Function: replayReport
+ *  Prints how the program kept to the capture.
+ */
+void replayReport(Replay* r);
+
+#endif
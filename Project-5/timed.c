@@ -0,0 +1,167 @@
+/*
+ * timed.c
+ *
+ * Absolute-time command emitter. See timed.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "clock.h"
+#include "timed.h"
+
+double timedNow() {
+
+	return clockNow();
+
+}
+
+static void* emitter(void* arg) {
+
+	TimedQueue* q = (TimedQueue*) arg;
+	TimedCommand next;
+
+	pthread_mutex_lock(&q->lock);
+	q->sleeper = clockSelf();
+
+	while (q->running) {
+
+		// sleep until just before the soonest deadline, or until an
+		// earlier command is queued
+		double wake = q->count > 0 ? q->pending[0].when - TIMED_SPIN : CLOCK_FOREVER;
+		if (timedNow() < wake) {
+			pthread_mutex_unlock(&q->lock);
+			clockSleepUntil(wake);
+			pthread_mutex_lock(&q->lock);
+			continue;
+		}
+
+		next = q->pending[0];
+		q->count--;
+		memmove(&q->pending[0], &q->pending[1], q->count * sizeof(TimedCommand));
+
+		pthread_mutex_unlock(&q->lock);
+
+		// spin out the last fraction of a millisecond
+		clockSpinUntil(next.when);
+
+		q->emit(next.tag, next.bytes, next.length);
+		double emitted = timedNow();
+
+		pthread_mutex_lock(&q->lock);
+
+		TimedRecord* r = &q->log[next.id % TIMED_LOG];
+		r->id = next.id;
+		r->scheduled = next.when;
+		r->emitted = emitted;
+
+		double late = emitted - next.when;
+		q->emitted++;
+		q->totalLate += late;
+		if (late > q->maxLate)
+			q->maxLate = late;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+
+	clockExit();
+	return NULL;
+
+}
+
+int timedStart(TimedQueue* q, TimedEmit emit) {
+
+	memset(q, 0, sizeof(TimedQueue));
+	q->emit = emit;
+	q->nextId = 1;
+	q->running = 1;
+	q->sleeper = -1;
+
+	pthread_mutex_init(&q->lock, NULL);
+
+	clockSpawn();
+	if (pthread_create(&q->thread, NULL, emitter, q) != 0) {
+		fprintf(stderr, "Timed: ERROR: could not start emitter\n");
+		q->running = 0;
+		clockExit();
+		return 0;
+	}
+
+	return 1;
+
+}
+
+long timedSchedule(TimedQueue* q, double when, int tag, const unsigned char* command, int length) {
+
+	int i;
+
+	if (length > TIMED_COMMAND) {
+		fprintf(stderr, "Timed: ERROR: %d byte command is too long\n", length);
+		return 0;
+	}
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->count >= TIMED_MAX) {
+		pthread_mutex_unlock(&q->lock);
+		fprintf(stderr, "Timed: ERROR: queue full\n");
+		return 0;
+	}
+
+	// keep pending sorted; equal times go out in the order queued
+	for (i = q->count; i > 0 && q->pending[i - 1].when > when; i--)
+		q->pending[i] = q->pending[i - 1];
+
+	TimedCommand* c = &q->pending[i];
+	c->id = q->nextId++;
+	c->when = when;
+	c->tag = tag;
+	memcpy(c->bytes, command, length);
+	c->length = length;
+	q->count++;
+
+	long id = c->id;
+
+	if (i == 0)
+		clockInterrupt(q->sleeper); // new soonest deadline
+
+	pthread_mutex_unlock(&q->lock);
+
+	return id;
+
+}
+
+double timedEmitted(TimedQueue* q, long id) {
+
+	double emitted = 0;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->log[id % TIMED_LOG].id == id)
+		emitted = q->log[id % TIMED_LOG].emitted;
+	pthread_mutex_unlock(&q->lock);
+
+	return emitted;
+
+}
+
+void timedStop(TimedQueue* q) {
+
+	if (!q->running)
+		return;
+
+	pthread_mutex_lock(&q->lock);
+	q->running = 0;
+	int dropped = q->count;
+	q->count = 0;
+	clockInterrupt(q->sleeper);
+	pthread_mutex_unlock(&q->lock);
+
+	clockBlock();
+	pthread_join(q->thread, NULL);
+	clockUnblock();
+
+	printf("Timed: %ld commands, mean %.3f ms late, worst %.3f ms, %d dropped\n",
+		q->emitted, q->emitted > 0 ? q->totalLate / q->emitted * 1000 : 0.0,
+		q->maxLate * 1000, dropped);
+
+}
@@ -0,0 +1,106 @@
+/*
+ * timed.h
+ *
+ * Timed command queue. Commands are scheduled for an absolute time on
+ * the program clock (clock.h) and a dedicated emitter thread sends
+ * each one when it is due: it sleeps until just before the deadline,
+ * then spins the rest of the way, so the command goes out within a
+ * fraction of a millisecond of its time instead of after a scheduler
+ * wakeup. The time every command actually went out is kept, so callers
+ * can check it, and the queue's worst lateness is reported when it
+ * stops.
+ */
+
+#ifndef INCLUDE_TIMED_H
+#define INCLUDE_TIMED_H
+
+#include <pthread.h>
+
+#define TIMED_MAX      32     // commands waiting at once
+#define TIMED_LOG      64     // emitted commands remembered
+#define TIMED_COMMAND  40     // longest command, bytes
+#define TIMED_SPIN     0.0005 // s before the deadline to stop sleeping and spin
+
+// Sends one command; tag is whatever the caller scheduled it with
+typedef void (*TimedEmit)(int tag, const unsigned char* command, int length);
+
+typedef struct
+{
+	long id;
+	double when; // s, program clock
+	int tag;
+	unsigned char bytes[TIMED_COMMAND];
+	int length;
+}
+TimedCommand;
+
+typedef struct
+{
+	long id;
+	double scheduled; // s
+	double emitted;   // s, once the bytes were handed to the port
+}
+TimedRecord;
+
+typedef struct
+{
+	TimedCommand pending[TIMED_MAX]; // sorted, soonest first
+	int count;
+	TimedRecord log[TIMED_LOG];      // by id % TIMED_LOG
+	long nextId;
+	TimedEmit emit;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int sleeper; // emitter's clock sleeper, woken for an earlier deadline
+	int running;
+
+	long emitted;      // commands sent
+	double totalLate;  // s
+	double maxLate;    // s
+}
+TimedQueue;
+
+/*
+ * Function: timedNow
+ *  Seconds on the clock commands are scheduled against.
+ */
+double timedNow();
+
+/*
+ * Function: timedStart
+ *  Starts the emitter thread.
+ *
+ *  emit: called on the emitter thread to send each command
+ *
+ *  Returns 1 on success, 0 if the thread could not be started.
+ */
+int timedStart(TimedQueue* q, TimedEmit emit);
+
+/*
+ * Function: timedSchedule
+ *  Queues a command to go out at an absolute time. A time already
+ *  past goes out straight away.
+ *
+ *  Returns the command's id, 0 if the queue is full or the command
+ *  too long.
+ */
+long timedSchedule(TimedQueue* q, double when, int tag, const unsigned char* command, int length);
+
+/*
+ * Function: timedEmitted
+ *  Looks up when a command actually went out.
+ *
+ *  Returns the time in seconds, 0 if it has not gone out yet or was
+ *  too long ago to be remembered.
+ */
+double timedEmitted(TimedQueue* q, long id);
+
+/*
+ * Function: timedStop
+ *  Stops the emitter thread, drops anything still queued and prints
+ *  the queue's timing summary.
+ */
+void timedStop(TimedQueue* q);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * wheel.h
+ *
+ * Host-side wheel velocity loop. The robot's own velocity controller
+ * drifts at low speed and on carpet, so this trims the commanded wheel
+ * velocities from the speeds measured with the encoders: feedforward
+ * on the target plus a PI correction on the tracking error. Gains are
+ * read from a small per-robot file.
+ */
+
+#ifndef INCLUDE_WHEEL_H
+#define INCLUDE_WHEEL_H
+
+typedef struct
+{
+	double kff;     // feedforward gain on the target velocity
+	double kp;      // proportional gain on the tracking error
+	double ki;      // integral gain, 1/s
+	double maxTrim; // largest correction added to a wheel, mm/s
+}
+WheelGains;
+
+typedef struct
+{
+	WheelGains gains;
+	double integral[2]; // left, right accumulated error, mm
+	double trim[2];     // last correction, mm/s
+	double target[2];   // last target, mm/s
+}
+WheelLoop;
+
+/*
+ * Function: wheelDefaultGains
+ *  Fills in gains that work on the lab robot on tile.
+ */
+void wheelDefaultGains(WheelGains* g);
+
+/*
+ * Function: wheelLoadGains
+ *  Reads gains from a file of "name value" lines (kff, kp, ki,
+ *  max_trim). Names left out keep their current value; lines
+ *  starting with # are comments.
+ *
+ *  Returns 1 on success, 0 if the file cannot be read.
+ */
+int wheelLoadGains(WheelGains* g, const char* path);
+
+/*
+ * Function: wheelInit
+ *  Starts the loop with no accumulated error.
+ */
+void wheelInit(WheelLoop* w, const WheelGains* g);
+
+/*
+ * Function: wheelReset
+ *  Drops the accumulated error, e.g. after the robot was held still.
+ */
+void wheelReset(WheelLoop* w);
+
+/*
+ * Function: wheelCommand
+ *  Computes the wheel velocities to send.
+ *
+ *  dt: seconds since the last command
+ *  targetLeft, targetRight: wheel velocities wanted, mm/s
+ *  measuredLeft, measuredRight: wheel velocities from the encoders, mm/s
+ *  left, right: filled with the velocities to send, mm/s
+ */
+void wheelCommand(WheelLoop* w, double dt, double targetLeft, double targetRight,
+	double measuredLeft, double measuredRight, short* left, short* right);
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * arena.c
+ *
+ * Arena geometry and file loading. See arena.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "arena.h"
+
+#define MM_PER_FOOT  304.8
+#define START_CLEAR  250.0 // mm from the start a scattered card keeps
+#define SCATTER_TRIES 1000
+#define OBSTACLE_LENGTH 200.0 // mm
+
+static int add_wall(Arena* a, double x0, double y0, double x1, double y1) {
+
+	if (a->wallCount >= ARENA_MAX_WALLS) {
+		fprintf(stderr, "Arena: ERROR: too many walls\n");
+		return 0;
+	}
+
+	Segment* s = &a->walls[a->wallCount++];
+	s->x0 = x0;
+	s->y0 = y0;
+	s->x1 = x1;
+	s->y1 = y1;
+	return 1;
+
+}
+
+static int add_box(Arena* a, double x0, double y0, double x1, double y1) {
+
+	return add_wall(a, x0, y0, x1, y0) && add_wall(a, x1, y0, x1, y1)
+		&& add_wall(a, x1, y1, x0, y1) && add_wall(a, x0, y1, x0, y0);
+
+}
+
+static int add_rect(Rect* rects, int* count, double x0, double y0, double x1, double y1) {
+
+	if (*count >= ARENA_MAX_RECTS) {
+		fprintf(stderr, "Arena: ERROR: too many cards or drops\n");
+		return 0;
+	}
+
+	Rect* r = &rects[(*count)++];
+	r->x0 = x0 < x1 ? x0 : x1;
+	r->x1 = x0 < x1 ? x1 : x0;
+	r->y0 = y0 < y1 ? y0 : y1;
+	r->y1 = y0 < y1 ? y1 : y0;
+	return 1;
+
+}
+
+void arenaDefault(Arena* a) {
+
+	memset(a, 0, sizeof(Arena));
+
+	// the square is tape on the floor, the walls are those of the room
+	add_box(a, -5 * MM_PER_FOOT, -5 * MM_PER_FOOT, 5 * MM_PER_FOOT, 5 * MM_PER_FOOT);
+
+	// 3x5 in index cards
+	add_rect(a->cards, &a->cardCount, -83, 168, 44, 244);
+	add_rect(a->cards, &a->cardCount, 231, -272, 358, -196);
+	add_rect(a->cards, &a->cardCount, -519, -392, -392, -316);
+
+	a->scatter.x0 = a->scatter.y0 = -2 * MM_PER_FOOT;
+	a->scatter.x1 = a->scatter.y1 = 2 * MM_PER_FOOT;
+	a->hasScatter = 1;
+
+}
+
+int arenaLoad(Arena* a, const char* path) {
+
+	FILE* f = fopen(path, "r");
+	char line[256];
+	char word[16];
+	double v[4];
+	int number = 0;
+	int ok = 1;
+
+	if (f == NULL) {
+		fprintf(stderr, "Arena: ERROR: cannot open %s\n", path);
+		return 0;
+	}
+
+	memset(a, 0, sizeof(Arena));
+
+	while (ok && fgets(line, sizeof(line), f) != NULL) {
+		char* hash = strchr(line, '#');
+		int n;
+
+		number++;
+		if (hash != NULL)
+			*hash = '\0';
+
+		n = sscanf(line, "%15s %lf %lf %lf %lf", word, &v[0], &v[1], &v[2], &v[3]);
+		if (n <= 0)
+			continue;
+
+		if (strcmp(word, "wall") == 0 && n == 5)
+			ok = add_wall(a, v[0], v[1], v[2], v[3]);
+		else if (strcmp(word, "box") == 0 && n == 5)
+			ok = add_box(a, v[0], v[1], v[2], v[3]);
+		else if (strcmp(word, "card") == 0 && n == 5)
+			ok = add_rect(a->cards, &a->cardCount, v[0], v[1], v[2], v[3]);
+		else if (strcmp(word, "drop") == 0 && n == 5)
+			ok = add_rect(a->drops, &a->dropCount, v[0], v[1], v[2], v[3]);
+		else if (strcmp(word, "scatter") == 0 && n == 5) {
+			int count = 0;
+			add_rect(&a->scatter, &count, v[0], v[1], v[2], v[3]);
+			a->hasScatter = 1;
+		}
+		else if (strcmp(word, "start") == 0 && n == 4) {
+			a->startX = v[0];
+			a->startY = v[1];
+			a->startHeading = v[2];
+		} else {
+			fprintf(stderr, "Arena: ERROR: %s:%d: bad line\n", path, number);
+			ok = 0;
+		}
+	}
+
+	fclose(f);
+	return ok;
+
+}
+
+static int overlaps(const Rect* a, const Rect* b) {
+
+	return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+
+}
+
+int arenaScatter(Arena* a, unsigned int seed) {
+
+	int i, j, k;
+
+	if (!a->hasScatter)
+		return 0;
+
+	for (i = 0; i < a->cardCount; i++) {
+		Rect* card = &a->cards[i];
+		double w = card->x1 - card->x0;
+		double h = card->y1 - card->y0;
+
+		for (k = 0; k < SCATTER_TRIES; k++) {
+			// a card may land either way round
+			if (rand_r(&seed) % 2) {
+				double t = w;
+				w = h;
+				h = t;
+			}
+			card->x0 = a->scatter.x0 + (a->scatter.x1 - a->scatter.x0 - w) * rand_r(&seed) / RAND_MAX;
+			card->y0 = a->scatter.y0 + (a->scatter.y1 - a->scatter.y0 - h) * rand_r(&seed) / RAND_MAX;
+			card->x1 = card->x0 + w;
+			card->y1 = card->y0 + h;
+
+			Rect start = { a->startX - START_CLEAR, a->startY - START_CLEAR,
+				a->startX + START_CLEAR, a->startY + START_CLEAR };
+			int clear = !overlaps(card, &start);
+			for (j = 0; j < i && clear; j++)
+				clear = !overlaps(card, &a->cards[j]);
+			if (clear)
+				break;
+		}
+	}
+
+	return 1;
+
+}
+
+void arenaObstacle(Arena* a, double x, double y, double bearing, double distance) {
+
+	double cx = x + distance * cos(bearing);
+	double cy = y + distance * sin(bearing);
+	double dx = OBSTACLE_LENGTH / 2 * -sin(bearing);
+	double dy = OBSTACLE_LENGTH / 2 * cos(bearing);
+
+	if (a->hasObstacle)
+		a->wallCount--;
+	a->hasObstacle = add_wall(a, cx - dx, cy - dy, cx + dx, cy + dy);
+
+}
+
+double arenaRay(const Arena* a, double x, double y, double heading, double max) {
+
+	double dx = cos(heading);
+	double dy = sin(heading);
+	double best = max;
+	int i;
+
+	for (i = 0; i < a->wallCount; i++) {
+		const Segment* s = &a->walls[i];
+		double ex = s->x1 - s->x0;
+		double ey = s->y1 - s->y0;
+		double denom = dx * ey - dy * ex;
+
+		if (fabs(denom) < 1e-9)
+			continue; // parallel
+
+		double wx = s->x0 - x;
+		double wy = s->y0 - y;
+		double t = (wx * ey - wy * ex) / denom; // along the ray
+		double u = (wx * dy - wy * dx) / denom; // along the wall
+
+		if (t >= 0 && t < best && u >= 0 && u <= 1)
+			best = t;
+	}
+
+	return best;
+
+}
+
+double arenaClearance(const Arena* a, double x, double y, double* bearing) {
+
+	double best = HUGE_VAL;
+	int i;
+
+	*bearing = 0;
+
+	for (i = 0; i < a->wallCount; i++) {
+		const Segment* s = &a->walls[i];
+		double ex = s->x1 - s->x0;
+		double ey = s->y1 - s->y0;
+		double length2 = ex * ex + ey * ey;
+		double u = 0;
+
+		if (length2 > 0)
+			u = ((x - s->x0) * ex + (y - s->y0) * ey) / length2;
+		if (u < 0)
+			u = 0;
+		if (u > 1)
+			u = 1;
+
+		double px = s->x0 + u * ex - x;
+		double py = s->y0 + u * ey - y;
+		double d = sqrt(px * px + py * py);
+
+		if (d < best) {
+			best = d;
+			*bearing = atan2(py, px);
+		}
+	}
+
+	return best;
+
+}
+
+static int in_rect(const Rect* r, double x, double y) {
+
+	return x >= r->x0 && x <= r->x1 && y >= r->y0 && y <= r->y1;
+
+}
+
+int arenaCard(const Arena* a, double x, double y) {
+
+	int i;
+
+	for (i = 0; i < a->cardCount; i++) {
+		if (in_rect(&a->cards[i], x, y))
+			return i;
+	}
+
+	return -1;
+
+}
+
+int arenaDrop(const Arena* a, double x, double y) {
+
+	int i;
+
+	for (i = 0; i < a->dropCount; i++) {
+		if (in_rect(&a->drops[i], x, y))
+			return 1;
+	}
+
+	return 0;
+
+}
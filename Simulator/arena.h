@@ -0,0 +1,111 @@
+/*
+ * arena.h
+ *
+ * 2D world for the simulator. Walls are line segments the robot can
+ * bump into and the wall and light bump sensors can see. Cards are
+ * rectangles on the floor that read bright on the cliff sensors, drops
+ * are rectangles that read as a cliff. Units are mm, angles in degrees
+ * counter-clockwise from +x.
+ */
+
+#ifndef INCLUDE_ARENA_H
+#define INCLUDE_ARENA_H
+
+#define ARENA_MAX_WALLS  64
+#define ARENA_MAX_RECTS  32
+
+typedef struct
+{
+	double x0, y0, x1, y1;
+}
+Segment;
+
+typedef struct
+{
+	double x0, y0, x1, y1; // x0 < x1, y0 < y1
+}
+Rect;
+
+typedef struct
+{
+	Segment walls[ARENA_MAX_WALLS];
+	int wallCount;
+	Rect cards[ARENA_MAX_RECTS];
+	int cardCount;
+	Rect drops[ARENA_MAX_RECTS];
+	int dropCount;
+	Rect scatter;          // where arenaScatter may put the cards
+	int hasScatter;
+	int hasObstacle;       // the last wall is the one from arenaObstacle
+	double startX, startY, startHeading;
+}
+Arena;
+
+/*
+ * Function: arenaDefault
+ *  The Project-5 arena: a 4 ft square marked on the floor of a 10 ft
+ *  room, the robot in its center facing +x and three index cards
+ *  inside it.
+ */
+void arenaDefault(Arena* a);
+
+/*
+ * Function: arenaLoad
+ *  Reads an arena file. One item per line, # starts a comment:
+ *
+ *   wall x0 y0 x1 y1
+ *   box x0 y0 x1 y1      four walls around a rectangle
+ *   card x0 y0 x1 y1
+ *   drop x0 y0 x1 y1
+ *   scatter x0 y0 x1 y1  area for arenaScatter
+ *   start x y heading
+ *
+ *  Returns 1 on success, 0 if the file cannot be read or has a bad line.
+ */
+int arenaLoad(Arena* a, const char* path);
+
+/*
+ * Function: arenaScatter
+ *  Moves the cards to places picked from seed inside the scatter area,
+ *  clear of each other and of the robot at the start. The same seed
+ *  always gives the same places.
+ *
+ *  Returns 0 if the arena has no scatter area.
+ */
+int arenaScatter(Arena* a, unsigned int seed);
+
+/*
+ * Function: arenaObstacle
+ *  Puts a short wall across bearing (radians), distance from (x, y),
+ *  in place of the one put there before, as something pushed against
+ *  the robot.
+ */
+void arenaObstacle(Arena* a, double x, double y, double bearing, double distance);
+
+/*
+ * Function: arenaRay
+ *  Distance from (x, y) along heading (radians) to the nearest wall,
+ *  or max if no wall is closer.
+ */
+double arenaRay(const Arena* a, double x, double y, double heading, double max);
+
+/*
+ * Function: arenaClearance
+ *  Distance from (x, y) to the nearest wall. bearing is filled with the
+ *  direction to the closest point in radians.
+ */
+double arenaClearance(const Arena* a, double x, double y, double* bearing);
+
+/*
+ * Function: arenaCard
+ *  Returns the index of the card under (x, y), or -1.
+ */
+int arenaCard(const Arena* a, double x, double y);
+
+/*
+ * Function: arenaDrop
+ *  Returns true if (x, y) is over a drop.
+ */
+int arenaDrop(const Arena* a, double x, double y);
+
+#endif
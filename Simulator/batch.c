@@ -0,0 +1,383 @@
+/*
+ * batch.c
+ *
+ * Structure of arrays robot model. See batch.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "oi.h"
+#include "robot.h"
+#include "batch.h"
+
+#define COLUMN_ALIGN 64 // bytes, a cache line and the widest vector
+
+// Points the arrays into base, or only adds up their size when base is
+// NULL. Returns the bytes needed.
+static size_t layout(Batch* b, char* base) {
+
+	size_t used = 0;
+	int n = b->count;
+	int i;
+
+#define COLUMN(field, type) \
+	do { \
+		b->field = base != NULL ? (type*) (base + used) : NULL; \
+		used += (sizeof(type) * n + COLUMN_ALIGN - 1) / COLUMN_ALIGN * COLUMN_ALIGN; \
+	} while (0)
+
+	COLUMN(x, double);
+	COLUMN(y, double);
+	COLUMN(heading, double);
+	COLUMN(cos, double);
+	COLUMN(sin, double);
+	COLUMN(left, double);
+	COLUMN(right, double);
+	COLUMN(requestLeft, double);
+	COLUMN(requestRight, double);
+	COLUMN(stalled, double);
+	COLUMN(clearance, double);
+	COLUMN(distance, double);
+	COLUMN(angle, double);
+	COLUMN(nextX, double);
+	COLUMN(nextY, double);
+	COLUMN(speed, double);
+	COLUMN(turn, double);
+	COLUMN(after, double);
+	COLUMN(bump, unsigned char);
+	for (i = 0; i < BATCH_CLIFFS; i++)
+		COLUMN(cliff[i], unsigned short);
+	for (i = 0; i < BATCH_LIGHTS; i++)
+		COLUMN(light[i], unsigned short);
+	COLUMN(lightBumps, unsigned char);
+	COLUMN(reflectivity, double);
+	COLUMN(seed, unsigned int);
+	for (i = 0; i < BATCH_CARDS; i++) {
+		COLUMN(cardX0[i], double);
+		COLUMN(cardY0[i], double);
+		COLUMN(cardX1[i], double);
+		COLUMN(cardY1[i], double);
+	}
+	COLUMN(cardsSeen, unsigned int);
+
+#undef COLUMN
+
+	return used;
+
+}
+
+static double clamp(double v, double lo, double hi) {
+
+	return v < lo ? lo : v > hi ? hi : v;
+
+}
+
+// robot.c's noise, one stream per robot
+static int noise(unsigned int* seed, int amplitude) {
+
+	*seed = *seed * 1103515245 + 12345;
+	return (int) ((*seed >> 16) % (2 * amplitude + 1)) - amplitude;
+
+}
+
+// cos and sin of a small angle, to a part in 1e12 below 0.05 rad
+static void small_rotation(double a, double* c, double* s) {
+
+	double a2 = a * a;
+	*c = 1 - a2 / 2 + a2 * a2 / 24;
+	*s = a * (1 - a2 / 6 + a2 * a2 / 120);
+
+}
+
+int batchInit(Batch* b, const Arena* arena, int count) {
+
+	int i, k;
+
+	memset(b, 0, sizeof(Batch));
+	if (count < 1 || arena->cardCount > BATCH_CARDS)
+		return 0;
+
+	b->count = count;
+	b->arena = arena;
+	b->cardCount = arena->cardCount;
+
+	size_t size = layout(b, NULL);
+	if (posix_memalign(&b->memory, COLUMN_ALIGN, size) != 0)
+		return 0;
+	memset(b->memory, 0, size);
+	layout(b, (char*) b->memory);
+
+	for (i = 0; i < count; i++) {
+		batchPlace(b, i, arena->startX, arena->startY, arena->startHeading * M_PI / 180);
+		b->reflectivity[i] = 1;
+		b->seed[i] = 12345 + i;
+		for (k = 0; k < b->cardCount; k++) {
+			b->cardX0[k][i] = arena->cards[k].x0;
+			b->cardY0[k][i] = arena->cards[k].y0;
+			b->cardX1[k][i] = arena->cards[k].x1;
+			b->cardY1[k][i] = arena->cards[k].y1;
+		}
+	}
+
+	return 1;
+
+}
+
+void batchFree(Batch* b) {
+
+	free(b->memory);
+	memset(b, 0, sizeof(Batch));
+
+}
+
+void batchPlace(Batch* b, int i, double x, double y, double heading) {
+
+	double bearing;
+
+	b->x[i] = x;
+	b->y[i] = y;
+	b->heading[i] = heading;
+	b->cos[i] = cos(heading);
+	b->sin[i] = sin(heading);
+	b->left[i] = b->right[i] = 0;
+	b->requestLeft[i] = b->requestRight[i] = 0;
+	b->stalled[i] = 0;
+	b->distance[i] = b->angle[i] = 0;
+	b->clearance[i] = arenaClearance(b->arena, x, y, &bearing);
+	b->cardsSeen[i] = 0;
+
+}
+
+void batchScatter(Batch* b, int i, unsigned int seed) {
+
+	Arena arena = *b->arena;
+	int k;
+
+	arenaScatter(&arena, seed);
+	for (k = 0; k < b->cardCount; k++) {
+		b->cardX0[k][i] = arena.cards[k].x0;
+		b->cardY0[k][i] = arena.cards[k].y0;
+		b->cardX1[k][i] = arena.cards[k].x1;
+		b->cardY1[k][i] = arena.cards[k].y1;
+	}
+	b->seed[i] = seed;
+
+}
+
+void batchDrive(Batch* b, int i, short velocity, short radius) {
+
+	double left = velocity;
+	double right = velocity;
+
+	// as robot.c converts Drive (137)
+	if (radius == RadCCW) {
+		left = -velocity;
+	} else if (radius == RadCW) {
+		right = -velocity;
+	} else if (radius != 0 && radius != 32767 && radius != (short) RadStraight) {
+		left = velocity * (radius - ROBOT_WHEEL_BASE / 2) / radius;
+		right = velocity * (radius + ROBOT_WHEEL_BASE / 2) / radius;
+	}
+
+	batchDriveWheels(b, i, (short) clamp(lround(left), -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX),
+		(short) clamp(lround(right), -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX));
+
+}
+
+void batchDriveWheels(Batch* b, int i, short left, short right) {
+
+	b->requestLeft[i] = clamp(left, -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX);
+	b->requestRight[i] = clamp(right, -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX);
+
+}
+
+void batchStep(Batch* b) {
+
+	const double dt = BATCH_STEP;
+	const double change = ROBOT_WHEEL_ACCEL * dt;
+	const int n = b->count;
+	const Arena* a = b->arena;
+	int i, k, w;
+
+	// wheels ramp toward their requests, and where the body would go
+	for (i = 0; i < n; i++) {
+		double dl = b->requestLeft[i] - b->left[i];
+		double dr = b->requestRight[i] - b->right[i];
+		dl = dl < -change ? -change : dl > change ? change : dl;
+		dr = dr < -change ? -change : dr > change ? change : dr;
+		double left = b->left[i] + dl;
+		double right = b->right[i] + dr;
+		b->left[i] = left;
+		b->right[i] = right;
+
+		double v = (left + right) / 2;
+		double turn = (right - left) / ROBOT_WHEEL_BASE * dt;
+		double c, s;
+		small_rotation(turn / 2, &c, &s);
+		b->speed[i] = v;
+		b->turn[i] = turn;
+		b->nextX[i] = b->x[i] + v * (b->cos[i] * c - b->sin[i] * s) * dt;
+		b->nextY[i] = b->y[i] + v * (b->sin[i] * c + b->cos[i] * s) * dt;
+		b->after[i] = HUGE_VAL;
+	}
+
+	// squared distance from there to the nearest wall, a wall at a time
+	for (w = 0; w < a->wallCount; w++) {
+		const Segment* s = &a->walls[w];
+		double ex = s->x1 - s->x0;
+		double ey = s->y1 - s->y0;
+		double length2 = ex * ex + ey * ey;
+		double scale = length2 > 0 ? 1 / length2 : 0;
+
+		for (i = 0; i < n; i++) {
+			double u = ((b->nextX[i] - s->x0) * ex + (b->nextY[i] - s->y0) * ey) * scale;
+			u = u < 0 ? 0 : u > 1 ? 1 : u;
+			double px = s->x0 + u * ex - b->nextX[i];
+			double py = s->y0 + u * ey - b->nextY[i];
+			double d2 = px * px + py * py;
+			b->after[i] = d2 < b->after[i] ? d2 : b->after[i];
+		}
+	}
+
+	// a body pushing on a wall stays put and its wheels stall; it may
+	// still turn in place
+	for (i = 0; i < n; i++) {
+		double after = sqrt(b->after[i]);
+		int blocked = after < ROBOT_RADIUS && after < b->clearance[i] && b->speed[i] != 0;
+
+		b->x[i] = blocked ? b->x[i] : b->nextX[i];
+		b->y[i] = blocked ? b->y[i] : b->nextY[i];
+		b->clearance[i] = blocked ? b->clearance[i] : after;
+		b->stalled[i] = blocked ? b->stalled[i] + dt : 0;
+		b->distance[i] += blocked ? 0 : b->speed[i] * dt;
+
+		double turn = b->turn[i];
+		double c, s;
+		small_rotation(turn, &c, &s);
+		double nc = b->cos[i] * c - b->sin[i] * s;
+		double ns = b->sin[i] * c + b->cos[i] * s;
+		// one Newton step back onto the unit circle
+		double fix = (3 - (nc * nc + ns * ns)) / 2;
+		b->cos[i] = nc * fix;
+		b->sin[i] = ns * fix;
+		b->heading[i] += turn;
+		b->angle[i] += turn;
+	}
+
+	// cards under the cliff sensors
+	for (k = 0; k < BATCH_CLIFFS; k++) {
+		double mc = (ROBOT_RADIUS - 10) * cos(robotCliffAngles[k]);
+		double ms = (ROBOT_RADIUS - 10) * sin(robotCliffAngles[k]);
+		int card;
+
+		for (card = 0; card < b->cardCount; card++) {
+			const double* x0 = b->cardX0[card];
+			const double* y0 = b->cardY0[card];
+			const double* x1 = b->cardX1[card];
+			const double* y1 = b->cardY1[card];
+
+			for (i = 0; i < n; i++) {
+				double px = b->x[i] + b->cos[i] * mc - b->sin[i] * ms;
+				double py = b->y[i] + b->sin[i] * mc + b->cos[i] * ms;
+				unsigned int inside = (px >= x0[i]) & (px <= x1[i]) & (py >= y0[i]) & (py <= y1[i]);
+				b->cardsSeen[i] |= inside << card;
+			}
+		}
+	}
+
+	b->now += dt;
+	b->steps += n;
+
+}
+
+void batchSense(Batch* b) {
+
+	const int n = b->count;
+	const Arena* a = b->arena;
+	int i, k, w;
+
+	// bumper: only the few robots against a wall need the bearing to it
+	for (i = 0; i < n; i++) {
+		unsigned char bump = 0;
+		if (b->clearance[i] <= ROBOT_RADIUS + 1) {
+			double bearing;
+			arenaClearance(a, b->x[i], b->y[i], &bearing);
+			double side = remainder(bearing - b->heading[i], 2 * M_PI);
+			if (fabs(side) <= 10 * M_PI / 180)
+				bump = BmpBoth;
+			else if (side > 0 && side < M_PI / 2)
+				bump = BmpLeft;
+			else if (side < 0 && side > -M_PI / 2)
+				bump = BmpRight;
+		}
+		b->bump[i] = bump;
+	}
+
+	// cliff signals, brighter over a card
+	for (k = 0; k < BATCH_CLIFFS; k++) {
+		double mc = (ROBOT_RADIUS - 10) * cos(robotCliffAngles[k]);
+		double ms = (ROBOT_RADIUS - 10) * sin(robotCliffAngles[k]);
+		unsigned short* signal = b->cliff[k];
+		int card;
+
+		for (i = 0; i < n; i++) {
+			double px = b->x[i] + b->cos[i] * mc - b->sin[i] * ms;
+			double py = b->y[i] + b->sin[i] * mc + b->cos[i] * ms;
+			int over = 0;
+			for (card = 0; card < b->cardCount; card++) {
+				over |= (px >= b->cardX0[card][i]) & (px <= b->cardX1[card][i])
+					& (py >= b->cardY0[card][i]) & (py <= b->cardY1[card][i]);
+			}
+			signal[i] = ROBOT_FLOOR_SIGNAL + over * ROBOT_CARD_SIGNAL + noise(&b->seed[i], 10);
+		}
+	}
+
+	// light bumpers: the nearest wall along each sensor's ray
+	for (i = 0; i < n; i++)
+		b->lightBumps[i] = 0;
+
+	for (k = 0; k < BATCH_LIGHTS; k++) {
+		double mc = cos(robotLightAngles[k]);
+		double ms = sin(robotLightAngles[k]);
+		unsigned short* signal = b->light[k];
+
+		for (i = 0; i < n; i++)
+			b->after[i] = ROBOT_LIGHT_RANGE;
+
+		for (w = 0; w < a->wallCount; w++) {
+			const Segment* s = &a->walls[w];
+			double ex = s->x1 - s->x0;
+			double ey = s->y1 - s->y0;
+
+			for (i = 0; i < n; i++) {
+				double dx = b->cos[i] * mc - b->sin[i] * ms;
+				double dy = b->sin[i] * mc + b->cos[i] * ms;
+				double ox = b->x[i] + ROBOT_RADIUS * dx;
+				double oy = b->y[i] + ROBOT_RADIUS * dy;
+				double denom = dx * ey - dy * ex;
+				double safe = fabs(denom) < 1e-9 ? 1 : denom;
+				double wx = s->x0 - ox;
+				double wy = s->y0 - oy;
+				double t = (wx * ey - wy * ex) / safe;
+				double u = (wx * dy - wy * dx) / safe;
+				int hit = fabs(denom) >= 1e-9 && t >= 0 && u >= 0 && u <= 1 && t < b->after[i];
+				b->after[i] = hit ? t : b->after[i];
+			}
+		}
+
+		for (i = 0; i < n; i++) {
+			double d = b->after[i];
+			int value = 0;
+			if (d < ROBOT_LIGHT_RANGE) {
+				value = (int) (ROBOT_LIGHT_MAX * b->reflectivity[i] * exp(-d / ROBOT_LIGHT_FALLOFF));
+				if (value > 0)
+					value += noise(&b->seed[i], 2) + 2;
+			}
+			signal[i] = value < 0 ? 0 : value > 4095 ? 4095 : value;
+			b->lightBumps[i] |= (signal[i] > ROBOT_LIGHT_THRESHOLD) << k;
+		}
+	}
+
+}
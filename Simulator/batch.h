@@ -0,0 +1,136 @@
+/*
+ * batch.h
+ *
+ * Many simulated Create 2s at once, for studies that need thousands of
+ * runs. There is no Open Interface and no pseudo-terminal: a controller
+ * reads the sensor arrays and sets wheel requests directly, between
+ * steps. Every quantity is an array with one entry per robot, so a step
+ * is a handful of loops over contiguous memory with no branches that
+ * depend on the robot, which the compiler vectorizes at -O3.
+ *
+ * The models are robot.c's: wheels ramp toward their requests and stall
+ * against walls, the bumper, cliff signals and light bumpers see the
+ * arena, with the same noise. Each robot has its own cards, and its own
+ * wall reflectivity scaling its light bumper signals. What is left out
+ * is what the projects' decisions do not read in bulk: encoders, the
+ * wall signal, drops, battery, songs and buttons.
+ */
+
+#ifndef INCLUDE_BATCH_H
+#define INCLUDE_BATCH_H
+
+#include "arena.h"
+
+#define BATCH_STEP    0.005 // s per batchStep, robot.c's physics step
+#define BATCH_CARDS   8     // cards each robot may have
+#define BATCH_CLIFFS  4     // left, front left, front right, right
+#define BATCH_LIGHTS  6     // light bumpers, left to right
+
+typedef struct
+{
+	int count;
+	const Arena* arena;     // walls, shared by all
+	double now;             // s since batchInit
+	unsigned long steps;    // robot steps taken, count per batchStep
+
+	// body
+	double* x;
+	double* y;
+	double* heading;        // radians, not wrapped
+	double* cos;            // of heading, kept by rotation instead of trig
+	double* sin;
+	double* left;           // wheel velocities being driven, mm/s
+	double* right;
+	double* requestLeft;    // from batchDrive
+	double* requestRight;
+	double* stalled;        // s pushing against a wall
+	double* clearance;      // to the nearest wall at the last step, mm
+
+	// what the controller reads, and clears when it has
+	double* distance;       // mm since cleared (packet 19)
+	double* angle;          // radians since cleared (packet 20)
+
+	// sensors, refreshed by batchSense
+	unsigned char* bump;    // bumper bits (packet 7)
+	unsigned short* cliff[BATCH_CLIFFS];  // signals (packets 28-31)
+	unsigned short* light[BATCH_LIGHTS];  // signals (packets 46-51)
+	unsigned char* lightBumps;            // bits (packet 45)
+	double* reflectivity;   // light bumper signal scale, 1 by default
+	unsigned int* seed;     // noise
+
+	// cards, BATCH_CARDS rectangles per robot
+	int cardCount;
+	double* cardX0[BATCH_CARDS];
+	double* cardY0[BATCH_CARDS];
+	double* cardX1[BATCH_CARDS];
+	double* cardY1[BATCH_CARDS];
+	unsigned int* cardsSeen; // bit per card passed over by a cliff sensor
+
+	// scratch within a step
+	double* nextX;          // where the body would go
+	double* nextY;
+	double* speed;          // mm/s forward
+	double* turn;           // radians this step
+	double* after;          // squared clearance there, then ray lengths
+
+	void* memory;           // all of the above, one allocation
+}
+Batch;
+
+/*
+ * Function: batchInit
+ *  Allocates count robots at the arena start, at rest, each with the
+ *  arena's cards and its own noise seed.
+ *
+ *  Returns 0 if the memory cannot be had or the arena has more than
+ *  BATCH_CARDS cards.
+ */
+int batchInit(Batch* b, const Arena* arena, int count);
+
+/*
+ * Function: batchFree
+ *  Frees the arrays of batchInit.
+ */
+void batchFree(Batch* b);
+
+/*
+ * Function: batchPlace
+ *  Puts robot i down at rest at (x, y) facing heading (radians).
+ */
+void batchPlace(Batch* b, int i, double x, double y, double heading);
+
+/*
+ * Function: batchScatter
+ *  Gives robot i the arena's cards scattered from seed, as arenaScatter
+ *  does, and noise from the same seed.
+ */
+void batchScatter(Batch* b, int i, unsigned int seed);
+
+/*
+ * Function: batchDrive
+ *  Drive (137): velocity and radius for robot i, converted to wheel
+ *  requests as the robot does.
+ */
+void batchDrive(Batch* b, int i, short velocity, short radius);
+
+/*
+ * Function: batchDriveWheels
+ *  Drive Direct (145): wheel requests for robot i in mm/s.
+ */
+void batchDriveWheels(Batch* b, int i, short left, short right);
+
+/*
+ * Function: batchStep
+ *  Moves every robot on by BATCH_STEP and marks the cards under their
+ *  cliff sensors.
+ */
+void batchStep(Batch* b);
+
+/*
+ * Function: batchSense
+ *  Refreshes every robot's bumper, cliff and light bumper readings, as
+ *  the robot does every 15 ms.
+ */
+void batchSense(Batch* b);
+
+#endif
@@ -0,0 +1,449 @@
+/*
+ * main.c
+ *
+ * Create 2 simulator. Opens a pseudo-terminal, prints the path of its
+ * slave side and plays the robot on the master side, so the project
+ * binaries run against it by pointing CREATE_DEVICE at that path.
+ *
+ * Bytes in both directions are paced at the 115200 baud wire rate and
+ * the robot is stepped against the monotonic clock, or with --virtual
+ * against a virtual clock shared with the program (see vclock.h), which
+ * runs a mission as fast as the program can keep up.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <math.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "oi.h"
+#include "arena.h"
+#include "robot.h"
+#include "vclock.h"
+
+#define BYTE_TIME   (10.0 / 115200) // start, 8 data and stop bits
+#define PHYSICS     0.005           // s between robot steps while idle
+#define TRACE_EVERY 0.015           // s between trace rows
+#define PRESS_TIME  0.2             // s a button press is held
+#define VIRTUAL_START 1000.0        // s on the virtual clock when the robot starts
+#define IDLE_POLL   0.0002          // s of real time between looks at a busy program
+#define PUSH_MAX    256             // pushes reported
+#define PUSH_GAP    0.5             // mm between the body and a pushed obstacle
+
+// Obstacles pushed against the bumper with --bump-every, and how long
+// the program took to back off them
+typedef struct
+{
+	double at;      // s it was pushed
+	double escaped; // s it was clear again, or -1
+	int seen;       // the bumper has read it
+}
+Push;
+
+// in turn straight ahead, front left and front right
+static const double pushSides[] = { 0, 45, -45 };
+
+static Push pushes[PUSH_MAX];
+static int pushCount = 0;
+
+static volatile sig_atomic_t pressed = 0;
+static volatile sig_atomic_t quit = 0;
+
+static void on_press(int sig) {
+
+	(void) sig;
+	pressed = 1;
+
+}
+
+static void on_quit(int sig) {
+
+	(void) sig;
+	quit = 1;
+
+}
+
+static double now_seconds() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+static void usage() {
+
+	fprintf(stderr,
+		"usage: createsim [--arena file] [--link path] [--trace file.csv] [--virtual clockfile]\n"
+		"                 [--button-at seconds] [--bump-every seconds] [--seed n]\n"
+		"                 [--exit-on-powerdown] [--quiet]\n");
+
+}
+
+static void report(const Robot* r) {
+
+	int i;
+
+	printf("Simulated %.2f s\n", r->now);
+	printf("  pose %.0f %.0f mm, heading %.1f deg\n", r->x, r->y, r->heading * 180 / M_PI);
+	printf("  bumps %d, battery %.0f of %.0f mAh\n", r->bumps, r->charge, r->capacity);
+
+	for (i = 0; i < r->arena->cardCount; i++) {
+		if (r->cardsSeen & (1u << i))
+			printf("  card %d found at %.2f s\n", i, r->cardTime[i]);
+		else
+			printf("  card %d not found\n", i);
+	}
+
+	if (pushCount > 0) {
+		double total = 0, worst = 0;
+		int escaped = 0;
+
+		for (i = 0; i < pushCount; i++) {
+			if (pushes[i].escaped < 0) {
+				printf("  push %d at %.2f s not escaped\n", i, pushes[i].at);
+				continue;
+			}
+			double took = pushes[i].escaped - pushes[i].at;
+			total += took;
+			if (took > worst)
+				worst = took;
+			escaped++;
+		}
+		printf("  pushes %d, escaped %d, mean %.3f s, worst %.3f s\n", pushCount, escaped,
+			escaped > 0 ? total / escaped : 0, worst);
+	}
+
+	printf("  commands:");
+	for (i = 128; i < 256; i++) {
+		if (r->opcodes[i] > 0)
+			printf(" %d x%lu", i, r->opcodes[i]);
+	}
+	printf("\n");
+
+}
+
+// The serial line: bytes from the program wait in inbox until the wire
+// would have delivered them, replies leave one byte time apart
+typedef struct
+{
+	int fd;
+	unsigned char inbox[ROBOT_OUT_MAX];
+	int inCount;
+	long long taken; // bytes read from the program
+	long long given; // bytes written to it
+	double nextIn;  // time the next byte in finishes arriving
+	double nextOut; // time the next byte out starts
+}
+Wire;
+
+// Takes what the program has written, returns the number of bytes
+static int wire_read(Wire* w, double now) {
+
+	int n = read(w->fd, w->inbox + w->inCount, sizeof(w->inbox) - w->inCount);
+
+	if (n <= 0)
+		return 0;
+
+	if (w->inCount == 0 && w->nextIn < now)
+		w->nextIn = now;
+	w->inCount += n;
+	w->taken += n;
+	return n;
+
+}
+
+// Runs the robot up to now. Returns 0 if the port is gone.
+static int wire_service(Wire* w, Robot* r, double now) {
+
+	unsigned char buf[256];
+	int idle = r->outLength == 0;
+	double made = now; // when a reply first appeared on an idle wire
+	int used = 0;
+	int n;
+
+	// deliver bytes whose last bit has arrived, stepping the robot up to each
+	while (used < w->inCount && w->nextIn + BYTE_TIME <= now) {
+		w->nextIn += BYTE_TIME;
+		robotStep(r, w->nextIn);
+		robotInput(r, w->inbox[used++]);
+		if (idle && r->outLength > 0 && made == now)
+			made = w->nextIn;
+	}
+	memmove(w->inbox, w->inbox + used, w->inCount - used);
+	w->inCount -= used;
+
+	robotStep(r, now);
+
+	if (idle && w->nextOut < made)
+		w->nextOut = made;
+	int due = (int) ((now - w->nextOut) / BYTE_TIME + 1e-6);
+	if (due > (int) sizeof(buf))
+		due = sizeof(buf);
+
+	n = robotTake(r, buf, due);
+	if (n > 0) {
+		int written = write(w->fd, buf, n);
+		if (written < 0 && errno != EAGAIN)
+			return 0;
+		if (written > 0)
+			w->given += written;
+		w->nextOut += n * BYTE_TIME;
+	}
+
+	return 1;
+
+}
+
+// Time the wire or the robot next has something to do
+static double wire_next(const Wire* w, const Robot* r, double now) {
+
+	double next = now + PHYSICS;
+
+	if (w->inCount > 0 && w->nextIn + BYTE_TIME < next)
+		next = w->nextIn + BYTE_TIME;
+	if (r->outLength > 0 && w->nextOut + BYTE_TIME < next)
+		next = w->nextOut + BYTE_TIME;
+	return next < now ? now : next;
+
+}
+
+// Pushes an obstacle against the bumper, taking away the last one
+static void push(Arena* a, const Robot* r) {
+
+	if (pushCount == PUSH_MAX)
+		return;
+
+	double side = pushSides[pushCount % (sizeof(pushSides) / sizeof(pushSides[0]))];
+	arenaObstacle(a, r->x, r->y, r->heading + side * M_PI / 180, ROBOT_RADIUS + PUSH_GAP);
+
+	Push* p = &pushes[pushCount++];
+	p->at = r->now;
+	p->escaped = -1;
+	p->seen = 0;
+
+}
+
+// The last push is escaped once the bumper has read it and then let go
+static void watch_push(const Robot* r) {
+
+	if (pushCount == 0)
+		return;
+
+	Push* p = &pushes[pushCount - 1];
+	if (p->escaped >= 0)
+		return;
+	if (r->snap.bumpDrop & BmpBoth)
+		p->seen = 1;
+	else if (p->seen)
+		p->escaped = r->now;
+
+}
+
+int main(int argc, char* argv[]) {
+
+	const char* arenaPath = NULL;
+	const char* linkPath = NULL;
+	const char* tracePath = NULL;
+	const char* clockPath = NULL;
+	double buttonAt = -1;
+	double bumpEvery = -1;
+	long seed = -1;
+	int exitOnPowerDown = 0;
+	int quiet = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc)
+			arenaPath = argv[++i];
+		else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc)
+			linkPath = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "--virtual") == 0 && i + 1 < argc)
+			clockPath = argv[++i];
+		else if (strcmp(argv[i], "--button-at") == 0 && i + 1 < argc)
+			buttonAt = atof(argv[++i]);
+		else if (strcmp(argv[i], "--bump-every") == 0 && i + 1 < argc)
+			bumpEvery = atof(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = atol(argv[++i]);
+		else if (strcmp(argv[i], "--exit-on-powerdown") == 0)
+			exitOnPowerDown = 1;
+		else if (strcmp(argv[i], "--quiet") == 0)
+			quiet = 1;
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	Arena arena;
+	if (arenaPath == NULL)
+		arenaDefault(&arena);
+	else if (!arenaLoad(&arena, arenaPath))
+		return 1;
+
+	// a seed scatters the cards, and changes the sensor noise below
+	if (seed >= 0)
+		arenaScatter(&arena, (unsigned int) seed);
+
+	FILE* trace = NULL;
+	if (tracePath != NULL) {
+		trace = fopen(tracePath, "w");
+		if (trace == NULL) {
+			fprintf(stderr, "Sim: ERROR: cannot write %s\n", tracePath);
+			return 1;
+		}
+		fprintf(trace, "time,x,y,heading,left,right,bump,cards\n");
+	}
+
+	SharedClock* clock = NULL;
+	if (clockPath != NULL && (clock = vclockCreate(clockPath, VIRTUAL_START)) == NULL)
+		return 1;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		fprintf(stderr, "Sim: ERROR: cannot open a pseudo-terminal\n");
+		return 1;
+	}
+
+	const char* slavePath = ptsname(master);
+
+	// hold the slave open so the master does not see a hangup every
+	// time the client closes it, and leave it raw for the client
+	int slave = open(slavePath, O_RDWR | O_NOCTTY);
+	struct termios options;
+	tcgetattr(slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+
+	if (linkPath != NULL) {
+		unlink(linkPath);
+		if (symlink(slavePath, linkPath) != 0)
+			fprintf(stderr, "Sim: ERROR: cannot link %s\n", linkPath);
+	}
+
+	printf("%s\n", slavePath);
+	fflush(stdout);
+
+	signal(SIGUSR1, on_press);
+	signal(SIGINT, on_quit);
+	signal(SIGTERM, on_quit);
+
+	Robot robot;
+	robotInit(&robot, &arena);
+	if (seed >= 0)
+		robot.seed = (unsigned int) seed;
+
+	Wire wire;
+	memset(&wire, 0, sizeof(Wire));
+	wire.fd = master;
+
+	double start = clock != NULL ? VIRTUAL_START : now_seconds();
+	double nextTrace = 0;
+	double nextPush = bumpEvery > 0 ? bumpEvery : -1;
+
+	while (!quit) {
+		double now = (clock != NULL ? vclockNow(clock) : now_seconds()) - start;
+
+		wire_read(&wire, now);
+		if (!wire_service(&wire, &robot, now))
+			break;
+
+		if (pressed || (buttonAt >= 0 && now >= buttonAt)) {
+			robotPress(&robot, 0x01, PRESS_TIME);
+			pressed = 0;
+			buttonAt = -1;
+		}
+
+		watch_push(&robot);
+		if (nextPush >= 0 && now >= nextPush) {
+			push(&arena, &robot);
+			nextPush += bumpEvery;
+		}
+
+		if (trace != NULL && now >= nextTrace) {
+			fprintf(trace, "%.3f,%.1f,%.1f,%.2f,%.0f,%.0f,%d,%u\n", robot.now, robot.x, robot.y,
+				robot.heading * 180 / M_PI, robot.left, robot.right, robot.snap.bumpDrop, robot.cardsSeen);
+			nextTrace = now + TRACE_EVERY;
+		}
+
+		if (robot.powerDown && exitOnPowerDown && robot.outLength == 0)
+			break;
+
+		if (clock == NULL || !vclockAttached(clock)) {
+			// sleep until the next byte is due, input arrives or the next
+			// step; with no program on it the virtual clock keeps real time
+			double next = wire_next(&wire, &robot, now);
+			struct pollfd fd = { master, POLLIN, 0 };
+			struct timespec timeout = { 0, (long) ((next - now) * 1e9) };
+			double before = now_seconds();
+			ppoll(&fd, wire.inCount < (int) sizeof(wire.inbox) ? 1 : 0, &timeout, NULL);
+			if (clock != NULL && !vclockAttached(clock))
+				vclockAdvance(clock, vclockNow(clock) + now_seconds() - before);
+			continue;
+		}
+
+		// virtual time moves only while every thread of the program
+		// sleeps, and not past bytes it wrote just before the last one did
+		if (!vclockIdle(clock, IDLE_POLL) || wire_read(&wire, now) > 0)
+			continue;
+
+		// bytes written but not through the pseudo-terminal yet, unless
+		// they are waiting for room in the inbox
+		if (wire.taken < vclockWritten(clock) && wire.inCount < (int) sizeof(wire.inbox))
+			continue;
+
+		// and replies not through to the program's side yet
+		int queued = 0;
+		ioctl(slave, FIONREAD, &queued);
+		if (wire.given > vclockRead(clock) + queued)
+			continue;
+
+		// the program only sees the robot when a thread wakes, so time
+		// jumps straight there; with no thread due to wake, the rest are
+		// waiting on one that is about to run or exit
+		double wake = vclockNextWake(clock);
+		if (wake >= CLOCK_FOREVER) {
+			struct timespec pause = { 0, (long) (IDLE_POLL * 1e9) };
+			nanosleep(&pause, NULL);
+			continue;
+		}
+		if (buttonAt >= 0 && buttonAt + start < wake)
+			wake = buttonAt + start;
+		if (nextPush >= 0 && nextPush + start < wake)
+			wake = nextPush + start;
+
+		// catch the robot up first, so replies due by then are in the port
+		if (!wire_service(&wire, &robot, wake - start))
+			break;
+		vclockAdvance(clock, wake);
+	}
+
+	if (!quiet)
+		report(&robot);
+
+	if (trace != NULL)
+		fclose(trace);
+	if (linkPath != NULL)
+		unlink(linkPath);
+	if (clock != NULL)
+		vclockClose(clock, clockPath);
+	close(slave);
+	close(master);
+
+	return 0;
+
+}
@@ -0,0 +1,119 @@
+/*
+ * packets.c
+ *
+ * Sensor packet sizes from the Create 2 OI specification. See packets.h.
+ */
+
+#include <stddef.h>
+
+#include "packets.h"
+
+static const PacketInfo packets[] = {
+	{  7, "bumps and wheel drops", 1, 0 },
+	{  8, "wall", 1, 0 },
+	{  9, "cliff left", 1, 0 },
+	{ 10, "cliff front left", 1, 0 },
+	{ 11, "cliff front right", 1, 0 },
+	{ 12, "cliff right", 1, 0 },
+	{ 13, "virtual wall", 1, 0 },
+	{ 14, "wheel overcurrents", 1, 0 },
+	{ 15, "dirt detect", 1, 0 },
+	{ 16, "unused", 1, 0 },
+	{ 17, "ir opcode", 1, 0 },
+	{ 18, "buttons", 1, 0 },
+	{ 19, "distance", 2, 1 },
+	{ 20, "angle", 2, 1 },
+	{ 21, "charging state", 1, 0 },
+	{ 22, "voltage", 2, 0 },
+	{ 23, "current", 2, 1 },
+	{ 24, "temperature", 1, 1 },
+	{ 25, "battery charge", 2, 0 },
+	{ 26, "battery capacity", 2, 0 },
+	{ 27, "wall signal", 2, 0 },
+	{ 28, "cliff left signal", 2, 0 },
+	{ 29, "cliff front left signal", 2, 0 },
+	{ 30, "cliff front right signal", 2, 0 },
+	{ 31, "cliff right signal", 2, 0 },
+	{ 32, "unused", 1, 0 },
+	{ 33, "unused", 2, 0 },
+	{ 34, "charging sources", 1, 0 },
+	{ 35, "oi mode", 1, 0 },
+	{ 36, "song number", 1, 0 },
+	{ 37, "song playing", 1, 0 },
+	{ 38, "stream packets", 1, 0 },
+	{ 39, "requested velocity", 2, 1 },
+	{ 40, "requested radius", 2, 1 },
+	{ 41, "requested right velocity", 2, 1 },
+	{ 42, "requested left velocity", 2, 1 },
+	{ 43, "left encoder counts", 2, 0 },
+	{ 44, "right encoder counts", 2, 0 },
+	{ 45, "light bumper", 1, 0 },
+	{ 46, "light bump left signal", 2, 0 },
+	{ 47, "light bump front left signal", 2, 0 },
+	{ 48, "light bump center left signal", 2, 0 },
+	{ 49, "light bump center right signal", 2, 0 },
+	{ 50, "light bump front right signal", 2, 0 },
+	{ 51, "light bump right signal", 2, 0 },
+	{ 52, "ir opcode left", 1, 0 },
+	{ 53, "ir opcode right", 1, 0 },
+	{ 54, "left motor current", 2, 1 },
+	{ 55, "right motor current", 2, 1 },
+	{ 56, "main brush motor current", 2, 1 },
+	{ 57, "side brush motor current", 2, 1 },
+	{ 58, "stasis", 1, 0 },
+};
+
+static const int groups[][3] = {
+	{   0,  7, 26 },
+	{   1,  7, 16 },
+	{   2, 17, 20 },
+	{   3, 21, 26 },
+	{   4, 27, 34 },
+	{   5, 35, 42 },
+	{   6,  7, 42 },
+	{ 100,  7, 58 },
+	{ 101, 43, 58 },
+	{ 106, 46, 51 },
+	{ 107, 54, 58 },
+};
+
+const PacketInfo* packetInfo(int id) {
+
+	if (id < PKT_FIRST || id > PKT_LAST)
+		return NULL;
+
+	return &packets[id - PKT_FIRST];
+
+}
+
+int packetGroup(int id, int* first, int* last) {
+
+	int i;
+
+	for (i = 0; i < (int) (sizeof(groups) / sizeof(groups[0])); i++) {
+		if (groups[i][0] == id) {
+			*first = groups[i][1];
+			*last = groups[i][2];
+			return 1;
+		}
+	}
+
+	return 0;
+
+}
+
+int packetSize(int id) {
+
+	int first, last, i;
+	int size = 0;
+
+	if (packetGroup(id, &first, &last)) {
+		for (i = first; i <= last; i++)
+			size += packets[i - PKT_FIRST].size;
+		return size;
+	}
+
+	const PacketInfo* info = packetInfo(id);
+	return info != NULL ? info->size : 0;
+
+}
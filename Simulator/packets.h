@@ -0,0 +1,51 @@
+/*
+ * packets.h
+ *
+ * Create 2 Open Interface sensor packet table: the size and sign of
+ * every packet (7-58) and the packet groups, so the bytes of a Sensors
+ * (142), Query List (149) or Stream (148) response can be laid out or
+ * taken apart.
+ */
+
+#ifndef INCLUDE_PACKETS_H
+#define INCLUDE_PACKETS_H
+
+#define PKT_FIRST  7
+#define PKT_LAST   58
+
+typedef struct
+{
+	int id;
+	const char* name;
+	int size;     // bytes, 1 or 2 (high byte first)
+	int isSigned;
+}
+PacketInfo;
+
+/*
+ * Function: packetInfo
+ *  Looks up a single packet.
+ *
+ *  Returns NULL for groups and unknown ids.
+ */
+const PacketInfo* packetInfo(int id);
+
+/*
+ * Function: packetGroup
+ *  Looks up a packet group (0-6, 100, 101, 106, 107).
+ *
+ *  first, last: filled with the packets the group holds
+ *
+ *  Returns 1 if id is a group, 0 if not.
+ */
+int packetGroup(int id, int* first, int* last);
+
+/*
+ * Function: packetSize
+ *  Bytes a packet or group takes in a response.
+ *
+ *  Returns 0 for unknown ids.
+ */
+int packetSize(int id);
+
+#endif
@@ -0,0 +1,580 @@
+/*
+ * robot.c
+ *
+ * Open Interface state machine, body kinematics and sensor model for
+ * the simulated Create 2. See robot.h.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "oi.h"
+#include "packets.h"
+#include "robot.h"
+
+#define DEG(d)  ((d) * M_PI / 180.0)
+
+#define DROP_SIGNAL      10     // cliff signal over a drop
+#define CLIFF_THRESHOLD  100    // below this a cliff bit is set
+#define WALL_RANGE       150.0  // mm the wall sensor sees
+#define IDLE_CURRENT     150.0  // mA
+#define MOTOR_CURRENT    1.0    // mA per mm/s of each wheel
+
+const double robotCliffAngles[4] = { DEG(65), DEG(20), DEG(-20), DEG(-65) };
+const double robotLightAngles[6] = { DEG(70), DEG(40), DEG(12), DEG(-12), DEG(-40), DEG(-70) };
+
+static double wrap_angle(double a) {
+
+	while (a > M_PI)
+		a -= 2 * M_PI;
+	while (a <= -M_PI)
+		a += 2 * M_PI;
+	return a;
+
+}
+
+static double clamp(double v, double lo, double hi) {
+
+	return v < lo ? lo : v > hi ? hi : v;
+
+}
+
+// small deterministic noise so readings are not perfectly flat
+static int noise(Robot* r, int amplitude) {
+
+	r->seed = r->seed * 1103515245 + 12345;
+	return (int) ((r->seed >> 16) % (2 * amplitude + 1)) - amplitude;
+
+}
+
+void robotInit(Robot* r, const Arena* arena) {
+
+	memset(r, 0, sizeof(Robot));
+	r->arena = arena;
+	r->x = arena->startX;
+	r->y = arena->startY;
+	r->heading = DEG(arena->startHeading);
+	r->mode = ModeOff;
+	r->capacity = 3000;
+	r->charge = 3000;
+	r->songNumber = -1;
+	r->seed = 12345;
+
+}
+
+static void reply(Robot* r, const unsigned char* bytes, int length) {
+
+	if (r->outLength + length > ROBOT_OUT_MAX)
+		return; // host is not reading, drop like a full UART buffer would
+
+	memcpy(r->out + r->outLength, bytes, length);
+	r->outLength += length;
+
+}
+
+int robotTake(Robot* r, unsigned char* buf, int max) {
+
+	int n = r->outLength < max ? r->outLength : max;
+
+	memcpy(buf, r->out, n);
+	memmove(r->out, r->out + n, r->outLength - n);
+	r->outLength -= n;
+	return n;
+
+}
+
+static int song_length(const Robot* r, int song) {
+
+	return r->songs[song][0];
+
+}
+
+static double song_seconds(const Robot* r, int song) {
+
+	double total = 0;
+	int i;
+
+	for (i = 0; i < song_length(r, song); i++)
+		total += r->songs[song][2 + 2 * i] / 64.0;
+	return total;
+
+}
+
+// Big endian 16 bit value
+static int put16(unsigned char* p, int v) {
+
+	p[0] = (v >> 8) & 0xFF;
+	p[1] = v & 0xFF;
+	return 2;
+
+}
+
+// Encodes one packet (not a group), returns the bytes written
+static int encode_packet(Robot* r, int id, unsigned char* p) {
+
+	const Snapshot* s = &r->snap;
+	int i;
+
+	switch (id) {
+	case 7:  p[0] = s->bumpDrop; return 1;
+	case 8:  p[0] = s->wallSignal > 100; return 1;
+	case 9:
+	case 10:
+	case 11:
+	case 12: p[0] = s->cliff[id - 9]; return 1;
+	case 14: p[0] = s->overcurrent; return 1;
+	case 18: p[0] = s->button; return 1;
+	case 19:
+		i = (int) lround(r->distance);
+		r->distance -= i;
+		return put16(p, (short) clamp(i, -32768, 32767));
+	case 20:
+		i = (int) lround(r->angle * 180 / M_PI);
+		r->angle -= DEG(i);
+		return put16(p, (short) clamp(i, -32768, 32767));
+	case 21: p[0] = 0; return 1; // not charging
+	case 22: return put16(p, 15000);
+	case 23: return put16(p, (short) -lround(IDLE_CURRENT + MOTOR_CURRENT * (fabs(r->left) + fabs(r->right))));
+	case 24: p[0] = 25; return 1;
+	case 25: return put16(p, (int) r->charge);
+	case 26: return put16(p, (int) r->capacity);
+	case 27: return put16(p, s->wallSignal);
+	case 28:
+	case 29:
+	case 30:
+	case 31: return put16(p, s->cliffSignal[id - 28]);
+	case 35: p[0] = r->mode; return 1;
+	case 36: p[0] = r->songNumber < 0 ? 0 : r->songNumber; return 1;
+	case 37: p[0] = r->now < r->playUntil; return 1;
+	case 38: p[0] = r->streamCount; return 1;
+	case 39: return put16(p, r->velocity);
+	case 40: return put16(p, r->radius);
+	case 41: return put16(p, r->requestRight);
+	case 42: return put16(p, r->requestLeft);
+	case 43: return put16(p, s->encoderLeft);
+	case 44: return put16(p, s->encoderRight);
+	case 45: p[0] = s->lightBumper; return 1;
+	case 46:
+	case 47:
+	case 48:
+	case 49:
+	case 50:
+	case 51: return put16(p, s->lightSignal[id - 46]);
+	case 54:
+	case 55: return put16(p, (short) lround(MOTOR_CURRENT * fabs(id == 54 ? r->left : r->right)));
+	case 58: p[0] = fabs(r->left) + fabs(r->right) > 0 && r->stalled == 0; return 1;
+	}
+
+	// everything else reads as zero
+	const PacketInfo* info = packetInfo(id);
+	int size = info != NULL ? info->size : 0;
+	memset(p, 0, size);
+	return size;
+
+}
+
+// Encodes a packet or a group, returns the bytes written
+static int encode(Robot* r, int id, unsigned char* p) {
+
+	int first, last, i;
+	int n = 0;
+
+	if (packetGroup(id, &first, &last)) {
+		for (i = first; i <= last; i++)
+			n += encode_packet(r, i, p + n);
+		return n;
+	}
+
+	return encode_packet(r, id, p);
+
+}
+
+static void send_frame(Robot* r) {
+
+	unsigned char frame[ROBOT_OUT_MAX / 4];
+	unsigned char sum = 0;
+	int n = 2;
+	int i;
+
+	for (i = 0; i < r->streamCount; i++) {
+		frame[n++] = r->stream[i];
+		n += encode(r, r->stream[i], frame + n);
+	}
+
+	frame[0] = 19;
+	frame[1] = n - 2;
+	for (i = 0; i < n; i++)
+		sum += frame[i];
+	frame[n++] = -sum;
+
+	reply(r, frame, n);
+
+}
+
+static void set_wheels(Robot* r, int left, int right) {
+
+	r->requestLeft = (short) clamp(left, -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX);
+	r->requestRight = (short) clamp(right, -ROBOT_WHEEL_MAX, ROBOT_WHEEL_MAX);
+
+}
+
+// Drive (137) velocity and radius to wheel velocities
+static void drive(Robot* r, short velocity, short radius) {
+
+	double left = velocity;
+	double right = velocity;
+
+	r->velocity = velocity;
+	r->radius = radius;
+
+	if (radius == RadCCW) {
+		left = -velocity;
+	} else if (radius == RadCW) {
+		right = -velocity;
+	} else if (radius != 0 && radius != 32767 && radius != (short) RadStraight) {
+		left = velocity * (radius - ROBOT_WHEEL_BASE / 2) / radius;
+		right = velocity * (radius + ROBOT_WHEEL_BASE / 2) / radius;
+	}
+
+	set_wheels(r, (int) lround(left), (int) lround(right));
+
+}
+
+static void stop_motion(Robot* r) {
+
+	r->velocity = 0;
+	r->radius = 0;
+	set_wheels(r, 0, 0);
+
+}
+
+int robotCommandLength(const unsigned char* c, int have) {
+
+	switch (c[0]) {
+	case CmdBaud:
+	case CmdMotors:
+	case CmdPlay:
+	case CmdSensors:
+	case CmdOutputs:
+	case 150: // pause / resume stream
+	case CmdIRChar:
+	case 165: // buttons
+		return 2;
+	case CmdLeds:
+	case CmdPWMMotors:
+	case 168: // set day and time
+		return 4;
+	case CmdDrive:
+	case CmdDriveWheels:
+	case 146: // drive pwm
+	case 163: // digit leds raw
+	case 164: // digit leds ascii
+		return 5;
+	case 162: // scheduling leds
+		return 3;
+	case 167: // schedule
+		return 16;
+	case CmdSong:
+		if (have < 3)
+			return 0;
+		return 3 + 2 * (c[2] > 16 ? 16 : c[2]);
+	case 148: // stream
+	case CmdSensorList:
+		if (have < 2)
+			return 0;
+		return 2 + c[1];
+	}
+
+	return 1;
+
+}
+
+static int can_drive(const Robot* r) {
+
+	return r->mode == ModeSafe || r->mode == ModeFull;
+
+}
+
+static void run_command(Robot* r, const unsigned char* c, int length) {
+
+	unsigned char buf[ROBOT_OUT_MAX / 4];
+	int n = 0;
+	int i;
+
+	r->opcodes[c[0]]++;
+
+	if (r->mode == ModeOff && c[0] != CmdStart)
+		return; // the OI ignores everything until Start
+
+	switch (c[0]) {
+	case CmdStart:
+		if (r->mode == ModeOff)
+			r->mode = ModePassive;
+		else if (r->mode != ModePassive) {
+			r->mode = ModePassive;
+			stop_motion(r);
+		}
+		break;
+	case CmdSafe:
+		r->mode = ModeSafe;
+		break;
+	case CmdFull:
+		r->mode = ModeFull;
+		break;
+	case CmdStop:
+		r->mode = ModeOff;
+		r->streamCount = 0;
+		stop_motion(r);
+		break;
+	case CmdPwrDwn:
+		r->mode = ModeOff;
+		r->streamCount = 0;
+		r->powerDown = 1;
+		stop_motion(r);
+		break;
+	case CmdDrive:
+		if (can_drive(r))
+			drive(r, (short) (c[1] << 8 | c[2]), (short) (c[3] << 8 | c[4]));
+		break;
+	case CmdDriveWheels:
+		if (can_drive(r)) {
+			r->velocity = 0;
+			r->radius = 0;
+			set_wheels(r, (short) (c[3] << 8 | c[4]), (short) (c[1] << 8 | c[2]));
+		}
+		break;
+	case CmdLeds:
+		if (can_drive(r))
+			memcpy(r->leds, c + 1, 3);
+		break;
+	case CmdSong:
+		if (c[1] < 16) {
+			r->songs[c[1]][0] = (length - 3) / 2;
+			memcpy(&r->songs[c[1]][1], c + 3, length - 3);
+		}
+		break;
+	case CmdPlay:
+		// a song already playing is not interrupted
+		if (can_drive(r) && c[1] < 16 && r->now >= r->playUntil && song_length(r, c[1]) > 0) {
+			r->songNumber = c[1];
+			r->playUntil = r->now + song_seconds(r, c[1]);
+		}
+		break;
+	case CmdSensors:
+		n = encode(r, c[1], buf);
+		reply(r, buf, n);
+		break;
+	case CmdSensorList:
+		for (i = 0; i < c[1]; i++)
+			n += encode(r, c[2 + i], buf + n);
+		reply(r, buf, n);
+		break;
+	case 148:
+		r->streamCount = c[1] < (int) sizeof(r->stream) ? c[1] : (int) sizeof(r->stream);
+		memcpy(r->stream, c + 2, r->streamCount);
+		r->streamPaused = 0;
+		r->nextFrame = r->now;
+		break;
+	case 150:
+		r->streamPaused = !c[1];
+		break;
+	}
+
+}
+
+void robotInput(Robot* r, unsigned char byte) {
+
+	int need;
+
+	r->command[r->have++] = byte;
+
+	need = robotCommandLength(r->command, r->have);
+	if (need == 0 || r->have < need)
+		return;
+
+	run_command(r, r->command, need);
+	r->have = 0;
+
+}
+
+void robotPress(Robot* r, unsigned char buttons, double seconds) {
+
+	r->buttonHeld = buttons;
+	r->buttonUntil = r->now + seconds;
+
+}
+
+// Point on the rim of the body at angle from the heading
+static void rim_point(const Robot* r, double angle, double distance, double* x, double* y) {
+
+	*x = r->x + distance * cos(r->heading + angle);
+	*y = r->y + distance * sin(r->heading + angle);
+
+}
+
+static void check_cards(Robot* r) {
+
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		double x, y;
+		rim_point(r, robotCliffAngles[i], ROBOT_RADIUS - 10, &x, &y);
+
+		int card = arenaCard(r->arena, x, y);
+		if (card >= 0 && card < 32 && !(r->cardsSeen & (1u << card))) {
+			r->cardsSeen |= 1u << card;
+			r->cardTime[card] = r->now;
+		}
+	}
+
+}
+
+static void move(Robot* r, double dt) {
+
+	double change = ROBOT_WHEEL_ACCEL * dt;
+	double left = can_drive(r) ? r->requestLeft : 0;
+	double right = can_drive(r) ? r->requestRight : 0;
+	double bearing;
+
+	// the motor controller ramps toward the request
+	r->left += clamp(left - r->left, -change, change);
+	r->right += clamp(right - r->right, -change, change);
+
+	double v = (r->left + r->right) / 2;
+	double w = (r->right - r->left) / ROBOT_WHEEL_BASE;
+	double nx = r->x + v * cos(r->heading + w * dt / 2) * dt;
+	double ny = r->y + v * sin(r->heading + w * dt / 2) * dt;
+
+	double before = arenaClearance(r->arena, r->x, r->y, &bearing);
+	double after = arenaClearance(r->arena, nx, ny, &bearing);
+
+	// a round body turning in place never moves toward a wall
+	if (after < ROBOT_RADIUS && after < before && v != 0) {
+		// pushing against the wall: the body stays put, the wheels stall
+		r->stalled += dt;
+		v = 0;
+	} else {
+		r->x = nx;
+		r->y = ny;
+		r->stalled = 0;
+	}
+
+	r->heading = wrap_angle(r->heading + w * dt);
+	r->distance += v * dt;
+	r->angle += w * dt;
+
+	// the encoders only see what the wheels actually turned
+	r->countLeft += (v - w * ROBOT_WHEEL_BASE / 2) * dt * ROBOT_COUNTS_PER_MM;
+	r->countRight += (v + w * ROBOT_WHEEL_BASE / 2) * dt * ROBOT_COUNTS_PER_MM;
+
+	r->charge -= (IDLE_CURRENT + MOTOR_CURRENT * (fabs(r->left) + fabs(r->right))) * dt / 3600;
+	if (r->charge < 0)
+		r->charge = 0;
+
+	check_cards(r);
+
+}
+
+// 0..max from a distance, strong up close and falling off with range
+static unsigned short reflect(double distance, double range, double falloff, int max) {
+
+	if (distance >= range)
+		return 0;
+	return (unsigned short) (max * exp(-distance / falloff));
+
+}
+
+static void sense(Robot* r) {
+
+	Snapshot* s = &r->snap;
+	double bearing;
+	int i;
+
+	// bumper: a wall touching the front half of the body
+	unsigned char bumped = s->bumpDrop;
+	s->bumpDrop = 0;
+	double clearance = arenaClearance(r->arena, r->x, r->y, &bearing);
+	if (clearance <= ROBOT_RADIUS + 1) {
+		double side = wrap_angle(bearing - r->heading);
+		if (fabs(side) <= DEG(10))
+			s->bumpDrop = BmpBoth;
+		else if (side > 0 && side < DEG(90))
+			s->bumpDrop = BmpLeft;
+		else if (side < 0 && side > DEG(-90))
+			s->bumpDrop = BmpRight;
+	}
+	if (s->bumpDrop && !bumped)
+		r->bumps++;
+
+	for (i = 0; i < 4; i++) {
+		double x, y;
+		rim_point(r, robotCliffAngles[i], ROBOT_RADIUS - 10, &x, &y);
+
+		if (arenaDrop(r->arena, x, y))
+			s->cliffSignal[i] = DROP_SIGNAL;
+		else if (arenaCard(r->arena, x, y) >= 0)
+			s->cliffSignal[i] = ROBOT_FLOOR_SIGNAL + ROBOT_CARD_SIGNAL + noise(r, 10);
+		else
+			s->cliffSignal[i] = ROBOT_FLOOR_SIGNAL + noise(r, 10);
+		s->cliff[i] = s->cliffSignal[i] < CLIFF_THRESHOLD;
+	}
+
+	// wall sensor looks right from the front right of the body
+	{
+		double x, y;
+		rim_point(r, DEG(-60), ROBOT_RADIUS, &x, &y);
+		double d = arenaRay(r->arena, x, y, r->heading - DEG(90), WALL_RANGE);
+		s->wallSignal = d < WALL_RANGE ? (unsigned short) (1023 * (1 - d / WALL_RANGE) * (1 - d / WALL_RANGE)) : 0;
+	}
+
+	s->lightBumper = 0;
+	for (i = 0; i < 6; i++) {
+		double x, y;
+		rim_point(r, robotLightAngles[i], ROBOT_RADIUS, &x, &y);
+		double d = arenaRay(r->arena, x, y, r->heading + robotLightAngles[i], ROBOT_LIGHT_RANGE);
+		s->lightSignal[i] = reflect(d, ROBOT_LIGHT_RANGE, ROBOT_LIGHT_FALLOFF, ROBOT_LIGHT_MAX);
+		if (s->lightSignal[i] > 0)
+			s->lightSignal[i] += noise(r, 2) + 2;
+		if (s->lightSignal[i] > ROBOT_LIGHT_THRESHOLD)
+			s->lightBumper |= 1 << i;
+	}
+
+	s->overcurrent = r->stalled >= ROBOT_STALL_TIME ? 0x18 : 0;
+	s->button = r->now < r->buttonUntil ? r->buttonHeld : 0;
+	s->encoderLeft = (unsigned short) (long) floor(r->countLeft);
+	s->encoderRight = (unsigned short) (long) floor(r->countRight);
+
+	// Safe mode falls back to Passive on a cliff or a wheel drop
+	if (r->mode == ModeSafe && (s->cliff[0] || s->cliff[1] || s->cliff[2] || s->cliff[3])) {
+		r->mode = ModePassive;
+		stop_motion(r);
+	}
+
+}
+
+void robotStep(Robot* r, double now) {
+
+	while (r->now < now) {
+		double dt = now - r->now;
+		if (dt > ROBOT_STEP_MAX)
+			dt = ROBOT_STEP_MAX;
+
+		move(r, dt);
+		r->now += dt;
+
+		if (r->now >= r->nextSense) {
+			sense(r);
+			r->nextSense += ROBOT_SENSOR_PERIOD;
+			if (r->nextSense < r->now)
+				r->nextSense = r->now + ROBOT_SENSOR_PERIOD;
+		}
+
+		if (r->streamCount > 0 && !r->streamPaused && r->now >= r->nextFrame) {
+			send_frame(r);
+			r->nextFrame += ROBOT_SENSOR_PERIOD;
+			if (r->nextFrame < r->now)
+				r->nextFrame = r->now + ROBOT_SENSOR_PERIOD;
+		}
+	}
+
+}
@@ -0,0 +1,147 @@
+/*
+ * robot.h
+ *
+ * Simulated Create 2. Takes the Open Interface byte stream one byte at
+ * a time, runs the commands, moves a differential-drive body through an
+ * arena and answers sensor requests from a snapshot that is refreshed
+ * every 15 ms like the real robot. Replies and stream frames are queued
+ * in out for the caller to deliver.
+ */
+
+#ifndef INCLUDE_ROBOT_H
+#define INCLUDE_ROBOT_H
+
+#include "arena.h"
+
+#define ROBOT_RADIUS          170.0  // mm
+#define ROBOT_WHEEL_BASE      235.0  // mm between the wheels
+#define ROBOT_COUNTS_PER_MM   2.2494 // encoder counts, 508.8 per revolution of a 72 mm wheel
+#define ROBOT_WHEEL_MAX       500    // mm/s
+#define ROBOT_SENSOR_PERIOD   0.015  // s between sensor updates
+#define ROBOT_STALL_TIME      0.3    // s blocked before the wheel overcurrent bit sets
+#define ROBOT_STEP_MAX        0.005  // s, longest physics step
+#define ROBOT_WHEEL_ACCEL     2000.0 // mm/s^2 the motor controller ramps at
+#define ROBOT_FLOOR_SIGNAL    1200   // cliff signal over plain floor
+#define ROBOT_CARD_SIGNAL     800    // extra signal over a white card
+#define ROBOT_LIGHT_RANGE     300.0  // mm the light bumpers see
+#define ROBOT_LIGHT_FALLOFF   40.0   // mm for the light bump signal to fall by 1/e
+#define ROBOT_LIGHT_MAX       3000   // light bump signal against a wall
+#define ROBOT_LIGHT_THRESHOLD 100    // light bumper bit set above this signal
+#define ROBOT_OUT_MAX         4096
+#define ROBOT_COMMAND_MAX     48     // longest command: Song with 16 notes is 34 bytes
+
+enum { ModeOff, ModePassive, ModeSafe, ModeFull };
+
+typedef struct
+{
+	unsigned char bumpDrop;   // packet 7
+	unsigned char cliff[4];   // packets 9-12: left, front left, front right, right
+	unsigned char overcurrent;
+	unsigned char button;
+	unsigned short wallSignal;
+	unsigned short cliffSignal[4];
+	unsigned char lightBumper;
+	unsigned short lightSignal[6];
+	unsigned short encoderLeft;
+	unsigned short encoderRight;
+}
+Snapshot;
+
+typedef struct
+{
+	const Arena* arena;
+
+	// body
+	double x, y, heading; // mm, radians
+	double left, right;   // wheel velocities being driven, mm/s
+	double countLeft, countRight; // encoder counts including the fraction
+	double distance, angle; // since the last read of packets 19 and 20, mm and radians
+	double stalled;       // s the wheels have been pushing against a wall
+
+	// Open Interface
+	int mode;
+	short velocity, radius;   // last Drive (137)
+	short requestLeft, requestRight;
+	unsigned char leds[3];
+	unsigned char songs[16][33]; // length then note, duration pairs
+	int songNumber;
+	double playUntil;
+	unsigned char stream[64];
+	int streamCount;
+	int streamPaused;
+	double charge, capacity; // mAh
+	double buttonUntil;
+	unsigned char buttonHeld;
+
+	// parser
+	unsigned char command[ROBOT_COMMAND_MAX];
+	int have;
+
+	// sensors
+	Snapshot snap;
+	double nextSense;
+	double nextFrame;
+	unsigned int seed;    // sensor noise
+
+	// what has happened so far
+	double now;
+	unsigned int cardsSeen;   // bit per card passed over by a cliff sensor
+	double cardTime[32];
+	int bumps;            // times the bumper was pressed
+	int powerDown;
+	unsigned long opcodes[256];
+
+	unsigned char out[ROBOT_OUT_MAX];
+	int outLength;
+}
+Robot;
+
+// sensor mounting angles from the heading in radians, left positive
+extern const double robotCliffAngles[4];  // left, front left, front right, right
+extern const double robotLightAngles[6];  // left to right
+
+/*
+ * Function: robotInit
+ *  Places the robot at the arena start, powered and in Off mode with
+ *  a full battery.
+ */
+void robotInit(Robot* r, const Arena* arena);
+
+/*
+ * Function: robotInput
+ *  Feeds one byte received from the host. A command runs as soon as
+ *  its last byte arrives.
+ */
+void robotInput(Robot* r, unsigned char byte);
+
+/*
+ * Function: robotStep
+ *  Advances the robot to time now: drives the body, refreshes the sensor
+ *  snapshot every ROBOT_SENSOR_PERIOD and queues stream frames.
+ */
+void robotStep(Robot* r, double now);
+
+/*
+ * Function: robotPress
+ *  Holds down buttons (packet 18 bits) for seconds.
+ */
+void robotPress(Robot* r, unsigned char buttons, double seconds);
+
+/*
+ * Function: robotTake
+ *  Removes up to max bytes from the front of the reply queue.
+ *
+ *  Returns the number of bytes copied to buf.
+ */
+int robotTake(Robot* r, unsigned char* buf, int max);
+
+/*
+ * Function: robotCommandLength
+ *  Total length of the command that starts with command[0], given the
+ *  have bytes received so far.
+ *
+ *  Returns 0 if more bytes are needed to tell.
+ */
+int robotCommandLength(const unsigned char* command, int have);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * vclock.c
+ *
+ * Moves the virtual clock on for the program under test. See vclock.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "vclock.h"
+
+SharedClock* vclockCreate(const char* path, double start) {
+
+	// a fresh file, never one a stale program still has mapped
+	unlink(path);
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Clock: ERROR: cannot create %s\n", path);
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(SharedClock)) != 0) {
+		fprintf(stderr, "Clock: ERROR: cannot size %s\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	void* map = mmap(NULL, sizeof(SharedClock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Clock: ERROR: cannot map %s\n", path);
+		return NULL;
+	}
+
+	SharedClock* c = (SharedClock*) map;
+	memset(c, 0, sizeof(SharedClock));
+	atomic_store(&c->now, (long long) (start * 1e9));
+	return c;
+
+}
+
+int vclockAttached(SharedClock* c) {
+
+	return atomic_load(&c->attached);
+
+}
+
+int vclockIdle(SharedClock* c, double timeout) {
+
+	int running = atomic_load(&c->running);
+
+	if (!atomic_load(&c->attached))
+		return 0;
+	if (running <= 0)
+		return 1;
+
+	// the program wakes the futex when its last running thread sleeps
+	struct timespec ts = { 0, (long) (timeout * 1e9) };
+	syscall(SYS_futex, &c->running, FUTEX_WAIT, running, &ts, NULL, 0);
+
+	return atomic_load(&c->attached) && atomic_load(&c->running) <= 0;
+
+}
+
+long long vclockWritten(SharedClock* c) {
+
+	return atomic_load(&c->written);
+
+}
+
+long long vclockRead(SharedClock* c) {
+
+	return atomic_load(&c->read);
+
+}
+
+double vclockNextWake(SharedClock* c) {
+
+	long long best = -1;
+	int i;
+
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		if (atomic_load(&c->state[i]) != SleeperAsleep)
+			continue;
+
+		long long wake = atomic_load(&c->wake[i]);
+		if (best < 0 || wake < best)
+			best = wake;
+	}
+
+	return best < 0 ? CLOCK_FOREVER : best / 1e9;
+
+}
+
+void vclockAdvance(SharedClock* c, double now) {
+
+	long long ns = llround(now * 1e9); // exact for a time from vclockNextWake
+	int i;
+
+	if (ns > atomic_load(&c->now))
+		atomic_store(&c->now, ns);
+	ns = atomic_load(&c->now);
+
+	for (i = 0; i < CLOCK_THREADS; i++) {
+		int expected = SleeperAsleep;
+
+		if (atomic_load(&c->state[i]) != SleeperAsleep || atomic_load(&c->wake[i]) > ns)
+			continue;
+
+		// counted as running before it is let go, so time cannot move
+		// on again before the thread has had its turn
+		if (atomic_compare_exchange_strong(&c->state[i], &expected, SleeperWoken)) {
+			atomic_fetch_add(&c->running, 1);
+			syscall(SYS_futex, &c->state[i], FUTEX_WAKE, 1, NULL, NULL, 0);
+		}
+	}
+
+}
+
+double vclockNow(SharedClock* c) {
+
+	return atomic_load(&c->now) / 1e9;
+
+}
+
+void vclockClose(SharedClock* c, const char* path) {
+
+	munmap(c, sizeof(SharedClock));
+	unlink(path);
+
+}
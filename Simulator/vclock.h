@@ -0,0 +1,78 @@
+/*
+ * vclock.h
+ *
+ * Simulator side of the virtual clock. The clock file holds the
+ * SharedClock of clock.h (the same header the projects use); the
+ * program maps it when CREATE_CLOCK names it. The simulator moves time
+ * on only while none of the program's threads is running, to the
+ * earliest of its own next event and the program's next wakeup, then
+ * wakes the threads whose sleep has ended.
+ */
+
+#ifndef INCLUDE_VCLOCK_H
+#define INCLUDE_VCLOCK_H
+
+#include "clock.h"
+
+/*
+ * Function: vclockCreate
+ *  Creates the clock file, replacing any old one, and maps it.
+ *
+ *  start: time to start the clock at, s
+ *
+ *  Returns NULL on failure.
+ */
+SharedClock* vclockCreate(const char* path, double start);
+
+/*
+ * Function: vclockAttached
+ *  Returns true while a program is using the clock.
+ */
+int vclockAttached(SharedClock* c);
+
+/*
+ * Function: vclockIdle
+ *  Waits up to timeout seconds of real time for every thread of the
+ *  program to be asleep or blocked.
+ *
+ *  Returns true if they are and a program is attached.
+ */
+int vclockIdle(SharedClock* c, double timeout);
+
+/*
+ * Function: vclockNextWake
+ *  Earliest time a sleeping thread wants to wake, or CLOCK_FOREVER.
+ */
+double vclockNextWake(SharedClock* c);
+
+/*
+ * Function: vclockWritten
+ *  Bytes the program has written to the port so far.
+ */
+long long vclockWritten(SharedClock* c);
+
+/*
+ * Function: vclockRead
+ *  Bytes the program has read from the port so far.
+ */
+long long vclockRead(SharedClock* c);
+
+/*
+ * Function: vclockAdvance
+ *  Moves time on to now and wakes every thread whose sleep has ended.
+ */
+void vclockAdvance(SharedClock* c, double now);
+
+/*
+ * Function: vclockNow
+ *  Current virtual time, s.
+ */
+double vclockNow(SharedClock* c);
+
+/*
+ * Function: vclockClose
+ *  Unmaps the clock and removes the file.
+ */
+void vclockClose(SharedClock* c, const char* path);
+
+#endif